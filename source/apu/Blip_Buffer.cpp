@@ -201,9 +201,16 @@ void Blip_Synth_Fast_::volume_unit( double new_unit )
 
 #if !BLIP_BUFFER_FAST
 
+#if BLIP_BUFFER_SIMD
+Blip_Synth_::Blip_Synth_( short* p, int w, short* k ) :
+	impulses( p ),
+	width( w ),
+	kernels( k )
+#else
 Blip_Synth_::Blip_Synth_( short* p, int w ) :
 	impulses( p ),
 	width( w )
+#endif
 {
 	volume_unit_ = 0.0;
 	kernel_unit  = 0;
@@ -286,7 +293,28 @@ void Blip_Synth_::adjust_impulse()
 	//for ( int i = blip_res; i--; printf( "\n" ) )
 	//  for ( int j = 0; j < width / 2; j++ )
 	//      printf( "%5ld,", impulses [j * blip_res + i + 1] );
+
+	#if BLIP_BUFFER_SIMD
+		update_kernels();
+	#endif
+}
+
+#if BLIP_BUFFER_SIMD
+void Blip_Synth_::update_kernels()
+{
+	// first half is read forward from the mirrored phase, second half backward
+	int const half = width / 2;
+	for ( int phase = 0; phase < blip_res; phase++ )
+	{
+		short* out = kernels + phase * width;
+		for ( int i = 0; i < half; i++ )
+		{
+			out [i]            = impulses [blip_res - phase + blip_res * i];
+			out [width - 1 - i] = impulses [phase + blip_res * i];
+		}
+	}
 }
+#endif
 
 void Blip_Synth_::treble_eq( blip_eq_t const& eq )
 {
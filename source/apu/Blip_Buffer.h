@@ -159,6 +159,22 @@ private:
 	#endif
 #endif
 
+// Use SSE2 or NEON for impulse addition and stereo mixing where available.
+// Define BLIP_BUFFER_NO_SIMD to use the portable code only.
+#if !defined (BLIP_BUFFER_NO_SIMD) && !BLIP_BUFFER_FAST && (defined (__SSE2__) || \
+		defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2))
+	#define BLIP_BUFFER_SSE2 1
+	#include <emmintrin.h>
+#elif !defined (BLIP_BUFFER_NO_SIMD) && !BLIP_BUFFER_FAST && \
+		(defined (__ARM_NEON) || defined (__ARM_NEON__))
+	#define BLIP_BUFFER_NEON 1
+	#include <arm_neon.h>
+#endif
+
+#if BLIP_BUFFER_SSE2 || BLIP_BUFFER_NEON
+	#define BLIP_BUFFER_SIMD 1
+#endif
+
 	// Internal
 	typedef blip_ulong blip_resampled_time_t;
 	int const blip_widest_impulse_ = 16;
@@ -184,7 +200,11 @@ private:
 		int delta_factor;
 
 		void volume_unit( double );
+	#if BLIP_BUFFER_SIMD
+		Blip_Synth_( short* impulses, int width, short* kernels );
+	#else
 		Blip_Synth_( short* impulses, int width );
+	#endif
 		void treble_eq( blip_eq_t const& );
 	private:
 		double volume_unit_;
@@ -193,6 +213,11 @@ private:
 		blip_long kernel_unit;
 		int impulses_size() const { return blip_res / 2 * width + 1; }
 		void adjust_impulse();
+	#if BLIP_BUFFER_SIMD
+		// Impulses rearranged so the 'width' values added for a phase are contiguous
+		short* const kernels;
+		void update_kernels();
+	#endif
 	};
 
 // Quality level, better = slower. In general, use blip_good_quality.
@@ -246,9 +271,15 @@ private:
 	Blip_Synth_ impl;
 	typedef short imp_t;
 	imp_t impulses [blip_res * (quality / 2) + 1];
+#if BLIP_BUFFER_SIMD
+	imp_t kernels [blip_res * quality];
+public:
+	Blip_Synth() : impl( impulses, quality, kernels ) { }
+#else
 public:
 	Blip_Synth() : impl( impulses, quality ) { }
 #endif
+#endif
 };
 
 // Low-pass equalization parameters
@@ -362,6 +393,36 @@ private:
 	blip_long accum;
 };
 
+#if BLIP_BUFFER_SIMD
+// Adds kernel [i] * delta to out [i], for count a multiple of 4
+inline void blip_add_kernel_( blip_long* BLIP_RESTRICT out, short const* BLIP_RESTRICT kernel,
+		int count, blip_long delta )
+{
+#if BLIP_BUFFER_SSE2
+	// SSE2 has no 32-bit multiply, so multiply even and odd lanes separately
+	__m128i const d = _mm_set1_epi32( delta );
+	for ( int i = 0; i < count; i += 4 )
+	{
+		__m128i k = _mm_loadl_epi64( (__m128i const*) (kernel + i) );
+		k = _mm_srai_epi32( _mm_unpacklo_epi16( k, k ), 16 );
+		__m128i even = _mm_mul_epu32( k, d );
+		__m128i odd  = _mm_mul_epu32( _mm_srli_epi64( k, 32 ), d );
+		__m128i prod = _mm_unpacklo_epi32( _mm_shuffle_epi32( even, _MM_SHUFFLE( 0, 0, 2, 0 ) ),
+				_mm_shuffle_epi32( odd, _MM_SHUFFLE( 0, 0, 2, 0 ) ) );
+		__m128i* p = (__m128i*) (out + i);
+		_mm_storeu_si128( p, _mm_add_epi32( _mm_loadu_si128( p ), prod ) );
+	}
+#else
+	for ( int i = 0; i < count; i += 4 )
+	{
+		int32_t* p = (int32_t*) (out + i);
+		int32x4_t k = vmovl_s16( vld1_s16( kernel + i ) );
+		vst1q_s32( p, vmlaq_n_s32( vld1q_s32( p ), k, (int32_t) delta ) );
+	}
+#endif
+}
+#endif
+
 #if defined (_M_IX86) || defined (_M_IA64) || defined (__i486__) || \
 		defined (__x86_64__) || defined (__ia64__) || defined (__i386__)
 	#define BLIP_CLAMP_( in ) in < -0x8000 || 0x7FFF < in
@@ -410,6 +471,11 @@ inline void Blip_Synth<quality,range>::offset_resampled( blip_resampled_time_t t
 
 	buf [0] = left;
 	buf [1] = right;
+#elif BLIP_BUFFER_SIMD
+
+	// same result as below, but the impulses for the phase are contiguous
+	int const fwd = (blip_widest_impulse_ - quality) / 2;
+	blip_add_kernel_( buf + fwd, kernels + phase * quality, quality, delta );
 #else
 
 	int const fwd = (blip_widest_impulse_ - quality) / 2;
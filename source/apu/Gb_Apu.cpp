@@ -53,7 +53,14 @@ void Gb_Apu::set_output( Blip_Buffer* center, Blip_Buffer* left, Blip_Buffer* ri
 		o.outputs [1] = right;
 		o.outputs [2] = left;
 		o.outputs [3] = center;
-		o.output = o.outputs [calc_output( i )];
+
+		// Remove current amplitude from old buffer, so outputs can be changed while playing
+		Blip_Buffer* out = o.outputs [calc_output( i )];
+		if ( o.output != out )
+		{
+			silence_osc( o );
+			o.output = out;
+		}
 	}
 	while ( ++i < osc );
 }
@@ -568,6 +568,20 @@ void Gb_Noise::run( blip_time_t time, blip_time_t end_time )
 	}
 }
 
+// True if all nybbles of wave are the same, so it plays as a constant amplitude
+static bool wave_is_flat( byte const* wave, int size )
+{
+	int const first = wave [0];
+	if ( (first >> 4) != (first & 0x0F) )
+		return false;
+
+	for ( int i = 1; i < size; i++ )
+		if ( wave [i] != first )
+			return false;
+
+	return true;
+}
+
 void Gb_Wave::run( blip_time_t time, blip_time_t end_time )
 {
 	// Calc volume
@@ -621,6 +635,11 @@ void Gb_Wave::run( blip_time_t time, blip_time_t end_time )
 		int ph = this->phase ^ swap_banks;
 		ph = (ph + 1) & wave_mask; // pre-advance
 
+		// A flat wave already at its amplitude generates no transitions
+		if ( playing && wave_is_flat( wave, (wave_mask >> 1) + 1 ) &&
+				((wave [0] & 0xF0) * volume_mul) >> (volume_shift + 4) == this->last_amp + dac_bias )
+			playing = false;
+
 		int const per = this->period();
 		if ( !playing )
 		{
@@ -2,6 +2,8 @@
 
 #include "Multi_Buffer.h"
 
+#include <string.h>
+
 /* Copyright (C) 2003-2007 Shay Green. This module is free software; you
 can redistribute it and/or modify it under the terms of the GNU Lesser
 General Public License as published by the Free Software Foundation; either
@@ -209,6 +211,60 @@ void Stereo_Mixer::mix_mono( blip_sample_t* out_, int count )
 	BLIP_READER_END( center, *bufs [2] );
 }
 
+#if BLIP_BUFFER_SIMD
+
+// runs the left, right and center integrators side by side in one vector,
+// and clamps both output samples at once with a saturating pack
+
+void Stereo_Mixer::mix_stereo( blip_sample_t* BLIP_RESTRICT out, int count )
+{
+	int const bass = BLIP_READER_BASS( *bufs [2] );
+	Blip_Buffer::buf_t_ const* BLIP_RESTRICT left   = bufs [0]->buffer_ + samples_read - count;
+	Blip_Buffer::buf_t_ const* BLIP_RESTRICT right  = bufs [1]->buffer_ + samples_read - count;
+	Blip_Buffer::buf_t_ const* BLIP_RESTRICT center = bufs [2]->buffer_ + samples_read - count;
+
+	blip_long accum [4] = { bufs [0]->reader_accum_, bufs [1]->reader_accum_, bufs [2]->reader_accum_, 0 };
+
+#if BLIP_BUFFER_SSE2
+	__m128i const shift = _mm_cvtsi32_si128( bass );
+	__m128i a = _mm_loadu_si128( (__m128i const*) accum );
+	for ( int i = 0; i < count; i++ )
+	{
+		__m128i c = _mm_shuffle_epi32( a, _MM_SHUFFLE( 2, 2, 2, 2 ) );
+		__m128i s = _mm_srai_epi32( _mm_add_epi32( a, c ), blip_sample_bits - 16 );
+		s = _mm_packs_epi32( s, s );
+
+		int pair = _mm_cvtsi128_si32( s );
+		memcpy( out + i * stereo, &pair, sizeof pair );
+
+		__m128i in = _mm_set_epi32( 0, center [i], right [i], left [i] );
+		a = _mm_add_epi32( _mm_sub_epi32( a, _mm_sra_epi32( a, shift ) ), in );
+	}
+	_mm_storeu_si128( (__m128i*) accum, a );
+#else
+	int32x4_t const shift = vdupq_n_s32( -bass );
+	int32x4_t a = vld1q_s32( (int32_t const*) accum );
+	for ( int i = 0; i < count; i++ )
+	{
+		int32x4_t c = vdupq_n_s32( vgetq_lane_s32( a, 2 ) );
+		int16x4_t s = vqmovn_s32( vshrq_n_s32( vaddq_s32( a, c ), blip_sample_bits - 16 ) );
+
+		out [i * stereo    ] = vget_lane_s16( s, 0 );
+		out [i * stereo + 1] = vget_lane_s16( s, 1 );
+
+		int32_t in_ [4] = { left [i], right [i], center [i], 0 };
+		a = vaddq_s32( vsubq_s32( a, vshlq_s32( a, shift ) ), vld1q_s32( in_ ) );
+	}
+	vst1q_s32( (int32_t*) accum, a );
+#endif
+
+	bufs [0]->reader_accum_ = accum [0];
+	bufs [1]->reader_accum_ = accum [1];
+	bufs [2]->reader_accum_ = accum [2];
+}
+
+#else
+
 void Stereo_Mixer::mix_stereo( blip_sample_t* out_, int count )
 {
 	blip_sample_t* BLIP_RESTRICT out = out_ + count * stereo;
@@ -251,3 +307,5 @@ void Stereo_Mixer::mix_stereo( blip_sample_t* out_, int count )
 		break;
 	}
 }
+
+#endif
@@ -0,0 +1,1622 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// Measures the emulation speed of the whole core on synthetic workloads:
+// instruction mixes of both CPU states, the line renderer of each video
+// mode, DMA transfers, sound, and save state round trips.
+//
+// The test ROMs are assembled when the benchmark starts, so that no game is
+// needed. Each one starts by a script of register writes and DMA copies
+// setting up the hardware, then jumps to a kernel looping forever.
+// The workloads driven by the hardware halt the CPU instead.
+//
+// Given a BIOS file, it rather times the BIOS functions performed natively,
+// once run by the BIOS file and once natively, to check the costs the native
+// functions add against the BIOS. Timer 0 counts the clock ticks of each
+// software interrupt from the cartridge code, less the ticks counted around
+// a no-op.
+
+#include "../gba/Bios.h"
+#include "../gba/Cartridge.h"
+#include "../gba/Display.h"
+#include "../gba/GBA.h"
+#include "../gba/Globals.h"
+#include "../gba/PerfCounters.h"
+#include "../gba/Savestate.h"
+#include "../gba/Sound.h"
+#include "../common/DisplayDriver.h"
+#include "../common/InputDriver.h"
+#include "../common/Settings.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Clocks per emulated second
+#define CLOCK_RATE 16777216
+
+// Frames emulated after loading a ROM before measuring
+#define BENCH_WARMUP_FRAMES 10
+
+// Save state round trips per repetition
+#define BENCH_ROUND_TRIPS 20
+
+// Frames emulated at most for a BIOS function to return
+#define BIOS_COST_FRAMES 10
+
+#define ROM_BASE 0x08000000
+#define IWRAM_BASE 0x03000000
+#define EWRAM_BASE 0x02000000
+
+// Data buffers of the load and store workloads, past the code in IWRAM
+#define IWRAM_DATA 0x03004000
+
+// ARM condition codes
+enum {
+	COND_EQ = 0x0,
+	COND_NE = 0x1,
+	COND_CS = 0x2,
+	COND_CC = 0x3,
+	COND_GT = 0xC,
+	COND_AL = 0xE
+};
+
+// ARM data processing opcodes
+enum {
+	ARM_AND = 0x0,
+	ARM_EOR = 0x1,
+	ARM_SUB = 0x2,
+	ARM_RSB = 0x3,
+	ARM_ADD = 0x4,
+	ARM_ADC = 0x5,
+	ARM_TST = 0x8,
+	ARM_TEQ = 0x9,
+	ARM_CMP = 0xA,
+	ARM_ORR = 0xC,
+	ARM_MOV = 0xD,
+	ARM_BIC = 0xE,
+	ARM_MVN = 0xF
+};
+
+// Shift types, for both CPU states
+enum {
+	SHIFT_LSL,
+	SHIFT_LSR,
+	SHIFT_ASR,
+	SHIFT_ROR
+};
+
+// Thumb operations with an 8 bit immediate
+enum {
+	THUMB_IMM_MOV,
+	THUMB_IMM_CMP,
+	THUMB_IMM_ADD,
+	THUMB_IMM_SUB
+};
+
+// Thumb ALU opcodes
+enum {
+	THUMB_AND = 0x0,
+	THUMB_EOR = 0x1,
+	THUMB_ADC = 0x5,
+	THUMB_ROR = 0x7,
+	THUMB_TST = 0x8,
+	THUMB_NEG = 0x9,
+	THUMB_CMP = 0xA,
+	THUMB_ORR = 0xC,
+	THUMB_MUL = 0xD,
+	THUMB_BIC = 0xE,
+	THUMB_MVN = 0xF
+};
+
+// Branches to a label, patched once the code is complete
+enum {
+	FIXUP_ARM_B,
+	FIXUP_THUMB_BCOND,
+	FIXUP_THUMB_B,
+	FIXUP_THUMB_BL
+};
+
+typedef struct {
+	guint offset;
+	guint label;
+	int kind;
+} Fixup;
+
+// Code assembled to run at a given address
+typedef struct {
+	GByteArray *bytes;
+	guint32 base;
+	GArray *labels;
+	GArray *fixups;
+} Asm;
+
+// Register write of the boot script
+typedef struct {
+	guint32 address;
+	guint16 value;
+} ScriptWrite;
+
+// Test ROM being built
+typedef struct {
+	// ROM contents, assembled at the cartridge address
+	Asm code;
+	// Register writes done at boot, in order
+	GArray *script;
+	// Address of the kernel, odd for Thumb code
+	guint32 entry;
+	guint boot;
+	GRand *rand;
+} BenchRom;
+
+typedef struct {
+	const char *name;
+	// Unit of the operations the time is divided by
+	const char *unit;
+	void (*build)(BenchRom *rom, int arg);
+	int arg;
+	// Operations done during a frame, for the benchmarks emulating frames
+	guint64 (*count_ops)(const PerfCounters *counters);
+	// Save function, for the save state round trip benchmarks
+	gboolean (*save)(const gchar *file, GError **err);
+} Benchmark;
+
+// BIOS function timed by the BIOS cost measurement
+typedef struct {
+	const char *name;
+	int comment;
+	// Place the data in the ROM, and return the arguments in r0 to r3
+	void (*build)(BenchRom *rom, int arg, guint32 *args);
+	int arg;
+} BiosCost;
+
+typedef struct {
+	double median;
+	double mean;
+	double stddev;
+	double min;
+	double max;
+} Stats;
+
+static gint repetitions = 5;
+static gint frames = 120;
+static gboolean json = FALSE;
+static gchar *filter = NULL;
+static gchar *biosFile = NULL;
+
+static GOptionEntry options[] = {
+	{ "repetitions", 'r', 0, G_OPTION_ARG_INT, &repetitions, "Measured runs of each benchmark", "N" },
+	{ "frames", 'f', 0, G_OPTION_ARG_INT, &frames, "Emulated frames per run", "N" },
+	{ "json", 'j', 0, G_OPTION_ARG_NONE, &json, "Print the results as JSON", NULL },
+	{ "filter", 0, 0, G_OPTION_ARG_STRING, &filter, "Only run the benchmarks whose name contains TEXT", "TEXT" },
+	{ "bios", 'b', 0, G_OPTION_ARG_FILENAME, &biosFile, "Time the BIOS functions with this BIOS file and natively", "FILE" },
+	{ NULL }
+};
+
+static void put16(guint8 *p, guint16 value) {
+	p[0] = value & 0xFF;
+	p[1] = value >> 8;
+}
+
+static void put32(guint8 *p, guint32 value) {
+	put16(p, value & 0xFFFF);
+	put16(p + 2, value >> 16);
+}
+
+static guint16 get16(const guint8 *p) {
+	return p[0] | (p[1] << 8);
+}
+
+static guint32 get32(const guint8 *p) {
+	return get16(p) | (get16(p + 2) << 16);
+}
+
+static void asm_init(Asm *a, guint32 base) {
+	a->bytes = g_byte_array_new();
+	a->base = base;
+	a->labels = g_array_new(FALSE, FALSE, sizeof(guint32));
+	a->fixups = g_array_new(FALSE, FALSE, sizeof(Fixup));
+}
+
+static void asm_free(Asm *a) {
+	if (a->bytes != NULL) {
+		g_byte_array_free(a->bytes, TRUE);
+	}
+	g_array_free(a->labels, TRUE);
+	g_array_free(a->fixups, TRUE);
+}
+
+static guint32 asm_here(const Asm *a) {
+	return a->base + a->bytes->len;
+}
+
+static void asm_emit16(Asm *a, guint16 value) {
+	guint8 bytes[2];
+	put16(bytes, value);
+	g_byte_array_append(a->bytes, bytes, sizeof(bytes));
+}
+
+static void asm_emit32(Asm *a, guint32 value) {
+	guint8 bytes[4];
+	put32(bytes, value);
+	g_byte_array_append(a->bytes, bytes, sizeof(bytes));
+}
+
+static void asm_align(Asm *a, guint alignment) {
+	static const guint8 zero = 0;
+	while (a->bytes->len % alignment != 0) {
+		g_byte_array_append(a->bytes, &zero, 1);
+	}
+}
+
+static guint asm_label(Asm *a) {
+	guint32 unbound = G_MAXUINT32;
+	g_array_append_val(a->labels, unbound);
+	return a->labels->len - 1;
+}
+
+static void asm_bind(Asm *a, guint label) {
+	g_array_index(a->labels, guint32, label) = asm_here(a);
+}
+
+// Record a branch to a label at the current position
+static void asm_fixup(Asm *a, int kind, guint label) {
+	Fixup fixup = { a->bytes->len, label, kind };
+	g_array_append_val(a->fixups, fixup);
+}
+
+// Patch the branch offsets, once all the labels are bound
+static void asm_resolve(Asm *a) {
+	for (guint i = 0; i < a->fixups->len; i++) {
+		const Fixup *fixup = &g_array_index(a->fixups, Fixup, i);
+		guint32 target = g_array_index(a->labels, guint32, fixup->label);
+		g_assert(target != G_MAXUINT32);
+
+		guint8 *p = a->bytes->data + fixup->offset;
+		guint32 pc = a->base + fixup->offset;
+
+		switch (fixup->kind) {
+		case FIXUP_ARM_B:
+			put32(p, get32(p) | (((target - pc - 8) >> 2) & 0xFFFFFF));
+			break;
+		case FIXUP_THUMB_BCOND:
+			put16(p, get16(p) | (((target - pc - 4) >> 1) & 0xFF));
+			break;
+		case FIXUP_THUMB_B:
+			put16(p, get16(p) | (((target - pc - 4) >> 1) & 0x7FF));
+			break;
+		case FIXUP_THUMB_BL:
+			put16(p, get16(p) | (((target - pc - 4) >> 12) & 0x7FF));
+			put16(p + 2, get16(p + 2) | (((target - pc - 4) >> 1) & 0x7FF));
+			break;
+		}
+	}
+}
+
+// Encode an immediate operand, an 8 bit value rotated right by an even amount
+static guint32 arm_imm(guint32 value) {
+	for (int rot = 0; rot < 16; rot++) {
+		guint32 imm = rot == 0 ? value : (value << (2 * rot)) | (value >> (32 - 2 * rot));
+		if (imm <= 0xFF) {
+			return (rot << 8) | imm;
+		}
+	}
+
+	g_error("Immediate %08x cannot be encoded", value);
+	return 0;
+}
+
+static void arm_dp_imm(Asm *a, int cond, int op, int s, int rd, int rn, guint32 imm) {
+	asm_emit32(a, (cond << 28) | 0x02000000 | (op << 21) | (s << 20) | (rn << 16) | (rd << 12) | arm_imm(imm));
+}
+
+static void arm_dp_reg(Asm *a, int cond, int op, int s, int rd, int rn, int rm, int shift, int amount) {
+	asm_emit32(a, (cond << 28) | (op << 21) | (s << 20) | (rn << 16) | (rd << 12) | (amount << 7) | (shift << 5) | rm);
+}
+
+static void arm_mul(Asm *a, int rd, int rm, int rs) {
+	asm_emit32(a, 0xE0000090 | (rd << 16) | (rs << 8) | rm);
+}
+
+// Load or store of 1, 2 or 4 bytes with a positive immediate offset
+static void arm_mem(Asm *a, gboolean load, int size, int rd, int rn, int offset) {
+	if (size == 2) {
+		asm_emit32(a, 0xE1C000B0 | (load << 20) | (rn << 16) | (rd << 12) | ((offset >> 4) << 8) | (offset & 15));
+	} else {
+		asm_emit32(a, 0xE5800000 | ((size == 1) << 22) | (load << 20) | (rn << 16) | (rd << 12) | offset);
+	}
+}
+
+// Load a word and increment the base register
+static void arm_ldr_post(Asm *a, int rd, int rn, int offset) {
+	asm_emit32(a, 0xE4900000 | (rn << 16) | (rd << 12) | offset);
+}
+
+// Load or store multiple, incrementing after
+static void arm_block(Asm *a, gboolean load, gboolean writeback, int rn, guint16 regs) {
+	asm_emit32(a, 0xE8800000 | (writeback << 21) | (load << 20) | (rn << 16) | regs);
+}
+
+static void arm_b(Asm *a, int cond, gboolean link, guint label) {
+	asm_fixup(a, FIXUP_ARM_B, label);
+	asm_emit32(a, (cond << 28) | 0x0A000000 | (link << 24));
+}
+
+static void arm_bx(Asm *a, int rm) {
+	asm_emit32(a, 0xE12FFF10 | rm);
+}
+
+static void arm_swi(Asm *a, int comment) {
+	asm_emit32(a, 0xEF000000 | (comment << 16));
+}
+
+static void arm_const(Asm *a, int rd, guint32 value) {
+	arm_dp_imm(a, COND_AL, ARM_MOV, 0, rd, 0, value & 0xFF);
+	for (int i = 1; i < 4; i++) {
+		arm_dp_imm(a, COND_AL, ARM_ORR, 0, rd, rd, value & (0xFF << (8 * i)));
+	}
+}
+
+static void thumb_shift(Asm *a, int shift, int rd, int rs, int amount) {
+	asm_emit16(a, (shift << 11) | (amount << 6) | (rs << 3) | rd);
+}
+
+static void thumb_add_reg(Asm *a, gboolean sub, int rd, int rs, int rn) {
+	asm_emit16(a, 0x1800 | (sub << 9) | (rn << 6) | (rs << 3) | rd);
+}
+
+static void thumb_imm(Asm *a, int op, int rd, int imm) {
+	asm_emit16(a, 0x2000 | (op << 11) | (rd << 8) | imm);
+}
+
+static void thumb_alu(Asm *a, int op, int rd, int rs) {
+	asm_emit16(a, 0x4000 | (op << 6) | (rs << 3) | rd);
+}
+
+// Load or store of 1, 2 or 4 bytes with an immediate offset
+static void thumb_mem(Asm *a, gboolean load, int size, int rd, int rb, int offset) {
+	switch (size) {
+	case 1:
+		asm_emit16(a, 0x7000 | (load << 11) | (offset << 6) | (rb << 3) | rd);
+		break;
+	case 2:
+		asm_emit16(a, 0x8000 | (load << 11) | ((offset >> 1) << 6) | (rb << 3) | rd);
+		break;
+	default:
+		asm_emit16(a, 0x6000 | (load << 11) | ((offset >> 2) << 6) | (rb << 3) | rd);
+		break;
+	}
+}
+
+static void thumb_stack(Asm *a, gboolean pop, guint8 regs) {
+	asm_emit16(a, 0xB400 | (pop << 11) | regs);
+}
+
+// Load or store multiple, with writeback
+static void thumb_block(Asm *a, gboolean load, int rb, guint8 regs) {
+	asm_emit16(a, 0xC000 | (load << 11) | (rb << 8) | regs);
+}
+
+static void thumb_bcond(Asm *a, int cond, guint label) {
+	asm_fixup(a, FIXUP_THUMB_BCOND, label);
+	asm_emit16(a, 0xD000 | (cond << 8));
+}
+
+static void thumb_b(Asm *a, guint label) {
+	asm_fixup(a, FIXUP_THUMB_B, label);
+	asm_emit16(a, 0xE000);
+}
+
+static void thumb_bl(Asm *a, guint label) {
+	asm_fixup(a, FIXUP_THUMB_BL, label);
+	asm_emit16(a, 0xF000);
+	asm_emit16(a, 0xF800);
+}
+
+static void thumb_bx(Asm *a, int rs) {
+	asm_emit16(a, 0x4700 | (rs << 3));
+}
+
+static void thumb_const(Asm *a, int rd, guint32 value) {
+	thumb_imm(a, THUMB_IMM_MOV, rd, value >> 24);
+	for (int shift = 16; shift >= 0; shift -= 8) {
+		thumb_shift(a, SHIFT_LSL, rd, rd, 8);
+		thumb_imm(a, THUMB_IMM_ADD, rd, (value >> shift) & 0xFF);
+	}
+}
+
+static void rom_init(BenchRom *rom) {
+	asm_init(&rom->code, ROM_BASE);
+	rom->script = g_array_new(FALSE, FALSE, sizeof(ScriptWrite));
+	rom->entry = 0;
+	rom->boot = asm_label(&rom->code);
+	rom->rand = g_rand_new_with_seed(0);
+
+	// Header, the boot code comes last once everything else is placed
+	arm_b(&rom->code, COND_AL, FALSE, rom->boot);
+	while (rom->code.bytes->len < 0xA0) {
+		asm_emit32(&rom->code, 0);
+	}
+	g_byte_array_append(rom->code.bytes, (const guint8 *) "VBA BENCH\0\0\0ZVBE", 16);
+	while (rom->code.bytes->len < 0xC0) {
+		asm_emit32(&rom->code, 0);
+	}
+}
+
+static void rom_free(BenchRom *rom) {
+	asm_free(&rom->code);
+	g_array_free(rom->script, TRUE);
+	g_rand_free(rom->rand);
+}
+
+// Write an I/O register at boot
+static void rom_io(BenchRom *rom, guint32 offset, guint16 value) {
+	ScriptWrite write = { 0x04000000 + offset, value };
+	g_array_append_val(rom->script, write);
+}
+
+static void rom_io32(BenchRom *rom, guint32 offset, guint32 value) {
+	rom_io(rom, offset, value & 0xFFFF);
+	rom_io(rom, offset + 2, value >> 16);
+}
+
+static guint32 rom_add_data(BenchRom *rom, const guint8 *data, guint size) {
+	asm_align(&rom->code, 4);
+	guint32 address = asm_here(&rom->code);
+	g_byte_array_append(rom->code.bytes, data, size);
+	return address;
+}
+
+static guint32 rom_add_random(BenchRom *rom, guint size) {
+	guint8 *data = (guint8 *) g_malloc(size);
+	for (guint i = 0; i < size; i++) {
+		data[i] = g_rand_int(rom->rand);
+	}
+
+	guint32 address = rom_add_data(rom, data, size);
+	g_free(data);
+	return address;
+}
+
+// Copy memory at boot, with 32 bit DMA 3 transfers
+static void rom_copy(BenchRom *rom, guint32 source, guint32 dest, guint size) {
+	for (guint offset = 0; offset < size; offset += 0x8000) {
+		guint length = MIN(size - offset, 0x8000);
+		rom_io32(rom, 0xD4, source + offset);
+		rom_io32(rom, 0xD8, dest + offset);
+		rom_io(rom, 0xDC, length / 4);
+		rom_io(rom, 0xDE, 0x8400);
+	}
+}
+
+// Store code assembled for IWRAM in the ROM, and copy it at boot
+static void rom_add_iwram_code(BenchRom *rom, Asm *code) {
+	asm_resolve(code);
+	asm_align(code, 4);
+
+	guint32 source = rom_add_data(rom, code->bytes->data, code->bytes->len);
+	rom_copy(rom, source, code->base, code->bytes->len);
+}
+
+static void rom_forced_blank(BenchRom *rom) {
+	rom_io(rom, 0x00, 0x0080);
+}
+
+/**
+ * Place the boot script and the boot code, and complete the ROM
+ * @param size return location for the ROM size
+ * @return ROM image, to be freed with g_free
+ */
+static guint8 *rom_finish(BenchRom *rom, gsize *size) {
+	Asm *a = &rom->code;
+
+	// Pairs of address and value words, ended by a zero address
+	guint8 *script = g_new(guint8, (rom->script->len + 1) * 8);
+	for (guint i = 0; i < rom->script->len; i++) {
+		const ScriptWrite *write = &g_array_index(rom->script, ScriptWrite, i);
+		put32(&script[i * 8], write->address);
+		put32(&script[i * 8 + 4], write->value);
+	}
+	put32(&script[rom->script->len * 8], 0);
+	guint32 scriptAddress = rom_add_data(rom, script, rom->script->len * 8 + 4);
+	g_free(script);
+
+	guint loop = asm_label(a);
+	guint done = asm_label(a);
+
+	asm_bind(a, rom->boot);
+	arm_const(a, 0, scriptAddress);
+	asm_bind(a, loop);
+	arm_ldr_post(a, 1, 0, 4);
+	arm_dp_imm(a, COND_AL, ARM_CMP, 1, 0, 1, 0);
+	arm_b(a, COND_EQ, FALSE, done);
+	arm_ldr_post(a, 2, 0, 4);
+	arm_mem(a, FALSE, 2, 2, 1, 0);
+	arm_b(a, COND_AL, FALSE, loop);
+	asm_bind(a, done);
+	arm_const(a, 0, rom->entry);
+	arm_bx(a, 0);
+
+	asm_resolve(a);
+
+	*size = a->bytes->len;
+	guint8 *data = g_byte_array_free(a->bytes, FALSE);
+	a->bytes = NULL;
+	return data;
+}
+
+// Kernel of the workloads driven by the hardware, the CPU halts forever
+// as no interrupt is enabled
+static void kernel_halt(BenchRom *rom) {
+	Asm *a = &rom->code;
+	asm_align(a, 4);
+	rom->entry = asm_here(a);
+
+	guint loop = asm_label(a);
+	asm_bind(a, loop);
+	arm_swi(a, 0x02);
+	arm_b(a, COND_AL, FALSE, loop);
+}
+
+// ARM ALU mix, from IWRAM like games do with their hot ARM code
+static void build_arm_alu(BenchRom *rom, int arg) {
+	Asm a;
+	asm_init(&a, IWRAM_BASE);
+
+	for (int r = 0; r < 12; r++) {
+		arm_dp_imm(&a, COND_AL, ARM_MOV, 0, r, 0, r * 17 + 1);
+	}
+
+	guint loop = asm_label(&a);
+	asm_bind(&a, loop);
+	arm_dp_reg(&a, COND_AL, ARM_ADD, 0, 0, 0, 1, SHIFT_LSL, 0);
+	arm_dp_reg(&a, COND_AL, ARM_EOR, 0, 1, 1, 0, SHIFT_ROR, 7);
+	arm_dp_reg(&a, COND_AL, ARM_ORR, 0, 2, 2, 1, SHIFT_LSL, 3);
+	arm_dp_reg(&a, COND_AL, ARM_SUB, 0, 3, 3, 2, SHIFT_LSR, 5);
+	arm_dp_reg(&a, COND_AL, ARM_AND, 0, 4, 0, 3, SHIFT_LSL, 0);
+	arm_dp_reg(&a, COND_AL, ARM_BIC, 0, 5, 5, 4, SHIFT_ASR, 2);
+	arm_mul(&a, 6, 0, 1);
+	arm_dp_reg(&a, COND_AL, ARM_ADD, 1, 7, 7, 6, SHIFT_LSL, 0);
+	arm_dp_imm(&a, COND_AL, ARM_ADC, 0, 8, 8, 1);
+	arm_dp_reg(&a, COND_AL, ARM_MOV, 0, 9, 0, 8, SHIFT_ASR, 2);
+	arm_dp_imm(&a, COND_AL, ARM_RSB, 0, 10, 9, 0xFF);
+	arm_dp_reg(&a, COND_AL, ARM_MVN, 0, 11, 0, 10, SHIFT_LSL, 0);
+	arm_dp_reg(&a, COND_AL, ARM_CMP, 1, 0, 11, 0, SHIFT_LSL, 0);
+	arm_dp_imm(&a, COND_NE, ARM_ADD, 0, 0, 0, 1);
+	arm_dp_reg(&a, COND_AL, ARM_TEQ, 1, 0, 1, 2, SHIFT_LSL, 0);
+	arm_b(&a, COND_AL, FALSE, loop);
+
+	rom_add_iwram_code(rom, &a);
+	asm_free(&a);
+
+	rom->entry = IWRAM_BASE;
+	rom_forced_blank(rom);
+}
+
+// Thumb ALU mix, from ROM like games do with most of their code
+static void build_thumb_alu(BenchRom *rom, int arg) {
+	Asm *a = &rom->code;
+	asm_align(a, 4);
+	rom->entry = asm_here(a) | 1;
+
+	for (int r = 0; r < 8; r++) {
+		thumb_imm(a, THUMB_IMM_MOV, r, r * 17 + 1);
+	}
+
+	guint loop = asm_label(a);
+	asm_bind(a, loop);
+	thumb_add_reg(a, FALSE, 0, 0, 1);
+	thumb_alu(a, THUMB_EOR, 1, 0);
+	thumb_shift(a, SHIFT_LSL, 2, 1, 3);
+	thumb_alu(a, THUMB_ORR, 2, 1);
+	thumb_shift(a, SHIFT_LSR, 3, 2, 5);
+	thumb_add_reg(a, TRUE, 3, 3, 0);
+	thumb_alu(a, THUMB_AND, 4, 3);
+	thumb_alu(a, THUMB_BIC, 5, 4);
+	thumb_alu(a, THUMB_MUL, 6, 0);
+	thumb_alu(a, THUMB_ADC, 7, 6);
+	thumb_alu(a, THUMB_ROR, 7, 1);
+	thumb_alu(a, THUMB_NEG, 5, 7);
+	thumb_alu(a, THUMB_MVN, 6, 5);
+	thumb_alu(a, THUMB_CMP, 6, 0);
+	thumb_alu(a, THUMB_TST, 1, 2);
+	thumb_imm(a, THUMB_IMM_ADD, 0, 13);
+	thumb_imm(a, THUMB_IMM_SUB, 1, 7);
+	thumb_b(a, loop);
+
+	rom_forced_blank(rom);
+}
+
+// Loads and stores of every size to IWRAM, EWRAM and ROM,
+// walking through 4 KiB buffers
+static void build_arm_load_store(BenchRom *rom, int arg) {
+	guint32 data = rom_add_random(rom, 0x100);
+
+	Asm a;
+	asm_init(&a, IWRAM_BASE);
+
+	arm_const(&a, 8, IWRAM_DATA);
+	arm_const(&a, 9, EWRAM_BASE);
+	arm_const(&a, 10, data);
+
+	guint loop = asm_label(&a);
+	asm_bind(&a, loop);
+	arm_mem(&a, TRUE, 4, 0, 8, 0);
+	arm_mem(&a, TRUE, 4, 1, 9, 4);
+	arm_dp_reg(&a, COND_AL, ARM_ADD, 0, 0, 0, 1, SHIFT_LSL, 0);
+	arm_mem(&a, FALSE, 4, 0, 9, 8);
+	arm_mem(&a, FALSE, 2, 1, 8, 12);
+	arm_mem(&a, TRUE, 2, 2, 9, 16);
+	arm_mem(&a, TRUE, 4, 3, 10, 0);
+	arm_mem(&a, TRUE, 1, 4, 8, 3);
+	arm_mem(&a, FALSE, 1, 4, 9, 21);
+	arm_block(&a, TRUE, FALSE, 9, 0x000F);
+	arm_block(&a, FALSE, FALSE, 8, 0x000F);
+	arm_dp_imm(&a, COND_AL, ARM_ADD, 0, 8, 8, 32);
+	arm_dp_imm(&a, COND_AL, ARM_BIC, 0, 8, 8, 0x1000);
+	arm_dp_imm(&a, COND_AL, ARM_ADD, 0, 9, 9, 32);
+	arm_dp_imm(&a, COND_AL, ARM_BIC, 0, 9, 9, 0x1000);
+	arm_b(&a, COND_AL, FALSE, loop);
+
+	rom_add_iwram_code(rom, &a);
+	asm_free(&a);
+
+	rom->entry = IWRAM_BASE;
+	rom_forced_blank(rom);
+}
+
+static void build_thumb_load_store(BenchRom *rom, int arg) {
+	guint32 data = rom_add_random(rom, 0x100);
+
+	Asm *a = &rom->code;
+	asm_align(a, 4);
+	rom->entry = asm_here(a) | 1;
+
+	thumb_const(a, 4, IWRAM_DATA);
+	thumb_const(a, 5, EWRAM_BASE);
+	thumb_const(a, 6, data);
+	thumb_const(a, 7, 0x1000);
+
+	guint loop = asm_label(a);
+	asm_bind(a, loop);
+	thumb_mem(a, TRUE, 4, 0, 4, 0);
+	thumb_mem(a, TRUE, 4, 1, 5, 4);
+	thumb_add_reg(a, FALSE, 0, 0, 1);
+	thumb_mem(a, FALSE, 4, 0, 5, 8);
+	thumb_mem(a, FALSE, 2, 1, 4, 12);
+	thumb_mem(a, TRUE, 2, 2, 5, 16);
+	thumb_mem(a, TRUE, 4, 3, 6, 0);
+	thumb_mem(a, TRUE, 1, 2, 4, 3);
+	thumb_mem(a, FALSE, 1, 2, 5, 21);
+	thumb_stack(a, FALSE, 0x03);
+	thumb_stack(a, TRUE, 0x0C);
+	thumb_block(a, TRUE, 5, 0x03);
+	thumb_block(a, FALSE, 4, 0x03);
+	thumb_alu(a, THUMB_BIC, 4, 7);
+	thumb_alu(a, THUMB_BIC, 5, 7);
+	thumb_b(a, loop);
+
+	rom_forced_blank(rom);
+}
+
+// Conditional branches taken at random, following a LFSR, and calls
+static void build_arm_branch(BenchRom *rom, int arg) {
+	Asm a;
+	asm_init(&a, IWRAM_BASE);
+
+	guint loop = asm_label(&a);
+	guint leaf = asm_label(&a);
+	guint skip1 = asm_label(&a);
+	guint skip2 = asm_label(&a);
+	guint skip3 = asm_label(&a);
+
+	arm_const(&a, 0, 0xACE1);
+	arm_const(&a, 12, 0xB400);
+
+	asm_bind(&a, loop);
+	arm_dp_reg(&a, COND_AL, ARM_MOV, 1, 0, 0, 0, SHIFT_LSR, 1);
+	arm_dp_reg(&a, COND_CS, ARM_EOR, 0, 0, 0, 12, SHIFT_LSL, 0);
+	arm_dp_imm(&a, COND_AL, ARM_TST, 1, 0, 0, 1);
+	arm_b(&a, COND_NE, FALSE, skip1);
+	arm_dp_imm(&a, COND_AL, ARM_ADD, 0, 1, 1, 1);
+	asm_bind(&a, skip1);
+	arm_dp_imm(&a, COND_AL, ARM_TST, 1, 0, 0, 2);
+	arm_b(&a, COND_EQ, TRUE, leaf);
+	arm_dp_imm(&a, COND_AL, ARM_TST, 1, 0, 0, 4);
+	arm_b(&a, COND_EQ, FALSE, skip2);
+	arm_dp_imm(&a, COND_AL, ARM_SUB, 0, 2, 2, 1);
+	asm_bind(&a, skip2);
+	arm_dp_reg(&a, COND_AL, ARM_CMP, 1, 0, 1, 2, SHIFT_LSL, 0);
+	arm_b(&a, COND_GT, FALSE, skip3);
+	arm_b(&a, COND_AL, TRUE, leaf);
+	asm_bind(&a, skip3);
+	arm_b(&a, COND_AL, FALSE, loop);
+
+	asm_bind(&a, leaf);
+	arm_dp_imm(&a, COND_AL, ARM_ADD, 0, 3, 3, 1);
+	arm_bx(&a, 14);
+
+	rom_add_iwram_code(rom, &a);
+	asm_free(&a);
+
+	rom->entry = IWRAM_BASE;
+	rom_forced_blank(rom);
+}
+
+static void build_thumb_branch(BenchRom *rom, int arg) {
+	Asm *a = &rom->code;
+	asm_align(a, 4);
+	rom->entry = asm_here(a) | 1;
+
+	guint loop = asm_label(a);
+	guint leaf = asm_label(a);
+	guint noxor = asm_label(a);
+	guint skip1 = asm_label(a);
+	guint skip2 = asm_label(a);
+	guint skip3 = asm_label(a);
+	guint skip4 = asm_label(a);
+
+	thumb_const(a, 0, 0xACE1);
+	thumb_const(a, 6, 0xB400);
+
+	// The shifts put the tested bit in the carry
+	asm_bind(a, loop);
+	thumb_shift(a, SHIFT_LSR, 0, 0, 1);
+	thumb_bcond(a, COND_CC, noxor);
+	thumb_alu(a, THUMB_EOR, 0, 6);
+	asm_bind(a, noxor);
+	thumb_shift(a, SHIFT_LSR, 1, 0, 1);
+	thumb_bcond(a, COND_CS, skip1);
+	thumb_imm(a, THUMB_IMM_ADD, 2, 1);
+	asm_bind(a, skip1);
+	thumb_shift(a, SHIFT_LSR, 1, 0, 2);
+	thumb_bcond(a, COND_CC, skip2);
+	thumb_bl(a, leaf);
+	asm_bind(a, skip2);
+	thumb_shift(a, SHIFT_LSR, 1, 0, 3);
+	thumb_bcond(a, COND_CS, skip3);
+	thumb_imm(a, THUMB_IMM_SUB, 3, 1);
+	asm_bind(a, skip3);
+	thumb_alu(a, THUMB_CMP, 2, 3);
+	thumb_bcond(a, COND_GT, skip4);
+	thumb_bl(a, leaf);
+	asm_bind(a, skip4);
+	thumb_b(a, loop);
+
+	asm_bind(a, leaf);
+	thumb_imm(a, THUMB_IMM_ADD, 4, 1);
+	thumb_bx(a, 14);
+
+	rom_forced_blank(rom);
+}
+
+// All 128 sprites, of every kind: regular and affine, double size,
+// semi-transparent, 16 and 256 colors
+static void bench_sprites(guint8 *oam) {
+	for (int i = 0; i < 128; i++) {
+		gboolean affine = (i & 1) == 0;
+
+		guint16 attr0 = (i * 13) % 160;
+		if (affine) {
+			attr0 |= 0x0100;
+			if (i % 4 == 0)
+				attr0 |= 0x0200;
+		}
+		if (i % 3 == 0)
+			attr0 |= 0x0400;
+		if (i % 4 == 3)
+			attr0 |= 0x2000;
+
+		guint16 attr1 = ((i * 37) % 240) | ((i % 5 == 0 ? 2 : 1) << 14);
+		if (affine)
+			attr1 |= ((i / 2) % 32) << 9;
+		else
+			attr1 |= (i & 3) << 12;
+
+		// Tiles from the second half of the sprite VRAM, usable in the bitmap modes
+		guint16 attr2 = (512 + (i * 8) % 256) | ((i & 3) << 10) | ((i & 15) << 12);
+
+		put16(&oam[i * 8], attr0);
+		put16(&oam[i * 8 + 2], attr1);
+		put16(&oam[i * 8 + 4], attr2);
+		put16(&oam[i * 8 + 6], 0);
+	}
+
+	// Rotation and scaling parameters, in the fourth halfword of the entries
+	for (int group = 0; group < 32; group++) {
+		double angle = group * G_PI / 16;
+		double scale = 1 + (group % 4) / 4.0;
+		put16(&oam[group * 32 + 6], (gint16) (cos(angle) * 256 / scale));
+		put16(&oam[group * 32 + 14], (gint16) (-sin(angle) * 256 / scale));
+		put16(&oam[group * 32 + 22], (gint16) (sin(angle) * 256 / scale));
+		put16(&oam[group * 32 + 30], (gint16) (cos(angle) * 256 / scale));
+	}
+}
+
+// Every layer of the video mode enabled, sprites, and alpha blending
+static void build_renderer(BenchRom *rom, int mode) {
+	static const struct {
+		guint16 dispcnt;
+		guint16 bldcnt;
+		guint16 bgcnt[4];
+	} modes[6] = {
+		{ 0x1F40, 0x2C43, { 0x1C00, 0x1D85, 0x1E0A, 0x5A83 } },
+		{ 0x1741, 0x2641, { 0x1C00, 0x1D05, 0x7E0A, 0x0000 } },
+		{ 0x1C42, 0x2844, { 0x0000, 0x0000, 0x7E0A, 0xB807 } },
+		{ 0x1443, 0x2450, { 0x0000, 0x0000, 0x0000, 0x0000 } },
+		{ 0x1444, 0x2450, { 0x0000, 0x0000, 0x0000, 0x0000 } },
+		{ 0x1445, 0x2450, { 0x0000, 0x0000, 0x0000, 0x0000 } }
+	};
+
+	// Random tiles, maps and bitmaps over the whole VRAM, random palettes
+	rom_copy(rom, rom_add_random(rom, 0x18000), 0x06000000, 0x18000);
+	rom_copy(rom, rom_add_random(rom, 0x400), 0x05000000, 0x400);
+
+	guint8 oam[0x400];
+	bench_sprites(oam);
+	rom_copy(rom, rom_add_data(rom, oam, sizeof(oam)), 0x07000000, sizeof(oam));
+
+	for (int bg = 0; bg < 4; bg++) {
+		rom_io(rom, 0x08 + bg * 2, modes[mode].bgcnt[bg]);
+		rom_io(rom, 0x10 + bg * 4, bg * 37);
+		rom_io(rom, 0x12 + bg * 4, bg * 19);
+	}
+
+	// BG2 rotated by 30 degrees, BG3 scaled down
+	rom_io(rom, 0x20, 0x00DE);
+	rom_io(rom, 0x22, 0xFF80);
+	rom_io(rom, 0x24, 0x0080);
+	rom_io(rom, 0x26, 0x00DE);
+	rom_io32(rom, 0x28, 0x00002000);
+	rom_io32(rom, 0x2C, 0x00001000);
+	rom_io(rom, 0x30, 0x00C0);
+	rom_io(rom, 0x32, 0x0040);
+	rom_io(rom, 0x34, 0xFFC0);
+	rom_io(rom, 0x36, 0x00C0);
+
+	rom_io(rom, 0x50, modes[mode].bldcnt);
+	rom_io(rom, 0x52, 0x0A06);
+	rom_io(rom, 0x00, modes[mode].dispcnt);
+
+	kernel_halt(rom);
+}
+
+// Back to back immediate DMA 3 transfers started by the CPU:
+// EWRAM to VRAM, ROM to EWRAM, IWRAM to palette
+static void build_dma_immediate(BenchRom *rom, int arg) {
+	guint32 data = rom_add_random(rom, 0x1000);
+
+	Asm a;
+	asm_init(&a, IWRAM_BASE);
+
+	arm_const(&a, 0, 0x040000D4);
+	arm_const(&a, 1, EWRAM_BASE);
+	arm_const(&a, 2, 0x06000000);
+	arm_const(&a, 3, 0x84000400);
+	arm_const(&a, 4, data);
+	arm_const(&a, 5, EWRAM_BASE + 0x10000);
+	arm_const(&a, 6, 0x80000800);
+	arm_const(&a, 7, IWRAM_DATA);
+	arm_const(&a, 8, 0x05000000);
+	arm_const(&a, 9, 0x84000080);
+
+	guint loop = asm_label(&a);
+	asm_bind(&a, loop);
+	arm_block(&a, FALSE, FALSE, 0, 0x000E);
+	arm_block(&a, FALSE, FALSE, 0, 0x0070);
+	arm_block(&a, FALSE, FALSE, 0, 0x0380);
+	arm_b(&a, COND_AL, FALSE, loop);
+
+	rom_add_iwram_code(rom, &a);
+	asm_free(&a);
+
+	rom->entry = IWRAM_BASE;
+	rom_forced_blank(rom);
+}
+
+// Repeating transfers started by the display, as used for raster effects:
+// per line scrolling and rotation from DMA 0 and 1, and an OAM buffer
+// copied at each vertical blank by DMA 2
+static void build_dma_display(BenchRom *rom, int arg) {
+	rom_copy(rom, rom_add_random(rom, 0x1000), IWRAM_BASE, 0x1000);
+
+	rom_io32(rom, 0xB0, IWRAM_BASE);
+	rom_io32(rom, 0xB4, 0x04000010);
+	rom_io(rom, 0xB8, 2);
+	rom_io(rom, 0xBA, 0xA260);
+
+	rom_io32(rom, 0xBC, EWRAM_BASE);
+	rom_io32(rom, 0xC0, 0x04000020);
+	rom_io(rom, 0xC4, 8);
+	rom_io(rom, 0xC6, 0xA260);
+
+	rom_io32(rom, 0xC8, EWRAM_BASE + 0x20000);
+	rom_io32(rom, 0xCC, 0x07000000);
+	rom_io(rom, 0xD0, 256);
+	rom_io(rom, 0xD2, 0x9660);
+
+	rom_forced_blank(rom);
+	kernel_halt(rom);
+}
+
+// The four PSG channels, and optionally both PCM channels fed by
+// the sound DMA, PCM A at 32 kHz and PCM B at 16 kHz
+static void build_sound(BenchRom *rom, int pcm) {
+	rom_io(rom, 0x84, 0x0080);
+	rom_io(rom, 0x80, 0xFF77);
+
+	for (int i = 0; i < 8; i++) {
+		rom_io(rom, 0x90 + i * 2, g_rand_int(rom->rand));
+	}
+
+	rom_io(rom, 0x62, 0xF080);
+	rom_io(rom, 0x64, 0x8600);
+	rom_io(rom, 0x68, 0xF040);
+	rom_io(rom, 0x6C, 0x8500);
+	rom_io(rom, 0x70, 0x0080);
+	rom_io(rom, 0x72, 0x2000);
+	rom_io(rom, 0x74, 0x8400);
+	rom_io(rom, 0x78, 0xF000);
+	rom_io(rom, 0x7C, 0x8021);
+
+	if (pcm) {
+		guint32 samples = rom_add_random(rom, 0x10000);
+
+		rom_io(rom, 0x82, 0xFB0E);
+
+		rom_io32(rom, 0xBC, samples);
+		rom_io32(rom, 0xC0, 0x040000A0);
+		rom_io(rom, 0xC6, 0xB640);
+		rom_io32(rom, 0xC8, samples + 0x8000);
+		rom_io32(rom, 0xCC, 0x040000A4);
+		rom_io(rom, 0xD2, 0xB640);
+
+		rom_io(rom, 0x100, 0xFE00);
+		rom_io(rom, 0x102, 0x0080);
+		rom_io(rom, 0x104, 0xFC00);
+		rom_io(rom, 0x106, 0x0080);
+	} else {
+		rom_io(rom, 0x82, 0x0002);
+	}
+
+	rom_forced_blank(rom);
+	kernel_halt(rom);
+}
+
+// Where the functions timed by the BIOS cost measurement write their output
+#define BIOS_COST_DEST (EWRAM_BASE + 0x1000)
+
+// Bytes produced by the copy and decompression functions
+#define BIOS_COST_LENGTH 256
+
+// Kernel of the BIOS cost measurement, in IWRAM. Timer 0 counts the clock
+// ticks of the software interrupt, or of a no-op for the baseline. The count
+// and the interrupt flags, telling whether the timer overflowed, are stored
+// at the start of EWRAM, followed by a nonzero word once done.
+static void kernel_bios_cost(BenchRom *rom, int comment, const guint32 *args) {
+	Asm a;
+	asm_init(&a, IWRAM_BASE);
+
+	arm_const(&a, 4, 0x04000100);
+	arm_const(&a, 5, 0x00C00000);
+	for (int i = 0; i < 4; i++) {
+		arm_const(&a, i, args[i]);
+	}
+
+	arm_mem(&a, FALSE, 4, 5, 4, 0);
+	if (comment >= 0) {
+		arm_swi(&a, comment);
+	} else {
+		arm_dp_reg(&a, COND_AL, ARM_MOV, 0, 0, 0, 0, SHIFT_LSL, 0);
+	}
+	arm_const(&a, 4, 0x04000100);
+	arm_mem(&a, TRUE, 2, 5, 4, 0);
+
+	arm_const(&a, 4, 0x04000200);
+	arm_mem(&a, TRUE, 2, 6, 4, 2);
+	arm_const(&a, 7, EWRAM_BASE);
+	arm_mem(&a, FALSE, 4, 5, 7, 0);
+	arm_mem(&a, FALSE, 4, 6, 7, 4);
+	arm_dp_imm(&a, COND_AL, ARM_MOV, 0, 5, 0, 1);
+	arm_mem(&a, FALSE, 4, 5, 7, 8);
+
+	guint loop = asm_label(&a);
+	asm_bind(&a, loop);
+	arm_swi(&a, 0x02);
+	arm_b(&a, COND_AL, FALSE, loop);
+
+	rom_add_iwram_code(rom, &a);
+	asm_free(&a);
+
+	rom->entry = IWRAM_BASE;
+}
+
+// Div, with a quotient of a few bits or of 31 bits
+static void build_bios_div(BenchRom *rom, int large, guint32 *args) {
+	args[0] = large ? 0x7FFFFFFF : 1000;
+	args[1] = large ? 3 : 7;
+}
+
+// Sqrt, with a result of a few bits or of 16 bits
+static void build_bios_sqrt(BenchRom *rom, int large, guint32 *args) {
+	args[0] = large ? 0x7FFFFFFF : 0x100;
+}
+
+static void build_bios_arctan2(BenchRom *rom, int arg, guint32 *args) {
+	args[0] = 0x2000;
+	args[1] = 0x1000;
+}
+
+// CpuSet copying halfwords, words, or filling words, from the ROM
+static void build_bios_cpuset(BenchRom *rom, int mode, guint32 *args) {
+	args[0] = rom_add_random(rom, BIOS_COST_LENGTH);
+	args[1] = BIOS_COST_DEST;
+	switch (mode) {
+	case 0:
+		args[2] = BIOS_COST_LENGTH / 2;
+		break;
+	case 1:
+		args[2] = BIOS_COST_LENGTH / 4 | 1 << 26;
+		break;
+	default:
+		args[2] = BIOS_COST_LENGTH / 4 | 1 << 26 | 1 << 24;
+		break;
+	}
+}
+
+// CpuFastSet copying or filling words, from the ROM
+static void build_bios_cpufastset(BenchRom *rom, int fill, guint32 *args) {
+	args[0] = rom_add_random(rom, BIOS_COST_LENGTH);
+	args[1] = BIOS_COST_DEST;
+	args[2] = BIOS_COST_LENGTH / 4 | (fill ? 1 << 24 : 0);
+}
+
+// Eight BgAffineSet or ObjAffineSet entries, the latter spaced like in OAM
+static void build_bios_affine(BenchRom *rom, int obj, guint32 *args) {
+	args[0] = rom_add_random(rom, obj ? 8 * 8 : 8 * 20);
+	args[1] = BIOS_COST_DEST;
+	args[2] = 8;
+	args[3] = obj ? 8 : 0;
+}
+
+// BitUnPack of 1 bit units to 4 bit units
+static void build_bios_bitunpack(BenchRom *rom, int arg, guint32 *args) {
+	guint8 info[8];
+	put16(info, BIOS_COST_LENGTH / 4);
+	info[2] = 1;
+	info[3] = 4;
+	put32(info + 4, 0);
+
+	args[0] = rom_add_random(rom, BIOS_COST_LENGTH / 4);
+	args[1] = BIOS_COST_DEST;
+	args[2] = rom_add_data(rom, info, sizeof(info));
+}
+
+// Start compressed data with the header of a decompression function
+static GByteArray *bios_stream_new(guint8 type, guint size) {
+	guint8 header[4];
+	put32(header, type | size << 8);
+	return g_byte_array_append(g_byte_array_new(), header, sizeof(header));
+}
+
+static guint32 bios_stream_add(BenchRom *rom, GByteArray *stream) {
+	guint32 address = rom_add_data(rom, stream->data, stream->len);
+	g_byte_array_free(stream, TRUE);
+	return address;
+}
+
+// LZ77UnCompWram of literal bytes only, or of the longest copies
+// after a first literal byte
+static void build_bios_lz77(BenchRom *rom, int copies, guint32 *args) {
+	GByteArray *stream = bios_stream_new(0x10, BIOS_COST_LENGTH);
+
+	guint remaining = BIOS_COST_LENGTH;
+	for (guint block = 0; remaining > 0; block++) {
+		guint flagOffset = stream->len;
+		guint8 flags = 0;
+		g_byte_array_append(stream, &flags, 1);
+
+		for (int bit = 7; bit >= 0 && remaining > 0; bit--) {
+			if (copies && (block > 0 || bit < 7) && remaining >= 3) {
+				guint length = MIN(remaining, 18);
+				guint8 copy[2] = { (guint8) ((length - 3) << 4), 0 };
+				g_byte_array_append(stream, copy, sizeof(copy));
+				flags |= 1 << bit;
+				remaining -= length;
+			} else {
+				guint8 literal = g_rand_int(rom->rand);
+				g_byte_array_append(stream, &literal, 1);
+				remaining--;
+			}
+		}
+		stream->data[flagOffset] = flags;
+	}
+
+	args[0] = bios_stream_add(rom, stream);
+	args[1] = BIOS_COST_DEST;
+}
+
+// HuffUnComp of 8 bit symbols, with a tree of two leaves
+static void build_bios_huffman(BenchRom *rom, int arg, guint32 *args) {
+	GByteArray *stream = bios_stream_new(0x28, BIOS_COST_LENGTH);
+
+	// Tree size, root node with two leaves, then the leaves
+	static const guint8 tree[] = { 0x01, 0xC0, 'A', 'B' };
+	g_byte_array_append(stream, tree, sizeof(tree));
+
+	// A bit per symbol
+	for (guint i = 0; i < BIOS_COST_LENGTH / 32; i++) {
+		guint8 word[4];
+		put32(word, g_rand_int(rom->rand));
+		g_byte_array_append(stream, word, sizeof(word));
+	}
+
+	args[0] = bios_stream_add(rom, stream);
+	args[1] = BIOS_COST_DEST;
+}
+
+// RLUnCompWram of literal blocks or of runs, of the longest lengths
+static void build_bios_rl(BenchRom *rom, int runs, guint32 *args) {
+	GByteArray *stream = bios_stream_new(0x30, BIOS_COST_LENGTH);
+
+	guint remaining = BIOS_COST_LENGTH;
+	while (remaining > 0) {
+		guint length;
+		if (runs && remaining >= 3) {
+			length = MIN(remaining, 130);
+			guint8 run[2] = { (guint8) (0x80 | (length - 3)), (guint8) g_rand_int(rom->rand) };
+			g_byte_array_append(stream, run, sizeof(run));
+		} else {
+			length = MIN(remaining, 128);
+			guint8 flag = length - 1;
+			g_byte_array_append(stream, &flag, 1);
+			for (guint i = 0; i < length; i++) {
+				guint8 literal = g_rand_int(rom->rand);
+				g_byte_array_append(stream, &literal, 1);
+			}
+		}
+		remaining -= length;
+	}
+
+	args[0] = bios_stream_add(rom, stream);
+	args[1] = BIOS_COST_DEST;
+}
+
+// Diff8bitUnFilterWram or Diff16bitUnFilter
+static void build_bios_diff(BenchRom *rom, int unit, guint32 *args) {
+	GByteArray *stream = bios_stream_new(0x80 | unit, BIOS_COST_LENGTH);
+
+	for (guint i = 0; i < BIOS_COST_LENGTH; i++) {
+		guint8 value = g_rand_int(rom->rand);
+		g_byte_array_append(stream, &value, 1);
+	}
+
+	args[0] = bios_stream_add(rom, stream);
+	args[1] = BIOS_COST_DEST;
+}
+
+static guint64 count_instructions(const PerfCounters *counters) {
+	return counters->armInstructions + counters->thumbInstructions;
+}
+
+static guint64 count_scanlines(const PerfCounters *counters) {
+	guint64 lines = 0;
+	for (int mode = 0; mode < PERF_VIDEO_MODES; mode++) {
+		lines += counters->modeScanlines[mode];
+	}
+	return lines;
+}
+
+static guint64 count_dma_bytes(const PerfCounters *counters) {
+	guint64 bytes = 0;
+	for (int ch = 0; ch < PERF_DMA_CHANNELS; ch++) {
+		bytes += counters->dmaBytes[ch];
+	}
+	return bytes;
+}
+
+static guint64 count_samples(const PerfCounters *counters) {
+	return counters->soundSamples;
+}
+
+static const Benchmark benchmarks[] = {
+	{ "cpu/arm-alu", "instruction", build_arm_alu, 0, count_instructions, NULL },
+	{ "cpu/thumb-alu", "instruction", build_thumb_alu, 0, count_instructions, NULL },
+	{ "cpu/arm-load-store", "instruction", build_arm_load_store, 0, count_instructions, NULL },
+	{ "cpu/thumb-load-store", "instruction", build_thumb_load_store, 0, count_instructions, NULL },
+	{ "cpu/arm-branch", "instruction", build_arm_branch, 0, count_instructions, NULL },
+	{ "cpu/thumb-branch", "instruction", build_thumb_branch, 0, count_instructions, NULL },
+	{ "ppu/mode0", "scanline", build_renderer, 0, count_scanlines, NULL },
+	{ "ppu/mode1", "scanline", build_renderer, 1, count_scanlines, NULL },
+	{ "ppu/mode2", "scanline", build_renderer, 2, count_scanlines, NULL },
+	{ "ppu/mode3", "scanline", build_renderer, 3, count_scanlines, NULL },
+	{ "ppu/mode4", "scanline", build_renderer, 4, count_scanlines, NULL },
+	{ "ppu/mode5", "scanline", build_renderer, 5, count_scanlines, NULL },
+	{ "dma/immediate", "byte", build_dma_immediate, 0, count_dma_bytes, NULL },
+	{ "dma/display", "byte", build_dma_display, 0, count_dma_bytes, NULL },
+	{ "apu/psg", "sample", build_sound, FALSE, count_samples, NULL },
+	{ "apu/psg-pcm", "sample", build_sound, TRUE, count_samples, NULL },
+	{ "savestate/compressed", "round trip", build_renderer, 0, NULL, savestate_save_to_file },
+	{ "savestate/raw", "round trip", build_renderer, 0, NULL, savestate_save_raw_to_file }
+};
+
+static const BiosCost biosCosts[] = {
+	{ "div/small", 0x06, build_bios_div, FALSE },
+	{ "div/large", 0x06, build_bios_div, TRUE },
+	{ "sqrt/small", 0x08, build_bios_sqrt, FALSE },
+	{ "sqrt/large", 0x08, build_bios_sqrt, TRUE },
+	{ "arctan2", 0x0A, build_bios_arctan2, 0 },
+	{ "cpuset/copy16", 0x0B, build_bios_cpuset, 0 },
+	{ "cpuset/copy32", 0x0B, build_bios_cpuset, 1 },
+	{ "cpuset/fill32", 0x0B, build_bios_cpuset, 2 },
+	{ "cpufastset/copy", 0x0C, build_bios_cpufastset, FALSE },
+	{ "cpufastset/fill", 0x0C, build_bios_cpufastset, TRUE },
+	{ "bgaffineset", 0x0E, build_bios_affine, FALSE },
+	{ "objaffineset", 0x0F, build_bios_affine, TRUE },
+	{ "bitunpack", 0x10, build_bios_bitunpack, 0 },
+	{ "lz77/literals", 0x11, build_bios_lz77, FALSE },
+	{ "lz77/copies", 0x11, build_bios_lz77, TRUE },
+	{ "huffman", 0x13, build_bios_huffman, 0 },
+	{ "rl/literals", 0x14, build_bios_rl, FALSE },
+	{ "rl/runs", 0x14, build_bios_rl, TRUE },
+	{ "diff8", 0x16, build_bios_diff, 1 },
+	{ "diff16", 0x18, build_bios_diff, 2 }
+};
+
+static void bench_draw_screen(const DisplayDriver *driver, guint16 *pix) {
+}
+
+static void bench_sound_pause(SoundDriver *driver, gboolean pause) {
+}
+
+static void bench_sound_reset(SoundDriver *driver) {
+}
+
+static void bench_sound_write(SoundDriver *driver, guint16 *finalWave, int length) {
+}
+
+static guint32 bench_read_joypad(InputDriver *driver) {
+	return 0;
+}
+
+static void bench_update_motion_sensor(InputDriver *driver) {
+}
+
+static int bench_read_sensor(InputDriver *driver) {
+	return 0;
+}
+
+static void bench_fail(const Benchmark *bench, GError *err) {
+	g_printerr("%s: %s\n", bench->name, err->message);
+	exit(1);
+}
+
+// Load a test ROM and reset the emulated system
+static gboolean bench_load_rom(BenchRom *rom, GError **err) {
+	gsize size;
+	guint8 *data = rom_finish(rom, &size);
+	rom_free(rom);
+
+	gboolean loaded = cartridge_load_rom_data(data, size, err);
+	g_free(data);
+	if (!loaded) {
+		return FALSE;
+	}
+
+	CPUInit();
+	CPUReset();
+
+	// A BIOS file would not start the test ROMs, they have no logo
+	if (!Bios::isReplacement()) {
+		Bios::boot();
+	}
+	return TRUE;
+}
+
+static void bench_load(const Benchmark *bench) {
+	GError *err = NULL;
+
+	BenchRom rom;
+	rom_init(&rom);
+	bench->build(&rom, bench->arg);
+
+	if (!bench_load_rom(&rom, &err)) {
+		bench_fail(bench, err);
+	}
+}
+
+/**
+ * Run a repetition of a benchmark
+ * @param ops return location for the number of operations
+ * @return elapsed time in nanoseconds
+ */
+static gint64 bench_run(const Benchmark *bench, const gchar *stateFile, guint64 *ops) {
+	GError *err = NULL;
+	*ops = 0;
+
+	gint64 start = perf_counters_get_time();
+
+	if (bench->save != NULL) {
+		for (int i = 0; i < BENCH_ROUND_TRIPS; i++) {
+			if (!bench->save(stateFile, &err) || !savestate_load_from_file(stateFile, &err)) {
+				bench_fail(bench, err);
+			}
+		}
+		*ops = BENCH_ROUND_TRIPS;
+	} else {
+		PerfCounters counters;
+		for (int i = 0; i < frames; i++) {
+			gba_run_frame();
+			perf_counters_get_last_frame(&counters);
+			*ops += bench->count_ops(&counters);
+		}
+	}
+
+	return perf_counters_get_time() - start;
+}
+
+static void bios_cost_fail(const BiosCost *cost, const char *message) {
+	g_printerr("%s: %s\n", cost->name, message);
+	exit(1);
+}
+
+/**
+ * Time a BIOS function
+ * @param comment software interrupt to time, or -1 for the baseline
+ * @param hle whether the function is performed natively
+ * @return clock ticks counted by the timer
+ */
+static guint32 bios_cost_run(const BiosCost *cost, int comment, gboolean hle) {
+	GError *err = NULL;
+
+	BenchRom rom;
+	rom_init(&rom);
+	guint32 args[4] = { 0, 0, 0, 0 };
+	cost->build(&rom, cost->arg, args);
+	kernel_bios_cost(&rom, comment, args);
+
+	Bios::setHLE(hle);
+	if (!bench_load_rom(&rom, &err)) {
+		bios_cost_fail(cost, err->message);
+	}
+	memset(workRAM, 0, 12);
+
+	for (int i = 0; i < BIOS_COST_FRAMES && get32(&workRAM[8]) == 0; i++) {
+		gba_run_frame();
+	}
+
+	if (get32(&workRAM[8]) == 0) {
+		bios_cost_fail(cost, "The function did not return");
+	}
+	if (get32(&workRAM[4]) & 0x0008) {
+		bios_cost_fail(cost, "The timer overflowed");
+	}
+	return get32(&workRAM[0]);
+}
+
+// Time each BIOS function with the BIOS file, then natively. The emulation
+// is deterministic, a single run of each is enough.
+static void bios_costs_print() {
+	guint32 baseline = bios_cost_run(&biosCosts[0], -1, FALSE);
+	gboolean first = TRUE;
+
+	if (json) {
+		g_print("{\"baseline_ticks\":%u,\"functions\":[", baseline);
+	} else {
+		g_print("Clock ticks of the BIOS functions, less %u ticks of timer overhead\n", baseline);
+		g_print("%-22s %12s %12s %8s\n", "function", "BIOS file", "native", "error");
+	}
+
+	for (guint c = 0; c < G_N_ELEMENTS(biosCosts); c++) {
+		const BiosCost *cost = &biosCosts[c];
+		if (filter != NULL && strstr(cost->name, filter) == NULL)
+			continue;
+
+		gint64 bios = (gint64) bios_cost_run(cost, cost->comment, FALSE) - baseline;
+		gint64 native = (gint64) bios_cost_run(cost, cost->comment, TRUE) - baseline;
+
+		if (json) {
+			g_print("%s\n{\"name\":\"%s\",\"swi\":%d,\"bios_ticks\":%" G_GINT64_FORMAT
+					",\"native_ticks\":%" G_GINT64_FORMAT "}",
+					first ? "" : ",", cost->name, cost->comment, bios, native);
+		} else {
+			g_print("%-22s %12" G_GINT64_FORMAT " %12" G_GINT64_FORMAT " %+7.1f%%\n", cost->name,
+					bios, native, bios > 0 ? 100.0 * (native - bios) / bios : 0);
+		}
+		first = FALSE;
+	}
+
+	if (json) {
+		g_print("\n]}\n");
+	}
+}
+
+static void bench_shutdown() {
+	soundShutdown();
+	cartridge_unload();
+	display_free();
+	CPUCleanUp();
+	settings_free();
+}
+
+static int compare_doubles(const void *a, const void *b) {
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+static void stats_compute(Stats *stats, const double *values, int count) {
+	double *sorted = g_new(double, count);
+	memcpy(sorted, values, count * sizeof(double));
+	qsort(sorted, count, sizeof(double), compare_doubles);
+
+	stats->median = count % 2 ? sorted[count / 2] : (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+	stats->min = sorted[0];
+	stats->max = sorted[count - 1];
+
+	double sum = 0;
+	for (int i = 0; i < count; i++) {
+		sum += values[i];
+	}
+	stats->mean = sum / count;
+
+	double squares = 0;
+	for (int i = 0; i < count; i++) {
+		squares += (values[i] - stats->mean) * (values[i] - stats->mean);
+	}
+	stats->stddev = count > 1 ? sqrt(squares / (count - 1)) : 0;
+
+	g_free(sorted);
+}
+
+static void print_json_stats(const Stats *stats) {
+	g_print("{\"median\":%.4f,\"mean\":%.4f,\"stddev\":%.4f,\"min\":%.4f,\"max\":%.4f}",
+			stats->median, stats->mean, stats->stddev, stats->min, stats->max);
+}
+
+int main(int argc, char **argv) {
+	GError *err = NULL;
+
+	GOptionContext *context = g_option_context_new("- measure the emulation speed on synthetic workloads");
+	g_option_context_add_main_entries(context, options, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &err)) {
+		g_printerr("%s\n", err->message);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	if (repetitions <= 0 || frames <= 0) {
+		g_printerr("The repetitions and frames must be positive\n");
+		return 1;
+	}
+
+	settings_init();
+
+	if (!CPUInitMemory(&err) || !CPULoadBios(biosFile, &err)) {
+		g_printerr("%s\n", err->message);
+		return 1;
+	}
+
+	DisplayDriver displayDriver;
+	displayDriver.drawScreen = bench_draw_screen;
+	displayDriver.driverData = NULL;
+	display_init(&displayDriver);
+
+	SoundDriver soundDriver;
+	soundDriver.pause = bench_sound_pause;
+	soundDriver.reset = bench_sound_reset;
+	soundDriver.write = bench_sound_write;
+	soundDriver.get_buffer_fill = NULL;
+	soundDriver.get_latency = NULL;
+	soundDriver.driverData = NULL;
+	soundInit(&soundDriver);
+
+	InputDriver inputDriver;
+	inputDriver.read_joypad = bench_read_joypad;
+	inputDriver.update_motion_sensor = bench_update_motion_sensor;
+	inputDriver.read_sensor_x = bench_read_sensor;
+	inputDriver.read_sensor_y = bench_read_sensor;
+	inputDriver.driverData = NULL;
+	gba_init_input(&inputDriver);
+
+	if (biosFile != NULL) {
+		bios_costs_print();
+		bench_shutdown();
+		return 0;
+	}
+
+	gchar *stateDir = g_dir_make_tmp("vba-bench-XXXXXX", &err);
+	if (stateDir == NULL) {
+		g_printerr("%s\n", err->message);
+		return 1;
+	}
+	gchar *stateFile = g_build_filename(stateDir, "bench.sgm", NULL);
+
+	double *nsPerOp = g_new(double, repetitions);
+	double *speed = g_new(double, repetitions);
+	gboolean first = TRUE;
+
+	if (json) {
+		g_print("{\"repetitions\":%d,\"frames\":%d,\"benchmarks\":[", repetitions, frames);
+	} else {
+		g_print("%d runs of %d frames, median and relative standard deviation\n", repetitions, frames);
+		g_print("%-22s %12s %7s  %-12s %14s\n", "benchmark", "ns/op", "stddev", "op", "emulated s/s");
+	}
+
+	for (guint b = 0; b < G_N_ELEMENTS(benchmarks); b++) {
+		const Benchmark *bench = &benchmarks[b];
+		if (filter != NULL && strstr(bench->name, filter) == NULL)
+			continue;
+
+		bench_load(bench);
+		for (int i = 0; i < BENCH_WARMUP_FRAMES; i++) {
+			gba_run_frame();
+		}
+
+		guint64 ops = 0;
+		for (int r = 0; r < repetitions; r++) {
+			gint64 elapsed = bench_run(bench, stateFile, &ops);
+			nsPerOp[r] = ops > 0 ? (double) elapsed / ops : 0;
+			speed[r] = (double) frames * GBA_FRAME_TICKS / CLOCK_RATE / (elapsed / 1e9);
+		}
+
+		Stats opStats, speedStats;
+		stats_compute(&opStats, nsPerOp, repetitions);
+		stats_compute(&speedStats, speed, repetitions);
+
+		if (json) {
+			g_print("%s\n{\"name\":\"%s\",\"unit\":\"%s\",\"ops\":%" G_GUINT64_FORMAT ",\"ns_per_op\":",
+					first ? "" : ",", bench->name, bench->unit, ops);
+			print_json_stats(&opStats);
+			g_print(",\"emulated_seconds_per_second\":");
+			if (bench->save == NULL) {
+				print_json_stats(&speedStats);
+			} else {
+				g_print("null");
+			}
+			g_print("}");
+		} else {
+			g_print("%-22s %12.3f %6.1f%%  %-12s ", bench->name, opStats.median,
+					opStats.mean > 0 ? 100 * opStats.stddev / opStats.mean : 0, bench->unit);
+			if (bench->save == NULL) {
+				g_print("%14.2f\n", speedStats.median);
+			} else {
+				g_print("%14s\n", "-");
+			}
+		}
+		first = FALSE;
+	}
+
+	if (json) {
+		g_print("\n]}\n");
+	}
+
+	g_free(nsPerOp);
+	g_free(speed);
+
+	g_unlink(stateFile);
+	g_rmdir(stateDir);
+	g_free(stateFile);
+	g_free(stateDir);
+
+	bench_shutdown();
+
+	return 0;
+}
@@ -0,0 +1,177 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// Measures the cost of sound synthesis for each quality tier, by feeding
+// the sound core with the register writes and timer overflows of a game
+// playing both PCM channels and two PSG channels.
+
+#include "../gba/Globals.h"
+#include "../gba/Sound.h"
+
+#include <glib.h>
+#include <stdlib.h>
+
+// GBA sound registers
+#define SGCNT0_H 0x82
+#define FIFOA_L 0xa0
+#define FIFOB_L 0xa4
+
+// Clocks per emulated second
+#define CLOCK_RATE 16777216
+
+// Timer periods of the two PCM channels, 32 kHz and 16 kHz
+#define TIMER0_PERIOD 512
+#define TIMER1_PERIOD 1024
+
+static void bench_driver_pause(SoundDriver *driver, gboolean pause) {
+}
+
+static void bench_driver_reset(SoundDriver *driver) {
+}
+
+static void bench_driver_write(SoundDriver *driver, guint16 *finalWave, int length) {
+}
+
+// Push 16 bytes of noise to a PCM FIFO, as the sound DMA would
+static void bench_fill_fifo(u32 fifo, GRand *rand) {
+	for (int i = 0; i < 4; i++) {
+		soundEvent(fifo,     (u16) g_rand_int(rand));
+		soundEvent(fifo + 2, (u16) g_rand_int(rand));
+	}
+}
+
+static void bench_setup_channels(GRand *rand) {
+	// PSG and both PCM channels at full volume, on both sides,
+	// PCM A on timer 0 and PCM B on timer 1
+	soundEvent(SGCNT0_H, (u16) 0x730E);
+	soundEvent(0x80, (u8) 0x77);
+	soundEvent(0x81, (u8) 0xFF);
+
+	// Square 1, 50% duty, trigger
+	soundEvent(0x62, (u8) 0x80);
+	soundEvent(0x63, (u8) 0xF0);
+	soundEvent(0x64, (u8) 0x00);
+	soundEvent(0x65, (u8) 0x86);
+
+	// Noise, trigger
+	soundEvent(0x79, (u8) 0xF0);
+	soundEvent(0x7C, (u8) 0x21);
+	soundEvent(0x7D, (u8) 0x80);
+
+	// Fill both FIFOs completely
+	bench_fill_fifo(FIFOA_L, rand);
+	bench_fill_fifo(FIFOA_L, rand);
+	bench_fill_fifo(FIFOB_L, rand);
+	bench_fill_fifo(FIFOB_L, rand);
+}
+
+/**
+ * Emulate the given number of seconds of sound
+ * @return elapsed time in microseconds
+ */
+static gint64 bench_run(SoundQuality quality, int seconds) {
+	GRand *rand = g_rand_new_with_seed(0);
+
+	soundSetQuality(quality);
+	soundReset();
+	bench_setup_channels(rand);
+
+	int timer1 = TIMER1_PERIOD;
+	int samples0 = 0;
+	int samples1 = 0;
+
+	gint64 start = g_get_monotonic_time();
+
+	for (gint64 clocks = 0; clocks < (gint64) seconds * CLOCK_RATE; clocks += TIMER0_PERIOD) {
+		// Same order as the CPU loop, sound tick first then timers
+		soundTicks -= TIMER0_PERIOD;
+		if (soundTicks <= 0) {
+			psoundTickfn();
+			soundTicks += SOUND_CLOCK_TICKS;
+		}
+
+		// Refill the FIFOs when half empty, so they never play silence
+		soundTimerOverflow(0);
+		if (++samples0 == 16) {
+			bench_fill_fifo(FIFOA_L, rand);
+			samples0 = 0;
+		}
+
+		timer1 -= TIMER0_PERIOD;
+		if (timer1 <= 0) {
+			timer1 += TIMER1_PERIOD;
+			soundTimerOverflow(1);
+			if (++samples1 == 16) {
+				bench_fill_fifo(FIFOB_L, rand);
+				samples1 = 0;
+			}
+		}
+
+		// Change the square frequency now and then
+		if ((clocks & 0x3FFFF) == 0) {
+			soundEvent(0x64, (u8) g_rand_int(rand));
+		}
+	}
+
+	gint64 elapsed = g_get_monotonic_time() - start;
+
+	g_rand_free(rand);
+
+	return elapsed;
+}
+
+int main(int argc, char **argv) {
+	int seconds = argc > 1 ? atoi(argv[1]) : 60;
+	if (seconds <= 0) {
+		g_printerr("Usage: %s [emulated seconds]\n", argv[0]);
+		return 1;
+	}
+
+	SoundDriver driver;
+	driver.pause = bench_driver_pause;
+	driver.reset = bench_driver_reset;
+	driver.write = bench_driver_write;
+	driver.get_buffer_fill = NULL;
+	driver.get_latency = NULL;
+	driver.driverData = NULL;
+
+	ioMem = (u8 *) g_malloc0(0x400);
+	soundInit(&driver);
+
+	static const struct {
+		SoundQuality quality;
+		const char *name;
+	} tiers[] = {
+		{ SOUND_QUALITY_FAST, "fast" },
+		{ SOUND_QUALITY_GOOD, "good" },
+		{ SOUND_QUALITY_BEST, "best" }
+	};
+
+	g_print("%d emulated seconds\n", seconds);
+	for (guint i = 0; i < G_N_ELEMENTS(tiers); i++) {
+		gint64 elapsed = bench_run(tiers[i].quality, seconds);
+		double perSecond = elapsed / 1000.0 / seconds;
+		g_print("%-5s %8.3f ms per emulated second (%.2f%% of real time)\n",
+				tiers[i].name, perSecond, perSecond / 10.0);
+	}
+
+	soundShutdown();
+	g_free(ioMem);
+
+	return 0;
+}
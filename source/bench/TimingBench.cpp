@@ -0,0 +1,356 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// Measures the cost of the memory access timing functions, comparing the
+// wait state lookup tables with the branching implementation they replaced.
+// Both are run on the same random trace of opcode fetches and data accesses,
+// and must produce the same ticks and prefetch buffer states.
+
+#include "../gba/CPU.h"
+#include "../gba/GBA.h"
+#include "../gba/Globals.h"
+
+#include <glib.h>
+#include <stdlib.h>
+
+using namespace CPU;
+
+// Trace operations: the eight timing functions, and starting the prefetch
+// as the Thumb load instructions do
+enum {
+	OP_DATA_NSEQ16,
+	OP_DATA_NSEQ32,
+	OP_DATA_SEQ16,
+	OP_DATA_SEQ32,
+	OP_CODE_NSEQ16,
+	OP_CODE_NSEQ32,
+	OP_CODE_SEQ16,
+	OP_CODE_SEQ32,
+	OP_START_PREFETCH
+};
+
+// Runs of each implementation
+#define BENCH_ROUNDS 5
+
+typedef struct {
+	u8 op;
+	u32 address;
+} Access;
+
+// WAITCNT values used by games, prefetch on and off
+static const u16 waitcntValues[] = { 0x0000, 0x4014, 0x4317, 0x45B7, 0x0317 };
+
+// Previous implementation, kept as the reference. The functions were
+// defined in CPU.cpp and called from the instruction handlers of the other
+// files, so they are kept out of line like they were.
+#ifdef __GNUC__
+# define BENCH_NOINLINE __attribute__((noinline))
+#else
+# define BENCH_NOINLINE
+#endif
+
+static BENCH_NOINLINE int refDataTicks(u32 address, const u8 *waits)
+{
+	int addr = (address>>24)&15;
+	int value = waits[addr];
+
+	if ((addr>=0x08) || (addr < 0x02))
+	{
+		busPrefetchCount=0;
+		busPrefetch=false;
+	}
+	else if (busPrefetch)
+	{
+		int waitState = value;
+		if (!waitState)
+			waitState = 1;
+		busPrefetchCount = ((busPrefetchCount+1)<<waitState) - 1;
+	}
+
+	return value;
+}
+
+static BENCH_NOINLINE int refCodeTicksAccess(u32 address, const u8 *nonSeqWaits)
+{
+	int addr = (address>>24)&15;
+
+	if ((addr>=0x08) && (addr<=0x0D))
+	{
+		if (busPrefetchCount&0x1)
+		{
+			if (busPrefetchCount&0x2)
+			{
+				busPrefetchCount = ((busPrefetchCount&0xFF)>>2) | (busPrefetchCount&0xFFFFFF00);
+				return 0;
+			}
+			busPrefetchCount = ((busPrefetchCount&0xFF)>>1) | (busPrefetchCount&0xFFFFFF00);
+			return memoryWaitSeq[addr]-1;
+		}
+		else
+		{
+			busPrefetchCount=0;
+			return nonSeqWaits[addr];
+		}
+	}
+	else
+	{
+		busPrefetchCount = 0;
+		return nonSeqWaits[addr];
+	}
+}
+
+static BENCH_NOINLINE int refCodeTicksAccessSeq16(u32 address)
+{
+	int addr = (address>>24)&15;
+
+	if ((addr>=0x08) && (addr<=0x0D))
+	{
+		if (busPrefetchCount&0x1)
+		{
+			busPrefetchCount = ((busPrefetchCount&0xFF)>>1) | (busPrefetchCount&0xFFFFFF00);
+			return 0;
+		}
+		else
+			if (busPrefetchCount>0xFF)
+			{
+				busPrefetchCount=0;
+				return memoryWait[addr];
+			}
+			else
+				return memoryWaitSeq[addr];
+	}
+	else
+	{
+		busPrefetchCount = 0;
+		return memoryWaitSeq[addr];
+	}
+}
+
+static BENCH_NOINLINE int refCodeTicksAccessSeq32(u32 address)
+{
+	int addr = (address>>24)&15;
+
+	if ((addr>=0x08) && (addr<=0x0D))
+	{
+		if (busPrefetchCount&0x1)
+		{
+			if (busPrefetchCount&0x2)
+			{
+				busPrefetchCount = ((busPrefetchCount&0xFF)>>2) | (busPrefetchCount&0xFFFFFF00);
+				return 0;
+			}
+			busPrefetchCount = ((busPrefetchCount&0xFF)>>1) | (busPrefetchCount&0xFFFFFF00);
+			return memoryWaitSeq[addr];
+		}
+		else
+			if (busPrefetchCount>0xFF)
+			{
+				busPrefetchCount=0;
+				return memoryWait32[addr];
+			}
+			else
+				return memoryWaitSeq32[addr];
+	}
+	else
+	{
+		return memoryWaitSeq32[addr];
+	}
+}
+
+// Dispatch a trace access to the previous implementation
+struct RefAccess {
+	static int run(const Access *access)
+	{
+		switch (access->op) {
+		case OP_DATA_NSEQ16: return refDataTicks(access->address, memoryWait);
+		case OP_DATA_NSEQ32: return refDataTicks(access->address, memoryWait32);
+		case OP_DATA_SEQ16:  return refDataTicks(access->address, memoryWaitSeq);
+		case OP_DATA_SEQ32:  return refDataTicks(access->address, memoryWaitSeq32);
+		case OP_CODE_NSEQ16: return refCodeTicksAccess(access->address, memoryWait);
+		case OP_CODE_NSEQ32: return refCodeTicksAccess(access->address, memoryWait32);
+		case OP_CODE_SEQ16:  return refCodeTicksAccessSeq16(access->address);
+		case OP_CODE_SEQ32:  return refCodeTicksAccessSeq32(access->address);
+		default:
+			busPrefetch = busPrefetchEnable;
+			return 0;
+		}
+	}
+};
+
+// Dispatch a trace access to the lookup tables
+struct TableAccess {
+	static int run(const Access *access)
+	{
+		switch (access->op) {
+		case OP_DATA_NSEQ16: return dataTicksAccess16(access->address);
+		case OP_DATA_NSEQ32: return dataTicksAccess32(access->address);
+		case OP_DATA_SEQ16:  return dataTicksAccessSeq16(access->address);
+		case OP_DATA_SEQ32:  return dataTicksAccessSeq32(access->address);
+		case OP_CODE_NSEQ16: return codeTicksAccess16(access->address);
+		case OP_CODE_NSEQ32: return codeTicksAccess32(access->address);
+		case OP_CODE_SEQ16:  return codeTicksAccessSeq16(access->address);
+		case OP_CODE_SEQ32:  return codeTicksAccessSeq32(access->address);
+		default:
+			busPrefetch = busPrefetchEnable;
+			return 0;
+		}
+	}
+};
+
+/**
+ * Build a trace resembling a game running from the cartridge. The sequence
+ * of accesses repeats like the body of a loop, so that only the timing
+ * functions themselves branch unpredictably: opcodes are fetched from the
+ * cartridge or now and then from the internal RAM, and data is accessed in
+ * the RAMs, the IO registers and the cartridge.
+ */
+static Access *bench_build_trace(guint length) {
+	static const u8 loopBody[] = {
+		OP_CODE_SEQ16, OP_CODE_SEQ16, OP_DATA_NSEQ32, OP_CODE_SEQ16,
+		OP_START_PREFETCH, OP_DATA_NSEQ16, OP_CODE_NSEQ16, OP_CODE_SEQ16,
+		OP_DATA_SEQ32, OP_CODE_SEQ32, OP_CODE_NSEQ32, OP_DATA_SEQ16,
+		OP_CODE_SEQ16, OP_CODE_SEQ32, OP_DATA_NSEQ32, OP_CODE_SEQ16
+	};
+	static const u32 dataRegions[] = { 0x02, 0x03, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x0E };
+
+	GRand *rand = g_rand_new_with_seed(0);
+	Access *trace = g_new(Access, length);
+
+	for (guint i = 0; i < length; i++) {
+		u8 op = loopBody[i % G_N_ELEMENTS(loopBody)];
+		u32 offset = g_rand_int(rand) & 0xFFFFFF;
+		u32 region;
+
+		if (op >= OP_CODE_NSEQ16 && op <= OP_CODE_SEQ32) {
+			region = g_rand_int_range(rand, 0, 10) == 0 ? 0x03 : 0x08;
+		} else {
+			region = dataRegions[g_rand_int_range(rand, 0, G_N_ELEMENTS(dataRegions))];
+		}
+
+		trace[i].op = op;
+		trace[i].address = (region << 24) | offset;
+	}
+
+	g_rand_free(rand);
+
+	return trace;
+}
+
+static void bench_set_waitcnt(u16 value) {
+	CPUUpdateRegister(0x204, value);
+	busPrefetch = false;
+	busPrefetchCount = 0;
+}
+
+/**
+ * Run the trace with both implementations
+ * @return whether the ticks and prefetch states were the same
+ */
+static gboolean bench_check(const Access *trace, guint length) {
+	for (guint w = 0; w < G_N_ELEMENTS(waitcntValues); w++) {
+		bench_set_waitcnt(waitcntValues[w]);
+
+		for (guint i = 0; i < length; i++) {
+			bool savedPrefetch = busPrefetch;
+			u32 savedCount = busPrefetchCount;
+
+			int expected = RefAccess::run(&trace[i]);
+			bool expectedPrefetch = busPrefetch;
+			u32 expectedCount = busPrefetchCount;
+
+			busPrefetch = savedPrefetch;
+			busPrefetchCount = savedCount;
+
+			int ticks = TableAccess::run(&trace[i]);
+
+			if (ticks != expected || busPrefetch != expectedPrefetch || busPrefetchCount != expectedCount) {
+				g_printerr("Mismatch with WAITCNT %04x at access %u, op %d address %08x: "
+						"ticks %d / %d, prefetch count %08x / %08x\n",
+						waitcntValues[w], i, trace[i].op, trace[i].address,
+						ticks, expected, busPrefetchCount, expectedCount);
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * Run the trace the given number of times
+ * @return elapsed time in microseconds
+ */
+template<typename Implementation>
+static gint64 bench_run(const Access *trace, guint length, int passes, long *ticks) {
+	bench_set_waitcnt(0x4317);
+
+	long total = 0;
+	gint64 start = g_get_monotonic_time();
+
+	for (int pass = 0; pass < passes; pass++) {
+		for (guint i = 0; i < length; i++) {
+			total += Implementation::run(&trace[i]);
+		}
+	}
+
+	gint64 elapsed = g_get_monotonic_time() - start;
+
+	*ticks = total;
+	return elapsed;
+}
+
+int main(int argc, char **argv) {
+	int passes = argc > 1 ? atoi(argv[1]) : 100;
+	if (passes <= 0) {
+		g_printerr("Usage: %s [passes]\n", argv[0]);
+		return 1;
+	}
+
+	const guint length = 1 << 20;
+
+	ioMem = (u8 *) g_malloc0(0x400);
+	CPU::init();
+
+	Access *trace = bench_build_trace(length);
+
+	if (!bench_check(trace, length)) {
+		g_free(trace);
+		g_free(ioMem);
+		return 1;
+	}
+
+	// Alternate the implementations and keep the best time of each,
+	// to reduce the influence of the other processes
+	long refTicks, tableTicks;
+	gint64 refElapsed = G_MAXINT64, tableElapsed = G_MAXINT64;
+
+	for (int round = 0; round < BENCH_ROUNDS; round++) {
+		refElapsed = MIN(refElapsed, bench_run<RefAccess>(trace, length, passes, &refTicks));
+		tableElapsed = MIN(tableElapsed, bench_run<TableAccess>(trace, length, passes, &tableTicks));
+	}
+
+	double accesses = (double) length * passes;
+	g_print("%.0f accesses, %ld ticks\n", accesses, tableTicks);
+	g_print("branches %6.3f ns per access\n", refElapsed * 1000.0 / accesses);
+	g_print("tables   %6.3f ns per access\n", tableElapsed * 1000.0 / accesses);
+
+	g_free(trace);
+	g_free(ioMem);
+
+	return refTicks == tableTicks ? 0 : 1;
+}
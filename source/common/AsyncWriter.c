@@ -0,0 +1,208 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include "AsyncWriter.h"
+#include "RingBuffer.h"
+
+#include <errno.h>
+
+// Bytes read from a queue at once, rounded down to whole records
+#define ASYNC_WRITER_CHUNK_SIZE 16384
+
+typedef struct {
+	struct ring_buffer *ring;
+	guint index;
+} AsyncWriterQueue;
+
+struct AsyncWriter {
+	gsize recordSize;
+	guint queueSize;
+	GPrivate *threadQueue;
+
+	GMutex queuesLock;
+	GPtrArray *queues;
+
+	AsyncWriterFunc func;
+	gpointer data;
+	gulong pollUsec;
+	guint8 *chunk;
+	gsize chunkSize;
+
+	GThread *thread;
+	volatile gint stop;
+	volatile gint dropped;
+
+	// Only accessed by the writer thread until it is joined
+	gboolean failed;
+	gint errnum;
+};
+
+static AsyncWriterQueue *async_writer_add_queue(AsyncWriter *writer) {
+	AsyncWriterQueue *queue = g_new(AsyncWriterQueue, 1);
+	queue->ring = ring_buffer_new(writer->queueSize);
+
+	g_mutex_lock(&writer->queuesLock);
+	queue->index = writer->queues->len;
+	g_ptr_array_add(writer->queues, queue);
+	g_mutex_unlock(&writer->queuesLock);
+
+	return queue;
+}
+
+AsyncWriter *async_writer_new(gsize recordSize, guint queueSize, GPrivate *threadQueue) {
+	AsyncWriter *writer = g_new0(AsyncWriter, 1);
+	writer->recordSize = recordSize;
+	writer->queueSize = queueSize;
+	writer->threadQueue = threadQueue;
+	writer->queues = g_ptr_array_new();
+	writer->chunkSize = MAX(ASYNC_WRITER_CHUNK_SIZE / recordSize, 1) * recordSize;
+	writer->chunk = g_malloc(writer->chunkSize);
+	g_mutex_init(&writer->queuesLock);
+
+	if (threadQueue == NULL) {
+		async_writer_add_queue(writer);
+	}
+
+	return writer;
+}
+
+void async_writer_free(AsyncWriter *writer) {
+	if (writer == NULL)
+		return;
+
+	g_assert(writer->thread == NULL);
+
+	for (guint i = 0; i < writer->queues->len; i++) {
+		AsyncWriterQueue *queue = (AsyncWriterQueue *)g_ptr_array_index(writer->queues, i);
+		ring_buffer_free(queue->ring);
+		g_free(queue);
+	}
+
+	g_ptr_array_free(writer->queues, TRUE);
+	g_mutex_clear(&writer->queuesLock);
+	g_free(writer->chunk);
+	g_free(writer);
+}
+
+void async_writer_push(AsyncWriter *writer, const void *records, guint count) {
+	AsyncWriterQueue *queue;
+	if (writer->threadQueue == NULL) {
+		queue = (AsyncWriterQueue *)g_ptr_array_index(writer->queues, 0);
+	} else {
+		queue = (AsyncWriterQueue *)g_private_get(writer->threadQueue);
+		if (queue == NULL) {
+			queue = async_writer_add_queue(writer);
+			g_private_set(writer->threadQueue, queue);
+		}
+	}
+
+	// Never wait for the writer thread
+	int size = count * writer->recordSize;
+	if (ring_buffer_avail(queue->ring) < size) {
+		g_atomic_int_add(&writer->dropped, count);
+		return;
+	}
+
+	ring_buffer_write(queue->ring, records, size);
+}
+
+/**
+ * Write the records queued by all the producers, or discard them
+ * when not writing
+ */
+static void async_writer_flush(AsyncWriter *writer, gboolean discard) {
+	g_mutex_lock(&writer->queuesLock);
+
+	for (guint i = 0; i < writer->queues->len; i++) {
+		AsyncWriterQueue *queue = (AsyncWriterQueue *)g_ptr_array_index(writer->queues, i);
+
+		int len;
+		while ((len = ring_buffer_read(queue->ring, writer->chunk, writer->chunkSize)) > 0) {
+			if (discard || writer->failed)
+				continue;
+
+			if (!writer->func(writer->chunk, len / writer->recordSize, queue->index, writer->data)) {
+				async_writer_fail(writer);
+			}
+		}
+	}
+
+	g_mutex_unlock(&writer->queuesLock);
+}
+
+static gpointer async_writer_thread(gpointer data) {
+	AsyncWriter *writer = (AsyncWriter *)data;
+
+	for (;;) {
+		// Records queued before stopping are all readable once stop is seen
+		gboolean stopping = g_atomic_int_get(&writer->stop);
+
+		async_writer_flush(writer, FALSE);
+
+		if (stopping) {
+			break;
+		}
+
+		g_usleep(writer->pollUsec);
+	}
+
+	return NULL;
+}
+
+void async_writer_start(AsyncWriter *writer, const gchar *name, AsyncWriterFunc func, gpointer data, gulong pollUsec) {
+	g_return_if_fail(writer->thread == NULL);
+
+	// Discard the records of a previous run
+	async_writer_flush(writer, TRUE);
+
+	writer->func = func;
+	writer->data = data;
+	writer->pollUsec = pollUsec;
+	writer->stop = 0;
+	writer->dropped = 0;
+	writer->failed = FALSE;
+	writer->errnum = 0;
+	writer->thread = g_thread_new(name, async_writer_thread, writer);
+}
+
+void async_writer_stop(AsyncWriter *writer) {
+	g_return_if_fail(writer->thread != NULL);
+
+	g_atomic_int_set(&writer->stop, 1);
+	g_thread_join(writer->thread);
+	writer->thread = NULL;
+}
+
+void async_writer_fail(AsyncWriter *writer) {
+	if (!writer->failed) {
+		writer->failed = TRUE;
+		writer->errnum = errno;
+	}
+}
+
+gboolean async_writer_failed(AsyncWriter *writer, gint *errnum) {
+	if (errnum != NULL) {
+		*errnum = writer->errnum;
+	}
+
+	return writer->failed;
+}
+
+gint async_writer_dropped(AsyncWriter *writer) {
+	return g_atomic_int_get(&writer->dropped);
+}
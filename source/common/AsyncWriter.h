@@ -0,0 +1,117 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef VBAM_ASYNCWRITER_H_
+#define VBAM_ASYNCWRITER_H_
+
+#include <glib.h>
+
+/* Set up for C function definitions, even when using C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Opaque writer of fixed size records, handed over by the producing
+ * threads through lock-free queues and written by a writer thread
+ *
+ * Producers never wait for the writer thread. When it falls behind, records
+ * are dropped and counted instead. The queues are kept from one start to the
+ * next, so that a writer can be started and stopped repeatedly.
+ */
+typedef struct AsyncWriter AsyncWriter;
+
+/**
+ * Write records, called on the writer thread. Once it fails, the records
+ * are discarded until the writer is started again.
+ * @param records queued records, which may be modified in place
+ * @param count number of records
+ * @param queue index of the queue the records come from
+ * @param data data given when starting the writer
+ * @return FALSE if writing failed, errno giving the reason
+ */
+typedef gboolean (*AsyncWriterFunc)(void *records, guint count, guint queue, gpointer data);
+
+/**
+ * Create a stopped writer
+ * @param recordSize size of a record, in bytes
+ * @param queueSize size of each queue, in bytes
+ * @param threadQueue statically allocated GPrivate holding the queue of each
+ *        producing thread, created on its first record. When NULL, there is
+ *        a single queue and only one thread may produce records.
+ * @return writer
+ */
+AsyncWriter *async_writer_new(gsize recordSize, guint queueSize, GPrivate *threadQueue);
+
+/**
+ * Free a stopped writer. Writers with per thread queues are never freed,
+ * as the threads keep a reference to their queue.
+ * @param writer writer, or NULL
+ */
+void async_writer_free(AsyncWriter *writer);
+
+/**
+ * Discard the queued records and start the writer thread
+ * @param writer stopped writer
+ * @param name name of the writer thread
+ * @param func function writing the records
+ * @param data data passed to func
+ * @param pollUsec period at which the writer thread looks for new records
+ */
+void async_writer_start(AsyncWriter *writer, const gchar *name, AsyncWriterFunc func, gpointer data, gulong pollUsec);
+
+/**
+ * Queue records to be written, or drop them if their queue is full
+ * @param writer writer
+ * @param records records
+ * @param count number of records
+ */
+void async_writer_push(AsyncWriter *writer, const void *records, guint count);
+
+/**
+ * Write the queued records and stop the writer thread
+ * @param writer running writer
+ */
+void async_writer_stop(AsyncWriter *writer);
+
+/**
+ * Record a failure to write, errno giving the reason. Only to be called
+ * while the writer is stopped, func reports its failures by returning FALSE.
+ * @param writer writer
+ */
+void async_writer_fail(AsyncWriter *writer);
+
+/**
+ * @param writer writer
+ * @param errnum return location for the errno of the first failure, or NULL
+ * @return whether writing failed since the writer was started
+ */
+gboolean async_writer_failed(AsyncWriter *writer, gint *errnum);
+
+/**
+ * @param writer writer
+ * @return number of records dropped since the writer was started
+ */
+gint async_writer_dropped(AsyncWriter *writer);
+
+/* Ends C function definitions when using C++ */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VBAM_ASYNCWRITER_H_ */
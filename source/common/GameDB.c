@@ -15,7 +15,10 @@
 // along with this program; if not, write to the Free Software Foundation,
 // Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
 
 #include "GameDB.h"
 #include "Loader.h"
@@ -23,16 +26,83 @@
 
 static const int DATABASE_VERSION = 2;
 
+/*
+ * The XML database is compiled once to a binary index stored in the cache
+ * directory, which is then mapped rather than parsed. The index is an open
+ * addressing hash table of fixed size entries keyed by game code, followed
+ * by a pool of the NUL terminated strings the entries refer to.
+ *
+ * The index records the modification time, size and SHA-256 of the XML file
+ * it was compiled from. It is used as is when the time and size match, and
+ * when only the time changed but the contents did not.
+ */
+
+#define INDEX_FILE "game-db.idx"
+#define INDEX_MAGIC "VBAGDBI"
+
+// Written in host byte order, so that indexes from machines with
+// a different byte order are detected and rebuilt
+#define INDEX_VERSION 1
+
+// Above that, the index file is considered corrupted
+#define INDEX_MAX_TABLE_BITS 20
+
+// String offset of missing fields
+#define INDEX_NO_STRING G_MAXUINT32
+
+#define INDEX_HAS_SRAM   (1 << 0)
+#define INDEX_HAS_EEPROM (1 << 1)
+#define INDEX_HAS_FLASH  (1 << 2)
+#define INDEX_HAS_RTC    (1 << 3)
+
 typedef struct {
-	GameInfos *game;
+	gchar magic[8];
+	guint32 version;
+
+	/** The hash table has 2^tableBits entries */
+	guint32 tableBits;
+
+	gint64 xmlMtime;
+	guint64 xmlSize;
+	guint8 xmlHash[32];
+
+	guint32 poolSize;
+	guint32 padding;
+} GameDBIndexHeader;
 
-	gboolean gameLoaded;
+typedef struct {
+	/** Game code, all zeroes for free entries */
+	gchar code[4];
+
+	guint32 flags;
+	gint32 EEPROMSize;
+	gint32 flashSize;
+
+	/** Offsets in the string pool */
+	guint32 title;
+	guint32 region;
+	guint32 publisher;
+} GameDBIndexEntry;
+
+typedef struct {
+	/** Games in database order */
+	GPtrArray *games;
 
-	const gchar *lookupCode;
+	/** Game being parsed */
+	GameInfos *game;
+
+	/** Depth of the current element */
+	guint depth;
 } GameDBParserContext;
 
+/** Loaded index, kept for the lifetime of the process */
+static GMutex indexLock;
+static GMappedFile *indexFile = NULL;
+static guint8 *indexData = NULL;
+static const GameDBIndexHeader *indexHeader = NULL;
+
 static int findv(const gchar **strings, const gchar *needle) {
-	for (int i = 0; i < g_strv_length((gchar **)strings); i++) {
+	for (int i = 0; strings[i] != NULL; i++) {
 		if (g_strcmp0(strings[i], needle) == 0) {
 			return i;
 		}
@@ -41,25 +111,9 @@ static int findv(const gchar **strings, const gchar *needle) {
 	return -1;
 }
 
-static gboolean g_markup_is_in_element(GMarkupParseContext *context, ...) {
-	va_list ap;
-
-	va_start(ap, context);
-
-	// Get the first items
-	const GSList *current_stack = g_markup_parse_context_get_element_stack(context);
-	const gchar *item = va_arg(ap, const gchar *);
-
-	// Compare items from both lists
-	while (current_stack != NULL && item != NULL && !g_strcmp0(current_stack->data, item)) {
-		current_stack = g_slist_next(current_stack);
-		item = va_arg(ap, const gchar *);
-	}
-
-	va_end(ap);
-
-	// Ensure the end of both lists was reached
-	return current_stack == NULL && item == NULL;
+static const gchar *g_markup_parent_element(GMarkupParseContext *context) {
+	const GSList *stack = g_markup_parse_context_get_element_stack(context);
+	return stack->next != NULL ? stack->next->data : NULL;
 }
 
 static void on_start_element(GMarkupParseContext *context,
@@ -70,12 +124,10 @@ static void on_start_element(GMarkupParseContext *context,
                           GError             **error)
 {
 	GameDBParserContext *db = (GameDBParserContext *)user_data;
-	
-	if (db->gameLoaded) {
-		return;
-	}
-	
-	if (g_markup_is_in_element(context, "games", NULL))
+
+	db->depth++;
+
+	if (db->depth == 1 && !g_strcmp0(element_name, "games"))
 	{
 		int version = -1;
 
@@ -91,36 +143,33 @@ static void on_start_element(GMarkupParseContext *context,
 					"Incorrect database version '%d', expected '%d'", version, DATABASE_VERSION);
 		}
 	}
-
-	if (g_markup_is_in_element(context, "game", "games", NULL))
+	else if (db->depth == 2 && !g_strcmp0(element_name, "game"))
 	{
-		// Read the current game code
 		const gchar *code = NULL;
 		gboolean r = g_markup_collect_attributes(element_name, attribute_names, attribute_values, error,
 				G_MARKUP_COLLECT_STRING, "code", &code,
 				G_MARKUP_COLLECT_STRING | G_MARKUP_COLLECT_OPTIONAL, "cloneOf", NULL,
 				G_MARKUP_COLLECT_INVALID);
 
-		// Is the current code matching the one we search
-		if (r && !g_strcmp0(code, db->lookupCode)) {
+		if (r) {
 			db->game = game_infos_new();
 			db->game->code = g_strdup(code);
 		}
 	}
 
-	if (!db->game) {
+	if (!db->game || db->depth != 4 || g_strcmp0(g_markup_parent_element(context), "cartridge")) {
 		return;
 	}
 
-	if (g_markup_is_in_element(context, "sram", "cartridge", "game", "games", NULL))
+	if (!g_strcmp0(element_name, "sram"))
 	{
 		db->game->hasSRAM = TRUE;
 	}
-	else if (g_markup_is_in_element(context, "hasRTC", "cartridge", "game", "games", NULL))
+	else if (!g_strcmp0(element_name, "hasRTC"))
 	{
 		db->game->hasRTC = TRUE;
 	}
-	else if (g_markup_is_in_element(context, "eeprom", "cartridge", "game", "games", NULL))
+	else if (!g_strcmp0(element_name, "eeprom"))
 	{
 		db->game->hasEEPROM = TRUE;
 		int sizeIndex = findv(attribute_names, "size");
@@ -129,7 +178,7 @@ static void on_start_element(GMarkupParseContext *context,
 			db->game->EEPROMSize = atoi(attribute_values[sizeIndex]);
 		}
 	}
-	else if (g_markup_is_in_element(context, "flash", "cartridge", "game", "games", NULL))
+	else if (!g_strcmp0(element_name, "flash"))
 	{
 		db->game->hasFlash = TRUE;
 		int sizeIndex = findv(attribute_names, "size");
@@ -146,14 +195,14 @@ static void on_end_element(GMarkupParseContext *context,
                           GError             **error)
 {
 	GameDBParserContext *db = (GameDBParserContext *)user_data;
-	
-	if (g_markup_is_in_element(context, "game", "games", NULL))
+
+	if (db->depth == 2 && db->game)
 	{
-		if (db->game)
-		{
-			db->gameLoaded = TRUE;
-		}
+		g_ptr_array_add(db->games, db->game);
+		db->game = NULL;
 	}
+
+	db->depth--;
 }
 
 static void on_text(GMarkupParseContext *context,
@@ -163,47 +212,49 @@ static void on_text(GMarkupParseContext *context,
                           GError             **error)
 {
 	GameDBParserContext *db = (GameDBParserContext *)user_data;
-	
-	if (db->gameLoaded) {
-		return;
-	}
-	
-	if (!db->game) {
+
+	if (!db->game || db->depth != 3) {
 		return;
 	}
 
-	if (g_markup_is_in_element(context, "title", "game", "games", NULL))
+	const gchar *element = g_markup_parse_context_get_element(context);
+	gchar **field;
+
+	if (!g_strcmp0(element, "title"))
 	{
-		db->game->title = g_strdup(text);
+		field = &db->game->title;
 	}
-	else if (g_markup_is_in_element(context, "region", "game", "games", NULL))
+	else if (!g_strcmp0(element, "region"))
 	{
-		db->game->region = g_strdup(text);
+		field = &db->game->region;
 	}
-	else if (g_markup_is_in_element(context, "publisher", "game", "games", NULL))
+	else if (!g_strcmp0(element, "publisher"))
 	{
-		db->game->publisher = g_strdup(text);
+		field = &db->game->publisher;
+	}
+	else
+	{
+		return;
 	}
+
+	// The last occurrence of repeated elements wins
+	g_free(*field);
+	*field = g_strndup(text, text_len);
 }
 
-GameInfos *game_db_lookup_code(const gchar *code, GError **err)
+/**
+ * Parse the whole XML database
+ *
+ * @return array of GameInfos, NULL on failure
+ */
+static GPtrArray *game_db_parse(const gchar *xmlData, gsize length, GError **err)
 {
 	g_return_val_if_fail(err == NULL || *err == NULL, NULL);
 
-	gchar *dbFilePath = data_get_file_path("db", "game-db.xml");
-	gchar *xmlData = NULL;
-	gsize  length = 0;
-
-	if (!g_file_get_contents(dbFilePath, &xmlData, &length, err)) {
-		g_free(dbFilePath);
-		return NULL;
-	}
-	g_free(dbFilePath);
-
-	GameDBParserContext *db = g_new(GameDBParserContext, 1);
-	db->game = NULL;
-	db->lookupCode = code;
-	db->gameLoaded = FALSE;
+	GameDBParserContext db;
+	db.games = g_ptr_array_new_with_free_func((GDestroyNotify)game_infos_free);
+	db.game = NULL;
+	db.depth = 0;
 
 	GMarkupParser parser;
 	parser.start_element = &on_start_element;
@@ -212,37 +263,331 @@ GameInfos *game_db_lookup_code(const gchar *code, GError **err)
 	parser.passthrough = NULL;
 	parser.error = NULL;
 
-	GMarkupParseContext *context = g_markup_parse_context_new(&parser, (GMarkupParseFlags)0, db, NULL);
-	if (!g_markup_parse_context_parse(context, xmlData, length, err)) {
-		game_infos_free(db->game);
-		g_free(db);
-		g_free(xmlData);
-		g_markup_parse_context_free(context);
+	GMarkupParseContext *context = g_markup_parse_context_new(&parser, (GMarkupParseFlags)0, &db, NULL);
+	gboolean r = g_markup_parse_context_parse(context, xmlData, length, err)
+			&& g_markup_parse_context_end_parse(context, err);
+	g_markup_parse_context_free(context);
+
+	game_infos_free(db.game);
+
+	if (!r) {
+		g_ptr_array_free(db.games, TRUE);
 		return NULL;
 	}
-	g_free(xmlData);
 
-	if (!g_markup_parse_context_end_parse(context, err)) {
-		game_infos_free(db->game);
-		g_free(db);
-		g_markup_parse_context_free(context);
+	return db.games;
+}
+
+static void game_db_hash_xml(const gchar *xmlData, gsize length, guint8 *hash)
+{
+	GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+	g_checksum_update(checksum, (const guchar *)xmlData, length);
+
+	gsize hashLength = 32;
+	g_checksum_get_digest(checksum, hash, &hashLength);
+	g_checksum_free(checksum);
+}
+
+static guint32 game_db_slot(const gchar *code, guint32 tableBits)
+{
+	guint32 key;
+	memcpy(&key, code, sizeof(key));
+
+	// Fibonacci hashing
+	return (key * 2654435761u) >> (32 - tableBits);
+}
+
+static guint32 game_db_pool_add(GString *pool, const gchar *string)
+{
+	if (string == NULL) {
+		return INDEX_NO_STRING;
+	}
+
+	guint32 offset = pool->len;
+	g_string_append_len(pool, string, strlen(string) + 1);
+
+	return offset;
+}
+
+/**
+ * Compile the parsed database to an index
+ *
+ * @return newly allocated index data
+ */
+static guint8 *game_db_compile(GPtrArray *games, const GStatBuf *xmlStat, const guint8 *xmlHash, gsize *length)
+{
+	// Keep the table at most half full
+	guint32 tableBits = 1;
+	while ((1u << tableBits) < games->len * 2) {
+		tableBits++;
+	}
+
+	guint32 slots = 1u << tableBits;
+	GameDBIndexEntry *table = g_new0(GameDBIndexEntry, slots);
+	GString *pool = g_string_new(NULL);
+
+	for (guint i = 0; i < games->len; i++) {
+		const GameInfos *game = g_ptr_array_index(games, i);
+
+		if (strlen(game->code) != sizeof(table->code)) {
+			continue; // Can't be looked up from a ROM header
+		}
+
+		// Linear probing, the first occurrence of a code wins
+		guint32 slot = game_db_slot(game->code, tableBits);
+		while (table[slot].code[0] != '\0' && memcmp(table[slot].code, game->code, sizeof(table->code))) {
+			slot = (slot + 1) & (slots - 1);
+		}
+
+		GameDBIndexEntry *entry = &table[slot];
+		if (entry->code[0] != '\0') {
+			continue;
+		}
+
+		memcpy(entry->code, game->code, sizeof(entry->code));
+		entry->flags = (game->hasSRAM ? INDEX_HAS_SRAM : 0)
+				| (game->hasEEPROM ? INDEX_HAS_EEPROM : 0)
+				| (game->hasFlash ? INDEX_HAS_FLASH : 0)
+				| (game->hasRTC ? INDEX_HAS_RTC : 0);
+		entry->EEPROMSize = game->EEPROMSize;
+		entry->flashSize = game->flashSize;
+		entry->title = game_db_pool_add(pool, game->title);
+		entry->region = game_db_pool_add(pool, game->region);
+		entry->publisher = game_db_pool_add(pool, game->publisher);
+	}
+
+	GameDBIndexHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+	header.version = INDEX_VERSION;
+	header.tableBits = tableBits;
+	header.xmlMtime = xmlStat->st_mtime;
+	header.xmlSize = xmlStat->st_size;
+	memcpy(header.xmlHash, xmlHash, sizeof(header.xmlHash));
+	header.poolSize = pool->len;
+
+	gsize tableSize = slots * sizeof(GameDBIndexEntry);
+	*length = sizeof(header) + tableSize + pool->len;
+
+	guint8 *data = g_malloc(*length);
+	memcpy(data, &header, sizeof(header));
+	memcpy(data + sizeof(header), table, tableSize);
+	memcpy(data + sizeof(header) + tableSize, pool->str, pool->len);
+
+	g_free(table);
+	g_string_free(pool, TRUE);
+
+	return data;
+}
+
+/**
+ * Check an index is complete and was compiled by this version
+ */
+static gboolean game_db_index_is_valid(const guint8 *data, gsize length)
+{
+	if (length < sizeof(GameDBIndexHeader)) {
+		return FALSE;
+	}
+
+	const GameDBIndexHeader *header = (const GameDBIndexHeader *)data;
+	if (memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic))
+			|| header->version != INDEX_VERSION
+			|| header->tableBits == 0
+			|| header->tableBits > INDEX_MAX_TABLE_BITS) {
+		return FALSE;
+	}
+
+	gsize tableSize = ((gsize)1 << header->tableBits) * sizeof(GameDBIndexEntry);
+	if (length != sizeof(GameDBIndexHeader) + tableSize + header->poolSize) {
+		return FALSE;
+	}
+
+	// Ensure string lookups stay in the pool
+	return header->poolSize == 0 || data[length - 1] == '\0';
+}
+
+static const GameDBIndexEntry *game_db_index_table(const GameDBIndexHeader *header)
+{
+	return (const GameDBIndexEntry *)(header + 1);
+}
+
+static const gchar *game_db_index_string(const GameDBIndexHeader *header, guint32 offset)
+{
+	if (offset >= header->poolSize) {
 		return NULL;
 	}
 
-	g_markup_parse_context_free(context);
+	const gchar *pool = (const gchar *)(game_db_index_table(header) + ((gsize)1 << header->tableBits));
+	return pool + offset;
+}
 
-	GameInfos *game;
+/**
+ * Map the index from the cache directory, if it is up to date
+ */
+static GMappedFile *game_db_map_index(const gchar *indexPath, const GStatBuf *xmlStat,
+		GMappedFile *xml)
+{
+	GMappedFile *mapped = g_mapped_file_new(indexPath, FALSE, NULL);
+	if (mapped == NULL) {
+		return NULL;
+	}
+
+	const guint8 *data = (const guint8 *)g_mapped_file_get_contents(mapped);
+	gsize length = g_mapped_file_get_length(mapped);
+
+	if (!game_db_index_is_valid(data, length)) {
+		g_mapped_file_unref(mapped);
+		return NULL;
+	}
+
+	const GameDBIndexHeader *header = (const GameDBIndexHeader *)data;
+	if (header->xmlSize != (guint64)xmlStat->st_size) {
+		g_mapped_file_unref(mapped);
+		return NULL;
+	}
+
+	if (header->xmlMtime != (gint64)xmlStat->st_mtime) {
+		// Touched, but maybe not modified
+		guint8 hash[32];
+		game_db_hash_xml(g_mapped_file_get_contents(xml), g_mapped_file_get_length(xml), hash);
+
+		if (memcmp(hash, header->xmlHash, sizeof(hash))) {
+			g_mapped_file_unref(mapped);
+			return NULL;
+		}
+
+		// Record the new time so that the next startups don't hash again
+		GameDBIndexHeader *refreshed = g_memdup(data, length);
+		refreshed->xmlMtime = xmlStat->st_mtime;
+		g_file_set_contents(indexPath, (const gchar *)refreshed, length, NULL);
+		g_free(refreshed);
+	}
+
+	return mapped;
+}
+
+/**
+ * Load the index, compiling and caching it if needed
+ */
+static gboolean game_db_open(const gchar *cacheDir, GError **err)
+{
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	gchar *dbFilePath = data_get_file_path("db", "game-db.xml");
+
+	GStatBuf xmlStat;
+	if (g_stat(dbFilePath, &xmlStat) != 0) {
+		g_set_error(err, G_FILE_ERROR, g_file_error_from_errno(errno),
+				"Failed to open file '%s': %s", dbFilePath, g_strerror(errno));
+		g_free(dbFilePath);
+		return FALSE;
+	}
+
+	GMappedFile *xml = g_mapped_file_new(dbFilePath, FALSE, err);
+	g_free(dbFilePath);
+	if (xml == NULL) {
+		return FALSE;
+	}
+
+	gchar *indexPath = cacheDir ? g_build_filename(cacheDir, INDEX_FILE, NULL) : NULL;
+
+	if (indexPath) {
+		indexFile = game_db_map_index(indexPath, &xmlStat, xml);
+		if (indexFile) {
+			indexHeader = (const GameDBIndexHeader *)g_mapped_file_get_contents(indexFile);
+			g_mapped_file_unref(xml);
+			g_free(indexPath);
+			return TRUE;
+		}
+	}
 
-	if (db->gameLoaded) {
-		game = db->game;
+	// Compile the index from the XML database
+	GPtrArray *games = game_db_parse(g_mapped_file_get_contents(xml), g_mapped_file_get_length(xml), err);
+	if (games == NULL) {
+		g_mapped_file_unref(xml);
+		g_free(indexPath);
+		return FALSE;
+	}
+
+	guint8 hash[32];
+	game_db_hash_xml(g_mapped_file_get_contents(xml), g_mapped_file_get_length(xml), hash);
+	g_mapped_file_unref(xml);
+
+	gsize length;
+	guint8 *data = game_db_compile(games, &xmlStat, hash, &length);
+	g_ptr_array_free(games, TRUE);
+
+	// g_file_set_contents is atomic, concurrent compilations are harmless.
+	// Without a cache, the index is only kept in memory.
+	if (indexPath) {
+		g_mkdir_with_parents(cacheDir, 0777);
+		if (g_file_set_contents(indexPath, (const gchar *)data, length, NULL)) {
+			indexFile = g_mapped_file_new(indexPath, FALSE, NULL);
+		}
+	}
+	g_free(indexPath);
+
+	if (indexFile && game_db_index_is_valid((const guint8 *)g_mapped_file_get_contents(indexFile),
+			g_mapped_file_get_length(indexFile))) {
+		indexHeader = (const GameDBIndexHeader *)g_mapped_file_get_contents(indexFile);
+		g_free(data);
 	} else {
-		game_infos_free(db->game);
-		game = NULL;
+		if (indexFile) {
+			g_mapped_file_unref(indexFile);
+			indexFile = NULL;
+		}
+		indexData = data;
+		indexHeader = (const GameDBIndexHeader *)indexData;
+	}
+
+	return TRUE;
+}
+
+GameInfos *game_db_lookup_code(const gchar *code, const gchar *cacheDir, GError **err)
+{
+	g_return_val_if_fail(err == NULL || *err == NULL, NULL);
+
+	g_mutex_lock(&indexLock);
+	gboolean loaded = indexHeader != NULL || game_db_open(cacheDir, err);
+	g_mutex_unlock(&indexLock);
+
+	if (!loaded) {
+		return NULL;
+	}
+
+	const GameDBIndexEntry *table = game_db_index_table(indexHeader);
+	guint32 mask = (1u << indexHeader->tableBits) - 1;
+	const GameDBIndexEntry *entry = NULL;
+
+	// The probe stops after visiting every slot, as a corrupt index
+	// may have no free slot
+	if (strlen(code) == sizeof(entry->code)) {
+		guint32 slot = game_db_slot(code, indexHeader->tableBits);
+		for (guint32 probes = 0; probes <= mask && table[slot].code[0] != '\0'; probes++, slot = (slot + 1) & mask) {
+			if (!memcmp(table[slot].code, code, sizeof(entry->code))) {
+				entry = &table[slot];
+				break;
+			}
+		}
+	}
+
+	if (entry == NULL) {
 		g_set_error(err, LOADER_ERROR, G_LOADER_ERROR_NOT_IN_DB,
 				"Game '%s' was not found in '%s'", code, "game-db.xml");
+		return NULL;
 	}
-	
-	g_free(db);
+
+	GameInfos *game = game_infos_new();
+	game->code = g_strndup(entry->code, sizeof(entry->code));
+	game->hasSRAM = (entry->flags & INDEX_HAS_SRAM) != 0;
+	game->hasEEPROM = (entry->flags & INDEX_HAS_EEPROM) != 0;
+	game->hasFlash = (entry->flags & INDEX_HAS_FLASH) != 0;
+	game->hasRTC = (entry->flags & INDEX_HAS_RTC) != 0;
+	game->EEPROMSize = entry->EEPROMSize;
+	game->flashSize = entry->flashSize;
+	game->title = g_strdup(game_db_index_string(indexHeader, entry->title));
+	game->region = g_strdup(game_db_index_string(indexHeader, entry->region));
+	game->publisher = g_strdup(game_db_index_string(indexHeader, entry->publisher));
 
 	return game;
 }
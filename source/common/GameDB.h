@@ -29,12 +29,18 @@ extern "C" {
 
 /**
  * Lookup cartridge data from the game database
- * 
+ *
+ * The first lookup loads a compiled index of the database from the cache
+ * directory, or compiles it from the XML database when it is missing or
+ * outdated. Lookups may be done from several threads.
+ *
  * @param code Four letter game code
+ * @param cacheDir directory where the compiled index is stored, or NULL to
+ *                 only keep it in memory
  * @param err error return location
  * @return NULL if the game is not found
  */
-GameInfos *game_db_lookup_code(const gchar *code, GError **err);
+GameInfos *game_db_lookup_code(const gchar *code, const gchar *cacheDir, GError **err);
 
 /* Ends C function definitions when using C++ */
 #ifdef __cplusplus
@@ -20,6 +20,13 @@
 
 #include <archive.h>
 #include <archive_entry.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
 
 struct RomLoader {
 	RomType type;
@@ -146,6 +153,102 @@ gboolean loader_load(RomLoader *loader, guint8 *data, int *size, GError **err) {
 	return TRUE;
 }
 
+/**
+ * Extract an archived ROM to the cache directory, if not done yet.
+ * Cache files are named after the checksum of the archive contents,
+ * so that they are shared by every instance loading the same archive.
+ *
+ * @return newly allocated path to the extracted ROM, NULL on failure
+ */
+static gchar *loader_extract_to_cache(RomLoader *loader, int maxSize, const gchar *cacheDir, GError **err) {
+	GMappedFile *archive = g_mapped_file_new(loader->filename, FALSE, err);
+	if (archive == NULL) {
+		return NULL;
+	}
+
+	gchar *checksum = g_compute_checksum_for_data(G_CHECKSUM_SHA1,
+			(const guchar *)g_mapped_file_get_contents(archive),
+			g_mapped_file_get_length(archive));
+	g_mapped_file_unref(archive);
+
+	gchar *romsDir = g_build_filename(cacheDir, "roms", NULL);
+	gchar *fileName = g_strconcat(checksum, ".gba", NULL);
+	gchar *cacheFile = g_build_filename(romsDir, fileName, NULL);
+	g_free(fileName);
+	g_free(checksum);
+
+	if (!g_file_test(cacheFile, G_FILE_TEST_IS_REGULAR)) {
+		g_mkdir_with_parents(romsDir, 0777);
+
+		int size = maxSize;
+		guint8 *data = g_malloc(size);
+
+		// g_file_set_contents is atomic, concurrent extractions are harmless
+		if (!loader_load(loader, data, &size, err)
+				|| !g_file_set_contents(cacheFile, (const gchar *)data, size, err)) {
+			g_free(data);
+			g_free(romsDir);
+			g_free(cacheFile);
+			return NULL;
+		}
+
+		g_free(data);
+	}
+
+	g_free(romsDir);
+
+	return cacheFile;
+}
+
+gboolean loader_map(RomLoader *loader, guint8 *data, int *size, const gchar *cacheDir, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	LoaderAccept accept = loader_accept_func(loader);
+	gchar *file;
+
+	if (accept(loader->filename)) {
+		file = g_strdup(loader->filename);
+	} else {
+		file = loader_extract_to_cache(loader, *size, cacheDir, err);
+		if (file == NULL) {
+			return FALSE;
+		}
+	}
+
+	int fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		g_set_error(err, LOADER_ERROR, G_LOADER_ERROR_FAILED,
+				"Loading error : %s", g_strerror(errno));
+		g_free(file);
+		return FALSE;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0 || st.st_size > *size) {
+		g_set_error(err, LOADER_ERROR, G_LOADER_ERROR_FAILED,
+				"Invalid ROM size for %s", file);
+		close(fd);
+		g_free(file);
+		return FALSE;
+	}
+
+	// Private read-only mappings share the page cache with the other instances
+	void *mapped = mmap(data, st.st_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+	close(fd);
+
+	if (mapped == MAP_FAILED) {
+		g_set_error(err, LOADER_ERROR, G_LOADER_ERROR_FAILED,
+				"Failed to map %s : %s", file, g_strerror(errno));
+		g_free(file);
+		return FALSE;
+	}
+
+	g_free(file);
+	*size = st.st_size;
+
+	return TRUE;
+}
+
 gchar *loader_read_code(RomLoader *loader, GError **err) {
 	static const size_t HEADER_SIZE = 192;
 
@@ -193,6 +296,108 @@ gchar *loader_read_code(RomLoader *loader, GError **err) {
 	return code;
 }
 
+/**
+ * Copy a header string, keeping only its printable characters
+ */
+static void loader_copy_header_string(gchar *dest, const guint8 *src, gsize length) {
+	gsize j = 0;
+	for (gsize i = 0; i < length; i++) {
+		if (g_ascii_isprint(src[i])) {
+			dest[j++] = src[i];
+		}
+	}
+
+	dest[j] = '\0';
+	g_strchomp(dest);
+}
+
+gboolean loader_digest(RomLoader *loader, RomDigest *digest, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	static const size_t HEADER_SIZE = 192;
+	static const size_t BUFFER_SIZE = 65536;
+
+	struct archive_entry *entry;
+	LoaderAccept accept = loader_accept_func(loader);
+	gboolean uncompressedFile = accept(loader->filename);
+	gboolean found = FALSE;
+
+	// Open the archive
+	struct archive *a = loader_open_archive(loader, err);
+	if (a == NULL) {
+		return FALSE;
+	}
+
+	guint8 header[HEADER_SIZE];
+	guint8 *buffer = g_malloc(BUFFER_SIZE);
+	GChecksum *sha1 = g_checksum_new(G_CHECKSUM_SHA1);
+	uLong crc = crc32(0L, Z_NULL, 0);
+	gsize size = 0;
+
+	// Iterate through the archived files
+	while (archive_read_next_header(a, &entry) == ARCHIVE_OK) {
+		if (uncompressedFile || accept(archive_entry_pathname(entry))) {
+			found = TRUE;
+			break;
+		} else {
+			archive_read_data_skip(a);
+		}
+	}
+
+	gboolean ok = found;
+
+	if (!found) {
+		g_set_error(err, LOADER_ERROR, G_LOADER_ERROR_FAILED,
+				"No ROM found in file %s", loader->filename);
+	}
+
+	// Stream the ROM through the checksums, keeping the header
+	while (ok) {
+		ssize_t readSize = archive_read_data(a, buffer, BUFFER_SIZE);
+
+		if (readSize < 0) {
+			g_set_error(err, LOADER_ERROR, G_LOADER_ERROR_FAILED,
+					"Error uncompressing %s from %s : %s", archive_entry_pathname(entry), loader->filename, archive_error_string(a));
+			ok = FALSE;
+			break;
+		}
+
+		if (readSize == 0) {
+			break;
+		}
+
+		if (size < HEADER_SIZE) {
+			memcpy(header + size, buffer, MIN(HEADER_SIZE - size, (gsize)readSize));
+		}
+
+		crc = crc32(crc, buffer, readSize);
+		g_checksum_update(sha1, buffer, readSize);
+		size += readSize;
+	}
+
+	// Free libarchive
+	archive_read_free(a);
+	g_free(buffer);
+
+	if (ok && size < HEADER_SIZE) {
+		g_set_error(err, LOADER_ERROR, G_LOADER_ERROR_FAILED,
+				"Invalid ROM size for %s", loader->filename);
+		ok = FALSE;
+	}
+
+	if (ok) {
+		loader_copy_header_string(digest->title, header + 0xa0, 12);
+		loader_copy_header_string(digest->code, header + 0xac, 4);
+		digest->size = size;
+		digest->crc32 = crc;
+		g_strlcpy(digest->sha1, g_checksum_get_string(sha1), sizeof(digest->sha1));
+	}
+
+	g_checksum_free(sha1);
+
+	return ok;
+}
+
 GQuark loader_error_quark() {
 	return g_quark_from_static_string("loader_error_quark");
 }
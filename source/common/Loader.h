@@ -49,6 +49,24 @@ typedef enum {
 	ROM_GBA
 } RomType;
 
+/**
+ * Identification data of a ROM, as found by loader_digest
+ */
+typedef struct {
+	/** Game code from the header */
+	gchar code[5];
+
+	/** Game title from the header, printable characters only */
+	gchar title[13];
+
+	/** Uncompressed ROM size */
+	gint size;
+
+	/** Checksums of the uncompressed ROM */
+	guint32 crc32;
+	gchar sha1[41];
+} RomDigest;
+
 /**
  * Opaque ROM loader struct
  */
@@ -80,6 +98,21 @@ void loader_free(RomLoader *loader);
  */
 gboolean loader_load(RomLoader *loader, guint8 *data, int *size, GError **err);
 
+/**
+ * Map a ROM read-only in memory, without copying it
+ *
+ * Uncompressed ROMs are mapped directly. Archived ROMs are extracted
+ * once to a file in the cache directory, which is then mapped.
+ *
+ * @param loader a loader
+ * @param data page aligned address where to map the ROM
+ * @param size input size of the address range and output ROM size
+ * @param cacheDir directory where to store the extracted ROMs
+ * @param err return location for a GError, or NULL
+ * @return TRUE if successful, FALSE otherwise
+ */
+gboolean loader_map(RomLoader *loader, guint8 *data, int *size, const gchar *cacheDir, GError **err);
+
 /**
  * Load the game code
  *
@@ -89,6 +122,16 @@ gboolean loader_load(RomLoader *loader, guint8 *data, int *size, GError **err);
  */
 gchar *loader_read_code(RomLoader *loader, GError **err);
 
+/**
+ * Read the header and compute the checksums of a ROM, reading it only once
+ *
+ * @param loader a loader
+ * @param digest return location for the ROM identification data
+ * @param err return location for a GError, or NULL
+ * @return TRUE if successful, FALSE otherwise
+ */
+gboolean loader_digest(RomLoader *loader, RomDigest *digest, GError **err);
+
 /* Ends C function definitions when using C++ */
 #ifdef __cplusplus
 }
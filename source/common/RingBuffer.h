@@ -27,6 +27,11 @@
 extern "C" {
 #endif
 
+/*
+ * Writing and reading can be done concurrently without locking,
+ * provided there is a single writer thread and a single reader thread.
+ * Resetting needs both to be stopped.
+ */
 struct ring_buffer;
 
 /*!
@@ -56,6 +61,16 @@ int ring_buffer_write(struct ring_buffer *buf, const void *data,
  */
 int ring_buffer_avail(struct ring_buffer *buf);
 
+/*!
+ * Returns the number of bytes waiting to be read in the buffer
+ */
+int ring_buffer_len(struct ring_buffer *buf);
+
+/*!
+ * Returns the size of the buffer in bytes, rounded up to a power of two
+ */
+unsigned int ring_buffer_capacity(struct ring_buffer *buf);
+
 /*!
  * Reads data from the ring buffer buf into memory region pointed to by data.
  * A maximum of len bytes will be read.  Returns -1 if the read failed or
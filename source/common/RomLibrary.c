@@ -0,0 +1,424 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include "RomLibrary.h"
+#include "GameDB.h"
+
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_FILE "rom-library.cache"
+#define CACHE_HEADER "VBA ROM library 2"
+
+// Path, file size, mtime, code, title, ROM size, CRC32, SHA-1
+#define CACHE_FIELDS 8
+
+// Path, file size, mtime of the files that are not readable ROMs
+#define CACHE_UNREADABLE_FIELDS 3
+
+struct RomLibrary {
+	/** Cache directory, NULL to not persist the library */
+	gchar *cacheDir;
+
+	/** Entries by path */
+	GHashTable *entries;
+
+	/** Files that are not readable ROMs by path, only the path,
+	 *  size and mtime are set */
+	GHashTable *unreadable;
+};
+
+typedef struct {
+	/** Entries and unreadable files of the previous scan,
+	 *  read-only while scanning */
+	GHashTable *previous;
+	GHashTable *previousUnreadable;
+
+	/** Entries and unreadable files found so far, protected by lock */
+	GHashTable *found;
+	GHashTable *unreadable;
+
+	GThreadPool *pool;
+
+	/** Jobs queued or running, protected by lock */
+	guint pending;
+
+	GMutex lock;
+	GCond done;
+} RomLibraryScan;
+
+typedef struct {
+	gchar *path;
+	gboolean directory;
+
+	/** Regular files only */
+	gint64 fileSize;
+	gint64 mtime;
+} RomLibraryJob;
+
+static const gchar *archiveSuffixes[] = {
+	".7z", ".bz2", ".gz", ".rar", ".tar", ".xz", ".zip", NULL
+};
+
+static void rom_library_entry_free(RomLibraryEntry *entry) {
+	if (entry == NULL)
+		return;
+
+	game_infos_free(entry->game);
+	g_free(entry->path);
+	g_free(entry);
+}
+
+static GHashTable *rom_library_entries_new() {
+	return g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)rom_library_entry_free);
+}
+
+static gboolean rom_library_is_rom(const gchar *file) {
+	gchar *lower = g_ascii_strdown(file, -1);
+	gboolean accepted = g_str_has_suffix(lower, ".gba");
+
+	for (int i = 0; !accepted && archiveSuffixes[i] != NULL; i++) {
+		accepted = g_str_has_suffix(lower, archiveSuffixes[i]);
+	}
+
+	g_free(lower);
+	return accepted;
+}
+
+static gchar *rom_library_cache_file(RomLibrary *library) {
+	return g_build_filename(library->cacheDir, CACHE_FILE, NULL);
+}
+
+static RomLibraryEntry *rom_library_parse_entry(const gchar *line, gboolean *readable) {
+	gchar **fields = g_strsplit(line, "\t", 0);
+	RomLibraryEntry *entry = NULL;
+
+	*readable = g_strv_length(fields) != CACHE_UNREADABLE_FIELDS;
+	if (!*readable) {
+		entry = g_new0(RomLibraryEntry, 1);
+		entry->path = g_strcompress(fields[0]);
+		entry->fileSize = g_ascii_strtoll(fields[1], NULL, 10);
+		entry->mtime = g_ascii_strtoll(fields[2], NULL, 10);
+	} else if (g_strv_length(fields) == CACHE_FIELDS
+			&& strlen(fields[7]) == sizeof(entry->digest.sha1) - 1) {
+		gchar *code = g_strcompress(fields[3]);
+		gchar *title = g_strcompress(fields[4]);
+
+		entry = g_new0(RomLibraryEntry, 1);
+		entry->path = g_strcompress(fields[0]);
+		entry->fileSize = g_ascii_strtoll(fields[1], NULL, 10);
+		entry->mtime = g_ascii_strtoll(fields[2], NULL, 10);
+		g_strlcpy(entry->digest.code, code, sizeof(entry->digest.code));
+		g_strlcpy(entry->digest.title, title, sizeof(entry->digest.title));
+		entry->digest.size = atoi(fields[5]);
+		entry->digest.crc32 = g_ascii_strtoull(fields[6], NULL, 16);
+		g_strlcpy(entry->digest.sha1, fields[7], sizeof(entry->digest.sha1));
+
+		g_free(code);
+		g_free(title);
+	}
+
+	g_strfreev(fields);
+	return entry;
+}
+
+/**
+ * Load the entries of the previous scan. A missing or invalid cache
+ * only means all the ROMs are read again.
+ */
+static void rom_library_load(RomLibrary *library) {
+	gchar *cacheFile = rom_library_cache_file(library);
+	gchar *data = NULL;
+
+	if (!g_file_get_contents(cacheFile, &data, NULL, NULL)) {
+		g_free(cacheFile);
+		return;
+	}
+	g_free(cacheFile);
+
+	gchar **lines = g_strsplit(data, "\n", 0);
+	g_free(data);
+
+	if (g_strcmp0(lines[0], CACHE_HEADER) == 0) {
+		for (int i = 1; lines[i] != NULL; i++) {
+			gboolean readable;
+			RomLibraryEntry *entry = rom_library_parse_entry(lines[i], &readable);
+			if (entry != NULL) {
+				g_hash_table_replace(readable ? library->entries : library->unreadable,
+						entry->path, entry);
+			}
+		}
+	}
+
+	g_strfreev(lines);
+}
+
+static gboolean rom_library_save(RomLibrary *library, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	GString *data = g_string_new(CACHE_HEADER "\n");
+
+	GHashTableIter iter;
+	RomLibraryEntry *entry;
+	g_hash_table_iter_init(&iter, library->entries);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&entry)) {
+		gchar *path = g_strescape(entry->path, NULL);
+		gchar *code = g_strescape(entry->digest.code, NULL);
+		gchar *title = g_strescape(entry->digest.title, NULL);
+
+		g_string_append_printf(data, "%s\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%s\t%s\t%d\t%08x\t%s\n",
+				path, entry->fileSize, entry->mtime, code, title,
+				entry->digest.size, entry->digest.crc32, entry->digest.sha1);
+
+		g_free(path);
+		g_free(code);
+		g_free(title);
+	}
+
+	g_hash_table_iter_init(&iter, library->unreadable);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&entry)) {
+		gchar *path = g_strescape(entry->path, NULL);
+
+		g_string_append_printf(data, "%s\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\n",
+				path, entry->fileSize, entry->mtime);
+
+		g_free(path);
+	}
+
+	gchar *cacheFile = rom_library_cache_file(library);
+
+	// g_file_set_contents is atomic, an interrupted save keeps the previous cache
+	g_mkdir_with_parents(library->cacheDir, 0777);
+	gboolean saved = g_file_set_contents(cacheFile, data->str, data->len, err);
+
+	g_free(cacheFile);
+	g_string_free(data, TRUE);
+
+	return saved;
+}
+
+RomLibrary *rom_library_new(const gchar *cacheDir) {
+	RomLibrary *library = g_new(RomLibrary, 1);
+	library->cacheDir = g_strdup(cacheDir);
+	library->entries = rom_library_entries_new();
+	library->unreadable = rom_library_entries_new();
+
+	if (cacheDir != NULL) {
+		rom_library_load(library);
+	}
+
+	return library;
+}
+
+void rom_library_free(RomLibrary *library) {
+	if (library == NULL)
+		return;
+
+	g_hash_table_destroy(library->entries);
+	g_hash_table_destroy(library->unreadable);
+	g_free(library->cacheDir);
+	g_free(library);
+}
+
+static void rom_library_queue(RomLibraryScan *scan, gchar *path, gboolean directory, const GStatBuf *st) {
+	RomLibraryJob *job = g_new(RomLibraryJob, 1);
+	job->path = path;
+	job->directory = directory;
+	job->fileSize = st ? st->st_size : 0;
+	job->mtime = st ? st->st_mtime : 0;
+
+	g_mutex_lock(&scan->lock);
+	scan->pending++;
+	g_mutex_unlock(&scan->lock);
+
+	g_thread_pool_push(scan->pool, job, NULL);
+}
+
+static void rom_library_scan_directory(RomLibraryScan *scan, const gchar *path) {
+	GDir *dir = g_dir_open(path, 0, NULL);
+	if (dir == NULL) {
+		return;
+	}
+
+	const gchar *name;
+	while ((name = g_dir_read_name(dir)) != NULL) {
+		gchar *child = g_build_filename(path, name, NULL);
+
+		// Symbolic links to directories are not followed to avoid cycles
+		GStatBuf st;
+		if (g_lstat(child, &st) == 0 && S_ISDIR(st.st_mode)) {
+			rom_library_queue(scan, child, TRUE, NULL);
+		} else if (rom_library_is_rom(name) && g_stat(child, &st) == 0 && S_ISREG(st.st_mode)) {
+			rom_library_queue(scan, child, FALSE, &st);
+		} else {
+			g_free(child);
+		}
+	}
+
+	g_dir_close(dir);
+}
+
+static gboolean rom_library_is_unchanged(const RomLibraryEntry *previous, const RomLibraryEntry *entry) {
+	return previous != NULL && previous->fileSize == entry->fileSize && previous->mtime == entry->mtime;
+}
+
+/**
+ * Identify a ROM file
+ * @param readable return location for whether the file is a readable ROM,
+ *                 the entry only recording its size and mtime otherwise
+ */
+static RomLibraryEntry *rom_library_scan_file(RomLibraryScan *scan, RomLibraryJob *job, gboolean *readable) {
+	RomLibraryEntry *previous = g_hash_table_lookup(scan->previous, job->path);
+	RomLibraryEntry *entry = g_new0(RomLibraryEntry, 1);
+	entry->path = job->path;
+	entry->fileSize = job->fileSize;
+	entry->mtime = job->mtime;
+
+	job->path = NULL;
+
+	// Unchanged files are not read again, nor decompressed again
+	// when they were found unreadable
+	if (rom_library_is_unchanged(previous, entry)) {
+		entry->digest = previous->digest;
+		*readable = TRUE;
+		return entry;
+	}
+
+	if (rom_library_is_unchanged(g_hash_table_lookup(scan->previousUnreadable, entry->path), entry)) {
+		*readable = FALSE;
+		return entry;
+	}
+
+	RomLoader *loader = loader_new(ROM_GBA, entry->path);
+	*readable = loader_digest(loader, &entry->digest, NULL);
+	loader_free(loader);
+
+	return entry;
+}
+
+static void rom_library_scan_job(gpointer data, gpointer user_data) {
+	RomLibraryJob *job = data;
+	RomLibraryScan *scan = user_data;
+	RomLibraryEntry *entry = NULL;
+	gboolean readable = FALSE;
+
+	if (job->directory) {
+		rom_library_scan_directory(scan, job->path);
+	} else {
+		entry = rom_library_scan_file(scan, job, &readable);
+	}
+
+	g_mutex_lock(&scan->lock);
+
+	if (entry != NULL) {
+		g_hash_table_replace(readable ? scan->found : scan->unreadable, entry->path, entry);
+	}
+
+	scan->pending--;
+	if (scan->pending == 0) {
+		g_cond_signal(&scan->done);
+	}
+
+	g_mutex_unlock(&scan->lock);
+
+	g_free(job->path);
+	g_free(job);
+}
+
+gboolean rom_library_scan(RomLibrary *library, const gchar * const *directories, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+	g_assert(library != NULL);
+
+	RomLibraryScan scan;
+	scan.previous = library->entries;
+	scan.previousUnreadable = library->unreadable;
+	scan.found = rom_library_entries_new();
+	scan.unreadable = rom_library_entries_new();
+	scan.pending = 0;
+	g_mutex_init(&scan.lock);
+	g_cond_init(&scan.done);
+
+	// Reading ROMs is mostly I/O and decompression, one thread per core
+	scan.pool = g_thread_pool_new(rom_library_scan_job, &scan, g_get_num_processors(), FALSE, err);
+	if (scan.pool == NULL) {
+		g_hash_table_destroy(scan.found);
+		g_hash_table_destroy(scan.unreadable);
+		g_mutex_clear(&scan.lock);
+		g_cond_clear(&scan.done);
+		return FALSE;
+	}
+
+	for (int i = 0; directories[i] != NULL; i++) {
+		rom_library_queue(&scan, g_strdup(directories[i]), TRUE, NULL);
+	}
+
+	// Directory jobs queue more jobs, wait until all are done
+	g_mutex_lock(&scan.lock);
+	while (scan.pending > 0) {
+		g_cond_wait(&scan.done, &scan.lock);
+	}
+	g_mutex_unlock(&scan.lock);
+
+	g_thread_pool_free(scan.pool, FALSE, TRUE);
+	g_mutex_clear(&scan.lock);
+	g_cond_clear(&scan.done);
+
+	g_hash_table_destroy(library->entries);
+	g_hash_table_destroy(library->unreadable);
+	library->entries = scan.found;
+	library->unreadable = scan.unreadable;
+
+	// Join with the game database, which is an in-memory lookup
+	GHashTableIter iter;
+	RomLibraryEntry *entry;
+	g_hash_table_iter_init(&iter, library->entries);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&entry)) {
+		entry->game = game_db_lookup_code(entry->digest.code, library->cacheDir, NULL);
+	}
+
+	if (library->cacheDir == NULL) {
+		return TRUE;
+	}
+
+	return rom_library_save(library, err);
+}
+
+static gint rom_library_compare_path(gconstpointer a, gconstpointer b) {
+	const RomLibraryEntry *entryA = *(const RomLibraryEntry **)a;
+	const RomLibraryEntry *entryB = *(const RomLibraryEntry **)b;
+
+	return g_strcmp0(entryA->path, entryB->path);
+}
+
+GPtrArray *rom_library_get_entries(RomLibrary *library) {
+	g_assert(library != NULL);
+
+	GPtrArray *entries = g_ptr_array_sized_new(g_hash_table_size(library->entries));
+
+	GHashTableIter iter;
+	RomLibraryEntry *entry;
+	g_hash_table_iter_init(&iter, library->entries);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&entry)) {
+		g_ptr_array_add(entries, entry);
+	}
+
+	g_ptr_array_sort(entries, rom_library_compare_path);
+
+	return entries;
+}
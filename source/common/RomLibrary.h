@@ -0,0 +1,100 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef VBAM_COMMON_ROMLIBRARY_H_
+#define VBAM_COMMON_ROMLIBRARY_H_
+
+#include <glib.h>
+#include "GameInfos.h"
+#include "Loader.h"
+
+/* Set up for C function definitions, even when using C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A ROM found while scanning the library
+ */
+typedef struct {
+	/** Path of the ROM or of the archive containing it */
+	gchar *path;
+
+	/** Size and modification time of the file, used to detect changes */
+	gint64 fileSize;
+	gint64 mtime;
+
+	/** Header data and checksums */
+	RomDigest digest;
+
+	/** Game database infos, NULL if the game is not in the database */
+	GameInfos *game;
+} RomLibraryEntry;
+
+/**
+ * Opaque ROM library
+ *
+ * The library lists the ROMs and archived ROMs found in a set of
+ * directories. The identification data of each ROM is kept in a cache file,
+ * so that rescans only read the files that were added or modified.
+ */
+typedef struct RomLibrary RomLibrary;
+
+/**
+ * Create a ROM library, with the entries of the previous scan if any
+ *
+ * @param cacheDir directory where the library cache is stored, or NULL
+ * @return new ROM library
+ */
+RomLibrary *rom_library_new(const gchar *cacheDir);
+
+/**
+ * Free a ROM library. If library is NULL, it simply returns.
+ *
+ * @param library ROM library
+ */
+void rom_library_free(RomLibrary *library);
+
+/**
+ * Scan directories recursively and in parallel for ROMs, replacing
+ * the library entries, and save the library cache.
+ * Files that are not readable ROMs are skipped, and not read again
+ * by the next scans until they are modified.
+ *
+ * @param library ROM library
+ * @param directories NULL terminated list of directories to scan
+ * @param err return location for a GError, or NULL
+ * @return FALSE if the scan could not be performed or the cache not saved
+ */
+gboolean rom_library_scan(RomLibrary *library, const gchar * const *directories, GError **err);
+
+/**
+ * List the library entries, sorted by path. The entries belong to the
+ * library and are valid until the next scan.
+ *
+ * @param library ROM library
+ * @return newly allocated array of RomLibraryEntry, free with g_ptr_array_free
+ */
+GPtrArray *rom_library_get_entries(RomLibrary *library);
+
+/* Ends C function definitions when using C++ */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VBAM_COMMON_ROMLIBRARY_H_ */
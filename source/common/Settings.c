@@ -42,21 +42,46 @@ static struct {
 typedef struct {
 	gchar *configFileName;
 	gchar *biosFileName;
+	gboolean biosHle;
 	gchar *saveDir;
 	gchar *batteryDir;
+	gchar *cacheDir;
 
 	gboolean fullscreen;
 	guint zoomFactor;
 
 	gboolean pauseWhenInactive;
 	gboolean showSpeed;
+	gboolean showAudioLatency;
+	gboolean showPerfCounters;
 	gboolean disableStatus;
+	gchar *frameSync;
 
 	guint soundSampleRate;
 	gdouble soundVolume;
+	gboolean soundDynamicRate;
+	gdouble soundMaxRateDelta;
+	gchar *soundMode;
+	guint soundTickPeriod;
+	gchar *soundQuality;
+	guint soundDeviceBufferSize;
+	guint soundBufferLength;
 
 	guint logChannels;
 
+	gchar *recordMovie;
+	gchar *playMovie;
+	guint movieKeyframeInterval;
+
+	guint savestateFullInterval;
+
+	gchar *captureSound;
+	gboolean captureStems;
+	gchar *traceFile;
+	gchar *profileFile;
+	gchar *profileSymbols;
+	gchar *eventLogFile;
+
 	guint32 joypad[G_N_ELEMENTS(buttons)];
 } Settings;
 
@@ -65,9 +90,20 @@ static gchar **filenames = NULL;
 
 static GOptionEntry commandLineOptions[] = {
   { "bios", 'b', 0, G_OPTION_ARG_FILENAME, &settings.biosFileName, "Use given bios file", NULL },
+  { "bios-hle", 0, 0, G_OPTION_ARG_NONE, &settings.biosHle, "Perform the BIOS functions natively, even with a bios file", NULL },
   { "fullscreen", 0, 0, G_OPTION_ARG_NONE, &settings.fullscreen, "Full screen", NULL },
   { "pause-when-inactive", 0, 0, G_OPTION_ARG_NONE, &settings.pauseWhenInactive, "Pause when inactive", NULL },
   { "show-speed", 0, 0, G_OPTION_ARG_NONE, &settings.showSpeed, "Show emulation speed", NULL },
+  { "show-perf-counters", 0, 0, G_OPTION_ARG_NONE, &settings.showPerfCounters, "Show the performance counters of each frame", NULL },
+  { "sound-mode", 0, 0, G_OPTION_ARG_STRING, &settings.soundMode, "Sound mode: normal, null (no output) or hash (print a hash of the audio on exit)", "MODE" },
+  { "record-movie", 0, 0, G_OPTION_ARG_FILENAME, &settings.recordMovie, "Record the input to a movie file", "FILE" },
+  { "play-movie", 0, 0, G_OPTION_ARG_FILENAME, &settings.playMovie, "Play back the input from a movie file", "FILE" },
+  { "capture-sound", 0, 0, G_OPTION_ARG_FILENAME, &settings.captureSound, "Capture the sound output to a WAV or FLAC file", "FILE" },
+  { "capture-stems", 0, 0, G_OPTION_ARG_NONE, &settings.captureStems, "Also capture the PCM and PSG channels separately", NULL },
+  { "trace", 0, 0, G_OPTION_ARG_FILENAME, &settings.traceFile, "Record a timeline of the emulation loop to a trace event file", "FILE" },
+  { "profile", 0, 0, G_OPTION_ARG_FILENAME, &settings.profileFile, "Sample the emulated code and write a flamegraph profile to a file", "FILE" },
+  { "profile-symbols", 0, 0, G_OPTION_ARG_FILENAME, &settings.profileSymbols, "Name the profiled functions using an ELF or map file", "FILE" },
+  { "event-log", 0, 0, G_OPTION_ARG_FILENAME, &settings.eventLogFile, "Record the events of the enabled log channels to a binary file", "FILE" },
   { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &filenames, NULL, "[GBA ROM file]" },
   { NULL }
 };
@@ -90,38 +126,78 @@ static SettingDescription settingsList[] = {
 	&settings.fullscreen, "display", "fullscreen", BOOLEAN,
 	&settings.zoomFactor, "display", "zoomFactor", INTEGER,
 	&settings.showSpeed, "display", "showSpeed", BOOLEAN,
+	&settings.showAudioLatency, "display", "showAudioLatency", BOOLEAN,
+	&settings.showPerfCounters, "display", "showPerfCounters", BOOLEAN,
 	&settings.pauseWhenInactive, "display", "pauseWhenInactive", BOOLEAN,
 	&settings.disableStatus, "display", "disableStatus", BOOLEAN,
+	&settings.frameSync, "display", "frameSync", STRING,
 	&settings.biosFileName, "paths", "biosFileName", STRING,
 	&settings.batteryDir, "paths", "batteryDir", STRING,
 	&settings.saveDir, "paths", "saveDir", STRING,
+	&settings.cacheDir, "paths", "cacheDir", STRING,
 	&settings.soundVolume, "sound", "volume", DOUBLE,
 	&settings.soundSampleRate, "sound", "sampleRate", INTEGER,
-	&settings.logChannels, "system", "logChannels", INTEGER
+	&settings.soundDynamicRate, "sound", "dynamicRateControl", BOOLEAN,
+	&settings.soundMaxRateDelta, "sound", "maxRateDelta", DOUBLE,
+	&settings.soundMode, "sound", "mode", STRING,
+	&settings.soundTickPeriod, "sound", "tickPeriod", INTEGER,
+	&settings.soundQuality, "sound", "quality", STRING,
+	&settings.soundDeviceBufferSize, "sound", "deviceBufferSize", INTEGER,
+	&settings.soundBufferLength, "sound", "bufferLength", INTEGER,
+	&settings.biosHle, "system", "biosHle", BOOLEAN,
+	&settings.logChannels, "system", "logChannels", INTEGER,
+	&settings.movieKeyframeInterval, "movie", "keyframeInterval", INTEGER,
+	&settings.savestateFullInterval, "savestate", "fullStateInterval", INTEGER
 };
 
 void settings_init() {
 	const gchar *userConfigDir = g_get_user_config_dir();
 	const gchar *userDataDir = g_get_user_data_dir();
+	const gchar *userCacheDir = g_get_user_cache_dir();
 
 	// Setup default values
 	settings.configFileName = g_build_filename(userConfigDir, CONF_DIR, "config", NULL);
 	settings.biosFileName = NULL;
 	settings.saveDir = g_build_filename(userDataDir, CONF_DIR, NULL);
 	settings.batteryDir = g_build_filename(userDataDir, CONF_DIR, NULL);
+	settings.cacheDir = g_build_filename(userCacheDir, CONF_DIR, NULL);
 
 	settings.fullscreen = FALSE;
 	settings.zoomFactor = 3;
 
 	settings.pauseWhenInactive = FALSE;
 	settings.showSpeed = FALSE;
+	settings.showAudioLatency = FALSE;
+	settings.showPerfCounters = FALSE;
 	settings.disableStatus = FALSE;
+	settings.frameSync = g_strdup("timer");
 
 	settings.soundSampleRate = 44100;
 	settings.soundVolume = 1.0f;
-
+	settings.soundDynamicRate = FALSE;
+	settings.soundMaxRateDelta = 0.005;
+	settings.soundMode = g_strdup("normal");
+	settings.soundTickPeriod = 10;
+	settings.soundQuality = g_strdup("best");
+	settings.soundDeviceBufferSize = 1024;
+	settings.soundBufferLength = 100;
+
+	settings.biosHle = FALSE;
 	settings.logChannels = 0;
 
+	settings.recordMovie = NULL;
+	settings.playMovie = NULL;
+	settings.movieKeyframeInterval = 600;
+
+	settings.savestateFullInterval = 1;
+
+	settings.captureSound = NULL;
+	settings.captureStems = FALSE;
+	settings.traceFile = NULL;
+	settings.profileFile = NULL;
+	settings.profileSymbols = NULL;
+	settings.eventLogFile = NULL;
+
 	for (guint i = 0; i < G_N_ELEMENTS(buttons); i++) {
 		settings.joypad[buttons[i].button] = 0;
 	}
@@ -132,6 +208,17 @@ void settings_free() {
 	g_free(settings.biosFileName);
 	g_free(settings.saveDir);
 	g_free(settings.batteryDir);
+	g_free(settings.cacheDir);
+	g_free(settings.frameSync);
+	g_free(settings.soundMode);
+	g_free(settings.soundQuality);
+	g_free(settings.recordMovie);
+	g_free(settings.playMovie);
+	g_free(settings.captureSound);
+	g_free(settings.traceFile);
+	g_free(settings.profileFile);
+	g_free(settings.profileSymbols);
+	g_free(settings.eventLogFile);
 }
 
 void settings_display_usage() {
@@ -362,24 +449,115 @@ gboolean settings_write_config_file(GError **err) {
 gboolean settings_check(GError **err) {
 	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
 
-	if (settings.biosFileName == NULL || g_strcmp0(settings.biosFileName, "") == 0) {
+	if (settings.soundVolume < 0.0 || settings.soundVolume > SETTINGS_SOUND_MAX_VOLUME) {
 		g_set_error(err,
 			G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
-			"You must configure the GBA BIOS ROM file.");
+			"The volume must be between 0 and %f.", SETTINGS_SOUND_MAX_VOLUME);
 		return FALSE;
 	}
 
-	if (settings.soundVolume < 0.0 || settings.soundVolume > SETTINGS_SOUND_MAX_VOLUME) {
+	if (settings.soundSampleRate < 11000 || settings.soundVolume > 48000) {
 		g_set_error(err,
 			G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
-			"The volume must be between 0 and %f.", SETTINGS_SOUND_MAX_VOLUME);
+			"The sound sample rate must be between 11000 KHz and 48000 KHz.");
 		return FALSE;
 	}
 
-	if (settings.soundSampleRate < 11000 || settings.soundVolume > 48000) {
+	if (settings.soundMaxRateDelta <= 0.0 || settings.soundMaxRateDelta > SETTINGS_SOUND_MAX_RATE_DELTA) {
 		g_set_error(err,
 			G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
-			"The sound sample rate must be between 11000 KHz and 48000 KHz.");
+			"The maximum sound rate delta must be between 0 and %f.", SETTINGS_SOUND_MAX_RATE_DELTA);
+		return FALSE;
+	}
+
+	if (g_strcmp0(settings.soundMode, "normal") != 0
+			&& g_strcmp0(settings.soundMode, "null") != 0
+			&& g_strcmp0(settings.soundMode, "hash") != 0) {
+		g_set_error(err,
+			G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+			"The sound mode must be normal, null or hash.");
+		return FALSE;
+	}
+
+	if (g_strcmp0(settings.frameSync, "audio") != 0
+			&& g_strcmp0(settings.frameSync, "timer") != 0
+			&& g_strcmp0(settings.frameSync, "vsync") != 0) {
+		g_set_error(err,
+			G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+			"The frame sync must be audio, timer or vsync.");
+		return FALSE;
+	}
+
+	if (g_strcmp0(settings.soundQuality, "fast") != 0
+			&& g_strcmp0(settings.soundQuality, "good") != 0
+			&& g_strcmp0(settings.soundQuality, "best") != 0) {
+		g_set_error(err,
+			G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+			"The sound quality must be fast, good or best.");
+		return FALSE;
+	}
+
+	if (settings.soundTickPeriod < 1 || settings.soundTickPeriod > 20) {
+		g_set_error(err,
+			G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+			"The sound tick period must be between 1 ms and 20 ms.");
+		return FALSE;
+	}
+
+	if (settings.soundDeviceBufferSize < 64 || settings.soundDeviceBufferSize > 8192
+			|| (settings.soundDeviceBufferSize & (settings.soundDeviceBufferSize - 1)) != 0) {
+		g_set_error(err,
+			G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+			"The sound device buffer size must be a power of two between 64 and 8192 samples.");
+		return FALSE;
+	}
+
+	if (settings.soundBufferLength < 10 || settings.soundBufferLength > 1000) {
+		g_set_error(err,
+			G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+			"The sound buffer length must be between 10 ms and 1000 ms.");
+		return FALSE;
+	}
+
+	if (settings.recordMovie != NULL && settings.playMovie != NULL) {
+		g_set_error(err,
+			G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+			"A movie cannot be recorded and played back at the same time.");
+		return FALSE;
+	}
+
+	if (settings.movieKeyframeInterval < 1) {
+		g_set_error(err,
+			G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+			"The movie keyframe interval must be at least one frame.");
+		return FALSE;
+	}
+
+	if (settings.savestateFullInterval < 1) {
+		g_set_error(err,
+			G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+			"The full savestate interval must be at least one save.");
+		return FALSE;
+	}
+
+	if (settings.captureStems && settings.captureSound == NULL) {
+		g_set_error(err,
+			G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+			"Capturing the sound stems requires a sound capture file.");
+		return FALSE;
+	}
+
+	if (settings.profileSymbols != NULL && settings.profileFile == NULL) {
+		g_set_error(err,
+			G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+			"Loading profiler symbols requires a profile file.");
+		return FALSE;
+	}
+
+	if (settings.eventLogFile != NULL && settings.logChannels == 0) {
+		g_set_error(err,
+			G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+			"Recording an event log requires enabling log channels.");
 		return FALSE;
 	}
 
@@ -394,10 +572,18 @@ const gchar *settings_get_save_dir() {
 	return settings.saveDir;
 }
 
+const gchar *settings_get_cache_dir() {
+	return settings.cacheDir;
+}
+
 const gchar *settings_get_bios() {
 	return settings.biosFileName;
 }
 
+gboolean settings_bios_hle() {
+	return settings.biosHle;
+}
+
 gboolean settings_is_fullscreen() {
 	return settings.fullscreen;
 }
@@ -414,10 +600,22 @@ gboolean settings_show_speed() {
 	return settings.showSpeed;
 }
 
+gboolean settings_show_audio_latency() {
+	return settings.showAudioLatency;
+}
+
+gboolean settings_show_perf_counters() {
+	return settings.showPerfCounters;
+}
+
 gboolean settings_disable_status_messages() {
 	return settings.disableStatus;
 }
 
+const gchar *settings_frame_sync() {
+	return settings.frameSync;
+}
+
 gdouble settings_sound_volume() {
 	return settings.soundVolume;
 }
@@ -426,8 +624,76 @@ guint settings_sound_sample_rate() {
 	return settings.soundSampleRate;
 }
 
-gboolean settings_log_channel_enabled(LogChannel channel) {
-	return settings.logChannels & (1 << channel);
+gboolean settings_sound_dynamic_rate_control() {
+	return settings.soundDynamicRate;
+}
+
+gdouble settings_sound_max_rate_delta() {
+	return settings.soundMaxRateDelta;
+}
+
+const gchar *settings_sound_mode() {
+	return settings.soundMode;
+}
+
+const gchar *settings_sound_quality() {
+	return settings.soundQuality;
+}
+
+guint settings_sound_tick_period() {
+	return settings.soundTickPeriod;
+}
+
+guint settings_sound_device_buffer_size() {
+	return settings.soundDeviceBufferSize;
+}
+
+guint settings_sound_buffer_length() {
+	return settings.soundBufferLength;
+}
+
+const gchar *settings_get_record_movie() {
+	return settings.recordMovie;
+}
+
+const gchar *settings_get_play_movie() {
+	return settings.playMovie;
+}
+
+guint settings_movie_keyframe_interval() {
+	return settings.movieKeyframeInterval;
+}
+
+guint settings_savestate_full_interval() {
+	return settings.savestateFullInterval;
+}
+
+const gchar *settings_get_capture_sound() {
+	return settings.captureSound;
+}
+
+gboolean settings_capture_stems() {
+	return settings.captureStems;
+}
+
+const gchar *settings_get_trace_file() {
+	return settings.traceFile;
+}
+
+const gchar *settings_get_profile_file() {
+	return settings.profileFile;
+}
+
+const gchar *settings_get_profile_symbols() {
+	return settings.profileSymbols;
+}
+
+const gchar *settings_get_event_log_file() {
+	return settings.eventLogFile;
+}
+
+guint settings_get_log_channels() {
+	return settings.logChannels;
 }
 
 guint32 settings_get_button_mapping(EKey button) {
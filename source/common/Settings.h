@@ -28,6 +28,7 @@ extern "C" {
 #endif
 
 #define SETTINGS_SOUND_MAX_VOLUME 2.0
+#define SETTINGS_SOUND_MAX_RATE_DELTA 0.05
 
 /**
  * Initialize the settings module and set default setting values
@@ -85,9 +86,15 @@ const gchar *settings_get_battery_dir();
 /** @return path where the state files are stored */
 const gchar *settings_get_save_dir();
 
-/** @return path of the GBA BIOS ROM file */
+/** @return path where the extracted ROMs and other cached files are stored */
+const gchar *settings_get_cache_dir();
+
+/** @return path of the GBA BIOS ROM file, NULL to use the built-in replacement */
 const gchar *settings_get_bios();
 
+/** @return whether to perform the BIOS functions natively when using a BIOS file */
+gboolean settings_bios_hle();
+
 /** @return whether to start display fullscreen */
 gboolean settings_is_fullscreen();
 
@@ -100,15 +107,79 @@ gboolean settings_pause_when_inactive();
 /** @return whether to always display the emulation speed */
 gboolean settings_show_speed();
 
+/** @return whether to display the measured audio latency */
+gboolean settings_show_audio_latency();
+
+/** @return whether to display the performance counters of each frame */
+gboolean settings_show_perf_counters();
+
 /** @return whether to disable informational status messages */
 gboolean settings_disable_status_messages();
 
+/**
+ * @return what the emulated frames are synchronized to, one of "audio",
+ * "timer" or "vsync". Dynamic sound rate control is always used when not
+ * synchronizing to audio.
+ */
+const gchar *settings_frame_sync();
+
 /** @return initial value for the sound volume */
 gdouble settings_sound_volume();
 
 /** @return sound sample rate value */
 guint settings_sound_sample_rate();
 
+/** @return whether to adjust the sound rate to the output buffer fill level */
+gboolean settings_sound_dynamic_rate_control();
+
+/** @return maximum relative sound rate adjustment for dynamic rate control */
+gdouble settings_sound_max_rate_delta();
+
+/** @return sound mode, one of "normal", "null" or "hash" */
+const gchar *settings_sound_mode();
+
+/** @return sound synthesis quality, one of "fast", "good" or "best" */
+const gchar *settings_sound_quality();
+
+/** @return period at which sound is synthesized, in milliseconds */
+guint settings_sound_tick_period();
+
+/** @return size of the sound device buffer, in samples */
+guint settings_sound_device_buffer_size();
+
+/** @return length of the sound output buffer, in milliseconds */
+guint settings_sound_buffer_length();
+
+/** @return path of the movie file to record the input to, or NULL */
+const gchar *settings_get_record_movie();
+
+/** @return path of the movie file to play the input back from, or NULL */
+const gchar *settings_get_play_movie();
+
+/** @return number of frames between movie keyframes */
+guint settings_movie_keyframe_interval();
+
+/** @return number of saves to a savestate slot between full states */
+guint settings_savestate_full_interval();
+
+/** @return path of the file to capture the sound output to, or NULL */
+const gchar *settings_get_capture_sound();
+
+/** @return whether to also capture the sound channels separately */
+gboolean settings_capture_stems();
+
+/** @return path of the file to record the emulation timeline to, or NULL */
+const gchar *settings_get_trace_file();
+
+/** @return path of the file to write the emulated code profile to, or NULL */
+const gchar *settings_get_profile_file();
+
+/** @return path of the ELF or map file naming the profiled functions, or NULL */
+const gchar *settings_get_profile_symbols();
+
+/** @return path of the file to record the log channel events to, or NULL */
+const gchar *settings_get_event_log_file();
+
 /**
  * Available log channels
  */
@@ -126,11 +197,8 @@ typedef enum {
 	LOG_SOUNDOUTPUT,
 } LogChannel;
 
-/**
- * @param channel log channel
- * @return TRUE if the specified log channel is enabled
- */
-gboolean settings_log_channel_enabled(LogChannel channel);
+/** @return enabled log channels, bit n being set when channel n is enabled */
+guint settings_get_log_channels();
 
 /**
  * @param button emulated button for which to query mapping information
@@ -0,0 +1,490 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include "SoundCapture.h"
+#include "AsyncWriter.h"
+
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+// Room for about 1.4 seconds of 48 kHz stereo sound, the largest queue size
+#define CAPTURE_QUEUE_SIZE (1 << 18)
+
+// Period at which the writer thread looks for new samples
+#define CAPTURE_POLL_USEC 5000
+
+#define WAV_HEADER_SIZE 44
+
+// Sample pairs per FLAC frame, and the matching block size code
+#define FLAC_BLOCK_SIZE 4096
+#define FLAC_BLOCK_SIZE_CODE 12
+#define FLAC_STREAMINFO_OFFSET 8
+#define FLAC_STREAMINFO_SIZE 34
+#define FLAC_MAX_FIXED_ORDER 4
+#define FLAC_MAX_RICE_PARAMETER 14
+
+typedef enum {
+	CAPTURE_WAV,
+	CAPTURE_FLAC
+} CaptureFormat;
+
+struct SoundCapture {
+	FILE *f;
+	CaptureFormat format;
+	guint sampleRate;
+
+	AsyncWriter *writer;
+
+	// Only accessed by the writer thread until it is stopped
+	guint64 frames;
+
+	// FLAC encoder state
+	gint16 block[FLAC_BLOCK_SIZE * 2];
+	guint blockFrames;
+	guint32 flacFrames;
+	guint32 minFrameSize;
+	guint32 maxFrameSize;
+	GChecksum *md5;
+	gint32 residual[FLAC_BLOCK_SIZE];
+	guint8 frame[FLAC_BLOCK_SIZE * 4 + 64];
+};
+
+// MSB first bit writer for FLAC frames
+typedef struct {
+	guint8 *data;
+	gsize len;
+	guint64 acc;
+	guint bits;
+} BitWriter;
+
+GQuark sound_capture_error_quark() {
+	return g_quark_from_static_string("sound_capture_error_quark");
+}
+
+static void bits_put(BitWriter *w, guint32 value, guint count) {
+	guint32 mask = count < 32 ? (1u << count) - 1 : 0xFFFFFFFF;
+
+	w->acc = (w->acc << count) | (value & mask);
+	w->bits += count;
+
+	while (w->bits >= 8) {
+		w->bits -= 8;
+		w->data[w->len++] = (guint8)(w->acc >> w->bits);
+	}
+}
+
+static void bits_align(BitWriter *w) {
+	if (w->bits > 0) {
+		bits_put(w, 0, 8 - w->bits);
+	}
+}
+
+static void bits_put_rice(BitWriter *w, guint32 value, guint k) {
+	guint32 q = value >> k;
+
+	// Unary coded quotient, then the k low bits
+	for (; q >= 32; q -= 32) {
+		bits_put(w, 0, 32);
+	}
+
+	if (q + 1 + k <= 32) {
+		bits_put(w, (1u << k) | (value & ((1u << k) - 1)), q + 1 + k);
+	} else {
+		bits_put(w, 1, q + 1);
+		bits_put(w, value, k);
+	}
+}
+
+// Frame numbers use the same variable length coding as UTF-8
+static void bits_put_utf8(BitWriter *w, guint32 value) {
+	if (value < 0x80) {
+		bits_put(w, value, 8);
+		return;
+	}
+
+	guint continuations = 1;
+	while (continuations < 6 && value >= (1u << (5 * continuations + 6))) {
+		continuations++;
+	}
+
+	guint8 lead = (guint8)(0xFF00 >> (continuations + 1));
+	bits_put(w, lead | (value >> (6 * continuations)), 8);
+
+	while (continuations-- > 0) {
+		bits_put(w, 0x80 | ((value >> (6 * continuations)) & 0x3F), 8);
+	}
+}
+
+static guint8 flac_crc8(const guint8 *data, gsize len) {
+	guint8 crc = 0;
+	for (gsize i = 0; i < len; i++) {
+		crc ^= data[i];
+		for (guint b = 0; b < 8; b++) {
+			crc = (crc & 0x80) ? (guint8)((crc << 1) ^ 0x07) : (guint8)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+static guint16 flac_crc16(const guint8 *data, gsize len) {
+	guint16 crc = 0;
+	for (gsize i = 0; i < len; i++) {
+		crc ^= (guint16)(data[i] << 8);
+		for (guint b = 0; b < 8; b++) {
+			crc = (crc & 0x8000) ? (guint16)((crc << 1) ^ 0x8005) : (guint16)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+static guint32 zigzag(gint32 value) {
+	return value >= 0 ? (guint32)value << 1 : ((guint32)-(value + 1) << 1) | 1;
+}
+
+/**
+ * Encode one channel of the current block, using the cheapest of a constant,
+ * fixed predictor or verbatim subframe
+ */
+static void flac_encode_subframe(SoundCapture *capture, BitWriter *w, guint channel) {
+	const gint16 *samples = capture->block + channel;
+	guint n = capture->blockFrames;
+
+	gboolean constant = TRUE;
+	for (guint i = 1; i < n && constant; i++) {
+		constant = samples[2 * i] == samples[0];
+	}
+
+	if (constant) {
+		bits_put(w, 0x00, 8);
+		bits_put(w, (guint16)samples[0], 16);
+		return;
+	}
+
+	// Pick the predictor order with the smallest residuals
+	guint maxOrder = MIN(FLAC_MAX_FIXED_ORDER, n - 1);
+	guint64 error[FLAC_MAX_FIXED_ORDER + 1] = { 0 };
+	for (guint i = maxOrder; i < n; i++) {
+		gint32 d0 = samples[2 * i];
+		gint32 d1 = d0 - samples[2 * (i - 1)];
+		gint32 d2 = i >= 2 ? d1 - (samples[2 * (i - 1)] - samples[2 * (i - 2)]) : 0;
+		gint32 d3 = i >= 3 ? d2 - (samples[2 * (i - 1)] - 2 * samples[2 * (i - 2)] + samples[2 * (i - 3)]) : 0;
+		gint32 d4 = i >= 4 ? d3 - (samples[2 * (i - 1)] - 3 * samples[2 * (i - 2)]
+				+ 3 * samples[2 * (i - 3)] - samples[2 * (i - 4)]) : 0;
+		error[0] += ABS(d0);
+		error[1] += ABS(d1);
+		error[2] += ABS(d2);
+		error[3] += ABS(d3);
+		error[4] += ABS(d4);
+	}
+
+	guint order = 0;
+	for (guint o = 1; o <= maxOrder; o++) {
+		if (error[o] < error[order]) {
+			order = o;
+		}
+	}
+
+	static const gint32 coefs[FLAC_MAX_FIXED_ORDER + 1][FLAC_MAX_FIXED_ORDER] = {
+		{ 0, 0, 0, 0 },
+		{ 1, 0, 0, 0 },
+		{ 2, -1, 0, 0 },
+		{ 3, -3, 1, 0 },
+		{ 4, -6, 4, -1 }
+	};
+
+	for (guint i = order; i < n; i++) {
+		gint32 prediction = 0;
+		for (guint j = 0; j < order; j++) {
+			prediction += coefs[order][j] * samples[2 * (i - 1 - j)];
+		}
+		capture->residual[i] = samples[2 * i] - prediction;
+	}
+
+	// Pick the Rice parameter giving the smallest residual
+	guint64 bestBits = G_MAXUINT64;
+	guint bestK = 0;
+	for (guint k = 0; k <= FLAC_MAX_RICE_PARAMETER; k++) {
+		guint64 bits = (guint64)(n - order) * (k + 1);
+		for (guint i = order; i < n && bits < bestBits; i++) {
+			bits += zigzag(capture->residual[i]) >> k;
+		}
+		if (bits < bestBits) {
+			bestBits = bits;
+			bestK = k;
+		}
+	}
+
+	if (16 * order + 10 + bestBits >= 16 * (guint64)n) {
+		// Verbatim
+		bits_put(w, 0x02, 8);
+		for (guint i = 0; i < n; i++) {
+			bits_put(w, (guint16)samples[2 * i], 16);
+		}
+		return;
+	}
+
+	// Fixed predictor, warm-up samples, then the residual as a single Rice partition
+	bits_put(w, (0x08 | order) << 1, 8);
+	for (guint i = 0; i < order; i++) {
+		bits_put(w, (guint16)samples[2 * i], 16);
+	}
+
+	bits_put(w, 0, 2);
+	bits_put(w, 0, 4);
+	bits_put(w, bestK, 4);
+	for (guint i = order; i < n; i++) {
+		bits_put_rice(w, zigzag(capture->residual[i]), bestK);
+	}
+}
+
+static gboolean flac_write_frame(SoundCapture *capture) {
+	BitWriter w = { capture->frame, 0, 0, 0 };
+	guint n = capture->blockFrames;
+	gboolean fullBlock = n == FLAC_BLOCK_SIZE;
+
+	// Sync code with fixed block size, block size, sample rate from
+	// STREAMINFO, independent left and right channels, 16 bit samples
+	bits_put(&w, 0xFFF8, 16);
+	bits_put(&w, fullBlock ? FLAC_BLOCK_SIZE_CODE : 7, 4);
+	bits_put(&w, 0, 4);
+	bits_put(&w, 1, 4);
+	bits_put(&w, 4, 3);
+	bits_put(&w, 0, 1);
+	bits_put_utf8(&w, capture->flacFrames);
+	if (!fullBlock) {
+		bits_put(&w, n - 1, 16);
+	}
+	bits_put(&w, flac_crc8(w.data, w.len), 8);
+
+	flac_encode_subframe(capture, &w, 0);
+	flac_encode_subframe(capture, &w, 1);
+
+	bits_align(&w);
+	bits_put(&w, flac_crc16(w.data, w.len), 16);
+
+	if (fwrite(w.data, 1, w.len, capture->f) != w.len) {
+		return FALSE;
+	}
+
+	capture->flacFrames++;
+	capture->minFrameSize = MIN(capture->minFrameSize, w.len);
+	capture->maxFrameSize = MAX(capture->maxFrameSize, w.len);
+
+	// The MD5 signature is computed over the little endian samples
+	for (guint i = 0; i < 2 * n; i++) {
+		capture->block[i] = GINT16_TO_LE(capture->block[i]);
+	}
+	g_checksum_update(capture->md5, (const guchar *)capture->block, 2 * n * sizeof(gint16));
+
+	capture->blockFrames = 0;
+
+	return TRUE;
+}
+
+static gboolean sound_capture_process(void *data, guint frames, guint queue, gpointer user_data) {
+	SoundCapture *capture = (SoundCapture *)user_data;
+
+	gint16 *samples = (gint16 *)data;
+
+	capture->frames += frames;
+
+	if (capture->format == CAPTURE_WAV) {
+		for (guint i = 0; i < 2 * frames; i++) {
+			samples[i] = GINT16_TO_LE(samples[i]);
+		}
+
+		return fwrite(samples, 2 * sizeof(gint16), frames, capture->f) == frames;
+	}
+
+	while (frames > 0) {
+		guint count = MIN(frames, FLAC_BLOCK_SIZE - capture->blockFrames);
+		memcpy(capture->block + 2 * capture->blockFrames, samples, count * 2 * sizeof(gint16));
+		capture->blockFrames += count;
+		samples += 2 * count;
+		frames -= count;
+
+		if (capture->blockFrames == FLAC_BLOCK_SIZE && !flac_write_frame(capture)) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static void put_le32(guint8 *data, guint32 value) {
+	data[0] = value;
+	data[1] = value >> 8;
+	data[2] = value >> 16;
+	data[3] = value >> 24;
+}
+
+static void put_le16(guint8 *data, guint16 value) {
+	data[0] = value;
+	data[1] = value >> 8;
+}
+
+static gboolean wav_write_header(SoundCapture *capture) {
+	guint8 header[WAV_HEADER_SIZE];
+	guint64 dataSize = capture->frames * 2 * sizeof(gint16);
+	guint32 size = (guint32)MIN(dataSize, G_MAXUINT32 - (WAV_HEADER_SIZE - 8));
+
+	memcpy(header, "RIFF", 4);
+	put_le32(header + 4, size + WAV_HEADER_SIZE - 8);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	put_le32(header + 16, 16);
+	put_le16(header + 20, 1);
+	put_le16(header + 22, 2);
+	put_le32(header + 24, capture->sampleRate);
+	put_le32(header + 28, capture->sampleRate * 2 * sizeof(gint16));
+	put_le16(header + 32, 2 * sizeof(gint16));
+	put_le16(header + 34, 16);
+	memcpy(header + 36, "data", 4);
+	put_le32(header + 40, size);
+
+	return fseek(capture->f, 0, SEEK_SET) == 0
+			&& fwrite(header, 1, sizeof(header), capture->f) == sizeof(header);
+}
+
+static gboolean flac_write_header(SoundCapture *capture, gboolean complete) {
+	guint8 header[FLAC_STREAMINFO_OFFSET + FLAC_STREAMINFO_SIZE];
+	BitWriter w = { header, 0, 0, 0 };
+
+	// Stream marker, then a STREAMINFO block as the last metadata block.
+	// Frame sizes and the MD5 signature are left as unknown until complete.
+	memcpy(header, "fLaC", 4);
+	w.len = 4;
+	bits_put(&w, 0x80, 8);
+	bits_put(&w, FLAC_STREAMINFO_SIZE, 24);
+
+	bits_put(&w, FLAC_BLOCK_SIZE, 16);
+	bits_put(&w, FLAC_BLOCK_SIZE, 16);
+	bits_put(&w, complete && capture->flacFrames > 0 ? capture->minFrameSize : 0, 24);
+	bits_put(&w, complete ? capture->maxFrameSize : 0, 24);
+	bits_put(&w, capture->sampleRate, 20);
+	bits_put(&w, 2 - 1, 3);
+	bits_put(&w, 16 - 1, 5);
+	bits_put(&w, (guint32)(capture->frames >> 32), 4);
+	bits_put(&w, (guint32)capture->frames, 32);
+
+	guint8 md5[16];
+	gsize md5Size = sizeof(md5);
+	memset(md5, 0, sizeof(md5));
+	if (complete) {
+		g_checksum_get_digest(capture->md5, md5, &md5Size);
+	}
+	memcpy(header + w.len, md5, sizeof(md5));
+
+	return fseek(capture->f, 0, SEEK_SET) == 0
+			&& fwrite(header, 1, sizeof(header), capture->f) == sizeof(header);
+}
+
+SoundCapture *sound_capture_new(const gchar *file, guint sampleRate, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, NULL);
+
+	FILE *f = g_fopen(file, "wb");
+	if (f == NULL) {
+		g_set_error(err, SOUND_CAPTURE_ERROR, G_SOUND_CAPTURE_ERROR_FAILED,
+				"Failed to open sound capture file %s: %s", file, g_strerror(errno));
+		return NULL;
+	}
+
+	gchar *lower = g_ascii_strdown(file, -1);
+	gboolean flac = g_str_has_suffix(lower, ".flac");
+	g_free(lower);
+
+	SoundCapture *capture = g_new(SoundCapture, 1);
+	capture->f = f;
+	capture->format = flac ? CAPTURE_FLAC : CAPTURE_WAV;
+	capture->sampleRate = sampleRate;
+	capture->writer = async_writer_new(2 * sizeof(gint16), CAPTURE_QUEUE_SIZE, NULL);
+	capture->frames = 0;
+	capture->blockFrames = 0;
+	capture->flacFrames = 0;
+	capture->minFrameSize = G_MAXUINT32;
+	capture->maxFrameSize = 0;
+	capture->md5 = g_checksum_new(G_CHECKSUM_MD5);
+
+	// Placeholder headers, completed once the length is known
+	gboolean success = flac ? flac_write_header(capture, FALSE) : wav_write_header(capture);
+	if (!success) {
+		g_set_error(err, SOUND_CAPTURE_ERROR, G_SOUND_CAPTURE_ERROR_FAILED,
+				"Failed to write sound capture file %s: %s", file, g_strerror(errno));
+		fclose(f);
+		async_writer_free(capture->writer);
+		g_checksum_free(capture->md5);
+		g_free(capture);
+		return NULL;
+	}
+
+	async_writer_start(capture->writer, "sound-capture", sound_capture_process, capture, CAPTURE_POLL_USEC);
+
+	return capture;
+}
+
+void sound_capture_write(SoundCapture *capture, const gint16 *samples, guint frames) {
+	g_assert(capture != NULL);
+
+	async_writer_push(capture->writer, samples, frames);
+}
+
+gboolean sound_capture_free(SoundCapture *capture, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	if (capture == NULL)
+		return TRUE;
+
+	AsyncWriter *writer = capture->writer;
+	async_writer_stop(writer);
+
+	if (capture->format == CAPTURE_FLAC && capture->blockFrames > 0
+			&& !async_writer_failed(writer, NULL) && !flac_write_frame(capture)) {
+		async_writer_fail(writer);
+	}
+
+	if (!async_writer_failed(writer, NULL)) {
+		gboolean success = capture->format == CAPTURE_FLAC
+				? flac_write_header(capture, TRUE) : wav_write_header(capture);
+		if (!success) {
+			async_writer_fail(writer);
+		}
+	}
+
+	if (fclose(capture->f) != 0) {
+		async_writer_fail(writer);
+	}
+
+	gint errnum;
+	gboolean success = FALSE;
+	if (async_writer_failed(writer, &errnum)) {
+		g_set_error(err, SOUND_CAPTURE_ERROR, G_SOUND_CAPTURE_ERROR_FAILED,
+				"Failed to write the sound capture: %s", g_strerror(errnum));
+	} else if (async_writer_dropped(writer) > 0) {
+		g_set_error(err, SOUND_CAPTURE_ERROR, G_SOUND_CAPTURE_ERROR_OVERRUN,
+				"%d sound samples were dropped while capturing", async_writer_dropped(writer));
+	} else {
+		success = TRUE;
+	}
+
+	async_writer_free(writer);
+	g_checksum_free(capture->md5);
+	g_free(capture);
+
+	return success;
+}
@@ -0,0 +1,86 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef VBAM_SOUNDCAPTURE_H_
+#define VBAM_SOUNDCAPTURE_H_
+
+#include <glib.h>
+
+/* Set up for C function definitions, even when using C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Sound capture error domain
+ */
+#define SOUND_CAPTURE_ERROR (sound_capture_error_quark())
+GQuark sound_capture_error_quark();
+
+/**
+ * Sound capture error types
+ */
+typedef enum
+{
+	G_SOUND_CAPTURE_ERROR_FAILED,
+	G_SOUND_CAPTURE_ERROR_OVERRUN
+} SoundCaptureError;
+
+/**
+ * Opaque streaming sound capture to a WAV or FLAC file
+ *
+ * Samples are handed to a writer thread through a lock-free queue, so
+ * capturing never blocks the emulation thread. When the writer thread falls
+ * behind, samples are dropped rather than waited for, and reported as an
+ * overrun when the capture is stopped.
+ */
+typedef struct SoundCapture SoundCapture;
+
+/**
+ * Create a 16 bit stereo capture file and start its writer thread.
+ * Files with a .flac extension are FLAC encoded, others are WAV files.
+ * @param file capture file name
+ * @param sampleRate sample rate of the captured sound
+ * @param err return location for a GError, or NULL
+ * @return sound capture, or NULL on failure
+ */
+SoundCapture *sound_capture_new(const gchar *file, guint sampleRate, GError **err);
+
+/**
+ * Queue samples to be written. Only one thread may write to a capture.
+ * @param capture sound capture
+ * @param samples interleaved left and right samples
+ * @param frames number of sample pairs
+ */
+void sound_capture_write(SoundCapture *capture, const gint16 *samples, guint frames);
+
+/**
+ * Write the queued samples, complete the file headers and stop the writer
+ * thread. If capture is NULL, it simply returns TRUE.
+ * @param capture sound capture
+ * @param err return location for a GError, or NULL
+ * @return FALSE if writing failed or samples were dropped
+ */
+gboolean sound_capture_free(SoundCapture *capture, GError **err);
+
+/* Ends C function definitions when using C++ */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VBAM_SOUNDCAPTURE_H_ */
@@ -46,6 +46,18 @@ struct SoundDriver {
 	 */
 	void (*write)(SoundDriver *driver, guint16 *finalWave, int length);
 
+	/**
+	 * Get the fill level of the driver output buffer, between 0 and 1.
+	 * Used for dynamic rate control, may be NULL.
+	 */
+	gfloat (*get_buffer_fill)(SoundDriver *driver);
+
+	/**
+	 * Get the time from the samples being written to them being played,
+	 * in microseconds, or -1 when unknown. May be NULL.
+	 */
+	gint (*get_latency)(SoundDriver *driver);
+
 	/**
 	 * Opaque driver specific data
 	 */
@@ -0,0 +1,300 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// fileno and fsync are not part of C99
+#define _DEFAULT_SOURCE
+
+#include "BatteryWriter.h"
+#include "Savestate.h"
+
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+// Journal layout: magic, sector count, sector size, then for each sector
+// its offset and contents, and finally the CRC32 of everything after the magic
+#define JOURNAL_MAGIC "VBABJRN1"
+#define JOURNAL_MAGIC_SIZE 8
+
+struct BatteryWriter {
+	gchar *file;
+	gchar *journal;
+	GThread *thread;
+	GAsyncQueue *queue;
+
+	GMutex lock;
+	GCond idle;
+	guint pending;
+	gchar *error;
+};
+
+// Queued job used to stop the writer thread
+static GByteArray stopJob;
+
+static void journal_append_int(GByteArray *journal, guint32 value) {
+	g_byte_array_append(journal, (const guint8 *)&value, sizeof(value));
+}
+
+static guint32 journal_read_int(const guint8 *data) {
+	guint32 value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+static gboolean file_sync(FILE *f) {
+	return fflush(f) == 0 && fsync(fileno(f)) == 0;
+}
+
+/**
+ * @return whether a journal was completely written
+ */
+static gboolean journal_is_valid(const guint8 *journal, gsize size) {
+	if (size < JOURNAL_MAGIC_SIZE + 3 * sizeof(guint32)
+			|| memcmp(journal, JOURNAL_MAGIC, JOURNAL_MAGIC_SIZE) != 0) {
+		return FALSE;
+	}
+
+	const guint8 *body = journal + JOURNAL_MAGIC_SIZE;
+	gsize bodySize = size - JOURNAL_MAGIC_SIZE - sizeof(guint32);
+	guint32 count = journal_read_int(body);
+	guint32 sectorSize = journal_read_int(body + sizeof(guint32));
+
+	return bodySize == 2 * sizeof(guint32) + (gsize)count * (sizeof(guint32) + sectorSize)
+			&& journal_read_int(body + bodySize) == crc32(0L, body, bodySize);
+}
+
+/**
+ * Write the sectors of a valid journal to the battery file
+ */
+static gboolean journal_apply(const gchar *file, const guint8 *journal, GError **err) {
+	const guint8 *body = journal + JOURNAL_MAGIC_SIZE;
+	guint32 count = journal_read_int(body);
+	guint32 sectorSize = journal_read_int(body + sizeof(guint32));
+
+	FILE *f = fopen(file, "r+b");
+	if (f == NULL && errno == ENOENT) {
+		f = fopen(file, "w+b");
+	}
+
+	if (f == NULL) {
+		g_set_error(err, SAVESTATE_ERROR, G_SAVESTATE_ERROR_FAILED,
+				"Failed to save battery: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	const guint8 *sector = body + 2 * sizeof(guint32);
+	gboolean success = TRUE;
+	for (guint32 i = 0; i < count && success; i++) {
+		guint32 offset = journal_read_int(sector);
+		success = fseek(f, offset, SEEK_SET) == 0
+				&& fwrite(sector + sizeof(guint32), 1, sectorSize, f) == sectorSize;
+		sector += sizeof(guint32) + sectorSize;
+	}
+
+	success = file_sync(f) && success;
+	if (fclose(f) != 0) {
+		success = FALSE;
+	}
+
+	if (!success) {
+		g_set_error(err, SAVESTATE_ERROR, G_SAVESTATE_ERROR_FAILED,
+				"Failed to save battery: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean journal_write(const gchar *journalFile, const GByteArray *journal, GError **err) {
+	FILE *f = fopen(journalFile, "wb");
+	if (f == NULL) {
+		g_set_error(err, SAVESTATE_ERROR, G_SAVESTATE_ERROR_FAILED,
+				"Failed to save battery journal: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	gboolean success = fwrite(journal->data, 1, journal->len, f) == journal->len;
+	success = file_sync(f) && success;
+	if (fclose(f) != 0) {
+		success = FALSE;
+	}
+
+	if (!success) {
+		g_set_error(err, SAVESTATE_ERROR, G_SAVESTATE_ERROR_FAILED,
+				"Failed to save battery journal: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gpointer battery_writer_thread(gpointer data) {
+	BatteryWriter *writer = (BatteryWriter *)data;
+
+	for (;;) {
+		GByteArray *journal = (GByteArray *)g_async_queue_pop(writer->queue);
+		if (journal == &stopJob) {
+			break;
+		}
+
+		GError *err = NULL;
+		if (journal_write(writer->journal, journal, &err)
+				&& journal_apply(writer->file, journal->data, &err)) {
+			g_unlink(writer->journal);
+		}
+
+		g_byte_array_free(journal, TRUE);
+
+		g_mutex_lock(&writer->lock);
+		if (err != NULL) {
+			g_free(writer->error);
+			writer->error = g_strdup(err->message);
+			g_clear_error(&err);
+		}
+		writer->pending--;
+		g_cond_broadcast(&writer->idle);
+		g_mutex_unlock(&writer->lock);
+	}
+
+	return NULL;
+}
+
+BatteryWriter *battery_writer_new(const gchar *file) {
+	BatteryWriter *writer = g_new(BatteryWriter, 1);
+
+	writer->file = g_strdup(file);
+	writer->journal = g_strconcat(file, ".journal", NULL);
+	writer->queue = g_async_queue_new();
+	writer->pending = 0;
+	writer->error = NULL;
+	g_mutex_init(&writer->lock);
+	g_cond_init(&writer->idle);
+
+	writer->thread = g_thread_new("battery-writer", battery_writer_thread, writer);
+
+	return writer;
+}
+
+void battery_writer_write(BatteryWriter *writer, const guint8 *data, gsize sectorSize, guint32 sectors) {
+	g_assert(writer != NULL);
+
+	if (sectors == 0) {
+		return;
+	}
+
+	GByteArray *journal = g_byte_array_new();
+	g_byte_array_append(journal, (const guint8 *)JOURNAL_MAGIC, JOURNAL_MAGIC_SIZE);
+
+	guint32 count = 0;
+	for (guint i = 0; i < 32; i++) {
+		if (sectors & (1u << i)) {
+			count++;
+		}
+	}
+
+	journal_append_int(journal, count);
+	journal_append_int(journal, sectorSize);
+
+	for (guint i = 0; i < 32; i++) {
+		if (sectors & (1u << i)) {
+			journal_append_int(journal, i * sectorSize);
+			g_byte_array_append(journal, data + i * sectorSize, sectorSize);
+		}
+	}
+
+	const guint8 *body = journal->data + JOURNAL_MAGIC_SIZE;
+	journal_append_int(journal, crc32(0L, body, journal->len - JOURNAL_MAGIC_SIZE));
+
+	g_mutex_lock(&writer->lock);
+	writer->pending++;
+	g_mutex_unlock(&writer->lock);
+
+	g_async_queue_push(writer->queue, journal);
+}
+
+gboolean battery_writer_sync(BatteryWriter *writer, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+	g_assert(writer != NULL);
+
+	g_mutex_lock(&writer->lock);
+	while (writer->pending > 0) {
+		g_cond_wait(&writer->idle, &writer->lock);
+	}
+
+	gchar *error = writer->error;
+	writer->error = NULL;
+	g_mutex_unlock(&writer->lock);
+
+	if (error != NULL) {
+		g_set_error(err, SAVESTATE_ERROR, G_SAVESTATE_ERROR_FAILED, "%s", error);
+		g_free(error);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void battery_writer_free(BatteryWriter *writer) {
+	if (writer == NULL)
+		return;
+
+	g_async_queue_push(writer->queue, &stopJob);
+	g_thread_join(writer->thread);
+
+	g_async_queue_unref(writer->queue);
+	g_mutex_clear(&writer->lock);
+	g_cond_clear(&writer->idle);
+	g_free(writer->error);
+	g_free(writer->journal);
+	g_free(writer->file);
+	g_free(writer);
+}
+
+gboolean battery_writer_recover(const gchar *file, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	gchar *journalFile = g_strconcat(file, ".journal", NULL);
+	gchar *journal = NULL;
+	gsize size = 0;
+
+	if (!g_file_get_contents(journalFile, &journal, &size, NULL)) {
+		// Nothing to recover
+		g_free(journalFile);
+		return TRUE;
+	}
+
+	if (journal_is_valid((const guint8 *)journal, size)
+			&& !journal_apply(file, (const guint8 *)journal, err)) {
+		// Keep the journal to try again next time
+		g_free(journal);
+		g_free(journalFile);
+		return FALSE;
+	}
+
+	g_free(journal);
+
+	// A journal that was not completely written is discarded,
+	// the battery file was not modified yet
+	g_unlink(journalFile);
+	g_free(journalFile);
+
+	return TRUE;
+}
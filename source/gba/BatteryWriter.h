@@ -0,0 +1,82 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef VBAM_GBA_BATTERYWRITER_H_
+#define VBAM_GBA_BATTERYWRITER_H_
+
+#include <glib.h>
+
+/* Set up for C function definitions, even when using C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Opaque background battery file writer
+ *
+ * Changed sectors are first written to a journal file next to the battery
+ * file, and only then to the battery file itself. A crash at any point leaves
+ * either the previous or the new contents once the journal is recovered.
+ */
+typedef struct BatteryWriter BatteryWriter;
+
+/**
+ * Start a writer thread for a battery file
+ * @param file battery file name
+ * @return battery writer
+ */
+BatteryWriter *battery_writer_new(const gchar *file);
+
+/**
+ * Queue sectors to be written to the battery file. The data is copied.
+ * @param writer battery writer
+ * @param data battery contents
+ * @param sectorSize size of a sector in bytes
+ * @param sectors bitmask of the sectors to write
+ */
+void battery_writer_write(BatteryWriter *writer, const guint8 *data, gsize sectorSize, guint32 sectors);
+
+/**
+ * Wait for the queued sectors to be written
+ * @param writer battery writer
+ * @param err return location for a GError, or NULL
+ * @return FALSE if a write failed since the last call
+ */
+gboolean battery_writer_sync(BatteryWriter *writer, GError **err);
+
+/**
+ * Write the queued sectors and stop the writer thread.
+ * If writer is NULL, it simply returns.
+ * @param writer battery writer
+ */
+void battery_writer_free(BatteryWriter *writer);
+
+/**
+ * Complete or discard a write interrupted by a crash
+ * @param file battery file name
+ * @param err return location for a GError, or NULL
+ * @return success
+ */
+gboolean battery_writer_recover(const gchar *file, GError **err);
+
+/* Ends C function definitions when using C++ */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VBAM_GBA_BATTERYWRITER_H_ */
@@ -0,0 +1,1091 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <math.h>
+#include <string.h>
+
+#include "Bios.h"
+#include "CPU.h"
+#include "GBA.h"
+#include "Globals.h"
+#include "MMU.h"
+#include "../common/Port.h"
+
+namespace Bios
+{
+
+using CPU::reg;
+
+// Approximate cost of the BIOS functions in clock ticks, not counting
+// the memory accesses which are added using the current wait states.
+// They were estimated from the BIOS loops. "vba_bench --bios FILE" times
+// each function run by a BIOS file and natively, from the same cartridge
+// code: fit these against its output when changing them.
+static const int SWI_TICKS              = 40; // Exception entry, dispatch and return
+static const int DIV_TICKS              = 20;
+static const int DIV_STEP_TICKS         = 13; // Per quotient bit
+static const int SQRT_TICKS             = 20;
+static const int SQRT_STEP_TICKS        = 14; // Per result bit
+static const int ARCTAN_TICKS           = 50;
+static const int CPUSET_UNIT_TICKS      = 5;  // Per halfword or word copied
+static const int CPUFASTSET_BLOCK_TICKS = 6;  // Per block of 8 words copied
+static const int BG_AFFINE_TICKS        = 80; // Per BgAffineSet entry
+static const int OBJ_AFFINE_TICKS       = 60; // Per ObjAffineSet entry
+static const int BITUNPACK_UNIT_TICKS   = 9;  // Per source unit unpacked
+static const int LZ77_BLOCK_TICKS       = 12; // Per flag byte
+static const int LZ77_BYTE_TICKS        = 8;  // Per byte decompressed
+static const int HUFF_BIT_TICKS         = 7;  // Per bit of the compressed stream
+static const int RL_BYTE_TICKS          = 6;  // Per byte decompressed
+static const int DIFF_UNIT_TICKS        = 6;  // Per unit unfiltered
+
+// Where the BIOS IRQ handler accumulates the acknowledged interrupts
+static const u32 BIOS_IF_ADDRESS = 0x03007FF8;
+
+// Replacement BIOS: exception vectors and the IRQ handler
+static const u32 replacementVectors[] =
+{
+	0xE59FF138, // 0x00 Reset: ldr pc, =0x08000000
+	0xE1B0F00E, // 0x04 Undefined instruction: movs pc, lr
+	0xE1B0F00E, // 0x08 SWI, only reached for the unsupported functions: movs pc, lr
+	0xE25EF004, // 0x0C Prefetch abort: subs pc, lr, #4
+	0xE25EF008, // 0x10 Data abort: subs pc, lr, #8
+	0xE1B0F00E, // 0x14 Reserved: movs pc, lr
+	0xEA000042, // 0x18 IRQ: b 0x128
+	0xE25EF004, // 0x1C FIQ: subs pc, lr, #4
+};
+
+static const u32 replacementIrqHandler[] =
+{
+	0xE92D500F, // 0x128 stmfd sp!, {r0-r3, r12, lr}
+	0xE3A00301, // 0x12C mov r0, #0x04000000
+	0xE28FE000, // 0x130 add lr, pc, #0
+	0xE510F004, // 0x134 ldr pc, [r0, #-4]
+	0xE8BD500F, // 0x138 ldmfd sp!, {r0-r3, r12, lr}
+	0xE25EF004, // 0x13C subs pc, lr, #4
+	0x08000000, // 0x140 Cartridge entry point
+};
+
+// sin(i * 2 * pi / 256) in 1.14 fixed point, as in the BIOS
+static const s16 sineTable[256] =
+{
+	0, 402, 803, 1205, 1605, 2005, 2404, 2801,
+	3196, 3589, 3980, 4369, 4756, 5139, 5519, 5896,
+	6269, 6639, 7005, 7366, 7723, 8075, 8423, 8765,
+	9102, 9434, 9759, 10079, 10393, 10701, 11002, 11297,
+	11585, 11866, 12139, 12406, 12665, 12916, 13159, 13395,
+	13622, 13842, 14053, 14255, 14449, 14634, 14810, 14978,
+	15136, 15286, 15426, 15557, 15678, 15790, 15892, 15985,
+	16069, 16142, 16206, 16260, 16305, 16339, 16364, 16379,
+	16384, 16379, 16364, 16339, 16305, 16260, 16206, 16142,
+	16069, 15985, 15892, 15790, 15678, 15557, 15426, 15286,
+	15136, 14978, 14810, 14634, 14449, 14255, 14053, 13842,
+	13622, 13395, 13159, 12916, 12665, 12406, 12139, 11866,
+	11585, 11297, 11002, 10701, 10393, 10079, 9759, 9434,
+	9102, 8765, 8423, 8075, 7723, 7366, 7005, 6639,
+	6269, 5896, 5519, 5139, 4756, 4369, 3980, 3589,
+	3196, 2801, 2404, 2005, 1605, 1205, 803, 402,
+	0, -402, -803, -1205, -1605, -2005, -2404, -2801,
+	-3196, -3589, -3980, -4369, -4756, -5139, -5519, -5896,
+	-6269, -6639, -7005, -7366, -7723, -8075, -8423, -8765,
+	-9102, -9434, -9759, -10079, -10393, -10701, -11002, -11297,
+	-11585, -11866, -12139, -12406, -12665, -12916, -13159, -13395,
+	-13622, -13842, -14053, -14255, -14449, -14634, -14810, -14978,
+	-15136, -15286, -15426, -15557, -15678, -15790, -15892, -15985,
+	-16069, -16142, -16206, -16260, -16305, -16339, -16364, -16379,
+	-16384, -16379, -16364, -16339, -16305, -16260, -16206, -16142,
+	-16069, -15985, -15892, -15790, -15678, -15557, -15426, -15286,
+	-15136, -14978, -14810, -14634, -14449, -14255, -14053, -13842,
+	-13622, -13395, -13159, -12916, -12665, -12406, -12139, -11866,
+	-11585, -11297, -11002, -10701, -10393, -10079, -9759, -9434,
+	-9102, -8765, -8423, -8075, -7723, -7366, -7005, -6639,
+	-6269, -5896, -5519, -5139, -4756, -4369, -3980, -3589,
+	-3196, -2801, -2404, -2005, -1605, -1205, -803, -402
+};
+
+static bool hle = false;
+static bool replacement = false;
+
+// Whether IntrWait is halted, to discard the old flags only once
+static bool intrWaiting = false;
+
+// Unsupported functions already reported
+static u32 reported[8];
+
+void setHLE(bool enable)
+{
+	hle = enable;
+}
+
+void setReplacement(bool enable)
+{
+	replacement = enable;
+	if (!enable)
+		return;
+
+	memset(bios, 0, 0x4000);
+
+	for (u32 i = 0; i < G_N_ELEMENTS(replacementVectors); i++)
+		WRITE32LE(&bios[i * 4], replacementVectors[i]);
+
+	for (u32 i = 0; i < G_N_ELEMENTS(replacementIrqHandler); i++)
+		WRITE32LE(&bios[0x128 + i * 4], replacementIrqHandler[i]);
+}
+
+bool isReplacement()
+{
+	return replacement;
+}
+
+static void jump(u32 address)
+{
+	CPU::armState = true;
+	reg[15].I = address;
+	CPU::armNextPC = reg[15].I;
+	reg[15].I += 4;
+	CPU::ARM_PREFETCH();
+}
+
+// Leave the CPU in system mode with the stacks set up, as the BIOS does
+// before jumping to a program
+static void start(u32 address)
+{
+	CPU::CPUSwitchMode(0x1F, false, false);
+
+	for (int i = 0; i < 15; i++)
+		reg[i].I = 0;
+
+	reg[13].I = 0x03007F00;
+	reg[R13_IRQ].I = 0x03007FA0;
+	reg[R14_IRQ].I = 0;
+	reg[SPSR_IRQ].I = 0;
+	reg[R13_SVC].I = 0x03007FE0;
+	reg[R14_SVC].I = 0;
+	reg[SPSR_SVC].I = 0;
+
+	CPU::armIrqEnable = true;
+	CPU::armState = true;
+	CPU::CPUUpdateCPSR();
+
+	jump(address);
+}
+
+void boot()
+{
+	intrWaiting = false;
+	start(0x08000000);
+}
+
+static void reportUnsupported(int comment)
+{
+	if (reported[comment >> 5] & (1 << (comment & 31)))
+		return;
+
+	reported[comment >> 5] |= 1 << (comment & 31);
+	g_message("Unsupported BIOS function %02x at %08x without a BIOS file", comment,
+	    CPU::armState ? CPU::armNextPC - 4 : CPU::armNextPC - 2);
+}
+
+// Ticks of a sequential access, wait states included
+static int accessTicks(u32 address, u32 unit)
+{
+	int region = (address >> 24) & 15;
+	return (unit == 4 ? memoryWaitSeq32[region] : memoryWaitSeq[region]) + 1;
+}
+
+// The BIOS refuses to read from its own memory
+static bool sourceIsReadable(u32 source, u32 length)
+{
+	return (source & 0x0E000000) != 0 && ((source + length) & 0x0E000000) != 0;
+}
+
+// Execute the current SWI again, once an interrupt has been handled
+static void repeatInstruction()
+{
+	if (CPU::armState)
+	{
+		reg[15].I = CPU::armNextPC - 4;
+		CPU::armNextPC = reg[15].I;
+		reg[15].I += 4;
+		CPU::ARM_PREFETCH();
+	}
+	else
+	{
+		reg[15].I = CPU::armNextPC - 2;
+		CPU::armNextPC = reg[15].I;
+		reg[15].I += 2;
+		CPU::THUMB_PREFETCH();
+	}
+}
+
+// Quotient and remainder rounded toward zero
+static void divide(s32 number, s32 denom, s32 *quotient, s32 *remainder, int *ticks)
+{
+	if (denom == 0)
+	{
+		*quotient = number < 0 ? -1 : 1;
+		*remainder = number;
+		*ticks += DIV_TICKS;
+		return;
+	}
+
+	if (number == G_MININT32 && denom == -1)
+	{
+		*quotient = G_MININT32;
+		*remainder = 0;
+	}
+	else
+	{
+		*quotient = number / denom;
+		*remainder = number % denom;
+	}
+
+	u32 absNumber = number < 0 ? -(u32)number : number;
+	u32 absDenom = denom < 0 ? -(u32)denom : denom;
+	int steps = g_bit_storage(absNumber) - g_bit_storage(absDenom) + 1;
+
+	*ticks += DIV_TICKS + DIV_STEP_TICKS * MAX(steps, 1);
+}
+
+static void swiDiv(int *ticks)
+{
+	s32 quotient, remainder;
+	divide(reg[0].I, reg[1].I, &quotient, &remainder, ticks);
+
+	reg[0].I = quotient;
+	reg[1].I = remainder;
+	reg[3].I = quotient < 0 ? -(u32)quotient : quotient;
+}
+
+static void swiSqrt(int *ticks)
+{
+	u32 n = reg[0].I;
+	u32 root = 0;
+	u32 bit = 1 << 30;
+
+	while (bit > n)
+		bit >>= 2;
+
+	while (bit)
+	{
+		if (n >= root + bit)
+		{
+			n -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+			root >>= 1;
+		bit >>= 2;
+	}
+
+	*ticks += SQRT_TICKS + SQRT_STEP_TICKS * g_bit_storage(root);
+	reg[0].I = root;
+}
+
+static s32 arcTan(s32 i)
+{
+	s32 a = -((s32)((u32)i * (u32)i) >> 14);
+	s32 b = ((0xA9 * a) >> 14) + 0x390;
+	b = ((b * a) >> 14) + 0x91C;
+	b = ((b * a) >> 14) + 0xFB6;
+	b = ((b * a) >> 14) + 0x16AA;
+	b = ((b * a) >> 14) + 0x2081;
+	b = ((b * a) >> 14) + 0x3651;
+	b = ((b * a) >> 14) + 0xA2F9;
+
+	return (i * b) >> 16;
+}
+
+static u32 arcTan2(s32 x, s32 y, int *ticks)
+{
+	if (y == 0)
+		return (x >> 16) & 0x8000;
+
+	if (x == 0)
+		return ((y >> 16) & 0x8000) + 0x4000;
+
+	s32 absX = ABS(x), absY = ABS(y);
+	s32 quotient, remainder;
+
+	if (absX > absY || (absX == absY && !(x < 0 && y < 0)))
+	{
+		divide((u32)y << 14, x, &quotient, &remainder, ticks);
+		s32 angle = arcTan(quotient);
+
+		if (x < 0)
+			return 0x8000 + angle;
+		else
+			return (((y >> 16) & 0x8000) << 1) + angle;
+	}
+	else
+	{
+		divide((u32)x << 14, y, &quotient, &remainder, ticks);
+		s32 angle = arcTan(quotient);
+
+		return (0x4000 + ((y >> 16) & 0x8000)) - angle;
+	}
+}
+
+// Copy or fill count units of a halfword or a word
+static void transfer(u32 dest, u32 source, u32 count, u32 unit, bool fill)
+{
+	u32 length = count * unit;
+	u8 *to = MMU::directRange(dest, length);
+	const u8 *from = MMU::directRange(source, fill ? unit : length);
+
+	if (to != NULL && from != NULL)
+	{
+		if (fill)
+		{
+			u8 value[4];
+			memcpy(value, from, unit);
+			for (u32 i = 0; i < length; i += unit)
+				memcpy(to + i, value, unit);
+		}
+		else if (to <= from || to >= from + length)
+		{
+			memmove(to, from, length);
+		}
+		else
+		{
+			// Forward copy over an overlapping range, repeating the source
+			for (u32 i = 0; i < length; i += unit)
+				memcpy(to + i, from + i, unit);
+		}
+
+		MMU::markRangeDirty(dest, length);
+		return;
+	}
+
+	u32 value = 0;
+	for (u32 i = 0; i < count; i++)
+	{
+		if (!fill || i == 0)
+			value = unit == 4 ? MMU::read32(source) : MMU::read16(source);
+
+		if (unit == 4)
+			MMU::write32(dest, value);
+		else
+			MMU::write16(dest, value);
+
+		if (!fill)
+			source += unit;
+		dest += unit;
+	}
+}
+
+static int transferTicks(u32 dest, u32 source, u32 count, u32 unit, bool fill)
+{
+	int readTicks = accessTicks(source, unit);
+	int writeTicks = accessTicks(dest, unit);
+
+	return fill ? readTicks + count * writeTicks : count * (readTicks + writeTicks);
+}
+
+static void cpuSet(int *ticks)
+{
+	u32 source = reg[0].I;
+	u32 dest = reg[1].I;
+	u32 control = reg[2].I;
+
+	u32 count = control & 0x1FFFFF;
+	u32 unit = (control & (1 << 26)) ? 4 : 2;
+	bool fill = control & (1 << 24);
+
+	source &= ~(unit - 1);
+	dest &= ~(unit - 1);
+
+	if (!sourceIsReadable(source, count * unit))
+		return;
+
+	transfer(dest, source, count, unit, fill);
+
+	*ticks += count * CPUSET_UNIT_TICKS + transferTicks(dest, source, count, unit, fill);
+}
+
+static void cpuFastSet(int *ticks)
+{
+	u32 source = reg[0].I & ~3;
+	u32 dest = reg[1].I & ~3;
+	u32 control = reg[2].I;
+
+	// Copies are done in blocks of 8 words
+	u32 count = ((control & 0x1FFFFF) + 7) & ~7;
+	bool fill = control & (1 << 24);
+
+	if (!sourceIsReadable(source, count * 4))
+		return;
+
+	transfer(dest, source, count, 4, fill);
+
+	*ticks += count / 8 * CPUFASTSET_BLOCK_TICKS + transferTicks(dest, source, count, 4, fill);
+}
+
+static void bgAffineSet(int *ticks)
+{
+	u32 source = reg[0].I;
+	u32 dest = reg[1].I;
+	u32 count = reg[2].I;
+
+	for (u32 i = 0; i < count; i++)
+	{
+		s32 cx = MMU::read32(source);
+		s32 cy = MMU::read32(source + 4);
+		s16 dispx = MMU::read16(source + 8);
+		s16 dispy = MMU::read16(source + 10);
+		s16 rx = MMU::read16(source + 12);
+		s16 ry = MMU::read16(source + 14);
+		u16 theta = MMU::read16(source + 16) >> 8;
+		source += 20;
+
+		s32 a = sineTable[(theta + 0x40) & 255];
+		s32 b = sineTable[theta];
+
+		s16 dx = (rx * a) >> 14;
+		s16 dmx = (rx * b) >> 14;
+		s16 dy = (ry * b) >> 14;
+		s16 dmy = (ry * a) >> 14;
+
+		MMU::write16(dest, dx);
+		MMU::write16(dest + 2, -dmx);
+		MMU::write16(dest + 4, dy);
+		MMU::write16(dest + 6, dmy);
+
+		s32 startx = cx - dx * dispx + dmx * dispy;
+		s32 starty = cy - dy * dispx - dmy * dispy;
+
+		MMU::write32(dest + 8, startx);
+		MMU::write32(dest + 12, starty);
+		dest += 16;
+	}
+
+	*ticks += count * BG_AFFINE_TICKS;
+}
+
+static void objAffineSet(int *ticks)
+{
+	u32 source = reg[0].I;
+	u32 dest = reg[1].I;
+	u32 count = reg[2].I;
+	u32 offset = reg[3].I;
+
+	for (u32 i = 0; i < count; i++)
+	{
+		s16 rx = MMU::read16(source);
+		s16 ry = MMU::read16(source + 2);
+		u16 theta = MMU::read16(source + 4) >> 8;
+		source += 8;
+
+		s32 a = sineTable[(theta + 0x40) & 255];
+		s32 b = sineTable[theta];
+
+		s16 dx = (rx * a) >> 14;
+		s16 dmx = (rx * b) >> 14;
+		s16 dy = (ry * b) >> 14;
+		s16 dmy = (ry * a) >> 14;
+
+		MMU::write16(dest, dx);
+		dest += offset;
+		MMU::write16(dest, -dmx);
+		dest += offset;
+		MMU::write16(dest, dy);
+		dest += offset;
+		MMU::write16(dest, dmy);
+		dest += offset;
+	}
+
+	*ticks += count * OBJ_AFFINE_TICKS;
+}
+
+static void bitUnPack(int *ticks)
+{
+	u32 source = reg[0].I;
+	u32 dest = reg[1].I;
+	u32 header = reg[2].I;
+
+	int length = MMU::read16(header);
+	int bits = MMU::read8(header + 2);
+	int dataSize = MMU::read8(header + 3);
+	u32 base = MMU::read32(header + 4);
+
+	if (!sourceIsReadable(source, length))
+		return;
+
+	if (bits != 1 && bits != 2 && bits != 4 && bits != 8)
+		return;
+
+	bool addBase = base & 0x80000000;
+	base &= 0x7FFFFFFF;
+
+	*ticks += length * (8 / bits) * BITUNPACK_UNIT_TICKS + length * accessTicks(source, 1);
+
+	u32 data = 0;
+	int written = 0;
+
+	for (int i = 0; i < length; i++)
+	{
+		u8 b = MMU::read8(source++);
+
+		for (int shift = 0; shift < 8; shift += bits)
+		{
+			u32 value = (b >> shift) & (0xFF >> (8 - bits));
+			if (value || addBase)
+				value += base;
+
+			data |= value << written;
+			written += dataSize;
+
+			if (written >= 32)
+			{
+				MMU::write32(dest, data);
+				*ticks += accessTicks(dest, 4);
+				dest += 4;
+				data = 0;
+				written = 0;
+			}
+		}
+	}
+}
+
+// Write decompressed data in units of the given size, as the BIOS does.
+// The byte variants must not be used for VRAM, which ignores byte writes.
+static int writeOutput(u32 dest, const u8 *data, u32 length, u32 unit)
+{
+	dest &= ~(unit - 1);
+	length &= ~(unit - 1);
+
+	int region = dest >> 24;
+	int ticks = (length / unit) * accessTicks(dest, unit);
+
+	u8 *to = MMU::directRange(dest, length);
+	if (to != NULL && (unit > 1 || region == 2 || region == 3))
+	{
+		memcpy(to, data, length);
+		MMU::markRangeDirty(dest, length);
+		return ticks;
+	}
+
+	for (u32 i = 0; i < length; i += unit)
+	{
+		if (unit == 1)
+			MMU::write8(dest + i, data[i]);
+		else if (unit == 2)
+			MMU::write16(dest + i, READ16LE(&data[i]));
+		else
+			MMU::write32(dest + i, READ32LE(&data[i]));
+	}
+
+	return ticks;
+}
+
+static u32 readHeader(u32 source)
+{
+	return MMU::read8(source) | (MMU::read8(source + 1) << 8) |
+	    (MMU::read8(source + 2) << 16) | (MMU::read8(source + 3) << 24);
+}
+
+static void lz77UnComp(u32 unit, int *ticks)
+{
+	u32 source = reg[0].I;
+	u32 dest = reg[1].I;
+
+	u32 header = readHeader(source);
+	source += 4;
+
+	u32 length = header >> 8;
+	if (!sourceIsReadable(source, length & 0x1FFFFF))
+		return;
+
+	u8 *out = (u8 *)g_malloc(length + 1);
+	u32 start = source;
+	u32 pos = 0;
+	u32 blocks = 0;
+
+	while (pos < length)
+	{
+		u8 flags = MMU::read8(source++);
+		blocks++;
+
+		for (int i = 0; i < 8 && pos < length; i++, flags <<= 1)
+		{
+			if (flags & 0x80)
+			{
+				u8 b0 = MMU::read8(source++);
+				u8 b1 = MMU::read8(source++);
+				u32 disp = (((b0 & 0x0F) << 8) | b1) + 1;
+				u32 count = (b0 >> 4) + 3;
+
+				for (; count > 0 && pos < length; count--, pos++)
+				{
+					// References before the start read what is already in memory
+					out[pos] = pos >= disp ? out[pos - disp] : MMU::read8(dest + pos - disp);
+				}
+			}
+			else
+			{
+				out[pos++] = MMU::read8(source++);
+			}
+		}
+	}
+
+	*ticks += blocks * LZ77_BLOCK_TICKS + length * LZ77_BYTE_TICKS +
+	    (source - start) * accessTicks(start, 1) + writeOutput(dest, out, length, unit);
+
+	g_free(out);
+}
+
+static void huffUnComp(int *ticks)
+{
+	u32 source = reg[0].I & ~3;
+	u32 dest = reg[1].I & ~3;
+
+	u32 header = readHeader(source);
+	u32 length = header >> 8;
+	int dataBits = header & 0x0F;
+
+	if (!sourceIsReadable(source, length & 0x1FFFFF))
+		return;
+
+	if (dataBits != 4 && dataBits != 8)
+		return;
+
+	// The tree is at most 512 bytes, starting with its size
+	u8 tree[512];
+	u32 treeLength = (MMU::read8(source + 4) + 1) * 2;
+	for (u32 i = 0; i < treeLength; i++)
+		tree[i] = MMU::read8(source + 4 + i);
+
+	u32 stream = source + 4 + treeLength;
+
+	// The output is written by words
+	u32 outLength = (length + 3) & ~3;
+	u8 *out = (u8 *)g_malloc(outLength + 4);
+	u32 pos = 0;
+	u32 data = 0;
+	int written = 0;
+	u32 node = 1;
+	u32 steps = 0;
+
+	while (pos < length)
+	{
+		u32 bits = MMU::read32(stream);
+		stream += 4;
+
+		for (int i = 31; i >= 0 && pos < length; i--, steps++)
+		{
+			bool right = (bits >> i) & 1;
+			u8 value = tree[node];
+			u32 child = (node & ~1) + (value & 0x3F) * 2 + 2 + right;
+
+			if (child >= treeLength)
+			{
+				// Malformed tree, stop like the BIOS would go astray
+				length = pos;
+				break;
+			}
+
+			if (value & (right ? 0x40 : 0x80))
+			{
+				data |= (tree[child] & (0xFF >> (8 - dataBits))) << written;
+				written += dataBits;
+				node = 1;
+
+				if (written == 32)
+				{
+					WRITE32LE(&out[pos], data);
+					pos += 4;
+					data = 0;
+					written = 0;
+				}
+			}
+			else
+			{
+				node = child;
+			}
+		}
+	}
+
+	*ticks += steps * HUFF_BIT_TICKS + (stream - source) * accessTicks(source, 4) / 4 +
+	    writeOutput(dest, out, pos, 4);
+
+	g_free(out);
+}
+
+static void rlUnComp(u32 unit, int *ticks)
+{
+	u32 source = reg[0].I;
+	u32 dest = reg[1].I;
+
+	u32 header = readHeader(source);
+	source += 4;
+
+	u32 length = header >> 8;
+	if (!sourceIsReadable(source, length & 0x1FFFFF))
+		return;
+
+	u8 *out = (u8 *)g_malloc(length + 1);
+	u32 start = source;
+	u32 pos = 0;
+
+	while (pos < length)
+	{
+		u8 d = MMU::read8(source++);
+
+		if (d & 0x80)
+		{
+			u32 count = (d & 0x7F) + 3;
+			u8 b = MMU::read8(source++);
+			for (; count > 0 && pos < length; count--)
+				out[pos++] = b;
+		}
+		else
+		{
+			u32 count = (d & 0x7F) + 1;
+			for (; count > 0 && pos < length; count--)
+				out[pos++] = MMU::read8(source++);
+		}
+	}
+
+	*ticks += length * RL_BYTE_TICKS + (source - start) * accessTicks(start, 1) +
+	    writeOutput(dest, out, length, unit);
+
+	g_free(out);
+}
+
+static void diff8bitUnFilter(u32 unit, int *ticks)
+{
+	u32 source = reg[0].I;
+	u32 dest = reg[1].I;
+
+	u32 header = readHeader(source);
+	source += 4;
+
+	u32 length = header >> 8;
+	if (!sourceIsReadable(source, length & 0x1FFFFF))
+		return;
+
+	u8 *out = (u8 *)g_malloc(length + 1);
+	u8 data = 0;
+
+	for (u32 i = 0; i < length; i++)
+	{
+		data += MMU::read8(source + i);
+		out[i] = data;
+	}
+
+	*ticks += length * (DIFF_UNIT_TICKS + accessTicks(source, 1)) + writeOutput(dest, out, length, unit);
+
+	g_free(out);
+}
+
+static void diff16bitUnFilter(int *ticks)
+{
+	u32 source = reg[0].I;
+	u32 dest = reg[1].I;
+
+	u32 header = readHeader(source);
+	source += 4;
+
+	u32 length = (header >> 8) & ~1;
+	if (!sourceIsReadable(source, length & 0x1FFFFF))
+		return;
+
+	u8 *out = (u8 *)g_malloc(length + 2);
+	u16 data = 0;
+
+	for (u32 i = 0; i < length; i += 2)
+	{
+		data += MMU::read16(source + i);
+		WRITE16LE(&out[i], data);
+	}
+
+	*ticks += length / 2 * (DIFF_UNIT_TICKS + accessTicks(source, 2)) + writeOutput(dest, out, length, 2);
+
+	g_free(out);
+}
+
+static void softReset()
+{
+	// The flag selects the entry point: work RAM or cartridge
+	u8 flag = MMU::read8(0x03007FFA);
+
+	memset(&internalRAM[0x7E00], 0, 0x200);
+	MMU::markRangeDirty(0x03007E00, 0x200);
+
+	intrWaiting = false;
+	start(flag ? 0x02000000 : 0x08000000);
+}
+
+static void registerRamReset(u32 flags)
+{
+	if (flags & 0x01)
+	{
+		memset(workRAM, 0, 0x40000);
+		MMU::markRangeDirty(0x02000000, 0x40000);
+	}
+
+	if (flags & 0x02)
+	{
+		// Without the stacks and the BIOS variables
+		memset(internalRAM, 0, 0x7E00);
+		MMU::markRangeDirty(0x03000000, 0x7E00);
+	}
+
+	if (flags & 0x04)
+	{
+		memset(paletteRAM, 0, 0x400);
+		MMU::markRangeDirty(0x05000000, 0x400);
+	}
+
+	if (flags & 0x08)
+	{
+		memset(vram, 0, 0x18000);
+		MMU::markRangeDirty(0x06000000, 0x18000);
+	}
+
+	if (flags & 0x10)
+	{
+		memset(oam, 0, 0x400);
+		MMU::markRangeDirty(0x07000000, 0x400);
+	}
+
+	if (flags & 0x20)
+	{
+		for (u32 address = 0x120; address < 0x130; address += 2)
+			MMU::write16(0x04000000 + address, 0);
+		MMU::write16(0x04000134, 0x8000);
+	}
+
+	if (flags & 0x40)
+	{
+		for (u32 address = 0x60; address < 0x88; address += 2)
+			MMU::write16(0x04000000 + address, 0);
+		for (u32 address = 0x90; address < 0xA0; address += 2)
+			MMU::write16(0x04000000 + address, 0);
+	}
+
+	if (flags & 0x80)
+	{
+		MMU::write16(0x04000000, 0x0080);
+		for (u32 address = 0x04; address < 0x60; address += 2)
+			MMU::write16(0x04000000 + address, 0);
+		MMU::write16(0x04000020, 0x0100);
+		MMU::write16(0x04000026, 0x0100);
+		MMU::write16(0x04000030, 0x0100);
+		MMU::write16(0x04000036, 0x0100);
+
+		for (u32 address = 0xB0; address < 0xE0; address += 2)
+			MMU::write16(0x04000000 + address, 0);
+		for (u32 address = 0x100; address < 0x110; address += 2)
+			MMU::write16(0x04000000 + address, 0);
+
+		MMU::write16(0x04000132, 0);
+		MMU::write16(0x04000200, 0);
+		MMU::write16(0x04000204, 0);
+		MMU::write16(0x04000208, 0);
+	}
+}
+
+static void hardReset()
+{
+	// Everything is cleared as when powering on, the BIOS variables
+	// included, and the cartridge always restarts
+	registerRamReset(0xFF);
+	memset(&internalRAM[0x7E00], 0, 0x200);
+	MMU::markRangeDirty(0x03007E00, 0x200);
+
+	intrWaiting = false;
+	start(0x08000000);
+}
+
+static void intrWait(bool discard, u16 flags)
+{
+	// Interrupts are enabled while waiting
+	MMU::write16(0x04000208, 1);
+
+	u16 biosIF = MMU::read16(BIOS_IF_ADDRESS);
+	if (discard && !intrWaiting)
+		biosIF &= ~flags;
+
+	if (biosIF & flags)
+	{
+		MMU::write16(BIOS_IF_ADDRESS, biosIF & ~flags);
+		intrWaiting = false;
+		return;
+	}
+
+	MMU::write16(BIOS_IF_ADDRESS, biosIF);
+	intrWaiting = true;
+
+	// Halt, and check again when the IRQ handler returns to the SWI
+	repeatInstruction();
+	MMU::write8(0x04000301, 0);
+}
+
+static void soundBias()
+{
+	u16 bias = MMU::read16(0x04000088) & ~0x3FE;
+	if (reg[0].I)
+		bias |= 0x200;
+	MMU::write16(0x04000088, bias);
+}
+
+static void midiKey2Freq()
+{
+	u32 freq = MMU::read32(reg[0].I + 4);
+	double exponent = ((180.0 - reg[1].I) - (reg[2].I / 256.0)) / 12.0;
+
+	reg[0].I = (u32)(freq / pow(2.0, exponent));
+}
+
+// Functions worth performing natively even with a BIOS file
+static bool hleFunction(int comment, int *ticks)
+{
+	switch (comment)
+	{
+	case 0x06:
+		swiDiv(ticks);
+		return true;
+	case 0x07:
+	{
+		u32 number = reg[0].I;
+		reg[0].I = reg[1].I;
+		reg[1].I = number;
+		swiDiv(ticks);
+		return true;
+	}
+	case 0x08:
+		swiSqrt(ticks);
+		return true;
+	case 0x09:
+		reg[0].I = arcTan(reg[0].I);
+		*ticks += ARCTAN_TICKS;
+		return true;
+	case 0x0A:
+		reg[0].I = arcTan2(reg[0].I, reg[1].I, ticks);
+		*ticks += ARCTAN_TICKS;
+		return true;
+	case 0x0B:
+		cpuSet(ticks);
+		return true;
+	case 0x0C:
+		cpuFastSet(ticks);
+		return true;
+	case 0x0E:
+		bgAffineSet(ticks);
+		return true;
+	case 0x0F:
+		objAffineSet(ticks);
+		return true;
+	case 0x10:
+		bitUnPack(ticks);
+		return true;
+	case 0x11:
+		lz77UnComp(1, ticks);
+		return true;
+	case 0x12:
+		lz77UnComp(2, ticks);
+		return true;
+	case 0x13:
+		huffUnComp(ticks);
+		return true;
+	case 0x14:
+		rlUnComp(1, ticks);
+		return true;
+	case 0x15:
+		rlUnComp(2, ticks);
+		return true;
+	case 0x16:
+		diff8bitUnFilter(1, ticks);
+		return true;
+	case 0x17:
+		diff8bitUnFilter(2, ticks);
+		return true;
+	case 0x18:
+		diff16bitUnFilter(ticks);
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Functions only the replacement BIOS needs
+static bool replacementFunction(int comment)
+{
+	switch (comment)
+	{
+	case 0x00:
+		softReset();
+		return true;
+	case 0x26: // HardReset, without the boot logo
+		hardReset();
+		return true;
+	case 0x01:
+		registerRamReset(reg[0].I);
+		return true;
+	case 0x02:
+		MMU::write8(0x04000301, 0);
+		return true;
+	case 0x03:
+		MMU::write8(0x04000301, 0x80);
+		return true;
+	case 0x04:
+		intrWait(reg[0].I != 0, reg[1].I);
+		return true;
+	case 0x05:
+		intrWait(true, 1);
+		return true;
+	case 0x0D:
+		reg[0].I = 0xBAAE187F;
+		return true;
+	case 0x19:
+		soundBias();
+		return true;
+	case 0x1F:
+		midiKey2Freq();
+		return true;
+	case 0x25: // MultiBoot, no link cable transfer
+		reg[0].I = 1;
+		return true;
+	case 0x27:
+		MMU::write8(0x04000301, reg[2].I);
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool softwareInterrupt(int comment, int *ticks)
+{
+	if (!hle && !replacement)
+		return false;
+
+	*ticks = SWI_TICKS;
+
+	if (hleFunction(comment, ticks))
+		return true;
+
+	if (!replacement)
+		return false;
+
+	if (!replacementFunction(comment))
+		reportUnsupported(comment);
+
+	return true;
+}
+
+} // namespace Bios
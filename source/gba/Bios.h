@@ -0,0 +1,53 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef VBAM_GBA_BIOS_H_
+#define VBAM_GBA_BIOS_H_
+
+#include "../common/Types.h"
+
+// High level emulation of the BIOS software interrupts.
+//
+// With a BIOS file, the math, memory copy, affine and decompression
+// functions can be performed natively instead of interpreting the BIOS code.
+// Without one, a small replacement BIOS only handles the exception vectors,
+// and every function it would provide is performed natively.
+namespace Bios
+{
+
+// Perform the frequently used functions natively even with a BIOS file
+void setHLE(bool enable);
+
+// Install the replacement BIOS in the BIOS memory when enabled,
+// otherwise the BIOS memory holds a BIOS file
+void setReplacement(bool enable);
+
+// Whether the replacement BIOS is in use, rather than a BIOS file
+bool isReplacement();
+
+// Set the CPU state the BIOS leaves when starting the cartridge,
+// used to boot without a BIOS file
+void boot();
+
+// Perform a software interrupt natively, if supported.
+// Returns true if it was, and the number of clock ticks it took in ticks.
+bool softwareInterrupt(int comment, int *ticks);
+
+} // namespace Bios
+
+#endif // VBAM_GBA_BIOS_H_
@@ -2,6 +2,8 @@
 #include "GBA.h"
 #include "Globals.h"
 #include "MMU.h"
+#include "Bios.h"
+#include "EventLog.h"
 #include "../common/Settings.h"
 
 #include <algorithm>
@@ -38,6 +40,8 @@ void init()
 
 		cpuBitsSet[i] = count;
 	}
+
+	updateWaitStates();
 }
 
 void reset()
@@ -96,206 +100,92 @@ static void CPUSwap(u32 *a, u32 *b)
 }
 #endif
 
-// Waitstates when accessing data
-int dataTicksAccess16(u32 address) // DATA 8/16bits NON SEQ
-{
-	int addr = (address>>24)&15;
-	int value =  memoryWait[addr];
+// Timing of each memory region for the current wait states
+RegionTiming regionTimings[16];
 
-	if ((addr>=0x08) || (addr < 0x02))
-	{
-		busPrefetchCount=0;
-		busPrefetch=false;
-	}
-	else if (busPrefetch)
-	{
-		int waitState = value;
-		if (!waitState)
-			waitState = 1;
-		busPrefetchCount = ((busPrefetchCount+1)<<waitState) - 1;
-	}
+// Prefetch buffer actions of opcode fetches: number of prefetched opcodes
+// consumed from busPrefetchCount, or reset the count
+static const int PREFETCH_RESET = -1;
 
-	return value;
-}
-
-int dataTicksAccess32(u32 address) // DATA 32bits NON SEQ
+static void setCodeTiming(CodeTiming &timing, u32 state, int ticks, int action)
 {
-	int addr = (address>>24)&15;
-	int value = memoryWait32[addr];
-
-	if ((addr>=0x08) || (addr < 0x02))
-	{
-		busPrefetchCount=0;
-		busPrefetch=false;
-	}
-	else if (busPrefetch)
-	{
-		int waitState = value;
-		if (!waitState)
-			waitState = 1;
-		busPrefetchCount = ((busPrefetchCount+1)<<waitState) - 1;
-	}
+	u32 packed = action == PREFETCH_RESET ? 0 : (action | PREFETCH_KEEP);
 
-	return value;
+	timing.ticks |= (u64)(u8)ticks << (state * 8);
+	timing.actions |= packed << (state * 4);
 }
 
-int dataTicksAccessSeq16(u32 address)// DATA 8/16bits SEQ
+void updateWaitStates()
 {
-	int addr = (address>>24)&15;
-	int value = memoryWaitSeq[addr];
-
-	if ((addr>=0x08) || (addr < 0x02))
+	for (int region = 0; region < 16; region++)
 	{
-		busPrefetchCount=0;
-		busPrefetch=false;
-	}
-	else if (busPrefetch)
-	{
-		int waitState = value;
-		if (!waitState)
-			waitState = 1;
-		busPrefetchCount = ((busPrefetchCount+1)<<waitState) - 1;
-	}
+		RegionTiming &timing = regionTimings[region];
 
-	return value;
-}
-
-int dataTicksAccessSeq32(u32 address)// DATA 32bits SEQ
-{
-	int addr = (address>>24)&15;
-	int value =  memoryWaitSeq32[addr];
-
-	if ((addr>=0x08) || (addr < 0x02))
-	{
-		busPrefetchCount=0;
-		busPrefetch=false;
-	}
-	else if (busPrefetch)
-	{
-		int waitState = value;
-		if (!waitState)
-			waitState = 1;
-		busPrefetchCount = ((busPrefetchCount+1)<<waitState) - 1;
-	}
+		// Data accesses to the BIOS and the cartridge stop the prefetch,
+		// other accesses let it fill according to their wait states
+		int dataTicks[ACCESS_TYPES] =
+		{
+			memoryWait[region], memoryWait32[region], memoryWaitSeq[region], memoryWaitSeq32[region]
+		};
 
-	return value;
-}
+		for (int type = 0; type < ACCESS_TYPES; type++)
+		{
+			timing.data[type].ticks = dataTicks[type];
+			timing.data[type].fillShift = dataTicks[type] ? dataTicks[type] : 1;
+			timing.data[type].keepsPrefetch = region >= 0x02 && region < 0x08;
 
+			timing.code[type].ticks = 0;
+			timing.code[type].actions = 0;
+		}
 
-// Waitstates when executing opcode
-int codeTicksAccess16(u32 address) // THUMB NON SEQ
-{
-	int addr = (address>>24)&15;
+		// Only opcodes fetched from the game pak go through the prefetch buffer
+		bool gamePak = region >= 0x08 && region <= 0x0D;
+		CodeTiming *code = timing.code;
 
-	if ((addr>=0x08) && (addr<=0x0D))
-	{
-		if (busPrefetchCount&0x1)
+		for (u32 state = 0; state < PREFETCH_STATES; state++)
 		{
-			if (busPrefetchCount&0x2)
+			bool ready = state & 1;             // busPrefetchCount bit 0
+			bool readyTwice = (state & 3) == 3; // busPrefetchCount bits 0 and 1
+			bool pending = state & 4;           // busPrefetchCount > 0xFF
+
+			if (!gamePak)
 			{
-				busPrefetchCount = ((busPrefetchCount&0xFF)>>2) | (busPrefetchCount&0xFFFFFF00);
-				return 0;
+				setCodeTiming(code[ACCESS_NSEQ16], state, memoryWait[region], PREFETCH_RESET);
+				setCodeTiming(code[ACCESS_NSEQ32], state, memoryWait32[region], PREFETCH_RESET);
+				setCodeTiming(code[ACCESS_SEQ16], state, memoryWaitSeq[region], PREFETCH_RESET);
+				setCodeTiming(code[ACCESS_SEQ32], state, memoryWaitSeq32[region], 0);
 			}
-			busPrefetchCount = ((busPrefetchCount&0xFF)>>1) | (busPrefetchCount&0xFFFFFF00);
-			return memoryWaitSeq[addr]-1;
-		}
-		else
-		{
-			busPrefetchCount=0;
-			return memoryWait[addr];
-		}
-	}
-	else
-	{
-		busPrefetchCount = 0;
-		return memoryWait[addr];
-	}
-}
-
-int codeTicksAccess32(u32 address) // ARM NON SEQ
-{
-	int addr = (address>>24)&15;
-
-	if ((addr>=0x08) && (addr<=0x0D))
-	{
-		if (busPrefetchCount&0x1)
-		{
-			if (busPrefetchCount&0x2)
+			else if (readyTwice)
 			{
-				busPrefetchCount = ((busPrefetchCount&0xFF)>>2) | (busPrefetchCount&0xFFFFFF00);
-				return 0;
+				setCodeTiming(code[ACCESS_NSEQ16], state, 0, 2);
+				setCodeTiming(code[ACCESS_NSEQ32], state, 0, 2);
+				setCodeTiming(code[ACCESS_SEQ16], state, 0, 1);
+				setCodeTiming(code[ACCESS_SEQ32], state, 0, 2);
 			}
-			busPrefetchCount = ((busPrefetchCount&0xFF)>>1) | (busPrefetchCount&0xFFFFFF00);
-			return memoryWaitSeq[addr] - 1;
-		}
-		else
-		{
-			busPrefetchCount = 0;
-			return memoryWait32[addr];
-		}
-	}
-	else
-	{
-		busPrefetchCount = 0;
-		return memoryWait32[addr];
-	}
-}
-
-int codeTicksAccessSeq16(u32 address) // THUMB SEQ
-{
-	int addr = (address>>24)&15;
-
-	if ((addr>=0x08) && (addr<=0x0D))
-	{
-		if (busPrefetchCount&0x1)
-		{
-			busPrefetchCount = ((busPrefetchCount&0xFF)>>1) | (busPrefetchCount&0xFFFFFF00);
-			return 0;
-		}
-		else
-			if (busPrefetchCount>0xFF)
+			else if (ready)
 			{
-				busPrefetchCount=0;
-				return memoryWait[addr];
+				setCodeTiming(code[ACCESS_NSEQ16], state, memoryWaitSeq[region] - 1, 1);
+				setCodeTiming(code[ACCESS_NSEQ32], state, memoryWaitSeq[region] - 1, 1);
+				setCodeTiming(code[ACCESS_SEQ16], state, 0, 1);
+				setCodeTiming(code[ACCESS_SEQ32], state, memoryWaitSeq[region], 1);
 			}
 			else
-				return memoryWaitSeq[addr];
-	}
-	else
-	{
-		busPrefetchCount = 0;
-		return memoryWaitSeq[addr];
-	}
-}
-
-int codeTicksAccessSeq32(u32 address) // ARM SEQ
-{
-	int addr = (address>>24)&15;
-
-	if ((addr>=0x08) && (addr<=0x0D))
-	{
-		if (busPrefetchCount&0x1)
-		{
-			if (busPrefetchCount&0x2)
 			{
-				busPrefetchCount = ((busPrefetchCount&0xFF)>>2) | (busPrefetchCount&0xFFFFFF00);
-				return 0;
+				setCodeTiming(code[ACCESS_NSEQ16], state, memoryWait[region], PREFETCH_RESET);
+				setCodeTiming(code[ACCESS_NSEQ32], state, memoryWait32[region], PREFETCH_RESET);
+
+				if (pending)
+				{
+					setCodeTiming(code[ACCESS_SEQ16], state, memoryWait[region], PREFETCH_RESET);
+					setCodeTiming(code[ACCESS_SEQ32], state, memoryWait32[region], PREFETCH_RESET);
+				}
+				else
+				{
+					setCodeTiming(code[ACCESS_SEQ16], state, memoryWaitSeq[region], 0);
+					setCodeTiming(code[ACCESS_SEQ32], state, memoryWaitSeq32[region], 0);
+				}
 			}
-			busPrefetchCount = ((busPrefetchCount&0xFF)>>1) | (busPrefetchCount&0xFFFFFF00);
-			return memoryWaitSeq[addr];
 		}
-		else
-			if (busPrefetchCount>0xFF)
-			{
-				busPrefetchCount=0;
-				return memoryWait32[addr];
-			}
-			else
-				return memoryWaitSeq32[addr];
-	}
-	else
-	{
-		return memoryWaitSeq32[addr];
 	}
 }
 
@@ -448,22 +338,21 @@ void CPUSoftwareInterrupt()
 	reg[15].I += 4;
 }
 
-void CPUSoftwareInterrupt(int comment)
+int CPUSoftwareInterrupt(int comment)
 {
 	if (armState) comment >>= 16;
 
 #ifdef GBA_LOGGING
-	if (settings_log_channel_enabled(LOG_SWI))
-	{
-		g_message("SWI: %08x at %08x (0x%08x,0x%08x,0x%08x,VCOUNT = %2d)\n", comment,
-		    armState ? armNextPC - 4: armNextPC -2,
-		    reg[0].I,
-		    reg[1].I,
-		    reg[2].I,
-		    VCOUNT);
-	}
+	EVENT_LOG(LOG_SWI, armState ? armNextPC - 4 : armNextPC - 2, comment,
+	    reg[0].I, reg[1].I, reg[2].I);
 #endif
+
+	int ticks;
+	if (Bios::softwareInterrupt(comment & 0xFF, &ticks))
+		return ticks;
+
 	CPUSoftwareInterrupt();
+	return 0;
 }
 
 void CPUUpdateCPSR()
@@ -68,14 +68,89 @@ void enableBusPrefetch(bool enable);
 int armExecute();
 int thumbExecute();
 
-int dataTicksAccess16(u32 address);
-int dataTicksAccess32(u32 address);
-int dataTicksAccessSeq16(u32 address);
-int dataTicksAccessSeq32(u32 address);
-int codeTicksAccess16(u32 address);
-int codeTicksAccess32(u32 address);
-int codeTicksAccessSeq16(u32 address);
-int codeTicksAccessSeq32(u32 address);
+enum AccessType
+{
+	ACCESS_NSEQ16,
+	ACCESS_NSEQ32,
+	ACCESS_SEQ16,
+	ACCESS_SEQ32,
+	ACCESS_TYPES
+};
+
+// State of the prefetch buffer as seen by an opcode fetch: bits 0 and 1
+// of busPrefetchCount, and bit 2 set when busPrefetchCount > 0xFF
+#define PREFETCH_STATES 8
+
+// Opcode fetch timing for each prefetch state, packed so that the lookup
+// only depends on the address and the state merely selects a field
+struct CodeTiming
+{
+	u64 ticks;   // 8 bits per state
+	u32 actions; // 4 bits per state: prefetched opcodes consumed from
+	             // busPrefetchCount in bits 0-1, bit 2 clear to reset it
+};
+
+#define PREFETCH_KEEP 4
+
+struct DataTiming
+{
+	u8 ticks;
+	u8 fillShift;     // busPrefetchCount growth while the prefetch is running
+	u8 keepsPrefetch; // 0 when the access stops the prefetch
+};
+
+struct RegionTiming
+{
+	CodeTiming code[ACCESS_TYPES];
+	DataTiming data[ACCESS_TYPES];
+};
+
+// Timing of each memory region, indexed by address >> 24
+extern RegionTiming regionTimings[16];
+
+// Rebuild the timing tables after a change of the memoryWait arrays
+void updateWaitStates();
+
+// Waitstates when accessing data
+inline int dataTicksAccess(AccessType type, u32 address)
+{
+	const DataTiming &timing = regionTimings[(address >> 24) & 15].data[type];
+
+	if (!timing.keepsPrefetch)
+	{
+		busPrefetchCount = 0;
+		busPrefetch = false;
+	}
+	else if (busPrefetch)
+	{
+		busPrefetchCount = ((busPrefetchCount + 1) << timing.fillShift) - 1;
+	}
+
+	return timing.ticks;
+}
+
+// Waitstates when executing opcode
+inline int codeTicksAccess(AccessType type, u32 address)
+{
+	const CodeTiming &timing = regionTimings[(address >> 24) & 15].code[type];
+
+	u32 state = (busPrefetchCount & 3) | ((busPrefetchCount > 0xFF) << 2);
+	u32 action = timing.actions >> (state * 4);
+
+	u32 next = ((busPrefetchCount & 0xFF) >> (action & 3)) | (busPrefetchCount & 0xFFFFFF00);
+	busPrefetchCount = (action & PREFETCH_KEEP) ? next : 0;
+
+	return (u8)(timing.ticks >> (state * 8));
+}
+
+inline int dataTicksAccess16(u32 address) { return dataTicksAccess(ACCESS_NSEQ16, address); }
+inline int dataTicksAccess32(u32 address) { return dataTicksAccess(ACCESS_NSEQ32, address); }
+inline int dataTicksAccessSeq16(u32 address) { return dataTicksAccess(ACCESS_SEQ16, address); }
+inline int dataTicksAccessSeq32(u32 address) { return dataTicksAccess(ACCESS_SEQ32, address); }
+inline int codeTicksAccess16(u32 address) { return codeTicksAccess(ACCESS_NSEQ16, address); }
+inline int codeTicksAccess32(u32 address) { return codeTicksAccess(ACCESS_NSEQ32, address); }
+inline int codeTicksAccessSeq16(u32 address) { return codeTicksAccess(ACCESS_SEQ16, address); }
+inline int codeTicksAccessSeq32(u32 address) { return codeTicksAccess(ACCESS_SEQ32, address); }
 
 void CPUSwitchMode(int mode, bool saveState);
 void CPUSwitchMode(int mode, bool saveState, bool breakLoop);
@@ -84,7 +159,8 @@ void CPUUpdateFlags(bool breakLoop);
 void CPUUpdateFlags();
 void CPUUndefinedException();
 void CPUSoftwareInterrupt();
-void CPUSoftwareInterrupt(int comment);
+// Returns the ticks taken by the BIOS function if it was performed natively
+int CPUSoftwareInterrupt(int comment);
 
 inline void ARM_PREFETCH()
 {
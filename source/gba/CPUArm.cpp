@@ -1,7 +1,10 @@
 #include "GBA.h"
 #include "CPU.h"
+#include "EventLog.h"
 #include "Globals.h"
 #include "MMU.h"
+#include "PerfCounters.h"
+#include "Profiler.h"
 #include "../common/Settings.h"
 
 namespace CPU
@@ -14,11 +17,7 @@ static int clockTicks;
 static INSN_REGPARM void armUnknownInsn(u32 opcode)
 {
 #ifdef GBA_LOGGING
-	if (settings_log_channel_enabled(LOG_UNDEFINED))
-	{
-		g_message("Undefined ARM instruction %08x at %08x\n", opcode,
-		    armNextPC-4);
-	}
+	EVENT_LOG(LOG_UNDEFINED, armNextPC - 4, opcode, FALSE, 0, 0);
 #endif
 	CPUUndefinedException();
 }
@@ -2563,7 +2562,7 @@ static INSN_REGPARM void armF00(u32 opcode)
 	clockTicks = codeTicksAccessSeq32(armNextPC) + 1;
 	clockTicks = (clockTicks * 2) + codeTicksAccess32(armNextPC) + 1;
 	busPrefetchCount = 0;
-	CPUSoftwareInterrupt(opcode & 0x00FFFFFF);
+	clockTicks += CPUSoftwareInterrupt(opcode & 0x00FFFFFF);
 }
 
 // Instruction table //////////////////////////////////////////////////////
@@ -2840,6 +2839,8 @@ int armExecute()
 			}
 		}
 
+		perfCounters.armInstructions++;
+
 		if (cond_res)
 			(*armInsnTable[((opcode>>16)&0xFF0) | ((opcode>>4)&0x0F)])(opcode);
 
@@ -2849,6 +2850,8 @@ int armExecute()
 			clockTicks = 1 + codeTicksAccessSeq32(oldArmNextPC);
 		cpuTotalTicks += clockTicks;
 
+		PROFILER_INSTRUCTION(clockTicks, oldArmNextPC, FALSE);
+
 	}
 	while (cpuTotalTicks<cpuNextEvent && armState && !holdState);
 
@@ -1,7 +1,10 @@
 #include "GBA.h"
 #include "CPU.h"
+#include "EventLog.h"
 #include "Globals.h"
 #include "MMU.h"
+#include "PerfCounters.h"
+#include "Profiler.h"
 #include "../common/Settings.h"
 
 namespace CPU
@@ -14,8 +17,7 @@ static int clockTicks;
 static INSN_REGPARM void thumbUnknownInsn(u32 opcode)
 {
 #ifdef GBA_LOGGING
-	if (settings_log_channel_enabled(LOG_UNDEFINED))
-		g_message("Undefined THUMB instruction %04x at %08x\n", opcode, armNextPC-2);
+	EVENT_LOG(LOG_UNDEFINED, armNextPC - 2, opcode, TRUE, 0, 0);
 #endif
 	CPUUndefinedException();
 }
@@ -1313,7 +1315,7 @@ static INSN_REGPARM void thumbDF(u32 opcode)
 	u32 address = 0;
 	clockTicks = 3;
 	busPrefetchCount=0;
-	CPUSoftwareInterrupt(opcode & 0xFF);
+	clockTicks += CPUSoftwareInterrupt(opcode & 0xFF);
 }
 
 // B offset
@@ -1516,6 +1518,8 @@ int thumbExecute()
 		reg[15].I += 2;
 		THUMB_PREFETCH_NEXT();
 
+		perfCounters.thumbInstructions++;
+
 		(*thumbInsnTable[opcode>>6])(opcode);
 
 		if (clockTicks < 0)
@@ -1526,6 +1530,8 @@ int thumbExecute()
 
 		cpuTotalTicks += clockTicks;
 
+		PROFILER_INSTRUCTION(clockTicks, oldArmNextPC, TRUE);
+
 	}
 	while (cpuTotalTicks < cpuNextEvent && !armState && !holdState);
 
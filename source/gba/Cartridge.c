@@ -1,9 +1,13 @@
+// MAP_ANONYMOUS is not part of C99
+#define _DEFAULT_SOURCE
+
 #include "Globals.h"
 #include "Cartridge.h"
 #include "CartridgeEEprom.h"
 #include "CartridgeFlash.h"
 #include "CartridgeRTC.h"
 #include "CartridgeSram.h"
+#include "BatteryWriter.h"
 #include "Savestate.h"
 #include "../common/GameDB.h"
 #include "../common/Loader.h"
@@ -14,44 +18,160 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Size of the address space reserved for the ROM
+#define ROM_SPACE_SIZE 0x2000000
+// Size of the repeating block of the open bus pattern
+#define OPEN_BUS_BLOCK_SIZE 0x20000
+
+// Battery sectors are written once the save memory has not been touched
+// for a while, so that bursts such as a flash sector erase followed
+// by its reprogramming end up in a single write
+#define BATTERY_QUIET_TIME (G_USEC_PER_SEC / 4)
+#define BATTERY_MAX_DELAY (2 * G_USEC_PER_SEC)
 
 static GameInfos *game = NULL;
 static u8 *rom = 0;
 
+static BatteryWriter *batteryWriter = NULL;
+static gboolean batteryOnDisk = FALSE;
+static guint32 batteryPendingSectors = 0;
+static gint64 batteryFirstWrite = 0;
+static gint64 batteryLastWrite = 0;
+
 static gchar *getRomCode()
 {
 	return g_strndup((gchar *) &rom[0xac], 4);
 }
 
+/**
+ * Reading past the end of the ROM returns the low bits of the address
+ * on the cartridge bus. The pattern repeats every 128 KiB, so a single
+ * block stored in the cache directory is mapped over the whole tail.
+ * The page holding the end of the ROM is completed in place.
+ */
+static void map_open_bus(int romSize) {
+	long pageSize = sysconf(_SC_PAGESIZE);
+	int address = (romSize + pageSize - 1) & ~(pageSize - 1);
+
+	// A mapped ROM is private and read only, the page is made writable
+	// without changing the file
+	if (address > romSize && mprotect(&rom[address - pageSize], pageSize, PROT_READ | PROT_WRITE) == 0) {
+		for (int i = romSize; i < address; i++) {
+			rom[i] = ((i & (OPEN_BUS_BLOCK_SIZE - 1)) >> 1) >> ((i & 1) * 8);
+		}
+	}
+
+	gchar *patternFile = g_build_filename(settings_get_cache_dir(), "open-bus.bin", NULL);
+
+	if (!g_file_test(patternFile, G_FILE_TEST_IS_REGULAR)) {
+		u16 *pattern = g_new(u16, OPEN_BUS_BLOCK_SIZE / 2);
+		for (int i = 0; i < OPEN_BUS_BLOCK_SIZE / 2; i++) {
+			WRITE16LE(&pattern[i], i);
+		}
+
+		g_mkdir_with_parents(settings_get_cache_dir(), 0777);
+		g_file_set_contents(patternFile, (const gchar *)pattern, OPEN_BUS_BLOCK_SIZE, NULL);
+		g_free(pattern);
+	}
+
+	int fd = open(patternFile, O_RDONLY);
+	g_free(patternFile);
+
+	if (fd < 0) {
+		return;
+	}
+
+	while (address < ROM_SPACE_SIZE) {
+		int offset = address % OPEN_BUS_BLOCK_SIZE;
+		int length = MIN(OPEN_BUS_BLOCK_SIZE - offset, ROM_SPACE_SIZE - address);
+
+		if (mmap(&rom[address], length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, offset) == MAP_FAILED) {
+			break;
+		}
+
+		address += length;
+	}
+
+	close(fd);
+}
+
+/**
+ * Replace the start of the ROM space by writable anonymous memory, where
+ * a previous ROM or its open bus pattern may be mapped read only
+ */
+static gboolean map_writable(int size, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	long pageSize = sysconf(_SC_PAGESIZE);
+	int length = (size + pageSize - 1) & ~(pageSize - 1);
+	if (mmap(rom, MIN(length, ROM_SPACE_SIZE), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+		g_set_error(err, LOADER_ERROR, G_LOADER_ERROR_FAILED,
+				"Failed to map the ROM: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 gboolean cartridge_load_rom(const char *filename, GError **err) {
 	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
 
-	int romSize = 0x2000000;
-	
+	int romSize = ROM_SPACE_SIZE;
+	GError *mapErr = NULL;
+
+	// Map the ROM when possible, and otherwise copy it
 	RomLoader *loader = loader_new(ROM_GBA, filename);
-	if (!loader_load(loader, rom, &romSize, err)) {
-		loader_free(loader);
-		return FALSE;
+	if (!loader_map(loader, rom, &romSize, settings_get_cache_dir(), &mapErr)) {
+		g_message("Copying the ROM, as it could not be mapped: %s", mapErr->message);
+		g_clear_error(&mapErr);
+
+		romSize = ROM_SPACE_SIZE;
+		if (!map_writable(romSize, err) || !loader_load(loader, rom, &romSize, err)) {
+			loader_free(loader);
+			return FALSE;
+		}
 	}
 	loader_free(loader);
 
-	// What does this do ?
-	/*u16 *temp = (u16 *)(rom+((romSize+1)&~1));
-	int i;
-	for(i = (romSize+1)&~1; i < 0x2000000; i+=2) {
-		WRITE16LE(temp, (i >> 1) & 0xFFFF);
-		temp++;
-	}*/
-	
+	map_open_bus(romSize);
+
 	gchar *code = getRomCode();
-	game = game_db_lookup_code(code, err);
+	game = game_db_lookup_code(code, settings_get_cache_dir(), err);
 	g_free(code);
 
 	return game != NULL;
 }
 
+gboolean cartridge_load_rom_data(const u8 *data, int size, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+	g_return_val_if_fail(size > 0 && size <= ROM_SPACE_SIZE, FALSE);
+
+	if (!map_writable(size, err)) {
+		return FALSE;
+	}
+
+	memcpy(rom, data, size);
+	map_open_bus(size);
+
+	game_infos_free(game);
+	game = game_infos_new();
+	game->code = getRomCode();
+	game->title = g_strndup((gchar *) &rom[0xa0], 12);
+
+	return TRUE;
+}
+
 void cartridge_unload()
 {
+	battery_writer_free(batteryWriter);
+	batteryWriter = NULL;
+	batteryOnDisk = FALSE;
+	batteryPendingSectors = 0;
+
 	game_infos_free(game);
 	game = NULL;
 }
@@ -91,9 +211,11 @@ gboolean cartridge_is_present() {
 
 gboolean cartridge_init()
 {
-	rom = (u8 *)malloc(0x2000000);
-	if (!rom)
+	// Reserve the address space, pages are only allocated when used
+	rom = (u8 *)mmap(NULL, ROM_SPACE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (rom == MAP_FAILED)
 	{
+		rom = 0;
 		return FALSE;
 	}
 
@@ -117,7 +239,7 @@ void cartridge_free()
 {
 	if (rom)
 	{
-		free(rom);
+		munmap(rom, ROM_SPACE_SIZE);
 		rom = 0;
 	}
 }
@@ -134,9 +256,108 @@ static gchar *get_battery_name() {
 	return batteryFile;
 }
 
+static const guint8 *battery_take_dirty_sectors(size_t *size, gsize *sectorSize, guint32 *sectors) {
+	if (game->hasFlash)
+	{
+		*sectorSize = CARTRIDGE_FLASH_SECTOR_SIZE;
+		*sectors = cartridge_flash_take_dirty_sectors();
+		return cartridge_flash_get_data(size);
+	}
+	else if (game->hasEEPROM)
+	{
+		*sectorSize = CARTRIDGE_EEPROM_SECTOR_SIZE;
+		*sectors = cartridge_eeprom_take_dirty_sectors();
+		return cartridge_eeprom_get_data(size);
+	}
+	else
+	{
+		*sectorSize = CARTRIDGE_SRAM_SECTOR_SIZE;
+		*sectors = cartridge_sram_take_dirty_sectors();
+		return cartridge_sram_get_data(size);
+	}
+}
+
+static void battery_flush(const guint8 *data, size_t size, gsize sectorSize) {
+	if (batteryWriter == NULL) {
+		gchar *batteryFile = get_battery_name();
+		batteryWriter = battery_writer_new(batteryFile);
+		g_free(batteryFile);
+	}
+
+	// Sectors can only be updated in place once the file is complete
+	guint32 sectors = batteryPendingSectors;
+	if (!batteryOnDisk) {
+		sectors = (guint32)((G_GUINT64_CONSTANT(1) << (size / sectorSize)) - 1);
+	}
+
+	battery_writer_write(batteryWriter, data, sectorSize, sectors);
+
+	batteryPendingSectors = 0;
+	batteryOnDisk = TRUE;
+}
+
+void cartridge_battery_update() {
+	if (!game->hasFlash && !game->hasEEPROM && !game->hasSRAM)
+		return;
+
+	size_t size;
+	gsize sectorSize;
+	guint32 dirty;
+	const guint8 *data = battery_take_dirty_sectors(&size, &sectorSize, &dirty);
+
+	gint64 now = g_get_monotonic_time();
+	if (dirty) {
+		if (!batteryPendingSectors) {
+			batteryFirstWrite = now;
+		}
+		batteryPendingSectors |= dirty;
+		batteryLastWrite = now;
+	}
+
+	if (batteryPendingSectors
+			&& (now - batteryLastWrite >= BATTERY_QUIET_TIME
+			|| now - batteryFirstWrite >= BATTERY_MAX_DELAY)) {
+		battery_flush(data, size, sectorSize);
+	}
+}
+
+void cartridge_battery_save_state(gzFile gzFile) {
+	if (game->hasFlash)
+		cartridge_flash_save_state(gzFile);
+	else if (game->hasEEPROM)
+		cartridge_eeprom_save_state(gzFile);
+	else if (game->hasSRAM)
+		cartridge_sram_save_state(gzFile);
+}
+
+void cartridge_battery_load_state(gzFile gzFile) {
+	if (game->hasFlash)
+		cartridge_flash_load_state(gzFile);
+	else if (game->hasEEPROM)
+		cartridge_eeprom_load_state(gzFile);
+	else if (game->hasSRAM)
+		cartridge_sram_load_state(gzFile);
+}
+
 gboolean cartridge_write_battery(GError **err) {
 	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
 
+	if (batteryOnDisk && (game->hasFlash || game->hasEEPROM || game->hasSRAM))
+	{
+		// Only write what changed since the battery was loaded or written
+		size_t size;
+		gsize sectorSize;
+		guint32 dirty;
+		const guint8 *data = battery_take_dirty_sectors(&size, &sectorSize, &dirty);
+
+		batteryPendingSectors |= dirty;
+		if (batteryPendingSectors) {
+			battery_flush(data, size, sectorSize);
+		}
+
+		return batteryWriter == NULL || battery_writer_sync(batteryWriter, err);
+	}
+
 	if (game->hasFlash || game->hasEEPROM || game->hasSRAM)
 	{
 		gchar *batteryFile = get_battery_name();
@@ -172,6 +393,14 @@ gboolean cartridge_write_battery(GError **err) {
 			return FALSE;
 		}
 
+		// The whole file was written, discard the tracked changes
+		size_t size;
+		gsize sectorSize;
+		guint32 dirty;
+		battery_take_dirty_sectors(&size, &sectorSize, &dirty);
+		batteryPendingSectors = 0;
+		batteryOnDisk = TRUE;
+
 		return TRUE;
 	}
 
@@ -182,6 +411,13 @@ gboolean cartridge_read_battery(GError **err) {
 	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
 
 	gchar *batteryFile = get_battery_name();
+
+	// Finish writing the changes interrupted by a crash, if any
+	if (!battery_writer_recover(batteryFile, err)) {
+		g_free(batteryFile);
+		return FALSE;
+	}
+
 	FILE *file = fopen(batteryFile, "rb");
 	g_free(batteryFile);
 
@@ -220,6 +456,8 @@ gboolean cartridge_read_battery(GError **err) {
 		return FALSE;
 	}
 
+	batteryOnDisk = TRUE;
+
 	return TRUE;
 }
 
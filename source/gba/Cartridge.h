@@ -20,6 +20,7 @@
 #define VBAM_GBA_CARTRIDGE_H_
 
 #include <glib.h>
+#include <zlib.h>
 #include "../common/Types.h"
 
 /* Set up for C function definitions, even when using C++ */
@@ -31,6 +32,8 @@ gboolean cartridge_init();
 void cartridge_reset();
 void cartridge_free();
 gboolean cartridge_load_rom(const gchar *filename, GError **err);
+// Load a ROM image from memory, for a game without save memory or entry in the game database
+gboolean cartridge_load_rom_data(const u8 *data, int size, GError **err);
 void cartridge_unload();
 void cartridge_get_game_name(u8 *romname);
 const gchar *cartridge_get_game_title();
@@ -40,6 +43,12 @@ gboolean cartridge_is_present();
 
 gboolean cartridge_read_battery(GError **err);
 gboolean cartridge_write_battery(GError **err);
+// Write the changed battery sectors in the background, to be called periodically
+void cartridge_battery_update();
+// Save memory contents and chip state, for the game's kind of save memory.
+// Loaded contents are written to the battery file as if the game wrote them.
+void cartridge_battery_save_state(gzFile gzFile);
+void cartridge_battery_load_state(gzFile gzFile);
 
 u32 cartridge_read32(const u32 address);
 u16 cartridge_read16(const u32 address);
@@ -18,6 +18,8 @@
 
 #include "CartridgeEEprom.h"
 
+#include "../common/Util.h"
+
 #include "string.h"
 
 #define EEPROM_IDLE           0
@@ -33,6 +35,7 @@ static int eepromAddress = 0;
 static guint8 eepromData[0x2000];
 static guint8 eepromBuffer[16];
 static int eepromSize = 0x0200;
+static guint32 eepromDirtySectors = 0;
 
 void cartridge_eeprom_init()
 {
@@ -167,6 +170,7 @@ void cartridge_eeprom_write(guint32 address, guint8 value)
 			{
 				eepromData[(eepromAddress << 3) + i] = eepromBuffer[i];
 			}
+			eepromDirtySectors |= 1u << ((eepromAddress << 3) / CARTRIDGE_EEPROM_SECTOR_SIZE);
 		}
 		else if (eepromBits == 0x41)
 		{
@@ -188,4 +192,42 @@ gboolean cartridge_eeprom_write_battery(FILE *file)
 	return fwrite(eepromData, 1, eepromSize, file) == (size_t)eepromSize;
 }
 
+void cartridge_eeprom_save_state(gzFile gzFile)
+{
+	utilGzWrite(gzFile, eepromData, sizeof(eepromData));
+	utilGzWrite(gzFile, eepromBuffer, sizeof(eepromBuffer));
+	utilWriteInt(gzFile, eepromMode);
+	utilWriteInt(gzFile, eepromByte);
+	utilWriteInt(gzFile, eepromBits);
+	utilWriteInt(gzFile, eepromAddress);
+	utilWriteInt(gzFile, eepromSize);
+}
+
+void cartridge_eeprom_load_state(gzFile gzFile)
+{
+	utilGzRead(gzFile, eepromData, sizeof(eepromData));
+	utilGzRead(gzFile, eepromBuffer, sizeof(eepromBuffer));
+	eepromMode = utilReadInt(gzFile);
+	eepromByte = utilReadInt(gzFile);
+	eepromBits = utilReadInt(gzFile);
+	eepromAddress = utilReadInt(gzFile);
+	eepromSize = utilReadInt(gzFile);
+
+	// The whole memory may have changed
+	eepromDirtySectors = (1u << (eepromSize / CARTRIDGE_EEPROM_SECTOR_SIZE)) - 1;
+}
+
+guint32 cartridge_eeprom_take_dirty_sectors()
+{
+	guint32 dirty = eepromDirtySectors;
+	eepromDirtySectors = 0;
+	return dirty;
+}
+
+const guint8 *cartridge_eeprom_get_data(size_t *size)
+{
+	*size = eepromSize;
+	return eepromData;
+}
+
 
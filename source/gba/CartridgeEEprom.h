@@ -21,6 +21,7 @@
 
 #include <glib.h>
 #include <stdio.h>
+#include <zlib.h>
 
 /* Set up for C function definitions, even when using C++ */
 #ifdef __cplusplus
@@ -33,6 +34,13 @@ void cartridge_eeprom_init();
 void cartridge_eeprom_reset(int size);
 gboolean cartridge_eeprom_read_battery(FILE *file, size_t size);
 gboolean cartridge_eeprom_write_battery(FILE *file);
+void cartridge_eeprom_load_state(gzFile gzFile);
+void cartridge_eeprom_save_state(gzFile gzFile);
+
+// Sectors written since the last call, one bit per sector
+#define CARTRIDGE_EEPROM_SECTOR_SIZE 0x200
+guint32 cartridge_eeprom_take_dirty_sectors();
+const guint8 *cartridge_eeprom_get_data(size_t *size);
 
 /* Ends C function definitions when using C++ */
 #ifdef __cplusplus
@@ -18,6 +18,8 @@
 
 #include "CartridgeFlash.h"
 
+#include "../common/Util.h"
+
 #include <string.h>
 
 #define FLASH_READ_ARRAY         0
@@ -38,6 +40,7 @@ static size_t flashSize = 0x10000;
 static int flashDeviceID = 0x1b;
 static int flashManufacturerID = 0x32;
 static int flashBank = 0;
+static guint32 flashDirtySectors = 0;
 
 static void flashSetSize(int size)
 {
@@ -177,12 +180,14 @@ void cartridge_flash_write(guint32 address, guint8 byte)
 			// SECTOR ERASE
 			guint8 *offset = flashSaveMemory + (flashBank << 16) + (address & 0xF000);
 			memset(offset, 0, 0x1000);
+			flashDirtySectors |= 1u << ((offset - flashSaveMemory) / CARTRIDGE_FLASH_SECTOR_SIZE);
 			flashReadState = FLASH_ERASE_COMPLETE;
 		}
 		else if (byte == 0x10)
 		{
 			// CHIP ERASE
 			memset(flashSaveMemory, 0, flashSize);
+			flashDirtySectors |= (guint32)((G_GUINT64_CONSTANT(1) << (flashSize / CARTRIDGE_FLASH_SECTOR_SIZE)) - 1);
 			flashReadState = FLASH_ERASE_COMPLETE;
 		}
 		else
@@ -209,6 +214,7 @@ void cartridge_flash_write(guint32 address, guint8 byte)
 		break;
 	case FLASH_PROGRAM:
 		flashSaveMemory[(flashBank<<16)+address] = byte;
+		flashDirtySectors |= 1u << (((flashBank<<16)+address) / CARTRIDGE_FLASH_SECTOR_SIZE);
 		flashState = FLASH_READ_ARRAY;
 		flashReadState = FLASH_READ_ARRAY;
 		break;
@@ -236,3 +242,37 @@ gboolean cartridge_flash_write_battery(FILE *file)
 	return fwrite(flashSaveMemory, 1, flashSize, file) == (size_t)flashSize;
 }
 
+void cartridge_flash_save_state(gzFile gzFile)
+{
+	utilGzWrite(gzFile, flashSaveMemory, sizeof(flashSaveMemory));
+	utilWriteInt(gzFile, flashState);
+	utilWriteInt(gzFile, flashReadState);
+	utilWriteInt(gzFile, flashSize);
+	utilWriteInt(gzFile, flashBank);
+}
+
+void cartridge_flash_load_state(gzFile gzFile)
+{
+	utilGzRead(gzFile, flashSaveMemory, sizeof(flashSaveMemory));
+	flashState = utilReadInt(gzFile);
+	flashReadState = utilReadInt(gzFile);
+	flashSetSize(utilReadInt(gzFile));
+	flashBank = utilReadInt(gzFile);
+
+	// The whole memory may have changed
+	flashDirtySectors = (guint32)((G_GUINT64_CONSTANT(1) << (flashSize / CARTRIDGE_FLASH_SECTOR_SIZE)) - 1);
+}
+
+guint32 cartridge_flash_take_dirty_sectors()
+{
+	guint32 dirty = flashDirtySectors;
+	flashDirtySectors = 0;
+	return dirty;
+}
+
+const guint8 *cartridge_flash_get_data(size_t *size)
+{
+	*size = flashSize;
+	return flashSaveMemory;
+}
+
@@ -21,6 +21,7 @@
 
 #include <glib.h>
 #include <stdio.h>
+#include <zlib.h>
 
 /* Set up for C function definitions, even when using C++ */
 #ifdef __cplusplus
@@ -33,6 +34,13 @@ void cartridge_flash_reset(int size);
 void cartridge_flash_init();
 gboolean cartridge_flash_read_battery(FILE *file, size_t size);
 gboolean cartridge_flash_write_battery(FILE *file);
+void cartridge_flash_load_state(gzFile gzFile);
+void cartridge_flash_save_state(gzFile gzFile);
+
+// Sectors written since the last call, one bit per sector
+#define CARTRIDGE_FLASH_SECTOR_SIZE 0x1000
+guint32 cartridge_flash_take_dirty_sectors();
+const guint8 *cartridge_flash_get_data(size_t *size);
 
 /* Ends C function definitions when using C++ */
 #ifdef __cplusplus
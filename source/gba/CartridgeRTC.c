@@ -39,6 +39,7 @@ typedef struct
 
 static RTCCLOCKDATA rtcClockData;
 static gboolean rtcEnabled = FALSE;
+static gint64 rtcFixedTime = -1;
 
 void cartridge_rtc_enable(gboolean enable)
 {
@@ -72,6 +73,28 @@ guint16 cartridge_rtc_read(guint32 address)
 	return 0;
 }
 
+void cartridge_rtc_set_time(gint64 time)
+{
+	rtcFixedTime = time;
+}
+
+static void rtc_get_time(struct tm *newtime)
+{
+	time_t long_time;
+
+	if (rtcFixedTime >= 0)
+	{
+		// The fixed time is already local
+		long_time = (time_t)rtcFixedTime;
+		*newtime = *gmtime(&long_time);
+	}
+	else
+	{
+		time(&long_time);
+		*newtime = *localtime(&long_time);
+	}
+}
+
 static guint8 toBCD(guint8 value)
 {
 	value = value % 100;
@@ -136,35 +159,29 @@ gboolean cartridge_rtc_write(guint32 address, guint16 value)
 							break;
 						case 0x65:
 						{
-							struct tm *newtime;
-							time_t long_time;
-
-							time( &long_time );                /* Get time as long integer. */
-							newtime = localtime( &long_time ); /* Convert to local time. */
+							struct tm newtime;
+							rtc_get_time(&newtime);
 
 							rtcClockData.dataLen = 7;
-							rtcClockData.data[0] = toBCD(newtime->tm_year);
-							rtcClockData.data[1] = toBCD(newtime->tm_mon+1);
-							rtcClockData.data[2] = toBCD(newtime->tm_mday);
-							rtcClockData.data[3] = toBCD(newtime->tm_wday);
-							rtcClockData.data[4] = toBCD(newtime->tm_hour);
-							rtcClockData.data[5] = toBCD(newtime->tm_min);
-							rtcClockData.data[6] = toBCD(newtime->tm_sec);
+							rtcClockData.data[0] = toBCD(newtime.tm_year);
+							rtcClockData.data[1] = toBCD(newtime.tm_mon+1);
+							rtcClockData.data[2] = toBCD(newtime.tm_mday);
+							rtcClockData.data[3] = toBCD(newtime.tm_wday);
+							rtcClockData.data[4] = toBCD(newtime.tm_hour);
+							rtcClockData.data[5] = toBCD(newtime.tm_min);
+							rtcClockData.data[6] = toBCD(newtime.tm_sec);
 							rtcClockData.state = DATA;
 							break;
 						}
 						case 0x67:
 						{
-							struct tm *newtime;
-							time_t long_time;
-
-							time( &long_time );                /* Get time as long integer. */
-							newtime = localtime( &long_time ); /* Convert to local time. */
+							struct tm newtime;
+							rtc_get_time(&newtime);
 
 							rtcClockData.dataLen = 3;
-							rtcClockData.data[0] = toBCD(newtime->tm_hour);
-							rtcClockData.data[1] = toBCD(newtime->tm_min);
-							rtcClockData.data[2] = toBCD(newtime->tm_sec);
+							rtcClockData.data[0] = toBCD(newtime.tm_hour);
+							rtcClockData.data[1] = toBCD(newtime.tm_min);
+							rtcClockData.data[2] = toBCD(newtime.tm_sec);
 							rtcClockData.state = DATA;
 							break;
 						}
@@ -32,6 +32,9 @@ gboolean cartridge_rtc_write(guint32 address, guint16 value);
 void cartridge_rtc_enable(gboolean enable);
 gboolean cartridge_rtc_is_enabled();
 void cartridge_rtc_reset();
+// Report a fixed local time, in seconds since 1970, instead of the host clock.
+// A negative time restores the host clock.
+void cartridge_rtc_set_time(gint64 time);
 
 void cartridge_rtc_load_state(gzFile gzFile);
 void cartridge_rtc_save_state(gzFile gzFile);
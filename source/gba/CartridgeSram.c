@@ -17,10 +17,14 @@
 // Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "CartridgeSram.h"
+
+#include "../common/Util.h"
+
 #include <string.h>
 
 #define SRAM_SIZE 0x10000
 static guint8 sramData[SRAM_SIZE];
+static guint32 sramDirtySectors = 0;
 
 void cartridge_sram_init()
 {
@@ -35,6 +39,7 @@ guint8 cartridge_sram_read(guint32 address)
 void cartridge_sram_write(guint32 address, guint8 byte)
 {
 	sramData[address & 0xFFFF] = byte;
+	sramDirtySectors |= 1u << ((address & 0xFFFF) / CARTRIDGE_SRAM_SECTOR_SIZE);
 }
 
 gboolean cartridge_sram_read_battery(FILE *file, size_t size)
@@ -46,3 +51,29 @@ gboolean cartridge_sram_write_battery(FILE *file)
 {
 	return fwrite(sramData, 1, SRAM_SIZE, file) == SRAM_SIZE;
 }
+
+void cartridge_sram_save_state(gzFile gzFile)
+{
+	utilGzWrite(gzFile, sramData, SRAM_SIZE);
+}
+
+void cartridge_sram_load_state(gzFile gzFile)
+{
+	utilGzRead(gzFile, sramData, SRAM_SIZE);
+
+	// The whole memory may have changed
+	sramDirtySectors = (guint32)((G_GUINT64_CONSTANT(1) << (SRAM_SIZE / CARTRIDGE_SRAM_SECTOR_SIZE)) - 1);
+}
+
+guint32 cartridge_sram_take_dirty_sectors()
+{
+	guint32 dirty = sramDirtySectors;
+	sramDirtySectors = 0;
+	return dirty;
+}
+
+const guint8 *cartridge_sram_get_data(size_t *size)
+{
+	*size = SRAM_SIZE;
+	return sramData;
+}
@@ -21,6 +21,7 @@
 
 #include <glib.h>
 #include <stdio.h>
+#include <zlib.h>
 
 /* Set up for C function definitions, even when using C++ */
 #ifdef __cplusplus
@@ -32,6 +33,13 @@ guint8 cartridge_sram_read(guint32 address);
 void cartridge_sram_write(guint32 address, guint8 byte);
 gboolean cartridge_sram_read_battery(FILE *file, size_t size);
 gboolean cartridge_sram_write_battery(FILE *file);
+void cartridge_sram_load_state(gzFile gzFile);
+void cartridge_sram_save_state(gzFile gzFile);
+
+// Sectors written since the last call, one bit per sector
+#define CARTRIDGE_SRAM_SECTOR_SIZE 0x1000
+guint32 cartridge_sram_take_dirty_sectors();
+const guint8 *cartridge_sram_get_data(size_t *size);
 
 /* Ends C function definitions when using C++ */
 #ifdef __cplusplus
@@ -0,0 +1,217 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include "EventLog.h"
+#include "Globals.h"
+#include "PerfCounters.h"
+#include "../common/AsyncWriter.h"
+
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+// Room for about six thousand records per thread, the largest queue size
+#define EVENT_LOG_QUEUE_SIZE (1 << 18)
+
+// Period at which the writer thread looks for new records
+#define EVENT_LOG_POLL_USEC 10000
+
+guint32 eventLogChannels = 0;
+guint32 eventLogFrame = 0;
+
+static GPrivate threadQueue;
+
+static struct {
+	gboolean running;
+	FILE *f;
+	AsyncWriter *writer;
+} eventLog;
+
+GQuark event_log_error_quark() {
+	return g_quark_from_static_string("event_log_error_quark");
+}
+
+void event_log_record(LogChannel channel, guint32 pc, guint32 a0, guint32 a1, guint32 a2, guint32 a3) {
+	EventLogRecord record;
+	memset(&record, 0, sizeof(record));
+	record.time = perf_counters_get_time();
+	record.frame = eventLogFrame;
+	record.pc = pc;
+	record.args[0] = a0;
+	record.args[1] = a1;
+	record.args[2] = a2;
+	record.args[3] = a3;
+	record.vcount = VCOUNT;
+	record.channel = channel;
+
+	async_writer_push(eventLog.writer, &record, 1);
+}
+
+void event_log_format(const EventLogRecord *record, GString *text) {
+	const guint32 *args = record->args;
+
+	switch (record->channel) {
+	case LOG_SWI:
+		g_string_append_printf(text, "SWI: %08x at %08x (0x%08x,0x%08x,0x%08x,VCOUNT = %2d)",
+				args[0], record->pc, args[1], args[2], args[3], record->vcount);
+		break;
+	case LOG_UNALIGNED_MEMORY:
+		// Address, value, access size in bits, and whether it is a write
+		if (args[3]) {
+			g_string_append_printf(text, "Unaligned %s write: %0*x to %08x from %08x",
+					args[2] == 32 ? "word" : "halfword", args[2] / 4, args[1], args[0], record->pc);
+		} else {
+			g_string_append_printf(text, "Unaligned %s read: %08x at %08x",
+					args[2] == 32 ? "word" : "halfword", args[0], record->pc);
+		}
+		break;
+	case LOG_ILLEGAL_READ:
+		// Address, and access size in bits
+		g_string_append_printf(text, "Illegal read: %08x at %08x", args[0], record->pc);
+		break;
+	case LOG_ILLEGAL_WRITE:
+		// Address, value, and access size in bits
+		g_string_append_printf(text, "Illegal write: %0*x to %08x from %08x",
+				args[2] / 4, args[1], args[0], record->pc);
+		break;
+	case LOG_DMA0:
+	case LOG_DMA1:
+	case LOG_DMA2:
+	case LOG_DMA3:
+		// Source, destination, control register, and byte count
+		g_string_append_printf(text, "DMA%d: s=%08x d=%08x c=%04x count=%08x",
+				record->channel - LOG_DMA0, args[0], args[1], args[2], args[3]);
+		break;
+	case LOG_UNDEFINED:
+		// Opcode, and whether it is a Thumb instruction
+		if (args[1]) {
+			g_string_append_printf(text, "Undefined THUMB instruction %04x at %08x", args[0], record->pc);
+		} else {
+			g_string_append_printf(text, "Undefined ARM instruction %08x at %08x", args[0], record->pc);
+		}
+		break;
+	case LOG_SOUNDOUTPUT:
+		// Latency in microseconds, and bytes written per sound tick
+		g_string_append_printf(text, "Sound: latency %d us, %d bytes per tick", (gint32)args[0], (gint32)args[1]);
+		break;
+	default:
+		g_string_append_printf(text, "Channel %d: at %08x (0x%08x,0x%08x,0x%08x,0x%08x)",
+				record->channel, record->pc, args[0], args[1], args[2], args[3]);
+		break;
+	}
+}
+
+static gboolean event_log_write(void *data, guint count, guint queue, gpointer unused) {
+	const EventLogRecord *records = (const EventLogRecord *)data;
+
+	if (eventLog.f != NULL) {
+		return fwrite(records, sizeof(EventLogRecord), count, eventLog.f) == count;
+	}
+
+	// Without a log file, the formatting cost is at least kept
+	// out of the emulation thread
+	GString *text = g_string_new(NULL);
+	for (guint i = 0; i < count; i++) {
+		g_string_truncate(text, 0);
+		event_log_format(&records[i], text);
+		g_message("%s", text->str);
+	}
+	g_string_free(text, TRUE);
+
+	return TRUE;
+}
+
+gboolean event_log_start(const gchar *file, guint32 channels, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+	g_return_val_if_fail(!eventLog.running, FALSE);
+
+	if (channels == 0)
+		return TRUE;
+
+	FILE *f = NULL;
+	if (file != NULL) {
+		f = g_fopen(file, "wb");
+		if (f == NULL) {
+			g_set_error(err, EVENT_LOG_ERROR, G_EVENT_LOG_ERROR_FAILED,
+					"Failed to open event log file %s: %s", file, g_strerror(errno));
+			return FALSE;
+		}
+
+		EventLogHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, EVENT_LOG_MAGIC, sizeof(header.magic));
+		header.version = EVENT_LOG_VERSION;
+		header.recordSize = sizeof(EventLogRecord);
+		header.startTime = perf_counters_get_time();
+
+		if (fwrite(&header, sizeof(header), 1, f) != 1) {
+			g_set_error(err, EVENT_LOG_ERROR, G_EVENT_LOG_ERROR_FAILED,
+					"Failed to write event log file %s: %s", file, g_strerror(errno));
+			fclose(f);
+			return FALSE;
+		}
+	}
+
+	// The writer is kept, along with the queues of the threads
+	if (eventLog.writer == NULL) {
+		eventLog.writer = async_writer_new(sizeof(EventLogRecord), EVENT_LOG_QUEUE_SIZE, &threadQueue);
+	}
+
+	eventLog.running = TRUE;
+	eventLog.f = f;
+	async_writer_start(eventLog.writer, "event-log-writer", event_log_write, NULL, EVENT_LOG_POLL_USEC);
+
+	eventLogChannels = channels;
+
+	return TRUE;
+}
+
+gboolean event_log_stop(GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	if (!eventLog.running)
+		return TRUE;
+
+	eventLogChannels = 0;
+
+	async_writer_stop(eventLog.writer);
+
+	if (eventLog.f != NULL && fclose(eventLog.f) != 0) {
+		async_writer_fail(eventLog.writer);
+	}
+
+	eventLog.f = NULL;
+	eventLog.running = FALSE;
+
+	gint errnum;
+	if (async_writer_failed(eventLog.writer, &errnum)) {
+		g_set_error(err, EVENT_LOG_ERROR, G_EVENT_LOG_ERROR_FAILED,
+				"Failed to write the event log: %s", g_strerror(errnum));
+		return FALSE;
+	}
+
+	gint dropped = async_writer_dropped(eventLog.writer);
+	if (dropped > 0) {
+		g_set_error(err, EVENT_LOG_ERROR, G_EVENT_LOG_ERROR_OVERRUN,
+				"%d events were dropped while logging", dropped);
+		return FALSE;
+	}
+
+	return TRUE;
+}
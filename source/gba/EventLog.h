@@ -0,0 +1,147 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef VBAM_GBA_EVENTLOG_H_
+#define VBAM_GBA_EVENTLOG_H_
+
+#include <glib.h>
+#include "../common/Settings.h"
+
+/* Set up for C function definitions, even when using C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Event log error domain
+ */
+#define EVENT_LOG_ERROR (event_log_error_quark())
+GQuark event_log_error_quark();
+
+/**
+ * Event log error types
+ */
+typedef enum
+{
+	G_EVENT_LOG_ERROR_FAILED,
+	G_EVENT_LOG_ERROR_OVERRUN,
+	G_EVENT_LOG_ERROR_BAD_FILE
+} EventLogError;
+
+/**
+ * Log of the events of the enabled log channels, such as the DMA transfers
+ * and the software interrupts.
+ *
+ * The core records fixed size binary records, to a lock-free queue per
+ * thread, and a writer thread empties the queues. The records are either
+ * written to a binary log file, to be decoded later with vba_event_log_decode,
+ * or formatted as messages when there is no log file. When the writer
+ * thread falls behind, records are dropped rather than waited for,
+ * and reported as an overrun when the log is stopped.
+ */
+
+/** First bytes of a log file */
+#define EVENT_LOG_MAGIC "VBAEVLOG"
+
+/** Version of the log file format */
+#define EVENT_LOG_VERSION 1
+
+/**
+ * Header of a log file, followed by the records.
+ * Both are stored in the byte order of the host.
+ */
+typedef struct {
+	gchar magic[8];
+	guint32 version;
+	guint32 recordSize;
+	/** Host time the log was started at, in nanoseconds */
+	gint64 startTime;
+} EventLogHeader;
+
+/**
+ * Event record, the meaning of the arguments depends on the channel
+ */
+typedef struct {
+	/** Host monotonic time, in nanoseconds */
+	gint64 time;
+	/** Emulated frame */
+	guint32 frame;
+	/** Address of the instruction causing the event */
+	guint32 pc;
+	guint32 args[4];
+	/** Emulated scanline */
+	guint16 vcount;
+	/** LogChannel the event was recorded on */
+	guint8 channel;
+	guint8 reserved[5];
+} EventLogRecord;
+
+/** Enabled channels, bit n being set when channel n is enabled */
+extern guint32 eventLogChannels;
+
+/** Emulated frame counter, incremented by the core at each vertical blank */
+extern guint32 eventLogFrame;
+
+/**
+ * Record an event if its channel is enabled. Checking the channel costs
+ * a single bit test, the arguments are only evaluated for enabled channels.
+ */
+#define EVENT_LOG(channel, pc, a0, a1, a2, a3) \
+	do { \
+		if (G_UNLIKELY(eventLogChannels & (1 << (channel)))) \
+			event_log_record((channel), (pc), (a0), (a1), (a2), (a3)); \
+	} while (0)
+
+/**
+ * Start recording the events of the given channels.
+ * If no channel is enabled, nothing is recorded and it simply returns TRUE.
+ *
+ * @param file binary log file, or NULL to format the events as messages
+ * @param channels enabled channels, bit n enabling channel n
+ * @param err return location for a GError, or NULL
+ * @return FALSE if the file could not be created
+ */
+gboolean event_log_start(const gchar *file, guint32 channels, GError **err);
+
+/**
+ * Record an event, use EVENT_LOG instead
+ */
+void event_log_record(LogChannel channel, guint32 pc, guint32 a0, guint32 a1, guint32 a2, guint32 a3);
+
+/**
+ * Describe an event, as a single line
+ * @param record event record
+ * @param text string the description is appended to
+ */
+void event_log_format(const EventLogRecord *record, GString *text);
+
+/**
+ * Write the recorded events and stop recording.
+ * If the log is not running, it simply returns TRUE.
+ *
+ * @param err return location for a GError, or NULL
+ * @return FALSE if writing failed or events were dropped
+ */
+gboolean event_log_stop(GError **err);
+
+/* Ends C function definitions when using C++ */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VBAM_GBA_EVENTLOG_H_ */
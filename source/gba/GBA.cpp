@@ -3,13 +3,19 @@
 #include <memory.h>
 #include <stdarg.h>
 #include <string.h>
+#include <errno.h>
 #include "Cartridge.h"
 #include "Display.h"
+#include "EventLog.h"
 #include "GBA.h"
 #include "CPU.h"
 #include "MMU.h"
+#include "Bios.h"
 #include "Globals.h"
 #include "Gfx.h"
+#include "PerfCounters.h"
+#include "Profiler.h"
+#include "Trace.h"
 #include "CartridgeRTC.h"
 #include "Savestate.h"
 #include "Sound.h"
@@ -32,6 +38,7 @@ static int layerEnableDelay = 0;
 static int cpuDmaTicksToUpdate = 0;
 
 static bool cpuBreakLoop = false;
+static bool cpuStopAtVblank = false;
 int cpuNextEvent = 0;
 
 static bool intState = false;
@@ -73,6 +80,8 @@ static u32 dma3Dest = 0;
 static gint64 lastTime = 0;
 static guint speed = 0;
 static int count = 0;
+// Host time since which the core loop is attributed to the CPU
+static gint64 perfCpuStart = 0;
 
 static InputDriver *inputDriver = NULL;
 
@@ -232,10 +241,9 @@ static inline void UPDATE_REG(u32 address, u16 value)
 	WRITE16LE(((u16 *)&ioMem[address]), value);
 }
 
-static inline int CPUUpdateTicks()
+// Ticks until the next sound, timer or IRQ event, if before cpuLoopTicks
+static inline int CPUTimerTicks(int cpuLoopTicks)
 {
-	int cpuLoopTicks = lcdTicks;
-
 	if (soundTicks < cpuLoopTicks)
 		cpuLoopTicks = soundTicks;
 
@@ -265,6 +273,119 @@ static inline int CPUUpdateTicks()
 	return cpuLoopTicks;
 }
 
+static inline int CPUUpdateTicks()
+{
+	return CPUTimerTicks(lcdTicks);
+}
+
+// Ticks until the next event while the CPU is halted. The LCD events raising
+// no enabled IRQ, starting no DMA and not ending the frame only update the
+// LCD registers and render a line, nothing else can change while halted, so
+// they are all handled in the update of the event following them.
+static int CPUHaltTicks()
+{
+#ifdef LINK_EMULATION
+	if (linkenable)
+		return 1;
+#endif
+
+	int cpuLoopTicks = CPUTimerTicks(G_MAXINT);
+	int lcdEventTicks = lcdTicks;
+	u16 dispstat = DISPSTAT;
+	int vcount = VCOUNT;
+	int lyc = DISPSTAT >> 8;
+
+	bool hblankDma = (DM0CNT_H & 0xB000) == 0xA000 || (DM1CNT_H & 0xB000) == 0xA000
+	    || (DM2CNT_H & 0xB000) == 0xA000 || (DM3CNT_H & 0xB000) == 0xA000;
+	bool hblankIrq = (DISPSTAT & 0x10) && (IE & 2);
+	bool vcountIrq = (DISPSTAT & 0x20) && (IE & 4);
+
+	while (lcdEventTicks < cpuLoopTicks)
+	{
+		int eventTicks = lcdEventTicks;
+		bool wake;
+
+		if (dispstat & 2)
+		{
+			// Leaving H-Blank for the next line
+			vcount++;
+			wake = (vcount == 160 && !(dispstat & 1)) || (vcountIrq && vcount == lyc);
+			if (vcount >= 228)
+			{
+				vcount = 0;
+				dispstat &= 0xFFFC;
+				wake = wake || (vcountIrq && lyc == 0);
+			}
+			dispstat &= 0xFFFD;
+			lcdEventTicks += 1008;
+		}
+		else
+		{
+			// Entering H-Blank
+			wake = hblankIrq || (hblankDma && !(dispstat & 1));
+			dispstat |= 2;
+			lcdEventTicks += 224;
+		}
+
+		if (wake)
+			return eventTicks;
+	}
+
+	return cpuLoopTicks;
+}
+
+// Check a state was saved for the loaded game
+static gboolean CPUCheckStateGameName(const u8 *savename, GError **err)
+{
+	u8 romname[17];
+	cartridge_get_game_name(romname);
+
+	if (memcmp(romname, savename, 16) != 0)
+	{
+		u8 name[17];
+		name[16] = 0;
+		for (int i = 0; i < 16; i++)
+			name[i] = savename[i] < 32 ? 32 : savename[i];
+
+		g_set_error(err, SAVESTATE_ERROR, G_SAVESTATE_WRONG_GAME,
+				"Cannot load save game for %s", name);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+// Refresh the state derived from registers and memory after loading a state
+static void CPUStateLoaded()
+{
+	if (IRQTicks > 0)
+		intState = true;
+	else
+	{
+		intState = false;
+		IRQTicks = 0;
+	}
+
+	// set pointers!
+	layerEnable = DISPCNT;
+
+	gfx_renderer_choose();
+	gfx_buffers_clear(true);
+	gfx_window0_update();
+	gfx_window1_update();
+
+	if (CPU::armState)
+	{
+		CPU::ARM_PREFETCH();
+	}
+	else
+	{
+		CPU::THUMB_PREFETCH();
+	}
+
+	CPUUpdateRegister(0x204, ioMem[0x204]);
+}
+
 void CPUWriteState(gzFile gzFile)
 {
 	utilWriteInt(gzFile, SAVE_GAME_VERSION);
@@ -301,21 +422,153 @@ gboolean CPUReadState(gzFile gzFile, GError **err) {
 		return FALSE;
 	}
 
-	u8 savename[17];
-	u8 romname[17];
-
+	u8 savename[16];
 	utilGzRead(gzFile, savename, 16);
+
+	if (!CPUCheckStateGameName(savename, err))
+		return FALSE;
+
+	utilGzRead(gzFile, &CPU::reg[0], sizeof(CPU::reg));
+
+	utilReadData(gzFile, saveGameStruct);
+
+	utilGzRead(gzFile, internalRAM, 0x8000);
+	utilGzRead(gzFile, paletteRAM, 0x400);
+	utilGzRead(gzFile, workRAM, 0x40000);
+	utilGzRead(gzFile, vram, 0x20000);
+	utilGzRead(gzFile, oam, 0x400);
+	display_read_state(gzFile);
+	utilGzRead(gzFile, ioMem, 0x400);
+
+	soundReadGame(gzFile, version);
+
+	cartridge_rtc_load_state(gzFile);
+
+	CPUStateLoaded();
+
+	return TRUE;
+}
+
+// Regions covered by incremental savestates, in file order
+static const struct
+{
+	int region;
+	u8 **mem;
+	u32 size;
+} stateRegions[] =
+{
+	{ 3, &internalRAM, 0x8000  },
+	{ 5, &paletteRAM,  0x400   },
+	{ 2, &workRAM,     0x40000 },
+	{ 6, &vram,        0x20000 },
+	{ 7, &oam,         0x400   }
+};
+
+static bool stateBaseValid = false;
+static u32 stateBaseChecksum = 0;
+
+static u32 CPUComputeStateChecksum()
+{
+	uLong crc = crc32(0L, Z_NULL, 0);
+
+	for (guint i = 0; i < G_N_ELEMENTS(stateRegions); i++)
+		crc = crc32(crc, *stateRegions[i].mem, stateRegions[i].size);
+
+	return crc;
+}
+
+void CPUMarkStateBase()
+{
+	stateBaseChecksum = CPUComputeStateChecksum();
+	stateBaseValid = true;
+
+	MMU::clearDirtyPages();
+}
+
+gboolean CPUGetStateBase(u32 *checksum)
+{
+	*checksum = stateBaseChecksum;
+	return stateBaseValid;
+}
+
+gboolean CPUWriteStateIncremental(gzFile gzFile, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	if (!stateBaseValid)
+	{
+		g_set_error(err, SAVESTATE_ERROR, G_SAVESTATE_NO_BASE,
+				"No base state to save an incremental state against");
+		return FALSE;
+	}
+
+	utilWriteInt(gzFile, SAVE_GAME_INCREMENTAL_VERSION);
+
+	u8 romname[17];
 	cartridge_get_game_name(romname);
+	utilGzWrite(gzFile, romname, 16);
 
-	if (memcmp(romname, savename, 16) != 0)
+	utilWriteInt(gzFile, stateBaseChecksum);
+
+	utilGzWrite(gzFile, &CPU::reg[0], sizeof(CPU::reg));
+
+	utilWriteData(gzFile, saveGameStruct);
+
+	for (guint i = 0; i < G_N_ELEMENTS(stateRegions); i++)
 	{
-		savename[16] = 0;
-		for (int i = 0; i < 16; i++)
-			if (savename[i] < 32)
-				savename[i] = 32;
+		const u8 *dirty = MMU::dirtyPages(stateRegions[i].region);
+		u8 *mem = *stateRegions[i].mem;
+		u32 pages = stateRegions[i].size >> MMU_PAGE_SHIFT;
 
-		g_set_error(err, SAVESTATE_ERROR, G_SAVESTATE_WRONG_GAME,
-				"Cannot load save game for %s", savename);
+		int count = 0;
+		for (u32 page = 0; page < pages; page++)
+			if (dirty[page])
+				count++;
+
+		utilWriteInt(gzFile, count);
+
+		for (u32 page = 0; page < pages; page++)
+		{
+			if (dirty[page])
+			{
+				utilWriteInt(gzFile, page);
+				utilGzWrite(gzFile, &mem[page << MMU_PAGE_SHIFT], MMU_PAGE_SIZE);
+			}
+		}
+	}
+
+	display_save_state(gzFile);
+	utilGzWrite(gzFile, ioMem, 0x400);
+
+	soundSaveGame(gzFile);
+	cartridge_rtc_save_state(gzFile);
+
+	return TRUE;
+}
+
+gboolean CPUReadStateIncremental(gzFile gzFile, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	int version = utilReadInt(gzFile);
+
+	if (version != SAVE_GAME_INCREMENTAL_VERSION)
+	{
+		g_set_error(err, SAVESTATE_ERROR, G_SAVESTATE_UNSUPPORTED_VERSION,
+				"Unsupported VisualBoyAdvance incremental save game version %d", version);
+		return FALSE;
+	}
+
+	u8 savename[16];
+	utilGzRead(gzFile, savename, 16);
+
+	if (!CPUCheckStateGameName(savename, err))
+		return FALSE;
+
+	u32 checksum = utilReadInt(gzFile);
+
+	if (!stateBaseValid || checksum != stateBaseChecksum)
+	{
+		g_set_error(err, SAVESTATE_ERROR, G_SAVESTATE_WRONG_BASE,
+				"The incremental state does not match the loaded base state");
 		return FALSE;
 	}
 
@@ -323,44 +576,250 @@ gboolean CPUReadState(gzFile gzFile, GError **err) {
 
 	utilReadData(gzFile, saveGameStruct);
 
-	if (IRQTicks > 0)
-		intState = true;
-	else
+	for (guint i = 0; i < G_N_ELEMENTS(stateRegions); i++)
 	{
-		intState = false;
-		IRQTicks = 0;
+		u8 *mem = *stateRegions[i].mem;
+		u32 pages = stateRegions[i].size >> MMU_PAGE_SHIFT;
+
+		int count = utilReadInt(gzFile);
+
+		for (int j = 0; j < count; j++)
+		{
+			u32 page = utilReadInt(gzFile);
+			if (page >= pages)
+			{
+				g_set_error(err, SAVESTATE_ERROR, G_SAVESTATE_ERROR_FAILED,
+						"Invalid page %u in incremental state", page);
+				return FALSE;
+			}
+
+			utilGzRead(gzFile, &mem[page << MMU_PAGE_SHIFT], MMU_PAGE_SIZE);
+
+			// Keep the page dirty so that the next incremental state
+			// is still relative to the same base
+			MMU::markPageDirty(stateRegions[i].region, page);
+		}
 	}
 
-	utilGzRead(gzFile, internalRAM, 0x8000);
-	utilGzRead(gzFile, paletteRAM, 0x400);
-	utilGzRead(gzFile, workRAM, 0x40000);
-	utilGzRead(gzFile, vram, 0x20000);
-	utilGzRead(gzFile, oam, 0x400);
 	display_read_state(gzFile);
 	utilGzRead(gzFile, ioMem, 0x400);
 
-	soundReadGame(gzFile, version);
+	soundReadGame(gzFile, SAVE_GAME_VERSION);
 
 	cartridge_rtc_load_state(gzFile);
 
-	// set pointers!
-	layerEnable = DISPCNT;
+	CPUStateLoaded();
 
-	gfx_renderer_choose();
-	gfx_buffers_clear(true);
-	gfx_window0_update();
-	gfx_window1_update();
+	return TRUE;
+}
 
-	if (CPU::armState)
+// Uncompressed states start with a header page, followed by the memory
+// regions each at a page aligned offset so that they can be mapped in place.
+// The remaining, small, state follows uncompressed. Its size is stored in
+// the header once written, so that a state is checked whole before loading.
+#define RAW_STATE_PAGE_SIZE 4096
+#define RAW_STATE_REGIONS (G_N_ELEMENTS(stateRegions) + 1)
+
+struct RawStateHeader
+{
+	char magic[8];
+	u32 version;
+	u8 romname[16];
+	u32 regionOffset[RAW_STATE_REGIONS];
+	u32 regionSize[RAW_STATE_REGIONS];
+	u32 extraOffset;
+	u32 extraSize;
+};
+
+static u8 *CPURawStateRegion(guint i)
+{
+	return i < G_N_ELEMENTS(stateRegions) ? *stateRegions[i].mem : ioMem;
+}
+
+static u32 CPURawStateRegionSize(guint i)
+{
+	return i < G_N_ELEMENTS(stateRegions) ? stateRegions[i].size : 0x400;
+}
+
+gboolean CPUWriteStateRaw(const gchar *file, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	static const u8 padding[RAW_STATE_PAGE_SIZE] = { 0 };
+
+	RawStateHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SAVE_GAME_RAW_MAGIC, sizeof(header.magic));
+	header.version = SAVE_GAME_VERSION;
+
+	u8 romname[17];
+	cartridge_get_game_name(romname);
+	memcpy(header.romname, romname, 16);
+
+	u32 offset = RAW_STATE_PAGE_SIZE;
+	for (guint i = 0; i < RAW_STATE_REGIONS; i++)
 	{
-		CPU::ARM_PREFETCH();
+		u32 size = CPURawStateRegionSize(i);
+		header.regionOffset[i] = offset;
+		header.regionSize[i] = size;
+		offset += (size + RAW_STATE_PAGE_SIZE - 1) & ~(RAW_STATE_PAGE_SIZE - 1);
+	}
+	header.extraOffset = offset;
+
+	FILE *f = fopen(file, "wb");
+	if (f == NULL)
+	{
+		g_set_error(err, SAVESTATE_ERROR, G_SAVESTATE_ERROR_FAILED,
+				"Failed to save state: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(padding, RAW_STATE_PAGE_SIZE - sizeof(header), 1, f);
+
+	for (guint i = 0; i < RAW_STATE_REGIONS; i++)
+	{
+		u32 size = CPURawStateRegionSize(i);
+		fwrite(CPURawStateRegion(i), size, 1, f);
+		if (size % RAW_STATE_PAGE_SIZE)
+			fwrite(padding, RAW_STATE_PAGE_SIZE - size % RAW_STATE_PAGE_SIZE, 1, f);
+	}
+
+	gboolean failed = ferror(f);
+	if (fclose(f) != 0)
+		failed = TRUE;
+
+	// Append the rest of the state without compression
+	gzFile gzFile = failed ? NULL : gzopen(file, "abT");
+	if (gzFile == NULL)
+	{
+		g_set_error(err, SAVESTATE_ERROR, G_SAVESTATE_ERROR_FAILED,
+				"Failed to save state: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	utilGzWrite(gzFile, &CPU::reg[0], sizeof(CPU::reg));
+	utilWriteData(gzFile, saveGameStruct);
+	display_save_state(gzFile);
+	soundSaveGame(gzFile);
+	cartridge_rtc_save_state(gzFile);
+
+	header.extraSize = gztell(gzFile);
+
+	if (gzclose(gzFile) != Z_OK)
+	{
+		g_set_error(err, SAVESTATE_ERROR, G_SAVESTATE_ERROR_FAILED,
+				"Failed to save state: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	f = fopen(file, "r+b");
+	failed = f == NULL
+			|| fseek(f, G_STRUCT_OFFSET(RawStateHeader, extraSize), SEEK_SET) != 0
+			|| fwrite(&header.extraSize, sizeof(header.extraSize), 1, f) != 1;
+	if (f != NULL && fclose(f) != 0)
+		failed = TRUE;
+
+	if (failed)
+	{
+		g_set_error(err, SAVESTATE_ERROR, G_SAVESTATE_ERROR_FAILED,
+				"Failed to save state: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+gboolean CPUReadStateRaw(const gchar *file, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	GError *mapErr = NULL;
+	GMappedFile *mapped = g_mapped_file_new(file, FALSE, &mapErr);
+	if (mapped == NULL)
+	{
+		SaveStateError code = G_SAVESTATE_ERROR_FAILED;
+		if (g_error_matches(mapErr, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			code = G_SAVESTATE_NOT_FOUND;
+
+		g_set_error(err, SAVESTATE_ERROR, code,
+				"Failed to load state: %s", mapErr->message);
+		g_error_free(mapErr);
+		return FALSE;
 	}
+
+	const u8 *data = (const u8 *)g_mapped_file_get_contents(mapped);
+	gsize length = g_mapped_file_get_length(mapped);
+
+	RawStateHeader header;
+	if (length < RAW_STATE_PAGE_SIZE)
+		memset(&header, 0, sizeof(header));
 	else
+		memcpy(&header, data, sizeof(header));
+
+	if (memcmp(header.magic, SAVE_GAME_RAW_MAGIC, sizeof(header.magic)) != 0
+			|| header.version > SAVE_GAME_VERSION || header.version < SAVE_GAME_VERSION_11)
 	{
-		CPU::THUMB_PREFETCH();
+		g_mapped_file_unref(mapped);
+		g_set_error(err, SAVESTATE_ERROR, G_SAVESTATE_UNSUPPORTED_VERSION,
+				"Unsupported VisualBoyAdvance uncompressed save game");
+		return FALSE;
 	}
 
-	CPUUpdateRegister(0x204, ioMem[0x204]);
+	if (!CPUCheckStateGameName(header.romname, err))
+	{
+		g_mapped_file_unref(mapped);
+		return FALSE;
+	}
+
+	// Nothing is loaded before the whole state is known to be there
+	gboolean truncated = header.extraSize == 0
+			|| header.extraOffset > length
+			|| length - header.extraOffset < header.extraSize;
+
+	for (guint i = 0; i < RAW_STATE_REGIONS; i++)
+	{
+		if (header.regionSize[i] != CPURawStateRegionSize(i)
+				|| header.regionOffset[i] > length
+				|| length - header.regionOffset[i] < header.regionSize[i])
+			truncated = TRUE;
+	}
+
+	if (truncated)
+	{
+		g_mapped_file_unref(mapped);
+		g_set_error(err, SAVESTATE_ERROR, G_SAVESTATE_ERROR_FAILED,
+				"Truncated or corrupt uncompressed save game");
+		return FALSE;
+	}
+
+	// Reading an uncompressed file through zlib is a plain copy
+	gzFile gzFile = gzopen(file, "rb");
+	if (gzFile == NULL || gzseek(gzFile, header.extraOffset, SEEK_SET) < 0)
+	{
+		if (gzFile != NULL)
+			gzclose(gzFile);
+
+		g_mapped_file_unref(mapped);
+		g_set_error(err, SAVESTATE_ERROR, G_SAVESTATE_ERROR_FAILED,
+				"Failed to load state: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	// Memory regions are copied straight from the mapping,
+	// so loading mostly costs the page faults
+	for (guint i = 0; i < RAW_STATE_REGIONS; i++)
+		memcpy(CPURawStateRegion(i), data + header.regionOffset[i], header.regionSize[i]);
+
+	g_mapped_file_unref(mapped);
+
+	utilGzRead(gzFile, &CPU::reg[0], sizeof(CPU::reg));
+	utilReadData(gzFile, saveGameStruct);
+	display_read_state(gzFile);
+	soundReadGame(gzFile, header.version);
+	cartridge_rtc_load_state(gzFile);
+
+	gzclose(gzFile);
+
+	CPUStateLoaded();
 
 	return TRUE;
 }
@@ -421,7 +880,23 @@ static void CPUCompareVCOUNT()
 
 }
 
-static void doDMA(u32 &s, u32 &d, u32 si, u32 di, u32 c, int transfer32)
+// Attribute the host time spent since the start of a section to a part of the
+// emulator, rather than to the CPU
+static inline void perfSectionEnd(PerfHostPart part, gint64 start)
+{
+	gint64 time = perf_counters_get_time() - start;
+	perfCounters.hostTime[part] += time;
+	perfCpuStart += time;
+}
+
+static inline void perfCpuUpdate()
+{
+	gint64 now = perf_counters_get_time();
+	perfCounters.hostTime[PERF_HOST_CPU] += now - perfCpuStart;
+	perfCpuStart = now;
+}
+
+static void doDMA(int ch, u32 &s, u32 &d, u32 si, u32 di, u32 c, int transfer32)
 {
 	int sm = s >> 24;
 	int dm = d >> 24;
@@ -436,6 +911,8 @@ static void doDMA(u32 &s, u32 &d, u32 si, u32 di, u32 c, int transfer32)
 	if (dm>15)
 		dm=15;
 
+	perfCounters.dmaBytes[ch] += transfer32 ? c << 2 : c << 1;
+
 	//if ((sm>=0x05) && (sm<=0x07) || (dm>=0x05) && (dm <=0x07))
 	//    blank = (((DISPSTAT | ((DISPSTAT>>1)&1))==1) ?  true : false);
 
@@ -514,6 +991,8 @@ static void doDMA(u32 &s, u32 &d, u32 si, u32 di, u32 c, int transfer32)
 
 void CPUCheckDMA(int reason, int dmamask)
 {
+	TRACE_BEGIN("CPUCheckDMA");
+
 	// DMA 0
 	if ((DM0CNT_H & 0x8000) && (dmamask & 1))
 	{
@@ -544,17 +1023,10 @@ void CPUCheckDMA(int reason, int dmamask)
 				break;
 			}
 #ifdef GBA_LOGGING
-			if (settings_log_channel_enabled(LOG_DMA0))
-			{
-				int count = (DM0CNT_L ? DM0CNT_L : 0x4000) << 1;
-				if (DM0CNT_H & 0x0400)
-					count <<= 1;
-				g_message("DMA0: s=%08x d=%08x c=%04x count=%08x\n", dma0Source, dma0Dest,
-				    DM0CNT_H,
-				    count);
-			}
+			EVENT_LOG(LOG_DMA0, CPU::armNextPC, dma0Source, dma0Dest, DM0CNT_H,
+			    ((DM0CNT_L ? DM0CNT_L : 0x4000) << 1) << ((DM0CNT_H >> 10) & 1));
 #endif
-			doDMA(dma0Source, dma0Dest, sourceIncrement, destIncrement,
+			doDMA(0, dma0Source, dma0Dest, sourceIncrement, destIncrement,
 			      DM0CNT_L ? DM0CNT_L : 0x4000,
 			      DM0CNT_H & 0x0400);
 
@@ -610,30 +1082,18 @@ void CPUCheckDMA(int reason, int dmamask)
 			if (reason == 3)
 			{
 #ifdef GBA_LOGGING
-				if (settings_log_channel_enabled(LOG_DMA1))
-				{
-					g_message("DMA1: s=%08x d=%08x c=%04x count=%08x\n", dma1Source, dma1Dest,
-					    DM1CNT_H,
-					    16);
-				}
+				EVENT_LOG(LOG_DMA1, CPU::armNextPC, dma1Source, dma1Dest, DM1CNT_H, 16);
 #endif
-				doDMA(dma1Source, dma1Dest, sourceIncrement, 0, 4,
+				doDMA(1, dma1Source, dma1Dest, sourceIncrement, 0, 4,
 				      0x0400);
 			}
 			else
 			{
 #ifdef GBA_LOGGING
-				if (settings_log_channel_enabled(LOG_DMA1))
-				{
-					int count = (DM1CNT_L ? DM1CNT_L : 0x4000) << 1;
-					if (DM1CNT_H & 0x0400)
-						count <<= 1;
-					g_message("DMA1: s=%08x d=%08x c=%04x count=%08x\n", dma1Source, dma1Dest,
-					    DM1CNT_H,
-					    count);
-				}
+				EVENT_LOG(LOG_DMA1, CPU::armNextPC, dma1Source, dma1Dest, DM1CNT_H,
+				    ((DM1CNT_L ? DM1CNT_L : 0x4000) << 1) << ((DM1CNT_H >> 10) & 1));
 #endif
-				doDMA(dma1Source, dma1Dest, sourceIncrement, destIncrement,
+				doDMA(1, dma1Source, dma1Dest, sourceIncrement, destIncrement,
 				      DM1CNT_L ? DM1CNT_L : 0x4000,
 				      DM1CNT_H & 0x0400);
 			}
@@ -690,31 +1150,18 @@ void CPUCheckDMA(int reason, int dmamask)
 			if (reason == 3)
 			{
 #ifdef GBA_LOGGING
-				if (settings_log_channel_enabled(LOG_DMA2))
-				{
-					int count = (4) << 2;
-					g_message("DMA2: s=%08x d=%08x c=%04x count=%08x\n", dma2Source, dma2Dest,
-					    DM2CNT_H,
-					    count);
-				}
+				EVENT_LOG(LOG_DMA2, CPU::armNextPC, dma2Source, dma2Dest, DM2CNT_H, 16);
 #endif
-				doDMA(dma2Source, dma2Dest, sourceIncrement, 0, 4,
+				doDMA(2, dma2Source, dma2Dest, sourceIncrement, 0, 4,
 				      0x0400);
 			}
 			else
 			{
 #ifdef GBA_LOGGING
-				if (settings_log_channel_enabled(LOG_DMA2))
-				{
-					int count = (DM2CNT_L ? DM2CNT_L : 0x4000) << 1;
-					if (DM2CNT_H & 0x0400)
-						count <<= 1;
-					g_message("DMA2: s=%08x d=%08x c=%04x count=%08x\n", dma2Source, dma2Dest,
-					    DM2CNT_H,
-					    count);
-				}
+				EVENT_LOG(LOG_DMA2, CPU::armNextPC, dma2Source, dma2Dest, DM2CNT_H,
+				    ((DM2CNT_L ? DM2CNT_L : 0x4000) << 1) << ((DM2CNT_H >> 10) & 1));
 #endif
-				doDMA(dma2Source, dma2Dest, sourceIncrement, destIncrement,
+				doDMA(2, dma2Source, dma2Dest, sourceIncrement, destIncrement,
 				      DM2CNT_L ? DM2CNT_L : 0x4000,
 				      DM2CNT_H & 0x0400);
 			}
@@ -769,17 +1216,10 @@ void CPUCheckDMA(int reason, int dmamask)
 				break;
 			}
 #ifdef GBA_LOGGING
-			if (settings_log_channel_enabled(LOG_DMA3))
-			{
-				int count = (DM3CNT_L ? DM3CNT_L : 0x10000) << 1;
-				if (DM3CNT_H & 0x0400)
-					count <<= 1;
-				g_message("DMA3: s=%08x d=%08x c=%04x count=%08x\n", dma3Source, dma3Dest,
-				    DM3CNT_H,
-				    count);
-			}
+			EVENT_LOG(LOG_DMA3, CPU::armNextPC, dma3Source, dma3Dest, DM3CNT_H,
+			    ((DM3CNT_L ? DM3CNT_L : 0x10000) << 1) << ((DM3CNT_H >> 10) & 1));
 #endif
-			doDMA(dma3Source, dma3Dest, sourceIncrement, destIncrement,
+			doDMA(3, dma3Source, dma3Dest, sourceIncrement, destIncrement,
 			      DM3CNT_L ? DM3CNT_L : 0x10000,
 			      DM3CNT_H & 0x0400);
 			if (DM3CNT_H & 0x4000)
@@ -801,6 +1241,8 @@ void CPUCheckDMA(int reason, int dmamask)
 			}
 		}
 	}
+
+	TRACE_END("CPUCheckDMA");
 }
 
 void CPUUpdateRegister(u32 address, u16 value)
@@ -1319,6 +1761,8 @@ void CPUUpdateRegister(u32 address, u16 value)
 			memoryWaitSeq32[i] = memoryWaitSeq[i]*2 + 1;
 		}
 
+		CPU::updateWaitStates();
+
 		CPU::enableBusPrefetch((value & 0x4000) == 0x4000);
 
 		UPDATE_REG(0x204, value & 0x7FFF);
@@ -1409,6 +1853,12 @@ static void applyTimer ()
 
 gboolean CPULoadBios(const gchar *biosFileName, GError **err)
 {
+	if (biosFileName == NULL || biosFileName[0] == '\0')
+	{
+		Bios::setReplacement(true);
+		return TRUE;
+	}
+
 	int size = 0x4000;
 	RomLoader *loader = loader_new(ROM_BIOS, biosFileName);
 	if (!loader_load(loader, bios, &size, err)) {
@@ -1416,6 +1866,8 @@ gboolean CPULoadBios(const gchar *biosFileName, GError **err)
 		return FALSE;
 	}
 	loader_free(loader);
+
+	Bios::setReplacement(false);
 	return TRUE;
 }
 
@@ -1442,6 +1894,10 @@ void CPUReset()
 	// clean io memory
 	memset(ioMem, 0, 0x400);
 
+	// previous base states no longer apply
+	stateBaseValid = false;
+	MMU::markAllPagesDirty();
+
 	DISPCNT  = 0x0080;
 	DISPSTAT = 0x0000;
 	VCOUNT   = 0x0000;
@@ -1576,6 +2032,11 @@ void CPUReset()
 
 	CPU::reset();
 
+	if (Bios::isReplacement())
+		Bios::boot();
+
+	perf_counters_reset();
+
 	lastTime = g_get_monotonic_time();
 
 }
@@ -1595,6 +2056,8 @@ void CPULoop(int ticks)
 	if (cpuNextEvent > ticks)
 		cpuNextEvent = ticks;
 
+	perfCpuStart = perf_counters_get_time();
+	TRACE_BEGIN("CPULoop");
 
 	for (;;)
 	{
@@ -1603,17 +2066,23 @@ void CPULoop(int ticks)
 			if (CPU::armState)
 			{
 				if (!CPU::armExecute())
-					return;
+					break;
 			}
 			else
 			{
 				if (!CPU::thumbExecute())
-					return;
+					break;
 			}
 			clockTicks = 0;
 		}
 		else
-			clockTicks = CPUUpdateTicks();
+		{
+			clockTicks = CPUHaltTicks();
+			perfCounters.haltCycles += clockTicks;
+
+			if (G_UNLIKELY(profilerEnabled))
+				profiler_halt(clockTicks);
+		}
 
 		cpuTotalTicks += clockTicks;
 
@@ -1636,6 +2105,7 @@ updateLoop:
 
 			lcdTicks -= clockTicks;
 
+lcdUpdate:
 
 			if (lcdTicks <= 0)
 			{
@@ -1740,7 +2210,19 @@ updateLoop:
 								UPDATE_REG(0x202, IF);
 							}
 							CPUCheckDMA(1, 0x0f);
+
+							gint64 drawStart = perf_counters_get_time();
+							TRACE_BEGIN("display_draw_screen");
 							display_draw_screen();
+							TRACE_END("display_draw_screen");
+							perfSectionEnd(PERF_HOST_FRONTEND, drawStart);
+
+							perfCpuUpdate();
+							perf_counters_end_frame();
+							eventLogFrame++;
+
+							if (cpuStopAtVblank)
+								cpuBreakLoop = true;
 						}
 
 						UPDATE_REG(0x04, DISPSTAT);
@@ -1749,8 +2231,12 @@ updateLoop:
 					}
 					else
 					{
+						gint64 renderStart = perf_counters_get_time();
+						TRACE_BEGIN("gfx_line_render");
 						gfx_line_render();
+						TRACE_END("gfx_line_render");
 						display_draw_line(VCOUNT, gfxLineMix);
+						perfSectionEnd(PERF_HOST_PPU, renderStart);
 
 						// entering H-Blank
 						DISPSTAT |= 2;
@@ -1764,6 +2250,10 @@ updateLoop:
 						}
 					}
 				}
+
+				// While halted, several LCD events are handled in one update
+				if (lcdTicks <= 0)
+					goto lcdUpdate;
 			}
 
 			// we shouldn't be doing sound in stop state, but we loose synchronization
@@ -1772,7 +2262,11 @@ updateLoop:
 			soundTicks -= clockTicks;
 			if (soundTicks <= 0)
 			{
+				gint64 soundStart = perf_counters_get_time();
+				TRACE_BEGIN("psoundTickfn");
 				psoundTickfn();
+				TRACE_END("psoundTickfn");
+				perfSectionEnd(PERF_HOST_APU, soundStart);
 				soundTicks += SOUND_CLOCK_TICKS;
 			}
 
@@ -1971,6 +2465,10 @@ updateLoop:
 				}
 			}
 
+			// Still halted, skip to the next event able to wake the CPU up
+			if (holdState)
+				cpuNextEvent = CPUHaltTicks();
+
 			if (remainingTicks > 0)
 			{
 				if (remainingTicks > cpuNextEvent)
@@ -1994,6 +2492,16 @@ updateLoop:
 
 		}
 	}
+
+	perfCpuUpdate();
+	TRACE_END("CPULoop");
+}
+
+void gba_run_frame() {
+	// A frame always ends within two frames worth of ticks, even with the display off
+	cpuStopAtVblank = true;
+	CPULoop(2 * GBA_FRAME_TICKS);
+	cpuStopAtVblank = false;
 }
 
 guint gba_get_speed() {
@@ -8,6 +8,14 @@
 
 #define SAVE_GAME_VERSION_11 11
 #define SAVE_GAME_VERSION  SAVE_GAME_VERSION_11
+// Above any full state version so that CPUReadState rejects incremental states
+#define SAVE_GAME_INCREMENTAL_VERSION 0x100
+// Magic bytes at the start of uncompressed, page aligned save states
+#define SAVE_GAME_RAW_MAGIC "VBARAWST"
+
+// CPU clock rate, and clock ticks in a frame of 228 lines of 1232 ticks
+#define GBA_CLOCK_RATE 16777216
+#define GBA_FRAME_TICKS 280896
 
 extern u8 biosProtected[4];
 extern int cpuNextEvent;
@@ -29,6 +37,18 @@ extern void CPULoop(int ticks);
 extern void CPUCheckDMA(int,int);
 gboolean CPUReadState(gzFile gzFile, GError **err);
 void CPUWriteState(gzFile gzFile);
+void CPUMarkStateBase();
+gboolean CPUGetStateBase(u32 *checksum);
+gboolean CPUReadStateIncremental(gzFile gzFile, GError **err);
+gboolean CPUWriteStateIncremental(gzFile gzFile, GError **err);
+gboolean CPUReadStateRaw(const gchar *file, GError **err);
+gboolean CPUWriteStateRaw(const gchar *file, GError **err);
+
+/**
+ * Emulate until the start of the next vertical blank, when the frame
+ * has just been drawn
+ */
+void gba_run_frame();
 
 /**
  * Return the emulation speed in percents
@@ -1,6 +1,7 @@
 #include "Gfx.h"
 #include "GfxHelpers.h"
 #include "Globals.h"
+#include "PerfCounters.h"
 
 typedef void (*InternalLineRenderer)();
 
@@ -22,6 +23,7 @@ static const ModeLineRenderers lineRenderers[] =
 };
 
 static InternalLineRenderer internalRenderLine = NULL;
+static int internalRenderMode = 0;
 
 int gfxCoeff[32] =
 {
@@ -56,6 +58,7 @@ void gfx_line_render()
 	}
 
 	internalRenderLine();
+	perfCounters.modeScanlines[internalRenderMode]++;
 }
 
 void gfx_BG2X_update()
@@ -103,6 +106,8 @@ void gfx_renderer_choose()
 	if (mode > 5)
 		return;
 
+	internalRenderMode = mode;
+
 	if (!fxOn && !windowOn && !(layerEnable & 0x8000))
 	{
 		internalRenderLine = lineRenderers[mode].simple;
@@ -2,10 +2,13 @@
 #include "../common/Settings.h"
 #include "Cartridge.h"
 #include "CPU.h"
+#include "EventLog.h"
 #include "GBA.h"
 #include "Globals.h"
+#include "PerfCounters.h"
 #include "Sound.h"
 #include <cstdio>
+#include <cstring>
 
 
 extern bool stopState;
@@ -27,6 +30,9 @@ namespace MMU
 
 static bool ioReadable[0x400];
 
+// One byte per page for each region, sized for the largest one (work RAM)
+static u8 dirtyMap[8][0x40000 >> MMU_PAGE_SHIFT];
+
 template <typename T>
 static inline T readLE(u8* x)
 {
@@ -184,19 +190,78 @@ void uninit()
 	ioMem = 0;
 }
 
+const u8 *dirtyPages(int region)
+{
+	return dirtyMap[region];
+}
+
+void markPageDirty(int region, u32 page)
+{
+	dirtyMap[region][page] = 1;
+}
+
+void markAllPagesDirty()
+{
+	memset(dirtyMap, 1, sizeof(dirtyMap));
+}
+
+void clearDirtyPages()
+{
+	memset(dirtyMap, 0, sizeof(dirtyMap));
+}
+
+u8 *directRange(u32 address, u32 length)
+{
+	int region = address >> 24;
+	u32 offset = address & 0x00FFFFFF;
+	u32 size;
+
+	switch (region)
+	{
+	case 2:
+	case 3:
+	case 5:
+	case 7:
+		size = memMap[region].mask + 1;
+		break;
+	case 6:
+		// Above that VRAM is mirrored differently depending on the video mode
+		size = 0x18000;
+		break;
+	default:
+		return NULL;
+	}
+
+	if (offset >= size || length > size - offset)
+		return NULL;
+
+	return &memMap[region].mem[offset];
+}
+
+void markRangeDirty(u32 address, u32 length)
+{
+	if (length == 0)
+		return;
+
+	int region = address >> 24;
+	u32 first = (address & memMap[region].mask) >> MMU_PAGE_SHIFT;
+	u32 last = ((address & memMap[region].mask) + length - 1) >> MMU_PAGE_SHIFT;
+
+	memset(&dirtyMap[region][first], 1, last - first + 1);
+}
+
 u32 read32(u32 address)
 {
- #ifdef GBA_LOGGING
+#ifdef GBA_LOGGING
 	if (address & 3)
 	{
-		if (settings_log_channel_enabled(LOG_UNALIGNED_MEMORY))
- 		{
-			g_message("Unaligned word read: %08x at %08x\n", address, CPU::armMode ?
- 			    CPU::armNextPC - 4 : CPU::armNextPC - 2);
- 		}
+		EVENT_LOG(LOG_UNALIGNED_MEMORY, CPU::armState ? CPU::armNextPC - 4 : CPU::armNextPC - 2,
+		    address, 0, 32, FALSE);
 	}
- #endif
+#endif
  
+	perfCounters.memoryAccesses[(address >> 24) & 15]++;
+
 	// Reads must be 32 bits aligned
 	u32 value =  memMap[address >> 24].read32(address & 0xFFFFFFFC);
  
@@ -211,17 +276,16 @@ u32 read32(u32 address)
  
 u32 read16(u32 address)
  {
- #ifdef GBA_LOGGING
- 	if (address & 1)
+#ifdef GBA_LOGGING
+	if (address & 1)
 	{
-		if (settings_log_channel_enabled(LOG_UNALIGNED_MEMORY))
-		{
-			g_message("Unaligned word read: %08x at %08x\n", address, CPU::armMode ?
-			    CPU::armNextPC - 4 : CPU::armNextPC - 2);
-		}
+		EVENT_LOG(LOG_UNALIGNED_MEMORY, CPU::armState ? CPU::armNextPC - 4 : CPU::armNextPC - 2,
+		    address, 0, 16, FALSE);
 	}
 #endif
 
+	perfCounters.memoryAccesses[(address >> 24) & 15]++;
+
 	// Reads must be 16 bits aligned
 	u16 value = memMap[address >> 24].read16(address & 0xFFFFFFFE);
 
@@ -243,6 +307,8 @@ u16 read16s(u32 address)
 
 u8 read8(u32 address)
 {
+	perfCounters.memoryAccesses[(address >> 24) & 15]++;
+
 	return memMap[address >> 24].read8(address);
 }
 
@@ -251,16 +317,13 @@ void write32(u32 address, u32 value)
 #ifdef GBA_LOGGING
 	if (address & 3)
 	{
-		if (settings_log_channel_enabled(LOG_UNALIGNED_MEMORY))
-		{
-			g_message("Unaligned word write: %08x to %08x from %08x\n",
-			    value,
-			    address,
-			    CPU::armMode ? CPU::armNextPC - 4 : CPU::armNextPC - 2);
-		}
+		EVENT_LOG(LOG_UNALIGNED_MEMORY, CPU::armState ? CPU::armNextPC - 4 : CPU::armNextPC - 2,
+		    address, value, 32, TRUE);
 	}
 #endif
 
+	perfCounters.memoryAccesses[(address >> 24) & 15]++;
+
 	memMap[address >> 24].write32(address & 0xFFFFFFFC, value);
 }
 
@@ -269,21 +332,20 @@ void write16(u32 address, u16 value)
 #ifdef GBA_LOGGING
 	if (address & 1)
 	{
-		if (settings_log_channel_enabled(LOG_UNALIGNED_MEMORY))
-		{
-			g_message("Unaligned halfword write: %04x to %08x from %08x\n",
-			    value,
-			    address,
-			    CPU::armMode ? CPU::armNextPC - 4 : CPU::armNextPC - 2);
-		}
+		EVENT_LOG(LOG_UNALIGNED_MEMORY, CPU::armState ? CPU::armNextPC - 4 : CPU::armNextPC - 2,
+		    address, value, 16, TRUE);
 	}
 #endif
 
+	perfCounters.memoryAccesses[(address >> 24) & 15]++;
+
 	memMap[address >> 24].write16(address & 0xFFFFFFFE, value);
 }
 
 void write8(u32 address, u8 b)
 {
+	perfCounters.memoryAccesses[(address >> 24) & 15]++;
+
 	memMap[address >> 24].write8(address, b);
 }
 
@@ -292,11 +354,8 @@ template<typename T>
 static T unreadable(u32 address)
 {
 #ifdef GBA_LOGGING
-		if (settings_log_channel_enabled(LOG_ILLEGAL_READ))
-		{
-			g_message("Illegal read: %08x at %08x\n", address, CPU::armMode ?
-			    CPU::armNextPC - 4 : CPU::armNextPC - 2);
-		}
+	EVENT_LOG(LOG_ILLEGAL_READ, CPU::armState ? CPU::armNextPC - 4 : CPU::armNextPC - 2,
+	    address, sizeof(T) * 8, 0, 0);
 #endif
 
 	return 0;
@@ -417,13 +476,8 @@ template<typename T>
 static void unwritable(u32 address, T value)
 {
 #ifdef GBA_LOGGING
-	if (settings_log_channel_enabled(LOG_ILLEGAL_WRITE))
-	{
-		g_message("Illegal write: %02x to %08x from %08x\n",
-			value,
-			address,
-			CPU::armMode ? CPU::armNextPC - 4 : CPU::armNextPC - 2);
-	}
+	EVENT_LOG(LOG_ILLEGAL_WRITE, CPU::armState ? CPU::armNextPC - 4 : CPU::armNextPC - 2,
+	    address, value, sizeof(T) * 8, 0);
 #endif
 }
 
@@ -433,6 +487,7 @@ static void writeGeneric(u32 address, T value)
 	u32 mask = memMap[s].mask;
 
 	writeLE<T>(&memMap[s].mem[address & mask], value);
+	dirtyMap[s][(address & mask) >> MMU_PAGE_SHIFT] = 1;
 }
 
 template<int s>
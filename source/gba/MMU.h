@@ -27,6 +27,22 @@ void CPUWriteMemory(u32 address, u32 value);
 void CPUWriteHalfWord(u32 address, u16 value);
 void CPUWriteByte(u32 address, u8 b);
 
+// Host memory backing a range of work RAM, palette, VRAM or OAM, for bulk
+// transfers bypassing the access handlers. NULL for the other regions, and
+// for ranges crossing the end of a region. Writers must mark the range dirty.
+u8 *directRange(u32 address, u32 length);
+void markRangeDirty(u32 address, u32 length);
+
+// Page level write tracking, used for incremental savestates.
+// Pages are indexed per memory region (address >> 24).
+#define MMU_PAGE_SHIFT 10
+#define MMU_PAGE_SIZE (1 << MMU_PAGE_SHIFT)
+
+const u8 *dirtyPages(int region);
+void markPageDirty(int region, u32 page);
+void markAllPagesDirty();
+void clearDirtyPages();
+
 } // namespace MMU
 
 #endif // MMU_H
@@ -0,0 +1,527 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include "Movie.h"
+
+#include "GBA.h"
+#include "Cartridge.h"
+#include "CartridgeRTC.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+// Movie file layout:
+//  - header: magic, version, game name, local time the recording started at
+//  - keyframes: one gzip compressed savestate each, either full or
+//    incremental against the previous full keyframe, followed by the
+//    save memory
+//  - footer: the joypad state of every frame and the keyframe index,
+//    followed by the footer offset and an end magic
+#define MOVIE_MAGIC "VBAMOVIE"
+#define MOVIE_END_MAGIC "VBAMVEND"
+#define MOVIE_VERSION 3
+
+// Number of keyframes between full keyframes, bounding both the size of
+// the incremental keyframes and the work of restoring one
+#define MOVIE_FULL_KEYFRAME_INTERVAL 16
+
+// Number of cycles emulated at once when seeking, a scanline
+#define MOVIE_SEEK_TICKS 1232
+
+typedef enum {
+	MOVIE_NONE,
+	MOVIE_RECORDING,
+	MOVIE_PLAYING
+} MovieMode;
+
+typedef struct {
+	guint32 frame;
+	guint32 offset;
+	/** Index of the full keyframe this one is relative to, its own if full */
+	guint32 base;
+} Keyframe;
+
+static MovieMode mode = MOVIE_NONE;
+static FILE *movieFile = NULL;
+static InputDriver movieDriver;
+static InputDriver *sourceDriver = NULL;
+static GArray *frames = NULL;
+static GArray *keyframes = NULL;
+static guint currentFrame = 0;
+static guint keyframeInterval = 0;
+static guint nextKeyframe = 0;
+static guint32 baseChecksum = 0;
+static gint64 startTime = 0;
+
+// The cartridge clock runs with the emulation from the recorded start time,
+// so that games reading it behave the same when played back
+static void movie_update_rtc() {
+	cartridge_rtc_set_time(startTime + (gint64)currentFrame * GBA_FRAME_TICKS / GBA_CLOCK_RATE);
+}
+
+static guint32 movie_read_joypad(InputDriver *driver) {
+	guint32 joy;
+
+	if (mode == MOVIE_PLAYING && currentFrame < frames->len) {
+		joy = g_array_index(frames, guint32, currentFrame);
+	} else {
+		joy = sourceDriver->read_joypad(sourceDriver);
+		if (mode == MOVIE_RECORDING) {
+			g_array_append_val(frames, joy);
+		}
+	}
+
+	currentFrame++;
+	movie_update_rtc();
+
+	return joy;
+}
+
+static void movie_update_motion_sensor(InputDriver *driver) {
+	sourceDriver->update_motion_sensor(sourceDriver);
+}
+
+static int movie_read_sensor_x(InputDriver *driver) {
+	return sourceDriver->read_sensor_x(sourceDriver);
+}
+
+static int movie_read_sensor_y(InputDriver *driver) {
+	return sourceDriver->read_sensor_y(sourceDriver);
+}
+
+static void movie_free() {
+	if (movieFile != NULL) {
+		fclose(movieFile);
+		movieFile = NULL;
+	}
+
+	if (frames != NULL) {
+		g_array_free(frames, TRUE);
+		frames = NULL;
+	}
+
+	if (keyframes != NULL) {
+		g_array_free(keyframes, TRUE);
+		keyframes = NULL;
+	}
+
+	if (sourceDriver != NULL) {
+		gba_init_input(sourceDriver);
+		sourceDriver = NULL;
+	}
+
+	cartridge_rtc_set_time(-1);
+
+	mode = MOVIE_NONE;
+}
+
+static void movie_install(MovieMode newMode, InputDriver *input) {
+	mode = newMode;
+	sourceDriver = input;
+	currentFrame = 0;
+	movie_update_rtc();
+
+	movieDriver.read_joypad = movie_read_joypad;
+	movieDriver.update_motion_sensor = movie_update_motion_sensor;
+	movieDriver.read_sensor_x = movie_read_sensor_x;
+	movieDriver.read_sensor_y = movie_read_sensor_y;
+	movieDriver.driverData = NULL;
+
+	gba_init_input(&movieDriver);
+}
+
+static gboolean movie_write_keyframe(GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	Keyframe keyframe;
+	keyframe.frame = currentFrame;
+	keyframe.base = keyframes->len;
+
+	// Keyframes are only incremental while the state base is still the
+	// previous full keyframe, loading a savestate moves it
+	u32 checksum;
+	gboolean full = keyframes->len % MOVIE_FULL_KEYFRAME_INTERVAL == 0
+			|| !CPUGetStateBase(&checksum) || checksum != baseChecksum;
+	if (!full) {
+		keyframe.base = g_array_index(keyframes, Keyframe, keyframes->len - 1).base;
+	}
+
+	// Keyframes are appended as gzip streams through a duplicate descriptor
+	gzFile gzFile = NULL;
+	if (fflush(movieFile) == 0 && fseek(movieFile, 0, SEEK_END) == 0) {
+		keyframe.offset = ftell(movieFile);
+
+		int fd = dup(fileno(movieFile));
+		if (fd >= 0) {
+			gzFile = gzdopen(fd, "wb");
+			if (gzFile == NULL) {
+				close(fd);
+			}
+		}
+	}
+
+	if (gzFile == NULL) {
+		g_set_error(err, MOVIE_ERROR, G_MOVIE_ERROR_FAILED,
+				"Failed to write movie keyframe: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	gboolean res = TRUE;
+	if (full) {
+		CPUWriteState(gzFile);
+	} else {
+		res = CPUWriteStateIncremental(gzFile, err);
+	}
+
+	if (res) {
+		cartridge_battery_save_state(gzFile);
+	}
+
+	if (gzclose(gzFile) != Z_OK && res) {
+		g_set_error(err, MOVIE_ERROR, G_MOVIE_ERROR_FAILED,
+				"Failed to write movie keyframe: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	if (!res) {
+		return FALSE;
+	}
+
+	if (full) {
+		CPUMarkStateBase();
+		CPUGetStateBase(&baseChecksum);
+	}
+
+	g_array_append_val(keyframes, keyframe);
+	nextKeyframe = currentFrame + keyframeInterval;
+
+	return TRUE;
+}
+
+static gboolean movie_read_state(const Keyframe *keyframe, gboolean full, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	gzFile gzFile = NULL;
+	int fd = dup(fileno(movieFile));
+	if (fd >= 0) {
+		if (lseek(fd, keyframe->offset, SEEK_SET) >= 0) {
+			gzFile = gzdopen(fd, "rb");
+		}
+
+		if (gzFile == NULL) {
+			close(fd);
+		}
+	}
+
+	if (gzFile == NULL) {
+		g_set_error(err, MOVIE_ERROR, G_MOVIE_ERROR_FAILED,
+				"Failed to read movie keyframe: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	gboolean res = full ? CPUReadState(gzFile, err) : CPUReadStateIncremental(gzFile, err);
+	if (res) {
+		cartridge_battery_load_state(gzFile);
+	}
+
+	gzclose(gzFile);
+
+	return res;
+}
+
+static gboolean movie_read_keyframe(const Keyframe *keyframe, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	if (keyframe->base >= keyframes->len) {
+		g_set_error(err, MOVIE_ERROR, G_MOVIE_ERROR_INVALID,
+				"Truncated or corrupt movie file");
+		return FALSE;
+	}
+
+	// Incremental keyframes are loaded on top of their full keyframe
+	const Keyframe *base = &g_array_index(keyframes, Keyframe, keyframe->base);
+	if (!movie_read_state(base, TRUE, err)) {
+		return FALSE;
+	}
+
+	CPUMarkStateBase();
+
+	if (base != keyframe && !movie_read_state(keyframe, FALSE, err)) {
+		return FALSE;
+	}
+
+	currentFrame = keyframe->frame;
+	movie_update_rtc();
+
+	return TRUE;
+}
+
+gboolean movie_record_start(const gchar *file, InputDriver *input, guint interval, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+	g_assert(input != NULL);
+
+	if (mode != MOVIE_NONE) {
+		g_set_error(err, MOVIE_ERROR, G_MOVIE_ERROR_BUSY,
+				"A movie is already active");
+		return FALSE;
+	}
+
+	movieFile = fopen(file, "wb");
+	if (movieFile == NULL) {
+		g_set_error(err, MOVIE_ERROR, G_MOVIE_ERROR_FAILED,
+				"Failed to record movie: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	guint32 version = MOVIE_VERSION;
+	u8 romname[17];
+	cartridge_get_game_name(romname);
+
+	GDateTime *now = g_date_time_new_now_local();
+	startTime = g_date_time_to_unix(now) + g_date_time_get_utc_offset(now) / G_TIME_SPAN_SECOND;
+	g_date_time_unref(now);
+
+	fwrite(MOVIE_MAGIC, 8, 1, movieFile);
+	fwrite(&version, sizeof(version), 1, movieFile);
+	fwrite(romname, 16, 1, movieFile);
+	fwrite(&startTime, sizeof(startTime), 1, movieFile);
+
+	frames = g_array_new(FALSE, FALSE, sizeof(guint32));
+	keyframes = g_array_new(FALSE, FALSE, sizeof(Keyframe));
+	keyframeInterval = MAX(interval, 1);
+
+	movie_install(MOVIE_RECORDING, input);
+
+	if (!movie_write_keyframe(err)) {
+		movie_free();
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean movie_read(void *data, gsize size, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	if (size > 0 && fread(data, size, 1, movieFile) != 1) {
+		g_set_error(err, MOVIE_ERROR, G_MOVIE_ERROR_INVALID,
+				"Truncated or corrupt movie file");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+gboolean movie_play_start(const gchar *file, InputDriver *input, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+	g_assert(input != NULL);
+
+	if (mode != MOVIE_NONE) {
+		g_set_error(err, MOVIE_ERROR, G_MOVIE_ERROR_BUSY,
+				"A movie is already active");
+		return FALSE;
+	}
+
+	movieFile = fopen(file, "rb");
+	if (movieFile == NULL) {
+		g_set_error(err, MOVIE_ERROR, G_MOVIE_ERROR_FAILED,
+				"Failed to play movie: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	gchar magic[8];
+	guint32 version;
+	if (!movie_read(magic, sizeof(magic), err) || !movie_read(&version, sizeof(version), err)) {
+		movie_free();
+		return FALSE;
+	}
+
+	if (memcmp(magic, MOVIE_MAGIC, sizeof(magic)) != 0 || version != MOVIE_VERSION) {
+		g_set_error(err, MOVIE_ERROR, G_MOVIE_ERROR_INVALID,
+				"Unsupported movie file");
+		movie_free();
+		return FALSE;
+	}
+
+	u8 romname[16];
+	if (!movie_read(romname, sizeof(romname), err) || !movie_read(&startTime, sizeof(startTime), err)) {
+		movie_free();
+		return FALSE;
+	}
+
+	guint32 footerOffset, frameCount, keyframeCount;
+	if (fseek(movieFile, -(long)(sizeof(footerOffset) + sizeof(magic)), SEEK_END) != 0
+			|| !movie_read(&footerOffset, sizeof(footerOffset), err)
+			|| !movie_read(magic, sizeof(magic), err)) {
+		g_clear_error(err);
+		g_set_error(err, MOVIE_ERROR, G_MOVIE_ERROR_INVALID,
+				"The movie file was not closed properly");
+		movie_free();
+		return FALSE;
+	}
+
+	if (memcmp(magic, MOVIE_END_MAGIC, sizeof(magic)) != 0
+			|| fseek(movieFile, footerOffset, SEEK_SET) != 0) {
+		g_set_error(err, MOVIE_ERROR, G_MOVIE_ERROR_INVALID,
+				"The movie file was not closed properly");
+		movie_free();
+		return FALSE;
+	}
+
+	frames = g_array_new(FALSE, FALSE, sizeof(guint32));
+	keyframes = g_array_new(FALSE, FALSE, sizeof(Keyframe));
+
+	if (!movie_read(&frameCount, sizeof(frameCount), err)) {
+		movie_free();
+		return FALSE;
+	}
+
+	g_array_set_size(frames, frameCount);
+	if (!movie_read(frames->data, frameCount * sizeof(guint32), err)
+			|| !movie_read(&keyframeCount, sizeof(keyframeCount), err)) {
+		movie_free();
+		return FALSE;
+	}
+
+	g_array_set_size(keyframes, keyframeCount);
+	if (!movie_read(keyframes->data, keyframeCount * sizeof(Keyframe), err)) {
+		movie_free();
+		return FALSE;
+	}
+
+	if (keyframeCount == 0 || g_array_index(keyframes, Keyframe, 0).frame != 0) {
+		g_set_error(err, MOVIE_ERROR, G_MOVIE_ERROR_INVALID,
+				"The movie file has no initial keyframe");
+		movie_free();
+		return FALSE;
+	}
+
+	movie_install(MOVIE_PLAYING, input);
+
+	if (!movie_read_keyframe(&g_array_index(keyframes, Keyframe, 0), err)) {
+		movie_free();
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean movie_write_footer(GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	guint32 frameCount = frames->len;
+	guint32 keyframeCount = keyframes->len;
+
+	fseek(movieFile, 0, SEEK_END);
+	guint32 footerOffset = ftell(movieFile);
+
+	fwrite(&frameCount, sizeof(frameCount), 1, movieFile);
+	fwrite(frames->data, sizeof(guint32), frameCount, movieFile);
+	fwrite(&keyframeCount, sizeof(keyframeCount), 1, movieFile);
+	fwrite(keyframes->data, sizeof(Keyframe), keyframeCount, movieFile);
+	fwrite(&footerOffset, sizeof(footerOffset), 1, movieFile);
+	fwrite(MOVIE_END_MAGIC, 8, 1, movieFile);
+
+	gboolean failed = ferror(movieFile);
+	if (fclose(movieFile) != 0) {
+		failed = TRUE;
+	}
+	movieFile = NULL;
+
+	if (failed) {
+		g_set_error(err, MOVIE_ERROR, G_MOVIE_ERROR_FAILED,
+				"Failed to write movie: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+gboolean movie_stop(GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	gboolean res = TRUE;
+	if (mode == MOVIE_RECORDING) {
+		res = movie_write_footer(err);
+	}
+
+	movie_free();
+
+	return res;
+}
+
+gboolean movie_update(GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	if (mode == MOVIE_RECORDING && currentFrame >= nextKeyframe) {
+		return movie_write_keyframe(err);
+	}
+
+	return TRUE;
+}
+
+gboolean movie_seek(guint frame, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	if (mode != MOVIE_PLAYING) {
+		g_set_error(err, MOVIE_ERROR, G_MOVIE_ERROR_FAILED,
+				"Only movies being played back can be seeked");
+		return FALSE;
+	}
+
+	// Keyframes are sorted by frame, find the last one before the target.
+	// When seeking forward, only restore it if it is ahead of the current frame.
+	const Keyframe *keyframe = NULL;
+	for (guint i = 0; i < keyframes->len; i++) {
+		const Keyframe *k = &g_array_index(keyframes, Keyframe, i);
+		if (k->frame > frame)
+			break;
+		keyframe = k;
+	}
+
+	if (frame < currentFrame || keyframe->frame > currentFrame) {
+		if (!movie_read_keyframe(keyframe, err)) {
+			return FALSE;
+		}
+	}
+
+	while (currentFrame < frame) {
+		CPULoop(MOVIE_SEEK_TICKS);
+	}
+
+	return TRUE;
+}
+
+gboolean movie_is_active() {
+	return mode != MOVIE_NONE;
+}
+
+guint movie_get_frame() {
+	return currentFrame;
+}
+
+guint movie_get_length() {
+	return frames != NULL ? frames->len : 0;
+}
+
+GQuark movie_error_quark() {
+	return g_quark_from_static_string("movie_error_quark");
+}
@@ -0,0 +1,111 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef VBAM_GBA_MOVIE_H_
+#define VBAM_GBA_MOVIE_H_
+
+#include <glib.h>
+#include "../common/InputDriver.h"
+
+/* Set up for C function definitions, even when using C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Movie error domain
+ */
+#define MOVIE_ERROR (movie_error_quark())
+GQuark movie_error_quark();
+
+/**
+ * Movie error types
+ */
+typedef enum
+{
+	G_MOVIE_ERROR_FAILED,
+	G_MOVIE_ERROR_INVALID,
+	G_MOVIE_ERROR_BUSY
+} MovieError;
+
+/**
+ * Start recording the joypad state of each frame to a movie file
+ *
+ * The movie takes over as the core input driver, forwarding to the given
+ * driver. A keyframe savestate is embedded right away, and then every
+ * keyframeInterval frames. Keyframes include the save memory, and the
+ * cartridge clock runs from the time the recording started.
+ * @param file movie file name
+ * @param input input driver to record
+ * @param keyframeInterval number of frames between keyframes
+ * @param err return location for a GError, or NULL
+ * @return success
+ */
+gboolean movie_record_start(const gchar *file, InputDriver *input, guint keyframeInterval, GError **err);
+
+/**
+ * Start playing back a movie file from its first frame
+ *
+ * The movie takes over as the core input driver. Once all the recorded
+ * frames are played, input is read from the given driver.
+ * @param file movie file name
+ * @param input input driver to use after the end of the movie
+ * @param err return location for a GError, or NULL
+ * @return success
+ */
+gboolean movie_play_start(const gchar *file, InputDriver *input, GError **err);
+
+/**
+ * Stop recording or playing back, restoring the original input driver.
+ * Does nothing when no movie is active.
+ * @param err return location for a GError, or NULL
+ * @return success writing the movie file
+ */
+gboolean movie_stop(GError **err);
+
+/**
+ * Embed a keyframe when one is due. To be called between CPULoop calls.
+ * @param err return location for a GError, or NULL
+ * @return success
+ */
+gboolean movie_update(GError **err);
+
+/**
+ * Seek a movie being played back to the given frame, by restoring the nearest
+ * previous keyframe and emulating the frames in between
+ * @param frame frame to seek to
+ * @param err return location for a GError, or NULL
+ * @return success
+ */
+gboolean movie_seek(guint frame, GError **err);
+
+/** @return whether a movie is being recorded or played back */
+gboolean movie_is_active();
+
+/** @return current frame number of the active movie */
+guint movie_get_frame();
+
+/** @return number of frames of the active movie */
+guint movie_get_length();
+
+/* Ends C function definitions when using C++ */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VBAM_GBA_MOVIE_H_ */
@@ -0,0 +1,78 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// clock_gettime is not part of C99
+#define _POSIX_C_SOURCE 199309L
+
+#include "PerfCounters.h"
+
+#include <string.h>
+
+#ifdef G_OS_WIN32
+# include <windows.h>
+#else
+# include <time.h>
+#endif
+
+PerfCounters perfCounters;
+
+static PerfCounters lastFrame;
+
+gint64 perf_counters_get_time() {
+#ifdef G_OS_WIN32
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+
+	QueryPerformanceCounter(&counter);
+
+	// Split the conversion to avoid overflowing
+	gint64 seconds = counter.QuadPart / frequency.QuadPart;
+	gint64 remainder = counter.QuadPart % frequency.QuadPart;
+	return seconds * G_GINT64_CONSTANT(1000000000) + remainder * G_GINT64_CONSTANT(1000000000) / frequency.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (gint64) now.tv_sec * G_GINT64_CONSTANT(1000000000) + now.tv_nsec;
+#endif
+}
+
+void perf_counters_add_host_time(PerfHostPart part, gint64 time) {
+	g_assert(part >= 0 && part < PERF_HOST_PARTS);
+
+	perfCounters.hostTime[part] += time;
+}
+
+void perf_counters_end_frame() {
+	lastFrame = perfCounters;
+	memset(&perfCounters, 0, sizeof(perfCounters));
+}
+
+void perf_counters_reset() {
+	memset(&lastFrame, 0, sizeof(lastFrame));
+	memset(&perfCounters, 0, sizeof(perfCounters));
+}
+
+void perf_counters_get_last_frame(PerfCounters *counters) {
+	g_assert(counters != NULL);
+
+	*counters = lastFrame;
+}
@@ -0,0 +1,124 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef VBAM_GBA_PERFCOUNTERS_H_
+#define VBAM_GBA_PERFCOUNTERS_H_
+
+#include <glib.h>
+
+/* Set up for C function definitions, even when using C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Parts of the emulator the host time is attributed to
+ */
+typedef enum {
+	/** CPU, DMA, timers: the core time not attributed to the other parts */
+	PERF_HOST_CPU,
+	/** Line rendering */
+	PERF_HOST_PPU,
+	/** Sound synthesis and output */
+	PERF_HOST_APU,
+	/** Frame presentation, rendering and event processing of the frontend */
+	PERF_HOST_FRONTEND,
+	PERF_HOST_PARTS
+} PerfHostPart;
+
+/** Memory regions, indexed by the upper byte of the address */
+#define PERF_MEMORY_REGIONS 16
+
+/** DMA channels */
+#define PERF_DMA_CHANNELS 4
+
+/** Video modes with a line renderer */
+#define PERF_VIDEO_MODES 6
+
+/**
+ * Counters of the work done by the emulator during a frame
+ */
+typedef struct {
+	/** Instructions executed in each CPU state */
+	guint64 armInstructions;
+	guint64 thumbInstructions;
+
+	/** Clock cycles the CPU spent halted or stopped */
+	guint64 haltCycles;
+
+	/** Memory accesses of the CPU and the DMA, per memory region */
+	guint64 memoryAccesses[PERF_MEMORY_REGIONS];
+
+	/** Bytes moved by each DMA channel */
+	guint64 dmaBytes[PERF_DMA_CHANNELS];
+
+	/** Scanlines rendered by the line renderers of each video mode */
+	guint64 modeScanlines[PERF_VIDEO_MODES];
+
+	/** Sound ticks, and stereo samples sent to the sound driver */
+	guint64 soundTicks;
+	guint64 soundSamples;
+
+	/** Host time spent in each part of the emulator, in nanoseconds */
+	gint64 hostTime[PERF_HOST_PARTS];
+} PerfCounters;
+
+/**
+ * Counters of the frame being emulated, incremented directly by the core.
+ * Use perf_counters_get_last_frame to read them.
+ */
+extern PerfCounters perfCounters;
+
+/**
+ * @return host monotonic time in nanoseconds
+ */
+gint64 perf_counters_get_time();
+
+/**
+ * Attribute host time to a part of the emulator, for the time measured
+ * outside of the core, such as the frontend rendering
+ *
+ * @param part part of the emulator the time was spent in
+ * @param time duration in nanoseconds
+ */
+void perf_counters_add_host_time(PerfHostPart part, gint64 time);
+
+/**
+ * Make the counters of the frame being emulated available
+ * through perf_counters_get_last_frame, and start counting a new frame
+ */
+void perf_counters_end_frame();
+
+/**
+ * Clear the counters, of the last frame and of the frame being emulated
+ */
+void perf_counters_reset();
+
+/**
+ * Get the counters of the last complete frame
+ *
+ * @param counters return location for the counters
+ */
+void perf_counters_get_last_frame(PerfCounters *counters);
+
+/* Ends C function definitions when using C++ */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VBAM_GBA_PERFCOUNTERS_H_ */
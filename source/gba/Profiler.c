@@ -0,0 +1,379 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include "Profiler.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// ELF constants, for 32 bits little endian files
+#define ELF_HEADER_SIZE 52
+#define ELF_SECTION_SIZE 40
+#define ELF_SYMBOL_SIZE 16
+#define ELF_SHT_SYMTAB 2
+#define ELF_STT_FUNC 2
+
+typedef struct {
+	guint32 address;
+	/** Size of the function, 0 if it extends up to the next symbol */
+	guint32 size;
+	gchar *name;
+} Symbol;
+
+gboolean profilerEnabled = FALSE;
+int profilerTicks = PROFILER_PERIOD;
+
+static struct {
+	gchar *file;
+
+	/** Samples per address, with the Thumb state in bit 0 */
+	GHashTable *samples;
+	guint64 haltSamples;
+
+	/** Symbols sorted by address */
+	GArray *symbols;
+} profiler;
+
+static const gchar *regionNames[16] = {
+	"BIOS", "0x01", "EWRAM", "IWRAM", "IO", "Palette", "VRAM", "OAM",
+	"ROM", "ROM", "ROM", "ROM", "ROM", "ROM", "SRAM", "0x0F"
+};
+
+GQuark profiler_error_quark() {
+	return g_quark_from_static_string("profiler_error_quark");
+}
+
+static gint symbol_compare(gconstpointer a, gconstpointer b) {
+	const Symbol *sa = (const Symbol *)a;
+	const Symbol *sb = (const Symbol *)b;
+
+	if (sa->address != sb->address)
+		return sa->address < sb->address ? -1 : 1;
+
+	// Prefer the symbols with a size for aliases
+	return (gint)(sb->size != 0) - (gint)(sa->size != 0);
+}
+
+static void symbols_add(guint32 address, guint32 size, const gchar *name) {
+	Symbol symbol;
+	symbol.address = address & ~1;
+	symbol.size = size;
+	symbol.name = g_strdup(name);
+
+	g_array_append_val(profiler.symbols, symbol);
+}
+
+static guint32 read_le32(const guint8 *data) {
+	return data[0] | (data[1] << 8) | (data[2] << 16) | ((guint32)data[3] << 24);
+}
+
+static guint16 read_le16(const guint8 *data) {
+	return data[0] | (data[1] << 8);
+}
+
+static gboolean is_elf(const gchar *data, gsize length) {
+	return length >= ELF_HEADER_SIZE && memcmp(data, "\177ELF", 4) == 0;
+}
+
+/**
+ * Load the function symbols of a 32 bits little endian ELF file
+ */
+static gboolean symbols_load_elf(const guint8 *data, gsize length, GError **err) {
+	if (data[4] != 1 || data[5] != 1) {
+		g_set_error(err, PROFILER_ERROR, G_PROFILER_ERROR_BAD_SYMBOLS,
+				"Only 32 bits little endian ELF files are supported");
+		return FALSE;
+	}
+
+	guint32 sectionsOffset = read_le32(data + 0x20);
+	guint16 sectionSize = read_le16(data + 0x2E);
+	guint16 sectionCount = read_le16(data + 0x30);
+
+	if (sectionSize < ELF_SECTION_SIZE || sectionsOffset > length
+			|| (gsize)sectionCount * sectionSize > length - sectionsOffset) {
+		g_set_error(err, PROFILER_ERROR, G_PROFILER_ERROR_BAD_SYMBOLS,
+				"Invalid ELF section table");
+		return FALSE;
+	}
+
+	for (guint i = 0; i < sectionCount; i++) {
+		const guint8 *section = data + sectionsOffset + i * sectionSize;
+		if (read_le32(section + 4) != ELF_SHT_SYMTAB)
+			continue;
+
+		guint32 offset = read_le32(section + 16);
+		guint32 size = read_le32(section + 20);
+		guint32 link = read_le32(section + 24);
+		if (offset > length || size > length - offset || link >= sectionCount) {
+			g_set_error(err, PROFILER_ERROR, G_PROFILER_ERROR_BAD_SYMBOLS,
+					"Invalid ELF symbol table");
+			return FALSE;
+		}
+
+		// Names are in the string table linked to the symbol table
+		const guint8 *strings = data + sectionsOffset + link * sectionSize;
+		guint32 stringsOffset = read_le32(strings + 16);
+		guint32 stringsSize = read_le32(strings + 20);
+		if (stringsOffset > length || stringsSize > length - stringsOffset) {
+			g_set_error(err, PROFILER_ERROR, G_PROFILER_ERROR_BAD_SYMBOLS,
+					"Invalid ELF string table");
+			return FALSE;
+		}
+
+		for (guint32 s = 0; s + ELF_SYMBOL_SIZE <= size; s += ELF_SYMBOL_SIZE) {
+			const guint8 *symbol = data + offset + s;
+			guint32 name = read_le32(symbol);
+			if ((symbol[12] & 0xF) != ELF_STT_FUNC || name >= stringsSize)
+				continue;
+
+			const gchar *start = (const gchar *)data + stringsOffset + name;
+			gchar *symbolName = g_strndup(start, stringsSize - name);
+			symbols_add(read_le32(symbol + 4), read_le32(symbol + 8), symbolName);
+			g_free(symbolName);
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * Load the symbols of a map file, with an address and a name per line,
+ * optionally separated by a symbol type as in the output of nm.
+ * The other lines are ignored.
+ */
+static gboolean symbols_load_map(const gchar *data, GError **err) {
+	gchar **lines = g_strsplit(data, "\n", -1);
+
+	for (gchar **line = lines; *line != NULL; line++) {
+		gchar **tokens = g_strsplit_set(g_strstrip(*line), " \t", -1);
+
+		// Drop the empty tokens between consecutive separators
+		guint count = 0;
+		for (guint i = 0; tokens[i] != NULL; i++) {
+			if (tokens[i][0] != '\0') {
+				tokens[count++] = tokens[i];
+			} else {
+				g_free(tokens[i]);
+			}
+		}
+		tokens[count] = NULL;
+
+		gboolean nmLine = count == 3 && strlen(tokens[1]) == 1;
+		if (count == 2 || (nmLine && strchr("TtWw", tokens[1][0]) != NULL)) {
+			gchar *end;
+			guint64 address = g_ascii_strtoull(tokens[0], &end, 16);
+
+			if (end != tokens[0] && *end == '\0' && address <= G_MAXUINT32) {
+				symbols_add((guint32)address, 0, tokens[count - 1]);
+			}
+		}
+
+		g_strfreev(tokens);
+	}
+
+	g_strfreev(lines);
+
+	if (profiler.symbols->len == 0) {
+		g_set_error(err, PROFILER_ERROR, G_PROFILER_ERROR_BAD_SYMBOLS,
+				"No symbols found in the map file");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean symbols_load(const gchar *file, GError **err) {
+	gchar *data;
+	gsize length;
+
+	if (!g_file_get_contents(file, &data, &length, err)) {
+		return FALSE;
+	}
+
+	gboolean success = is_elf(data, length)
+			? symbols_load_elf((const guint8 *)data, length, err)
+			: symbols_load_map(data, err);
+
+	g_free(data);
+
+	g_array_sort(profiler.symbols, symbol_compare);
+
+	return success;
+}
+
+/**
+ * @return the function containing an address, or NULL
+ */
+static const Symbol *symbols_lookup(guint32 address) {
+	GArray *symbols = profiler.symbols;
+
+	// Last symbol at or before the address
+	guint low = 0, high = symbols->len;
+	while (low < high) {
+		guint middle = (low + high) / 2;
+		if (g_array_index(symbols, Symbol, middle).address <= address) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+
+	if (low == 0)
+		return NULL;
+
+	// The first of the aliases is the one with a size, if any
+	guint index = low - 1;
+	while (index > 0 && g_array_index(symbols, Symbol, index - 1).address == g_array_index(symbols, Symbol, index).address) {
+		index--;
+	}
+
+	const Symbol *symbol = &g_array_index(symbols, Symbol, index);
+	if (symbol->size != 0 && address - symbol->address >= symbol->size)
+		return NULL;
+
+	return symbol;
+}
+
+static void profiler_free_symbols() {
+	if (profiler.symbols == NULL)
+		return;
+
+	for (guint i = 0; i < profiler.symbols->len; i++) {
+		g_free(g_array_index(profiler.symbols, Symbol, i).name);
+	}
+
+	g_array_free(profiler.symbols, TRUE);
+	profiler.symbols = NULL;
+}
+
+gboolean profiler_start(const gchar *file, const gchar *symbolFile, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+	g_return_val_if_fail(!profilerEnabled, FALSE);
+
+	profiler.symbols = g_array_new(FALSE, FALSE, sizeof(Symbol));
+
+	if (symbolFile != NULL && !symbols_load(symbolFile, err)) {
+		profiler_free_symbols();
+		return FALSE;
+	}
+
+	profiler.file = g_strdup(file);
+	profilerTicks = PROFILER_PERIOD;
+	profiler.samples = g_hash_table_new(g_direct_hash, g_direct_equal);
+	profiler.haltSamples = 0;
+
+	profilerEnabled = TRUE;
+
+	return TRUE;
+}
+
+/**
+ * Start the next period, returning the number of periods
+ * the cycles accounted last have ended
+ */
+static int profiler_take_periods() {
+	int periods = 1 - profilerTicks / PROFILER_PERIOD;
+	profilerTicks += periods * PROFILER_PERIOD;
+
+	return periods;
+}
+
+void profiler_sample(guint32 pc, gboolean thumb) {
+	// Instructions stalled for longer than a period weigh as much as
+	// the periods they span, as do the halted cycles
+	int periods = profiler_take_periods();
+
+	gpointer key = GUINT_TO_POINTER((pc & ~1) | (thumb ? 1 : 0));
+	guint count = GPOINTER_TO_UINT(g_hash_table_lookup(profiler.samples, key));
+	g_hash_table_insert(profiler.samples, key, GUINT_TO_POINTER(count + periods));
+}
+
+void profiler_halt(int ticks) {
+	profilerTicks -= ticks;
+	if (profilerTicks <= 0) {
+		profiler.haltSamples += profiler_take_periods();
+	}
+}
+
+/**
+ * Add the samples of an address to the count of its stack
+ */
+static void profiler_collapse(gpointer key, gpointer value, gpointer data) {
+	GHashTable *stacks = (GHashTable *)data;
+	guint32 address = GPOINTER_TO_UINT(key) & ~1;
+	gboolean thumb = GPOINTER_TO_UINT(key) & 1;
+
+	const Symbol *symbol = symbols_lookup(address);
+
+	gchar *stack;
+	if (symbol != NULL) {
+		stack = g_strdup_printf("%s;%s;%s", regionNames[(address >> 24) & 15],
+				thumb ? "thumb" : "arm", symbol->name);
+	} else {
+		stack = g_strdup_printf("%s;%s;0x%08x", regionNames[(address >> 24) & 15],
+				thumb ? "thumb" : "arm", address);
+	}
+
+	guint64 *count = (guint64 *)g_hash_table_lookup(stacks, stack);
+	if (count == NULL) {
+		count = g_new0(guint64, 1);
+		g_hash_table_insert(stacks, stack, count);
+	} else {
+		g_free(stack);
+	}
+
+	*count += GPOINTER_TO_UINT(value);
+}
+
+gboolean profiler_stop(GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	if (!profilerEnabled)
+		return TRUE;
+
+	profilerEnabled = FALSE;
+
+	GHashTable *stacks = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	g_hash_table_foreach(profiler.samples, profiler_collapse, stacks);
+
+	// Sorted, so that profiles can be compared
+	GList *keys = g_list_sort(g_hash_table_get_keys(stacks), (GCompareFunc)strcmp);
+
+	GString *output = g_string_new(NULL);
+	for (GList *it = keys; it != NULL; it = it->next) {
+		guint64 *count = (guint64 *)g_hash_table_lookup(stacks, it->data);
+		g_string_append_printf(output, "%s %" G_GUINT64_FORMAT "\n", (const gchar *)it->data, *count);
+	}
+
+	if (profiler.haltSamples > 0) {
+		g_string_append_printf(output, "halt %" G_GUINT64_FORMAT "\n", profiler.haltSamples);
+	}
+
+	gboolean success = g_file_set_contents(profiler.file, output->str, output->len, err);
+
+	g_string_free(output, TRUE);
+	g_list_free(keys);
+	g_hash_table_destroy(stacks);
+	g_hash_table_destroy(profiler.samples);
+	profiler.samples = NULL;
+	profiler_free_symbols();
+	g_free(profiler.file);
+	profiler.file = NULL;
+
+	return success;
+}
@@ -0,0 +1,121 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef VBAM_GBA_PROFILER_H_
+#define VBAM_GBA_PROFILER_H_
+
+#include <glib.h>
+
+/* Set up for C function definitions, even when using C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Profiler error domain
+ */
+#define PROFILER_ERROR (profiler_error_quark())
+GQuark profiler_error_quark();
+
+/**
+ * Profiler error types
+ */
+typedef enum
+{
+	G_PROFILER_ERROR_FAILED,
+	G_PROFILER_ERROR_BAD_SYMBOLS
+} ProfilerError;
+
+/**
+ * Sampling profiler of the emulated code
+ *
+ * The emulated PC is sampled at a fixed period of emulated clock cycles,
+ * and the samples are counted per address. The cycles are counted as the
+ * instructions execute, so that the samples do not follow the timing of the
+ * LCD and timer events. The cycles of DMA transfers are not counted. When the profiler is stopped,
+ * the counts are written in the collapsed stack format read by the
+ * flamegraph tools, one line per memory region, CPU state and function:
+ *
+ *     ROM;thumb;UpdateSprites 1234
+ *
+ * Without symbols, or for addresses outside of the known functions,
+ * the address itself is used as the function name.
+ */
+
+/** Emulated clock cycles between samples */
+#define PROFILER_PERIOD 1024
+
+/** Whether the profiler is running, checked before updating it */
+extern gboolean profilerEnabled;
+
+/** Emulated clock cycles left before the next sample */
+extern int profilerTicks;
+
+/**
+ * Account for the cycles of an executed instruction, and sample its address
+ * when they end a period. When the profiler is off, this costs a single test.
+ */
+#define PROFILER_INSTRUCTION(ticks, pc, thumb) \
+	do { \
+		if (G_UNLIKELY(profilerEnabled) && (profilerTicks -= (ticks)) <= 0) \
+			profiler_sample((pc), (thumb)); \
+	} while (0)
+
+/**
+ * Start profiling, and load the function symbols if a symbol file is given.
+ * The symbol file is either an ELF file, or a map file listing an address
+ * and a name per line, such as the output of nm.
+ *
+ * @param file file the profile is written to when stopping
+ * @param symbolFile symbol file, or NULL
+ * @param err return location for a GError, or NULL
+ * @return FALSE if the symbols could not be loaded
+ */
+gboolean profiler_start(const gchar *file, const gchar *symbolFile, GError **err);
+
+/**
+ * Sample an instruction ending one or more periods, use PROFILER_INSTRUCTION instead
+ *
+ * @param pc address of the instruction
+ * @param thumb whether the CPU is in the Thumb state
+ */
+void profiler_sample(guint32 pc, gboolean thumb);
+
+/**
+ * Account for the cycles the CPU spends halted, waiting for an interrupt.
+ * The periods they end are counted as halt samples.
+ *
+ * @param ticks emulated clock cycles spent halted
+ */
+void profiler_halt(int ticks);
+
+/**
+ * Write the profile and stop profiling.
+ * If the profiler is not running, it simply returns TRUE.
+ *
+ * @param err return location for a GError, or NULL
+ * @return FALSE if the profile could not be written
+ */
+gboolean profiler_stop(GError **err);
+
+/* Ends C function definitions when using C++ */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VBAM_GBA_PROFILER_H_ */
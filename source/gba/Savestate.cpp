@@ -20,15 +20,48 @@
 
 #include "GBA.h"
 #include "Cartridge.h"
+#include "Trace.h"
 #include "../common/Settings.h"
 
 #include <errno.h>
+#include <stdio.h>
 #include <string.h>
 #include <zlib.h>
 
+// Slot whose full state is the current state base, if any,
+// and the number of saves to it since that full state
+static struct {
+	gint slot;
+	u32 checksum;
+	guint saves;
+} slotBase = { -1, 0, 0 };
+
+static gboolean is_raw_state(const gchar *file) {
+	gchar magic[8];
+	gboolean raw = FALSE;
+
+	FILE *f = fopen(file, "rb");
+	if (f != NULL) {
+		raw = fread(magic, sizeof(magic), 1, f) == 1
+				&& memcmp(magic, SAVE_GAME_RAW_MAGIC, sizeof(magic)) == 0;
+		fclose(f);
+	}
+
+	return raw;
+}
+
 gboolean savestate_load_from_file(const gchar *file, GError **err) {
 	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
 
+	if (is_raw_state(file)) {
+		gboolean res = CPUReadStateRaw(file, err);
+		if (res) {
+			CPUMarkStateBase();
+		}
+
+		return res;
+	}
+
 	gzFile gzFile = gzopen(file, "rb");
 	if (gzFile == NULL) {
 		SaveStateError code = G_SAVESTATE_ERROR_FAILED;
@@ -45,6 +78,10 @@ gboolean savestate_load_from_file(const gchar *file, GError **err) {
 
 	gzclose(gzFile);
 
+	if (res) {
+		CPUMarkStateBase();
+	}
+
 	return res;
 }
 
@@ -62,10 +99,64 @@ gboolean savestate_save_to_file(const gchar *file, GError **err) {
 
 	gzclose(gzFile);
 
+	CPUMarkStateBase();
+
+	return TRUE;
+}
+
+gboolean savestate_save_raw_to_file(const gchar *file, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	if (!CPUWriteStateRaw(file, err)) {
+		return FALSE;
+	}
+
+	CPUMarkStateBase();
+
 	return TRUE;
 }
 
-static gchar *get_slot_filename(gint num) {
+gboolean savestate_save_incremental_to_file(const gchar *file, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	gzFile gzFile = gzopen(file, "wb");
+	if (gzFile == NULL) {
+		g_set_error(err, SAVESTATE_ERROR, G_SAVESTATE_ERROR_FAILED,
+				"Failed to save state: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	gboolean res = CPUWriteStateIncremental(gzFile, err);
+
+	gzclose(gzFile);
+
+	return res;
+}
+
+gboolean savestate_load_incremental_from_file(const gchar *baseFile, const gchar *file, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	gzFile gzFile = gzopen(file, "rb");
+	if (gzFile == NULL) {
+		SaveStateError code = G_SAVESTATE_ERROR_FAILED;
+		if (errno == ENOENT) {
+			code = G_SAVESTATE_NOT_FOUND;
+		}
+
+		g_set_error(err, SAVESTATE_ERROR, code,
+				"Failed to load state: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	gboolean res = savestate_load_from_file(baseFile, err)
+			&& CPUReadStateIncremental(gzFile, err);
+
+	gzclose(gzFile);
+
+	return res;
+}
+
+static gchar *get_slot_filename(gint num, const gchar *extension) {
 	const gchar *saveDir = settings_get_save_dir();
 
 	//TODO: Ensure the filename is safe
@@ -73,7 +164,7 @@ static gchar *get_slot_filename(gint num) {
 
 	gchar *stateNum = g_strdup_printf("%d", num + 1);
 	gchar *baseName = g_path_get_basename(gameTitle);
-	gchar *fileName = g_strconcat(baseName, "_", stateNum, ".sgm", NULL);
+	gchar *fileName = g_strconcat(baseName, "_", stateNum, extension, NULL);
 	gchar *stateName = g_build_filename(saveDir, fileName, NULL);
 
 	g_free(fileName);
@@ -86,10 +177,30 @@ static gchar *get_slot_filename(gint num) {
 gboolean savestate_load_slot(gint num, GError **err) {
 	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
 
-	gchar *stateName = get_slot_filename(num);
-	gboolean success = savestate_load_from_file(stateName, err);
+	TRACE_BEGIN("savestate_load_slot");
+
+	gchar *stateName = get_slot_filename(num, ".sgm");
+	gchar *incrementalName = get_slot_filename(num, ".sgi");
+
+	gboolean success;
+	gboolean incremental = g_file_test(incrementalName, G_FILE_TEST_EXISTS);
+	if (incremental) {
+		success = savestate_load_incremental_from_file(stateName, incrementalName, err);
+	} else {
+		success = savestate_load_from_file(stateName, err);
+	}
+
+	if (success) {
+		slotBase.slot = num;
+		slotBase.saves = incremental ? 1 : 0;
+		CPUGetStateBase(&slotBase.checksum);
+	}
+
+	g_free(incrementalName);
 	g_free(stateName);
 
+	TRACE_END("savestate_load_slot");
+
 	if (g_error_matches(*err, SAVESTATE_ERROR, G_SAVESTATE_NOT_FOUND)) {
 		g_clear_error(err);
 		g_set_error(err, SAVESTATE_ERROR, G_SAVESTATE_NOT_FOUND,
@@ -102,10 +213,43 @@ gboolean savestate_load_slot(gint num, GError **err) {
 gboolean savestate_save_slot(gint num, GError **err) {
 	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
 
-	gchar *stateName = get_slot_filename(num);
-	gboolean success = savestate_save_to_file(stateName, err);
+	TRACE_BEGIN("savestate_save_slot");
+
+	gchar *stateName = get_slot_filename(num, ".sgm");
+	gchar *incrementalName = get_slot_filename(num, ".sgi");
+
+	// Only every fullStateInterval-th save to a slot is a full state, the
+	// others replace the slot's incremental state against that full state
+	u32 checksum;
+	gboolean incremental = num == slotBase.slot
+			&& slotBase.saves < settings_savestate_full_interval()
+			&& CPUGetStateBase(&checksum) && checksum == slotBase.checksum;
+
+	gboolean success;
+	if (incremental) {
+		success = savestate_save_incremental_to_file(incrementalName, err);
+	} else {
+		success = savestate_save_to_file(stateName, err);
+
+		// The incremental state was against the replaced full state
+		if (success) {
+			remove(incrementalName);
+
+			slotBase.slot = num;
+			slotBase.saves = 0;
+			CPUGetStateBase(&slotBase.checksum);
+		}
+	}
+
+	if (success) {
+		slotBase.saves++;
+	}
+
+	g_free(incrementalName);
 	g_free(stateName);
 
+	TRACE_END("savestate_save_slot");
+
 	return success;
 }
 
@@ -40,11 +40,15 @@ typedef enum
 	G_SAVESTATE_ERROR_FAILED,
 	G_SAVESTATE_WRONG_GAME,
 	G_SAVESTATE_UNSUPPORTED_VERSION,
-	G_SAVESTATE_NOT_FOUND
+	G_SAVESTATE_NOT_FOUND,
+	G_SAVESTATE_NO_BASE,
+	G_SAVESTATE_WRONG_BASE
 } SaveStateError;
 
 /**
  * Load a save state from file
+ *
+ * Both compressed and uncompressed save states are supported.
  * @param file file name
  * @param err return location for a GError, or NULL
  * @return success
@@ -59,6 +63,37 @@ gboolean savestate_load_from_file(const gchar *file, GError **err);
  */
 gboolean savestate_save_to_file(const gchar *file, GError **err);
 
+/**
+ * Save an uncompressed save state to file
+ *
+ * The memory regions are stored page aligned so that loading the state
+ * only requires mapping the file and copying them in place.
+ * @param file file name
+ * @param err return location for a GError, or NULL
+ * @return success
+ */
+gboolean savestate_save_raw_to_file(const gchar *file, GError **err);
+
+/**
+ * Save an incremental save state to file
+ *
+ * Only the memory pages written since the last base state was saved
+ * or loaded are stored. Full save states act as bases.
+ * @param file file name
+ * @param err return location for a GError, or NULL
+ * @return success
+ */
+gboolean savestate_save_incremental_to_file(const gchar *file, GError **err);
+
+/**
+ * Load an incremental save state on top of its base
+ * @param baseFile file name of the full save state the incremental state was saved against
+ * @param file file name of the incremental save state
+ * @param err return location for a GError, or NULL
+ * @return success
+ */
+gboolean savestate_load_incremental_from_file(const gchar *baseFile, const gchar *file, GError **err);
+
 /**
  * Load a save state from a slot
  * @param num slot number
@@ -69,6 +104,10 @@ gboolean savestate_load_slot(gint num, GError **err);
 
 /**
  * Save a save state to a slot
+ *
+ * A full state is saved every settings_savestate_full_interval() saves to
+ * the same slot. The saves in between only write an incremental state
+ * against it, next to it, and loading the slot loads both.
  * @param num slot number
  * @param err return location for a GError, or NULL
  * @return success
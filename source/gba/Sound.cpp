@@ -3,13 +3,18 @@
 #include "Sound.h"
 
 #include "GBA.h"
+#include "EventLog.h"
 #include "Globals.h"
+#include "PerfCounters.h"
+#include "Trace.h"
 #include "../common/Port.h"
 
 #include "../apu/Gb_Apu.h"
 #include "../apu/Multi_Buffer.h"
 
 #include "../common/SoundDriver.h"
+#include "../common/SoundCapture.h"
+#include "../common/Settings.h"
 
 // GBA sound registers
 #define SGCNT0_H 0x82
@@ -24,15 +29,25 @@ static SoundDriver * soundDriver = NULL;
 extern bool stopState;      // TODO: silence sound when true
 
 static int const SOUND_CLOCK_TICKS_ = 167772; // 1/100 second
+static int const SOUND_CLOCK_RATE   = 16777216;
+static int const SOUND_MAX_TICK_MS  = 20;
 
-static u16   soundFinalWave [1600];
+// Room for the longest tick at 48 kHz, with dynamic rate control
+static u16   soundFinalWave [2 * 48000 * SOUND_MAX_TICK_MS / 1000 * 21 / 20 + 16];
+static int   soundClockTicks    = SOUND_CLOCK_TICKS_;
+static int   soundLogTicks      = 0;
 static long  soundSampleRate    = 44100;
 static bool  soundInterpolation = true;
+static SoundQuality soundQuality = SOUND_QUALITY_BEST;
 static bool  soundPaused        = true;
 static float soundFiltering     = 0.5f;
 int   SOUND_CLOCK_TICKS  = SOUND_CLOCK_TICKS_;
 int   soundTicks         = SOUND_CLOCK_TICKS_;
 
+static float soundMaxRateDelta = 0.0f;
+static SoundMode soundMode   = SOUND_MODE_NORMAL;
+static u32   soundHash       = 0;
+static u32   soundHashTicks  = 0;
 static float soundVolume     = 1.0f;
 static float soundFiltering_ = -1;
 static float soundVolume_    = -1;
@@ -40,6 +55,17 @@ static float soundVolume_    = -1;
 void interp_rate()
 { /* empty for now */ }
 
+// FNV-1a over the events that make up the audio output
+static u32 const sound_hash_seed = 0x811C9DC5;
+
+static inline void hash_sound_event( int a, int b )
+{
+	u32 const event [3] = { (u32) a, (u32) b, (u32) (SOUND_CLOCK_TICKS - soundTicks) };
+	u8 const* p = (u8 const*) event;
+	for ( unsigned i = 0; i < sizeof event; i++ )
+		soundHash = (soundHash ^ p [i]) * 0x01000193;
+}
+
 class Gba_Pcm
 {
 public:
@@ -81,7 +107,42 @@ static Gba_Pcm_Fifo     pcm [2];
 static Gb_Apu*          gb_apu;
 static Stereo_Buffer*   stereo_buffer;
 
+// While capturing the sources separately, each one is synthesized to its own
+// stem buffer, and the stems are mixed together for the output
+enum { stem_pcm_a, stem_pcm_b, stem_psg, stem_count };
+static Stereo_Buffer*   stem_buffers [stem_count];
+static bool             stems_wanted;
+static bool             stems_active;
+static blip_sample_t    stemWave [stem_count] [sizeof soundFinalWave / sizeof (u16)];
+
+// Capture of the output, then of each stem
+static SoundCapture*    sound_captures [1 + stem_count];
+
+static inline Stereo_Buffer* output_buffer( int stem )
+{
+	return stems_active ? stem_buffers [stem] : stereo_buffer;
+}
+
 static Blip_Synth<blip_best_quality,1> pcm_synth [3]; // 32 kHz, 16 kHz, 8 kHz
+static Blip_Synth<blip_good_quality,1> pcm_synth_good [3];
+static Blip_Synth<blip_med_quality ,1> pcm_synth_fast;
+
+// Adds a PCM amplitude change using the synth of the current quality tier
+static inline void pcm_offset( int filter, blip_time_t time, int delta, Blip_Buffer* out )
+{
+	switch ( soundQuality )
+	{
+	case SOUND_QUALITY_FAST:
+		pcm_synth_fast.offset( time, delta, out );
+		break;
+	case SOUND_QUALITY_GOOD:
+		pcm_synth_good [filter].offset( time, delta, out );
+		break;
+	default:
+		pcm_synth [filter].offset( time, delta, out );
+		break;
+	}
+}
 
 static inline blip_time_t blip_time()
 {
@@ -101,20 +162,21 @@ void Gba_Pcm::apply_control( int idx )
 	shift = ~ioMem [SGCNT0_H] >> (2 + idx) & 1;
 
 	int ch = 0;
-	if (ioMem [NR52] & 0x80)
+	if ((ioMem [NR52] & 0x80) && soundMode == SOUND_MODE_NORMAL)
 		ch = ioMem [SGCNT0_H+1] >> (idx * 4) & 3;
 
+	Stereo_Buffer* buffer = output_buffer( stem_pcm_a + idx );
 	Blip_Buffer* out = 0;
 	switch ( ch )
 	{
 	case 1:
-		out = stereo_buffer->right();
+		out = buffer->right();
 		break;
 	case 2:
-		out = stereo_buffer->left();
+		out = buffer->left();
 		break;
 	case 3:
-		out = stereo_buffer->center();
+		out = buffer->center();
 		break;
 	}
 
@@ -123,7 +185,7 @@ void Gba_Pcm::apply_control( int idx )
 		if ( output )
 		{
 			output->set_modified();
-			pcm_synth [0].offset( blip_time(), -last_amp, output );
+			pcm_offset( 0, blip_time(), -last_amp, output );
 		}
 		last_amp = 0;
 		output = out;
@@ -153,7 +215,7 @@ void Gba_Pcm::update( int dac )
 			last_amp = dac;
 
 			int filter = 0;
-			if ( soundInterpolation )
+			if ( soundInterpolation && soundQuality != SOUND_QUALITY_FAST )
 			{
 				// base filtering on how long since last sample was output
 				int period = time - last_time;
@@ -166,7 +228,7 @@ void Gba_Pcm::update( int dac )
 				filter = filters [idx];
 			}
 
-			pcm_synth [filter].offset( time, delta, output );
+			pcm_offset( filter, time, delta, output );
 		}
 		last_time = time;
 	}
@@ -197,6 +259,9 @@ void Gba_Pcm_Fifo::timer_overflowed( int which_timer )
 		dac = fifo [readIndex];
 		readIndex = (readIndex + 1) & 31;
 		pcm.update( dac );
+
+		if ( soundMode == SOUND_MODE_HASH )
+			hash_sound_event( which, dac );
 	}
 }
 
@@ -259,6 +324,9 @@ void soundEvent(u32 address, u8 data)
 		ioMem[address] = data;
 		gb_apu->write_register( blip_time(), gb_addr, data );
 
+		if ( soundMode == SOUND_MODE_HASH )
+			hash_sound_event( gb_addr, data );
+
 		if ( address == NR52 )
 			apply_control();
 	}
@@ -280,7 +348,11 @@ static void apply_volume( bool apu_only = false )
 	if ( !apu_only )
 	{
 		for ( int i = 0; i < 3; i++ )
-			pcm_synth [i].volume( 0.66 / 256 * soundVolume_ );
+		{
+			pcm_synth      [i].volume( 0.66 / 256 * soundVolume_ );
+			pcm_synth_good [i].volume( 0.66 / 256 * soundVolume_ );
+		}
+		pcm_synth_fast.volume( 0.66 / 256 * soundVolume_ );
 	}
 }
 
@@ -335,21 +407,113 @@ static void end_frame( blip_time_t time )
 	pcm [0].pcm.end_frame( time );
 	pcm [1].pcm.end_frame( time );
 
-	gb_apu       ->end_frame( time );
-	stereo_buffer->end_frame( time );
+	gb_apu->end_frame( time );
+
+	if ( stems_active )
+	{
+		for ( int i = 0; i < stem_count; i++ )
+			stem_buffers [i]->end_frame( time );
+	}
+	else
+	{
+		stereo_buffer->end_frame( time );
+	}
+}
+
+// Reads the stems, hands them to their captures, and mixes them to soundFinalWave
+static int mix_stems()
+{
+	// The stems are mixed sample by sample, so the same count is read from each
+	long count = stem_buffers [0]->samples_avail();
+	for ( int i = 1; i < stem_count; i++ )
+	{
+		if ( stem_buffers [i]->samples_avail() < count )
+			count = stem_buffers [i]->samples_avail();
+	}
+
+	for ( int i = 0; i < stem_count; i++ )
+	{
+		stem_buffers [i]->read_samples( stemWave [i], count );
+
+		if ( sound_captures [1 + i] )
+			sound_capture_write( sound_captures [1 + i], stemWave [i], count / 2 );
+	}
+
+	for ( long n = 0; n < count; n++ )
+	{
+		int s = stemWave [stem_pcm_a] [n] + stemWave [stem_pcm_b] [n] + stemWave [stem_psg] [n];
+		if ( (s16) s != s )
+			s = 0x7FFF - (s >> 24);
+		soundFinalWave [n] = (u16) s;
+	}
+
+	return count;
 }
 
 static void flush_samples(Multi_Buffer * buffer)
 {
+	TRACE_BEGIN("flush_samples");
+
+	int samples;
+	if ( stems_active )
+	{
+		samples = mix_stems();
+	}
+	else
+	{
+		samples = buffer->samples_avail();
+
+		// Ensure we won't overflow soundFinalWave
+		assert(samples * sizeof(blip_sample_t) < sizeof(soundFinalWave));
+
+		buffer->read_samples((blip_sample_t*) soundFinalWave, samples);
+	}
+
 	// The number of bytes of available sound date
-	int soundBufferLen = buffer->samples_avail() * sizeof(blip_sample_t);
+	int soundBufferLen = samples * sizeof(blip_sample_t);
 
-	// Ensure we won't overflow soundFinalWave
-	assert(soundBufferLen < sizeof(soundFinalWave));
+	perfCounters.soundSamples += samples / 2;
 
-	buffer->read_samples((blip_sample_t*) soundFinalWave, buffer->samples_avail());
+	if ( sound_captures [0] )
+		sound_capture_write( sound_captures [0], (const gint16*) soundFinalWave, samples / 2 );
 
 	soundDriver->write(soundDriver, soundFinalWave, soundBufferLen);
+
+#ifdef GBA_LOGGING
+	if (eventLogChannels & (1 << LOG_SOUNDOUTPUT))
+	{
+		// Report about once per emulated second
+		soundLogTicks += SOUND_CLOCK_TICKS;
+		if (soundLogTicks >= SOUND_CLOCK_RATE)
+		{
+			soundLogTicks = 0;
+			EVENT_LOG(LOG_SOUNDOUTPUT, 0, soundGetLatency(), soundBufferLen, 0, 0);
+		}
+	}
+#endif
+
+	TRACE_END("flush_samples");
+}
+
+// Dynamic rate control: slightly stretch or shrink the audio so the driver
+// output buffer stays half full, instead of blocking when it is full or
+// starving when it is empty. The pitch change is inaudible for small deltas.
+static void apply_rate_control()
+{
+	if ( soundMaxRateDelta <= 0.0f || !soundDriver->get_buffer_fill )
+		return;
+
+	float fill = soundDriver->get_buffer_fill(soundDriver);
+
+	// More samples per clock when below half full, less when above
+	double ratio = 1.0 + soundMaxRateDelta * (1.0 - 2.0 * fill);
+	stereo_buffer->clock_rate( (long) (gb_apu->clock_rate / ratio) );
+
+	for ( int i = 0; i < stem_count; i++ )
+	{
+		if ( stem_buffers [i] )
+			stem_buffers [i]->clock_rate( (long) (gb_apu->clock_rate / ratio) );
+	}
 }
 
 static void apply_filtering()
@@ -364,25 +528,54 @@ static void apply_filtering()
 		int cutoff = base_freq >> i;
 		if ( cutoff > nyquist )
 			cutoff = nyquist;
-		pcm_synth [i].treble_eq( blip_eq_t( 0, 0, stereo_buffer->sample_rate(), cutoff ) );
+		pcm_synth      [i].treble_eq( blip_eq_t( 0, 0, stereo_buffer->sample_rate(), cutoff ) );
+		pcm_synth_good [i].treble_eq( blip_eq_t( 0, 0, stereo_buffer->sample_rate(), cutoff ) );
 	}
+
+	// The fast tier has a single kernel, the one for 32 kHz samples
+	int cutoff = base_freq;
+	if ( cutoff > nyquist )
+		cutoff = nyquist;
+	pcm_synth_fast.treble_eq( blip_eq_t( 0, 0, stereo_buffer->sample_rate(), cutoff ) );
 }
 
+static void apply_stems();
+
 void psoundTickfn()
 {
-	if ( gb_apu && stereo_buffer )
+	perfCounters.soundTicks++;
+
+	if ( gb_apu && soundMode != SOUND_MODE_NORMAL )
+	{
+		// Keep the APU state up to date, but don't synthesize anything
+		pcm [0].pcm.end_frame( SOUND_CLOCK_TICKS );
+		pcm [1].pcm.end_frame( SOUND_CLOCK_TICKS );
+		gb_apu->end_frame( SOUND_CLOCK_TICKS );
+
+		if ( soundMode == SOUND_MODE_HASH )
+			hash_sound_event( -1, soundHashTicks++ );
+	}
+	else if ( gb_apu && stereo_buffer )
 	{
 		// Run sound hardware to present
 		end_frame( SOUND_CLOCK_TICKS );
 
 		flush_samples(stereo_buffer);
 
+		apply_rate_control();
+
 		if ( soundFiltering_ != soundFiltering )
 			apply_filtering();
 
 		if ( soundVolume_ != soundVolume )
 			apply_volume();
+
+		if ( stems_active != stems_wanted )
+			apply_stems();
 	}
+
+	// Apply a new tick period at the tick boundary, before the next one is scheduled
+	SOUND_CLOCK_TICKS = soundClockTicks;
 }
 
 static void apply_muting()
@@ -396,14 +589,54 @@ static void apply_muting()
 	if ( gb_apu )
 	{
 		// APU
+		Stereo_Buffer* buffer = output_buffer( stem_psg );
 		for ( int i = 0; i < 4; i++ )
 		{
-			gb_apu->set_output( stereo_buffer->center(),
-			                    stereo_buffer->left(), stereo_buffer->right(), i );
+			if ( soundMode == SOUND_MODE_NORMAL )
+				gb_apu->set_output( buffer->center(),
+				                    buffer->left(), buffer->right(), i );
+			else
+				gb_apu->set_output( 0, 0, 0, i );
 		}
 	}
 }
 
+// Routes the sound to the stem buffers or back to stereo_buffer.
+// Must be called at a tick boundary, when no sound is pending.
+static void apply_stems()
+{
+	if ( stems_wanted )
+	{
+		for ( int i = 0; i < stem_count; i++ )
+		{
+			if ( !stem_buffers [i] )
+			{
+				stem_buffers [i] = new Stereo_Buffer; // TODO: handle out of memory
+				stem_buffers [i]->set_sample_rate( soundSampleRate );
+			}
+			stem_buffers [i]->clock_rate( stereo_buffer->center()->clock_rate() );
+			stem_buffers [i]->clear();
+		}
+	}
+	else
+	{
+		stereo_buffer->clear();
+	}
+
+	stems_active = stems_wanted;
+	apply_muting();
+}
+
+static void free_stems()
+{
+	for ( int i = 0; i < stem_count; i++ )
+	{
+		delete stem_buffers [i];
+		stem_buffers [i] = 0;
+	}
+	stems_active = false;
+}
+
 static void reset_apu()
 {
 	gb_apu->reset( gb_apu->mode_agb, true );
@@ -429,8 +662,10 @@ static void remake_stereo_buffer()
 		gb_apu = new Gb_Apu; // TODO: handle out of memory
 		reset_apu();
 	}
+	gb_apu->set_output( 0, 0, 0 );
 
 	// Stereo_Buffer
+	free_stems();
 	delete stereo_buffer;
 	stereo_buffer = 0;
 
@@ -444,15 +679,142 @@ static void remake_stereo_buffer()
 	apply_filtering();
 
 	// Volume Level
-	apply_muting();
+	if ( stems_wanted )
+		apply_stems();
+	else
+		apply_muting();
 	apply_volume();
 }
 
 void soundShutdown()
 {
+	soundCaptureStop( NULL );
 	soundDriver = NULL;
 }
 
+gboolean soundCaptureStart( const gchar* file, gboolean stems, GError** err )
+{
+	g_return_val_if_fail( err == NULL || *err == NULL, FALSE );
+
+	if ( sound_captures [0] )
+	{
+		g_set_error( err, SOUND_CAPTURE_ERROR, G_SOUND_CAPTURE_ERROR_FAILED,
+				"Sound is already being captured" );
+		return FALSE;
+	}
+
+	sound_captures [0] = sound_capture_new( file, soundSampleRate, err );
+	if ( !sound_captures [0] )
+		return FALSE;
+
+	if ( stems )
+	{
+		// Stems are written next to the capture, as base.pcma.wav and so on
+		static const char* const stem_names [stem_count] = { "pcma", "pcmb", "psg" };
+
+		const gchar* dot = strrchr( file, '.' );
+		gchar* base = dot ? g_strndup( file, dot - file ) : g_strdup( file );
+		const gchar* ext = dot ? dot : "";
+
+		for ( int i = 0; i < stem_count; i++ )
+		{
+			gchar* stem_file = g_strconcat( base, ".", stem_names [i], ext, NULL );
+			sound_captures [1 + i] = sound_capture_new( stem_file, soundSampleRate, err );
+			g_free( stem_file );
+
+			if ( !sound_captures [1 + i] )
+			{
+				g_free( base );
+				soundCaptureStop( NULL );
+				return FALSE;
+			}
+		}
+		g_free( base );
+
+		// Sound is routed to the stems from the next tick
+		stems_wanted = true;
+	}
+
+	return TRUE;
+}
+
+gboolean soundCaptureStop( GError** err )
+{
+	g_return_val_if_fail( err == NULL || *err == NULL, FALSE );
+
+	gboolean success = TRUE;
+	for ( int i = 0; i < 1 + stem_count; i++ )
+	{
+		GError* capture_err = NULL;
+		if ( !sound_capture_free( sound_captures [i], &capture_err ) )
+		{
+			if ( success )
+				g_propagate_error( err, capture_err );
+			else
+				g_clear_error( &capture_err );
+			success = FALSE;
+		}
+		sound_captures [i] = 0;
+	}
+
+	// The stems are mixed until the next tick, then routing goes back to normal
+	stems_wanted = false;
+
+	return success;
+}
+
+gboolean soundIsCapturing()
+{
+	return sound_captures [0] != 0;
+}
+
+void soundSetQuality( SoundQuality quality )
+{
+	soundQuality = quality;
+}
+
+SoundQuality soundGetQuality()
+{
+	return soundQuality;
+}
+
+void soundSetTickPeriod( int msec )
+{
+	if ( msec < 1 )
+		msec = 1;
+	if ( msec > SOUND_MAX_TICK_MS )
+		msec = SOUND_MAX_TICK_MS;
+
+	soundClockTicks = SOUND_CLOCK_RATE * msec / 1000;
+}
+
+int soundGetLatency()
+{
+	if ( !soundDriver || !soundDriver->get_latency )
+		return -1;
+
+	return soundDriver->get_latency(soundDriver);
+}
+
+void soundSetMode( SoundMode mode )
+{
+	soundMode      = mode;
+	soundHash      = sound_hash_seed;
+	soundHashTicks = 0;
+
+	apply_muting();
+}
+
+SoundMode soundGetMode()
+{
+	return soundMode;
+}
+
+u32 soundGetHash()
+{
+	return soundHash;
+}
+
 void soundPause(gboolean pause)
 {
 	soundPaused = pause;
@@ -470,16 +832,28 @@ float soundGetVolume()
 	return soundVolume;
 }
 
+void soundSetDynamicRateControl( float maxDelta )
+{
+	soundMaxRateDelta = maxDelta;
+
+	if ( maxDelta <= 0.0f && stereo_buffer && gb_apu )
+		stereo_buffer->clock_rate( gb_apu->clock_rate );
+}
+
 void soundReset()
 {
-	soundDriver->reset(soundDriver);
+	if (soundDriver)
+		soundDriver->reset(soundDriver);
+
+	soundHash      = sound_hash_seed;
+	soundHashTicks = 0;
 
 	remake_stereo_buffer();
 	reset_apu();
 
 	soundPaused = true;
-	SOUND_CLOCK_TICKS = SOUND_CLOCK_TICKS_;
-	soundTicks        = SOUND_CLOCK_TICKS_;
+	SOUND_CLOCK_TICKS = soundClockTicks;
+	soundTicks        = soundClockTicks;
 
 	soundEvent( NR52, (u8) 0x80 );
 }
@@ -16,6 +16,60 @@ bool soundInit(SoundDriver *driver);
 void soundSetVolume( float );
 float soundGetVolume();
 
+// Adjusts the output rate by up to maxDelta (e.g. 0.005 for 0.5%) to keep
+// the sound driver buffer half full. 0 disables dynamic rate control.
+void soundSetDynamicRateControl( float maxDelta );
+
+// Null mode keeps the sound hardware state exact, but skips synthesis, mixing
+// and output. Hash mode additionally keeps a rolling hash of the sound events
+// (register writes and PCM samples), for regression checks in headless runs.
+enum SoundMode
+{
+	SOUND_MODE_NORMAL,
+	SOUND_MODE_NULL,
+	SOUND_MODE_HASH
+};
+
+// Quality of the PCM channels synthesis. Best uses 16 point kernels and
+// picks a low-pass filter depending on the sample rate, good does the same with
+// 12 point kernels, and fast uses a single 8 point kernel.
+enum SoundQuality
+{
+	SOUND_QUALITY_FAST,
+	SOUND_QUALITY_GOOD,
+	SOUND_QUALITY_BEST
+};
+
+// Manages the synthesis quality, can be changed at any time
+void soundSetQuality( SoundQuality quality );
+SoundQuality soundGetQuality();
+
+// Sets the period at which sound is synthesized and handed to the driver,
+// from 1 to 20 milliseconds. Shorter periods reduce latency.
+void soundSetTickPeriod( int msec );
+
+// Time from sound being synthesized to being played, in microseconds,
+// as measured by the sound driver. -1 if unknown.
+int soundGetLatency();
+
+// Manages the sound mode. Changing it resets the hash.
+void soundSetMode( SoundMode mode );
+SoundMode soundGetMode();
+
+// Hash of the sound events since the last reset, in hash mode
+u32 soundGetHash();
+
+// Starts capturing the sound output to a WAV or FLAC file, depending on its
+// extension. With stems, the PCM A, PCM B and PSG channels are also captured
+// separately, before mixing, to files named after the capture file.
+gboolean soundCaptureStart( const gchar* file, gboolean stems, GError** err );
+
+// Stops capturing and completes the capture files. Does nothing when not capturing.
+gboolean soundCaptureStop( GError** err );
+
+// Whether the sound output is being captured
+gboolean soundIsCapturing();
+
 // Pauses/resumes system sound output
 void soundPause(gboolean pause);
 
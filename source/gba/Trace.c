@@ -0,0 +1,148 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include "Trace.h"
+#include "PerfCounters.h"
+#include "../common/AsyncWriter.h"
+
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <stdio.h>
+
+// Room for about ten thousand events per thread
+#define TRACE_QUEUE_SIZE (1 << 18)
+
+// Period at which the writer thread looks for new events
+#define TRACE_POLL_USEC 10000
+
+typedef struct {
+	const gchar *name;
+	gint64 time;
+	gchar phase;
+} TraceEvent;
+
+gboolean traceEnabled = FALSE;
+
+static GPrivate threadQueue;
+
+static struct {
+	FILE *f;
+	AsyncWriter *writer;
+	gint64 startTime;
+} trace;
+
+GQuark trace_error_quark() {
+	return g_quark_from_static_string("trace_error_quark");
+}
+
+void trace_event(const gchar *name, gchar phase) {
+	TraceEvent event;
+	event.name = name;
+	event.time = perf_counters_get_time();
+	event.phase = phase;
+
+	async_writer_push(trace.writer, &event, 1);
+}
+
+static gboolean trace_write_events(void *records, guint count, guint queue, gpointer data) {
+	const TraceEvent *events = (const TraceEvent *)records;
+
+	for (guint i = 0; i < count; i++) {
+		gint64 time = MAX(events[i].time - trace.startTime, 0);
+
+		// Timestamps are in microseconds, threads are numbered from one
+		if (fprintf(trace.f, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%" G_GINT64_FORMAT ".%03d,\"pid\":1,\"tid\":%u}",
+				events[i].name, events[i].phase, time / 1000, (int)(time % 1000), queue + 1) < 0) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+gboolean trace_start(const gchar *file, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+	g_return_val_if_fail(trace.f == NULL, FALSE);
+
+	FILE *f = g_fopen(file, "w");
+	if (f == NULL) {
+		g_set_error(err, TRACE_ERROR, G_TRACE_ERROR_FAILED,
+				"Failed to open trace file %s: %s", file, g_strerror(errno));
+		return FALSE;
+	}
+
+	// The process name comes first, so that the events can all be
+	// preceded by a separator
+	if (fputs("{\"traceEvents\":[\n"
+			"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"VBA\"}}", f) < 0) {
+		g_set_error(err, TRACE_ERROR, G_TRACE_ERROR_FAILED,
+				"Failed to write trace file %s: %s", file, g_strerror(errno));
+		fclose(f);
+		return FALSE;
+	}
+
+	// The writer is kept, along with the queues of the threads
+	if (trace.writer == NULL) {
+		trace.writer = async_writer_new(sizeof(TraceEvent), TRACE_QUEUE_SIZE, &threadQueue);
+	}
+
+	trace.f = f;
+	trace.startTime = perf_counters_get_time();
+	async_writer_start(trace.writer, "trace-writer", trace_write_events, NULL, TRACE_POLL_USEC);
+
+	traceEnabled = TRUE;
+
+	return TRUE;
+}
+
+gboolean trace_stop(GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	if (trace.f == NULL)
+		return TRUE;
+
+	traceEnabled = FALSE;
+
+	async_writer_stop(trace.writer);
+
+	if (!async_writer_failed(trace.writer, NULL) && fputs("\n],\"displayTimeUnit\":\"ms\"}\n", trace.f) < 0) {
+		async_writer_fail(trace.writer);
+	}
+
+	if (fclose(trace.f) != 0) {
+		async_writer_fail(trace.writer);
+	}
+
+	trace.f = NULL;
+
+	gint errnum;
+	if (async_writer_failed(trace.writer, &errnum)) {
+		g_set_error(err, TRACE_ERROR, G_TRACE_ERROR_FAILED,
+				"Failed to write the trace: %s", g_strerror(errnum));
+		return FALSE;
+	}
+
+	gint dropped = async_writer_dropped(trace.writer);
+	if (dropped > 0) {
+		g_set_error(err, TRACE_ERROR, G_TRACE_ERROR_OVERRUN,
+				"%d trace events were dropped while tracing", dropped);
+		return FALSE;
+	}
+
+	return TRUE;
+}
@@ -0,0 +1,93 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef VBAM_GBA_TRACE_H_
+#define VBAM_GBA_TRACE_H_
+
+#include <glib.h>
+
+/* Set up for C function definitions, even when using C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Trace error domain
+ */
+#define TRACE_ERROR (trace_error_quark())
+GQuark trace_error_quark();
+
+/**
+ * Trace error types
+ */
+typedef enum
+{
+	G_TRACE_ERROR_FAILED,
+	G_TRACE_ERROR_OVERRUN
+} TraceError;
+
+/**
+ * Timeline of the emulation loop, written to a trace event JSON file
+ * that can be opened in Perfetto or chrome://tracing.
+ *
+ * Each thread records its events in its own lock-free queue, which a writer
+ * thread empties into the trace file, so that tracing never blocks. When
+ * the writer thread falls behind, events are dropped rather than waited for,
+ * and reported as an overrun when the trace is stopped.
+ */
+
+/** Whether a trace is being recorded, checked before recording events */
+extern gboolean traceEnabled;
+
+/**
+ * Mark the beginning and the end of a slice of the timeline.
+ * The name must be a string literal without characters needing escaping in
+ * JSON, and the slices of a thread must be properly nested.
+ */
+#define TRACE_BEGIN(name) do { if (G_UNLIKELY(traceEnabled)) trace_event((name), 'B'); } while (0)
+#define TRACE_END(name) do { if (G_UNLIKELY(traceEnabled)) trace_event((name), 'E'); } while (0)
+
+/**
+ * Create a trace file and start recording events
+ * @param file trace file name
+ * @param err return location for a GError, or NULL
+ * @return FALSE if the file could not be created
+ */
+gboolean trace_start(const gchar *file, GError **err);
+
+/**
+ * Record an event of the current thread, use TRACE_BEGIN and TRACE_END instead
+ * @param name static name of the slice
+ * @param phase 'B' for the beginning of the slice, 'E' for its end
+ */
+void trace_event(const gchar *name, gchar phase);
+
+/**
+ * Write the recorded events, complete the trace file and stop recording.
+ * If no trace is being recorded, it simply returns TRUE.
+ * @param err return location for a GError, or NULL
+ * @return FALSE if writing failed or events were dropped
+ */
+gboolean trace_stop(GError **err);
+
+/* Ends C function definitions when using C++ */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VBAM_GBA_TRACE_H_ */
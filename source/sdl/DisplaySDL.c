@@ -114,7 +114,12 @@ static gboolean display_sdl_create_window(Display *display, GError **err) {
 		return FALSE;
 	}
 
-	display->renderer = SDL_CreateRenderer(display->window, -1, SDL_RENDERER_ACCELERATED);
+	int rendererFlags = SDL_RENDERER_ACCELERATED;
+	if (g_strcmp0(settings_frame_sync(), "vsync") == 0) {
+		rendererFlags |= SDL_RENDERER_PRESENTVSYNC;
+	}
+
+	display->renderer = SDL_CreateRenderer(display->window, -1, rendererFlags);
 	if (display->renderer == NULL) {
 		g_set_error(err, DISPLAY_ERROR, G_DISPLAY_ERROR_FAILED,
 				"Failed to create renderer: %s", SDL_GetError());
@@ -171,6 +176,18 @@ gboolean display_sdl_is_fullscreen(Display *display) {
 	return display->fullscreen;
 }
 
+gint display_sdl_get_refresh_rate(Display *display) {
+	g_assert(display != NULL);
+
+	SDL_DisplayMode mode;
+	int index = SDL_GetWindowDisplayIndex(display->window);
+	if (index < 0 || SDL_GetCurrentDisplayMode(index, &mode) != 0) {
+		return 0;
+	}
+
+	return mode.refresh_rate;
+}
+
 gboolean display_sdl_toggle_fullscreen(Display *display, GError **err) {
 	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
 	g_assert(display != NULL);
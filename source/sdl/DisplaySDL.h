@@ -51,6 +51,14 @@ void display_sdl_free(Display *display);
  */
 gboolean display_sdl_is_fullscreen(Display *display);
 
+/**
+ * Refresh rate of the screen the window is on
+ *
+ * @param display display display
+ * @return refresh rate in Hz, 0 if unknown
+ */
+gint display_sdl_get_refresh_rate(Display *display);
+
 /**
  * Toggle between windowed and fullscreen mode
  *
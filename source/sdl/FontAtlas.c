@@ -0,0 +1,237 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 2008 VBA-M development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+#include "FontAtlas.h"
+#include "../common/DisplayDriver.h"
+#include "../common/Util.h"
+
+#include <SDL_ttf.h>
+
+// Width of the atlas texture, glyphs are packed in rows
+#define ATLAS_WIDTH 1024
+
+typedef struct {
+	/** Glyph position in the atlas, empty if the character has no glyph */
+	SDL_Rect rect;
+
+	/** Horizontal offset of the glyph image from the pen position */
+	gint offset;
+
+	/** Pen advance after the glyph */
+	gint advance;
+} Glyph;
+
+struct FontAtlas {
+	SDL_Renderer *renderer;
+	guint size;
+	guint refCount;
+
+	gint height;
+	Glyph glyphs[256];
+
+	SDL_Texture *texture;
+};
+
+/** Atlases currently in use */
+static GSList *atlases = NULL;
+
+static gboolean font_atlas_has_glyph(guint c) {
+	// Latin-1 printable characters
+	return (c >= 32 && c < 127) || c >= 160;
+}
+
+static void font_atlas_free_surfaces(SDL_Surface **surfaces) {
+	for (guint c = 0; c < 256; c++) {
+		SDL_FreeSurface(surfaces[c]);
+	}
+}
+
+static gboolean font_atlas_build(FontAtlas *atlas, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	gchar *fontFile = data_get_file_path("fonts", "DroidSans-Bold.ttf");
+	TTF_Font *font = TTF_OpenFont(fontFile, atlas->size);
+	g_free(fontFile);
+
+	if (font == NULL) {
+		g_set_error(err, DISPLAY_ERROR, G_DISPLAY_ERROR_FAILED,
+				"Failed to load font: %s", TTF_GetError());
+		return FALSE;
+	}
+
+	atlas->height = TTF_FontHeight(font);
+
+	// Rasterize each glyph in white, the color is applied when rendering
+	SDL_Color white = { 255, 255, 255, 255 };
+	SDL_Surface *surfaces[256] = { NULL };
+	gint x = 0, y = 0, rowHeight = 0;
+
+	for (guint c = 0; c < 256; c++) {
+		Glyph *glyph = &atlas->glyphs[c];
+		memset(glyph, 0, sizeof(Glyph));
+
+		if (!font_atlas_has_glyph(c)) {
+			continue;
+		}
+
+		gint minx, advance;
+		if (TTF_GlyphMetrics(font, c, &minx, NULL, NULL, NULL, &advance) != 0) {
+			continue; // Not in the font
+		}
+
+		glyph->offset = MIN(minx, 0);
+		glyph->advance = advance;
+
+		// Rendering the character as text lets SDL_ttf position it
+		// relative to the baseline like it does for whole strings.
+		// Blank glyphs may not render, they only advance the pen.
+		gchar str[2] = { (gchar) c, '\0' };
+		surfaces[c] = TTF_RenderText_Blended(font, str, white);
+		if (surfaces[c] == NULL) {
+			continue;
+		}
+
+		// Start a new row when the glyph does not fit
+		if (x + surfaces[c]->w > ATLAS_WIDTH) {
+			x = 0;
+			y += rowHeight;
+			rowHeight = 0;
+		}
+
+		glyph->rect.x = x;
+		glyph->rect.y = y;
+		glyph->rect.w = surfaces[c]->w;
+		glyph->rect.h = surfaces[c]->h;
+
+		x += surfaces[c]->w;
+		rowHeight = MAX(rowHeight, surfaces[c]->h);
+	}
+
+	TTF_CloseFont(font);
+
+	SDL_Surface *sheet = SDL_CreateRGBSurface(0, ATLAS_WIDTH, MAX(y + rowHeight, 1), 32,
+			0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+	if (sheet == NULL) {
+		g_set_error(err, DISPLAY_ERROR, G_DISPLAY_ERROR_FAILED,
+				"Failed to create surface : %s", SDL_GetError());
+		font_atlas_free_surfaces(surfaces);
+		return FALSE;
+	}
+
+	// Copy the glyphs with their alpha channel rather than blending them
+	for (guint c = 0; c < 256; c++) {
+		if (surfaces[c] != NULL) {
+			SDL_SetSurfaceBlendMode(surfaces[c], SDL_BLENDMODE_NONE);
+			SDL_BlitSurface(surfaces[c], NULL, sheet, &atlas->glyphs[c].rect);
+		}
+	}
+
+	font_atlas_free_surfaces(surfaces);
+
+	atlas->texture = SDL_CreateTextureFromSurface(atlas->renderer, sheet);
+	SDL_FreeSurface(sheet);
+
+	if (atlas->texture == NULL) {
+		g_set_error(err, DISPLAY_ERROR, G_DISPLAY_ERROR_FAILED,
+				"Failed create texture : %s", SDL_GetError());
+		return FALSE;
+	}
+
+	SDL_SetTextureBlendMode(atlas->texture, SDL_BLENDMODE_BLEND);
+
+	return TRUE;
+}
+
+FontAtlas *font_atlas_ref(SDL_Renderer *renderer, guint size, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, NULL);
+
+	for (GSList *it = atlases; it != NULL; it = it->next) {
+		FontAtlas *atlas = it->data;
+		if (atlas->renderer == renderer && atlas->size == size) {
+			atlas->refCount++;
+			return atlas;
+		}
+	}
+
+	FontAtlas *atlas = g_new(FontAtlas, 1);
+	atlas->renderer = renderer;
+	atlas->size = size;
+	atlas->refCount = 1;
+	atlas->texture = NULL;
+
+	if (!font_atlas_build(atlas, err)) {
+		SDL_DestroyTexture(atlas->texture);
+		g_free(atlas);
+		return NULL;
+	}
+
+	atlases = g_slist_prepend(atlases, atlas);
+
+	return atlas;
+}
+
+void font_atlas_unref(FontAtlas *atlas) {
+	if (atlas == NULL)
+		return;
+
+	g_assert(atlas->refCount > 0);
+
+	if (--atlas->refCount > 0)
+		return;
+
+	atlases = g_slist_remove(atlases, atlas);
+
+	SDL_DestroyTexture(atlas->texture);
+	g_free(atlas);
+}
+
+void font_atlas_get_text_size(FontAtlas *atlas, const gchar *text, gint *width, gint *height) {
+	g_assert(atlas != NULL);
+
+	gint w = 0;
+	for (const guchar *c = (const guchar *) text; *c; c++) {
+		w += atlas->glyphs[*c].advance;
+	}
+
+	*width = w;
+	*height = atlas->height;
+}
+
+void font_atlas_render_text(FontAtlas *atlas, const gchar *text, gint x, gint y, SDL_Color color, guint8 alpha) {
+	g_assert(atlas != NULL);
+
+	// The atlas is shared, set the modulation for each string
+	SDL_SetTextureColorMod(atlas->texture, color.r, color.g, color.b);
+	SDL_SetTextureAlphaMod(atlas->texture, alpha);
+
+	// All the quads come from the same texture so the renderer can batch them
+	for (const guchar *c = (const guchar *) text; *c; c++) {
+		const Glyph *glyph = &atlas->glyphs[*c];
+
+		if (glyph->rect.w > 0) {
+			SDL_Rect screenRect;
+			screenRect.x = x + glyph->offset;
+			screenRect.y = y;
+			screenRect.w = glyph->rect.w;
+			screenRect.h = glyph->rect.h;
+
+			SDL_RenderCopy(atlas->renderer, atlas->texture, &glyph->rect, &screenRect);
+		}
+
+		x += glyph->advance;
+	}
+}
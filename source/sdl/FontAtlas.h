@@ -0,0 +1,83 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 2008 VBA-M development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+#ifndef __VBA_FONTATLAS_H__
+#define __VBA_FONTATLAS_H__
+
+#include <SDL.h>
+#include <glib.h>
+
+/* Set up for C function definitions, even when using C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Opaque glyph atlas
+ *
+ * The Latin-1 glyphs of the OSD font are rasterized once per font size
+ * into a single white texture. Text is then drawn as one quad per glyph,
+ * tinted with the texture color and alpha modulation.
+ */
+typedef struct FontAtlas FontAtlas;
+
+/**
+ * Get the atlas for a font size, creating it if no other user holds it
+ *
+ * @param renderer renderer the atlas texture is created for
+ * @param size font size in pixels
+ * @param err return location for a GError, or NULL
+ * @return a reference to the atlas or NULL in case of error
+ */
+FontAtlas *font_atlas_ref(SDL_Renderer *renderer, guint size, GError **err);
+
+/**
+ * Release a reference to an atlas, freeing it when it was the last one.
+ * If atlas is NULL, it simply returns.
+ *
+ * @param atlas glyph atlas
+ */
+void font_atlas_unref(FontAtlas *atlas);
+
+/**
+ * Compute the size a Latin-1 string would be rendered at
+ *
+ * @param atlas glyph atlas
+ * @param text string to measure
+ * @param width return location for the width in pixels
+ * @param height return location for the height in pixels
+ */
+void font_atlas_get_text_size(FontAtlas *atlas, const gchar *text, gint *width, gint *height);
+
+/**
+ * Render a Latin-1 string
+ *
+ * @param atlas glyph atlas
+ * @param text string to render
+ * @param x screen position of the left of the text
+ * @param y screen position of the top of the text
+ * @param color text color
+ * @param alpha text opacity, from 0 to 255
+ */
+void font_atlas_render_text(FontAtlas *atlas, const gchar *text, gint x, gint y, SDL_Color color, guint8 alpha);
+
+/* Ends C function definitions when using C++ */
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __VBA_FONTATLAS_H__
@@ -0,0 +1,140 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 2008 VBA-M development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+#include "FramePacer.h"
+#include "../gba/GBA.h"
+
+// Frames run at once to catch up after a stall, beyond that time is skipped
+#define MAX_CATCH_UP_FRAMES 3
+
+// Frames run per presentation when fast forwarding with vsync
+#define FAST_FORWARD_FRAMES 4
+
+// Time before the deadline from which to spin rather than sleep, in microseconds
+#define SPIN_USEC 1000
+
+// How close the refresh rate must be to a multiple of the frame rate
+// to run exactly one frame every few refreshes
+#define CADENCE_TOLERANCE 0.01
+
+static FrameSync frameSync = FRAME_SYNC_AUDIO;
+static gboolean fastForward = FALSE;
+
+// Timer mode, and vsync mode without a steady cadence.
+// Frame deadlines are computed from a start time to avoid drifting.
+static gint64 startTime = 0;
+static gint64 frames = 0;
+
+// Vsync mode, emulate a frame every refreshesPerFrame refreshes, if not 0
+static guint refreshesPerFrame = 0;
+static guint refreshes = 0;
+
+/**
+ * @return monotonic time at which the frame following the given number of
+ * frames is due
+ */
+static gint64 frame_pacer_deadline(gint64 frame) {
+	return startTime + frame * GBA_FRAME_TICKS * G_USEC_PER_SEC / GBA_CLOCK_RATE;
+}
+
+static void frame_pacer_restart() {
+	startTime = g_get_monotonic_time();
+	frames = 0;
+	refreshes = 0;
+}
+
+void frame_pacer_init(FrameSync sync, gint refreshRate) {
+	frameSync = sync;
+	fastForward = FALSE;
+	refreshesPerFrame = 0;
+
+	if (sync == FRAME_SYNC_VSYNC && refreshRate > 0) {
+		gdouble frameRate = (gdouble)GBA_CLOCK_RATE / GBA_FRAME_TICKS;
+		gdouble ratio = refreshRate / frameRate;
+		guint multiple = (guint)(ratio + 0.5);
+
+		if (multiple > 0 && ABS(ratio - multiple) < CADENCE_TOLERANCE * multiple) {
+			refreshesPerFrame = multiple;
+		}
+	}
+
+	frame_pacer_restart();
+}
+
+guint frame_pacer_frames_due() {
+	if (frameSync == FRAME_SYNC_AUDIO) {
+		return 1;
+	}
+
+	if (fastForward) {
+		return frameSync == FRAME_SYNC_VSYNC ? FAST_FORWARD_FRAMES : 1;
+	}
+
+	if (refreshesPerFrame > 0) {
+		// The small difference with the display rate is absorbed
+		// by the dynamic audio rate control
+		refreshes++;
+		if (refreshes < refreshesPerFrame) {
+			return 0;
+		}
+
+		refreshes = 0;
+		return 1;
+	}
+
+	// Run the frames that are due by now
+	gint64 now = g_get_monotonic_time();
+	guint due = 0;
+	while (frame_pacer_deadline(frames + due) <= now) {
+		due++;
+
+		if (due > MAX_CATCH_UP_FRAMES) {
+			// Too late, probably paused or stalled
+			frame_pacer_restart();
+			frames = 1;
+			return 1;
+		}
+	}
+
+	frames += due;
+	return due;
+}
+
+void frame_pacer_wait() {
+	if (frameSync != FRAME_SYNC_TIMER || fastForward) {
+		return;
+	}
+
+	gint64 deadline = frame_pacer_deadline(frames);
+	gint64 now = g_get_monotonic_time();
+
+	// Sleeping is not precise, spin for the last bit
+	if (deadline - now > SPIN_USEC) {
+		g_usleep(deadline - now - SPIN_USEC);
+	}
+
+	while (g_get_monotonic_time() < deadline);
+}
+
+void frame_pacer_set_fast_forward(gboolean enable) {
+	if (fastForward && !enable) {
+		// Don't try to catch up with the time spent fast forwarding
+		frame_pacer_restart();
+	}
+
+	fastForward = enable;
+}
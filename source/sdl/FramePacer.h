@@ -0,0 +1,69 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 2008 VBA-M development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+#ifndef __VBA_FRAMEPACER_H__
+#define __VBA_FRAMEPACER_H__
+
+#include <glib.h>
+
+/* Set up for C function definitions, even when using C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * What the emulated frames are synchronized to
+ */
+typedef enum {
+	FRAME_SYNC_AUDIO,   // Blocking sound output, one frame per main loop iteration
+	FRAME_SYNC_TIMER,   // Sleep until each frame is due
+	FRAME_SYNC_VSYNC    // Presentation blocks until the display refresh
+} FrameSync;
+
+/**
+ * Set up the frame pacing
+ *
+ * @param sync what to synchronize to
+ * @param refreshRate display refresh rate in Hz, 0 if unknown
+ */
+void frame_pacer_init(FrameSync sync, gint refreshRate);
+
+/**
+ * Get the number of frames to emulate before the next presentation
+ *
+ * @return number of frames, possibly 0
+ */
+guint frame_pacer_frames_due();
+
+/**
+ * Wait until the next frame is due. Only waits in timer mode.
+ */
+void frame_pacer_wait();
+
+/**
+ * Run as fast as possible, or back at normal speed
+ *
+ * @param enable whether to fast forward
+ */
+void frame_pacer_set_fast_forward(gboolean enable);
+
+/* Ends C function definitions when using C++ */
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __VBA_FRAMEPACER_H__
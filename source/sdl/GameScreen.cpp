@@ -18,12 +18,15 @@
 #include "GameScreen.h"
 #include "GUI.h"
 #include "DisplaySDL.h"
+#include "FramePacer.h"
 #include "InputSDL.h"
 #include "OSD.h"
 #include "Timer.h"
 #include "VBA.h"
 #include "../gba/Cartridge.h"
 #include "../gba/GBA.h"
+#include "../gba/Movie.h"
+#include "../gba/PerfCounters.h"
 #include "../gba/Savestate.h"
 #include "../gba/Sound.h"
 #include "../common/Settings.h"
@@ -34,6 +37,10 @@
 static const int screenWidth = 240;
 static const int screenHeight = 160;
 
+// Lines of the performance counters overlay, and frames between its updates
+static const int perfLines = 7;
+static const int perfRefreshFrames = 30;
+
 struct GameScreen {
 	Screen *screen;
 
@@ -44,6 +51,9 @@ struct GameScreen {
 	Display *display;
 
 	TextOSD *speed;
+	TextOSD *latency;
+	TextOSD *perf[perfLines];
+	int perfFrames;
 	TextOSD *status;
 	Timeout *mouseTimeout;
 
@@ -63,6 +73,64 @@ static void gamescreen_update_speed(TextOSD *speed) {
 	text_osd_set_message(speed, buffer);
 }
 
+static void gamescreen_update_latency(TextOSD *latency) {
+	if (latency == NULL)
+		return;
+
+	char buffer[50];
+	int us = soundGetLatency();
+	if (us < 0) {
+		g_sprintf(buffer, "Audio: -- ms");
+	} else {
+		g_sprintf(buffer, "Audio: %d.%d ms", us / 1000, us / 100 % 10);
+	}
+	text_osd_set_message(latency, buffer);
+}
+
+static void gamescreen_update_perf(GameScreen *game) {
+	if (game->perf[0] == NULL)
+		return;
+
+	// Keep the values readable
+	if (game->perfFrames++ % perfRefreshFrames != 0)
+		return;
+
+	PerfCounters c;
+	perf_counters_get_last_frame(&c);
+
+	guint64 rom = 0;
+	for (int i = 0x8; i <= 0xD; i++) {
+		rom += c.memoryAccesses[i];
+	}
+
+	char buffer[perfLines][100];
+	g_snprintf(buffer[0], sizeof(buffer[0]), "CPU %.2f PPU %.2f APU %.2f UI %.2f ms",
+			c.hostTime[PERF_HOST_CPU] / 1e6, c.hostTime[PERF_HOST_PPU] / 1e6,
+			c.hostTime[PERF_HOST_APU] / 1e6, c.hostTime[PERF_HOST_FRONTEND] / 1e6);
+	g_snprintf(buffer[1], sizeof(buffer[1]), "ARM %" G_GUINT64_FORMAT " Thumb %" G_GUINT64_FORMAT
+			" Halt %" G_GUINT64_FORMAT " cycles",
+			c.armInstructions, c.thumbInstructions, c.haltCycles);
+	g_snprintf(buffer[2], sizeof(buffer[2]), "BIOS %" G_GUINT64_FORMAT " EWRAM %" G_GUINT64_FORMAT
+			" IWRAM %" G_GUINT64_FORMAT " IO %" G_GUINT64_FORMAT,
+			c.memoryAccesses[0x0], c.memoryAccesses[0x2], c.memoryAccesses[0x3], c.memoryAccesses[0x4]);
+	g_snprintf(buffer[3], sizeof(buffer[3]), "PAL %" G_GUINT64_FORMAT " VRAM %" G_GUINT64_FORMAT
+			" OAM %" G_GUINT64_FORMAT " ROM %" G_GUINT64_FORMAT " SRAM %" G_GUINT64_FORMAT,
+			c.memoryAccesses[0x5], c.memoryAccesses[0x6], c.memoryAccesses[0x7], rom, c.memoryAccesses[0xE]);
+	g_snprintf(buffer[4], sizeof(buffer[4]), "DMA %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT
+			" %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " bytes",
+			c.dmaBytes[0], c.dmaBytes[1], c.dmaBytes[2], c.dmaBytes[3]);
+	g_snprintf(buffer[5], sizeof(buffer[5]), "Lines %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT
+			" %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT,
+			c.modeScanlines[0], c.modeScanlines[1], c.modeScanlines[2],
+			c.modeScanlines[3], c.modeScanlines[4], c.modeScanlines[5]);
+	g_snprintf(buffer[6], sizeof(buffer[6]), "Sound %" G_GUINT64_FORMAT " ticks %" G_GUINT64_FORMAT " samples",
+			c.soundTicks, c.soundSamples);
+
+	for (int i = 0; i < perfLines; i++) {
+		text_osd_set_message(game->perf[i], buffer[i]);
+	}
+}
+
 static void gamescreen_update_texture(GameScreen *game, guint16 *pix) {
 	g_assert(game != NULL);
 
@@ -70,6 +138,8 @@ static void gamescreen_update_texture(GameScreen *game, guint16 *pix) {
 	// TODO: Error checking
 
 	gamescreen_update_speed(game->speed);
+	gamescreen_update_latency(game->latency);
+	gamescreen_update_perf(game);
 }
 
 static void gamescreen_render(gpointer entity) {
@@ -106,6 +176,10 @@ static void gamescreen_free(GameScreen *game) {
 
 	text_osd_free(game->status);
 	text_osd_free(game->speed);
+	text_osd_free(game->latency);
+	for (int i = 0; i < perfLines; i++) {
+		text_osd_free(game->perf[i]);
+	}
 
 	display_sdl_renderable_free(game->renderable);
 	SDL_DestroyTexture(game->screenTexture);
@@ -281,7 +355,18 @@ static void gamescreen_update(gpointer entity) {
 	g_assert(game != NULL);
 
 	if (!game->inactive) {
-		CPULoop(250000);
+		guint frames = frame_pacer_frames_due();
+		for (guint i = 0; i < frames; i++) {
+			gba_run_frame();
+
+			GError *err = NULL;
+			if (!movie_update(&err)) {
+				gamescreen_show_status_message(game, err->message);
+				g_clear_error(&err);
+			}
+
+			cartridge_battery_update();
+		}
 	} else {
 		SDL_Delay(500);
 	}
@@ -296,6 +381,11 @@ GameScreen *gamescreen_create(Display *display, GError **err) {
 	game->displayDriver = NULL;
 	game->status = NULL;
 	game->speed = NULL;
+	game->latency = NULL;
+	for (int i = 0; i < perfLines; i++) {
+		game->perf[i] = NULL;
+	}
+	game->perfFrames = 0;
 	game->display = display;
 	game->renderable = display_sdl_renderable_create(display, game, NULL);
 	game->renderable->render = gamescreen_render;
@@ -332,6 +422,35 @@ GameScreen *gamescreen_create(Display *display, GError **err) {
 		text_osd_set_opacity(game->speed, 75);
 	}
 
+	if (settings_show_audio_latency()) {
+		game->latency = text_osd_create(display, NULL, NULL, err);
+		if (game->latency == NULL) {
+			gamescreen_free(game);
+			return NULL;
+		}
+
+		text_osd_set_color(game->latency, 255, 0, 0);
+		text_osd_set_alignment(game->latency, ALIGN_RIGHT, ALIGN_TOP);
+		text_osd_set_position(game->latency, 5, 5);
+		text_osd_set_size(game->latency, 240, 5);
+		text_osd_set_opacity(game->latency, 75);
+	}
+
+	if (settings_show_perf_counters()) {
+		for (int i = 0; i < perfLines; i++) {
+			game->perf[i] = text_osd_create(display, NULL, NULL, err);
+			if (game->perf[i] == NULL) {
+				gamescreen_free(game);
+				return NULL;
+			}
+
+			text_osd_set_color(game->perf[i], 255, 255, 0);
+			text_osd_set_position(game->perf[i], 5, 12 + i * 6);
+			text_osd_set_size(game->perf[i], 240, 5);
+			text_osd_set_opacity(game->perf[i], 75);
+		}
+	}
+
 	if (!settings_disable_status_messages()) {
 		game->status = text_osd_create(display, NULL, NULL, err);
 		if (game->status == NULL) {
@@ -16,11 +16,8 @@
 // Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 
 #include "OSD.h"
+#include "FontAtlas.h"
 #include "Timer.h"
-#include "../common/DisplayDriver.h"
-#include "../common/Util.h"
-
-#include <SDL_ttf.h>
 
 struct TextOSD {
 	Renderable *renderable;
@@ -30,8 +27,8 @@ struct TextOSD {
 	SDL_Color color;
 	gint opacity;
 
-	/** Texture to render */
-	SDL_Texture *texture;
+	/** Glyphs for the current size, loaded when first rendering */
+	FontAtlas *font;
 };
 
 struct ImageOSD {
@@ -55,71 +52,53 @@ static guint text_compute_size(TextOSD *text) {
 	return display_sdl_scale(text->renderable->display, text->renderable->height);
 }
 
-static gboolean text_update_texture(TextOSD *text, GError **err) {
+static gboolean text_update_font(TextOSD *text, GError **err) {
 	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
 
-	SDL_DestroyTexture(text->texture);
-
-	gchar *fontFile = data_get_file_path("fonts", "DroidSans-Bold.ttf");
-	TTF_Font *font = TTF_OpenFont(fontFile, text_compute_size(text));
-	g_free(fontFile);
-
-	if (font == NULL) {
-		g_set_error(err, DISPLAY_ERROR, G_DISPLAY_ERROR_FAILED,
-				"Failed to load font: %s", TTF_GetError());
-		return FALSE;
+	if (text->font != NULL) {
+		return TRUE;
 	}
 
-	SDL_Surface *surface = TTF_RenderText_Blended(font, text->message, text->color);
-	if (surface == NULL) {
-		g_set_error(err, DISPLAY_ERROR, G_DISPLAY_ERROR_FAILED,
-				"Failed render text: %s", TTF_GetError());
-		return FALSE;
-	}
+	text->font = font_atlas_ref(text->renderable->renderer, text_compute_size(text), err);
 
-	text->texture = SDL_CreateTextureFromSurface(text->renderable->renderer, surface);
-	if (text->texture == NULL) {
-		g_set_error(err, DISPLAY_ERROR, G_DISPLAY_ERROR_FAILED,
-				"Failed create texture : %s", SDL_GetError());
-		return FALSE;
-	}
-
-	if (text->opacity != 100) {
-		SDL_SetTextureAlphaMod(text->texture, text->opacity * 255 / 100);
-	}
-
-	SDL_FreeSurface(surface);
-	TTF_CloseFont(font);
-
-	return TRUE;
+	return text->font != NULL;
 }
 
-static void osd_render(Renderable *renderable, SDL_Texture *texture) {
-	int textWidth, textHeight;
-	SDL_QueryTexture(texture, NULL, NULL, &textWidth, &textHeight);
+static void text_release_font(TextOSD *text) {
+	font_atlas_unref(text->font);
+	text->font = NULL;
+}
 
+static void osd_compute_rect(Renderable *renderable, gint width, gint height, SDL_Rect *screenRect) {
 	int rendWidth = display_sdl_scale(renderable->display, renderable->width);
 	int rendHeight = display_sdl_scale(renderable->display, renderable->height);
 
 	gint x, y;
 	display_sdl_renderable_get_absolute_position(renderable, &x, &y);
 
-	SDL_Rect screenRect;
-	screenRect.w = textWidth;
-	screenRect.h = textHeight;
-	screenRect.y = y + (rendHeight - textHeight) / 2;
+	screenRect->w = width;
+	screenRect->h = height;
+	screenRect->y = y + (rendHeight - height) / 2;
 
 	switch (renderable->horizontalAlignment) {
 	case ALIGN_LEFT:
-		screenRect.x = x;
+		screenRect->x = x;
 		break;
 	case ALIGN_CENTER:
-		screenRect.x = x + (rendWidth - textWidth) / 2;
+		screenRect->x = x + (rendWidth - width) / 2;
 		break;
 	case ALIGN_RIGHT:
-		screenRect.x = x + rendWidth - textWidth;
+		screenRect->x = x + rendWidth - width;
 		break;
 	}
+}
+
+static void osd_render(Renderable *renderable, SDL_Texture *texture) {
+	int textureWidth, textureHeight;
+	SDL_QueryTexture(texture, NULL, NULL, &textureWidth, &textureHeight);
+
+	SDL_Rect screenRect;
+	osd_compute_rect(renderable, textureWidth, textureHeight, &screenRect);
 
 	SDL_RenderCopy(renderable->renderer, texture, NULL, &screenRect);
 }
@@ -131,18 +110,25 @@ static void text_osd_render(gpointer entity) {
 		return; // Nothing to render
 	}
 
-	if (text->texture == NULL) {
-		text_update_texture(text, NULL);
+	if (!text_update_font(text, NULL)) {
+		return;
 	}
 
-	osd_render(text->renderable, text->texture);
+	gint textWidth, textHeight;
+	font_atlas_get_text_size(text->font, text->message, &textWidth, &textHeight);
+
+	SDL_Rect screenRect;
+	osd_compute_rect(text->renderable, textWidth, textHeight, &screenRect);
+
+	font_atlas_render_text(text->font, text->message, screenRect.x, screenRect.y,
+			text->color, text->opacity * 255 / 100);
 }
 
 static void text_osd_resize(gpointer entity) {
 	TextOSD *text = entity;
 
-	SDL_DestroyTexture(text->texture);
-	text->texture = NULL;
+	// The font size depends on the screen size
+	text_release_font(text);
 }
 
 
@@ -160,10 +146,10 @@ TextOSD *text_osd_create(Display *display, const gchar *message, const Renderabl
 	text->color.r = 0;
 	text->color.g = 0;
 	text->color.b = 0;
-	text->texture = NULL;
+	text->font = NULL;
 
-	// Render here to perform error checking
-	if (text->message && !text_update_texture(text, err)) {
+	// Load the font here to perform error checking
+	if (text->message && !text_update_font(text, err)) {
 		text_osd_free(text);
 		return NULL;
 	}
@@ -175,7 +161,7 @@ void text_osd_free(TextOSD *text) {
 	if (text == NULL)
 		return;
 
-	SDL_DestroyTexture(text->texture);
+	text_release_font(text);
 
 	display_sdl_renderable_free(text->renderable);
 	timeout_free(text->autoclear);
@@ -192,9 +178,6 @@ void text_osd_set_message(TextOSD *text, const gchar *message) {
 
 	g_free(text->message);
 	text->message = g_strdup(message);
-
-	SDL_DestroyTexture(text->texture);
-	text->texture = NULL;
 }
 
 void text_osd_set_color(TextOSD *text, guint8 r, guint8 g, guint8 b) {
@@ -203,9 +186,6 @@ void text_osd_set_color(TextOSD *text, guint8 r, guint8 g, guint8 b) {
 	text->color.r = r;
 	text->color.g = g;
 	text->color.b = b;
-
-	SDL_DestroyTexture(text->texture);
-	text->texture = NULL;
 }
 
 void text_osd_set_position(TextOSD *text, gint x, gint y) {
@@ -225,17 +205,13 @@ void text_osd_set_opacity(TextOSD *text, gint opacity) {
 	g_assert(opacity >= 0 && opacity <= 100);
 
 	text->opacity = opacity;
-
-	SDL_DestroyTexture(text->texture);
-	text->texture = NULL;
 }
 
 void text_osd_set_size(TextOSD *text, gint width, gint height) {
 	g_assert(text != NULL);
 	display_sdl_renderable_set_size(text->renderable, width, height);
 
-	SDL_DestroyTexture(text->texture);
-	text->texture = NULL;
+	text_release_font(text);
 }
 
 static void text_osd_autoclear(gpointer entity) {
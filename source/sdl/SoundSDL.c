@@ -20,19 +20,65 @@
 #include "../common/RingBuffer.h"
 
 #include <SDL.h>
+#include <string.h>
 
+// Marks when the audio data up to a position in the stream was written
+typedef struct {
+	guint32 position;
+	gint64 time;
+} LatencyMarker;
+
+// Number of latency markers that can be waiting to be reached by the callback
+#define LATENCY_MARKERS 64
+
+// The audio callback runs on a real-time thread, and must never wait on the
+// emulation thread. Samples are exchanged through a lock-free ring buffer,
+// and the callback posts a semaphore each time it frees space in it.
 typedef struct {
 	struct ring_buffer *_rbuf;
 
-	SDL_cond  * _cond;
-	SDL_mutex * _mutex;
+	SDL_sem * _space;
+
+	// Seconds of audio the ring buffer can hold
+	float delay;
+
+	// Latency measurement. Each write queues a marker, and the callback
+	// measures the time elapsed once it has read the data up to it.
+	struct ring_buffer *markers;
+	guint32 written;            // Producer side stream position
+	guint32 read;               // Consumer side stream position
+	LatencyMarker pending;      // Next marker to be reached by the consumer
+	gboolean hasPending;
+	gint64 deviceLatency;       // Time to play a device buffer, in microseconds
+	volatile gint latency;      // Average latency, in microseconds
 
 	gboolean _initialized;
 	gboolean sync;
 } DriverData;
 
-// Hold up to 100 ms of data in the ring buffer
-static const float delay = 0.1f;
+static void sound_sdl_measure_latency(DriverData *data) {
+	gint64 now = g_get_monotonic_time();
+
+	for (;;) {
+		if (!data->hasPending) {
+			data->hasPending = ring_buffer_read(data->markers, &data->pending,
+					sizeof(data->pending)) == sizeof(data->pending);
+			if (!data->hasPending)
+				return;
+		}
+
+		// Positions wrap around, compare the distance
+		if ((gint32)(data->read - data->pending.position) < 0)
+			return;
+
+		// The data just read still has to go through the device buffer
+		gint latency = now - data->pending.time + data->deviceLatency;
+		gint average = g_atomic_int_get(&data->latency);
+		g_atomic_int_set(&data->latency, average ? average + (latency - average) / 16 : latency);
+
+		data->hasPending = FALSE;
+	}
+}
 
 static void sound_sdl_read(SoundDriver *driver, guint8 *stream, int len) {
 	g_assert(driver != NULL);
@@ -41,12 +87,27 @@ static void sound_sdl_read(SoundDriver *driver, guint8 *stream, int len) {
 	if (!data->_initialized || len <= 0)
 		return;
 
-	SDL_LockMutex(data->_mutex);
+	int read = ring_buffer_read(data->_rbuf, stream, len);
+
+	// Play silence when the emulation can't keep up
+	if (read < len)
+		memset(stream + read, 0, len - read);
+
+	if (read > 0)
+		SDL_SemPost(data->_space);
+
+	data->read += read;
+	sound_sdl_measure_latency(data);
+}
 
-	ring_buffer_read(data->_rbuf, stream, len);
+static void sound_sdl_mark_latency(DriverData *data) {
+	LatencyMarker marker;
+	marker.position = data->written;
+	marker.time = g_get_monotonic_time();
 
-	SDL_CondSignal(data->_cond);
-	SDL_UnlockMutex(data->_mutex);
+	// Skip the measurement rather than waiting when the callback is stalled
+	if (ring_buffer_avail(data->markers) >= (int)sizeof(marker))
+		ring_buffer_write(data->markers, &marker, sizeof(marker));
 }
 
 static void sound_sdl_write(SoundDriver *driver, guint16 * finalWave, int length) {
@@ -59,11 +120,10 @@ static void sound_sdl_write(SoundDriver *driver, guint16 * finalWave, int length
 	if (SDL_GetAudioStatus() != SDL_AUDIO_PLAYING)
 		SDL_PauseAudio(0);
 
-	SDL_LockMutex(data->_mutex);
-
 	unsigned int samples = length / 4;
+	data->written += samples * 4;
 
-	int avail;
+	unsigned int avail;
 	while ((avail = ring_buffer_avail(data->_rbuf) / 4) < samples)
 	{
 		ring_buffer_write(data->_rbuf, finalWave, avail * 4);
@@ -71,23 +131,40 @@ static void sound_sdl_write(SoundDriver *driver, guint16 * finalWave, int length
 		finalWave += avail * 2;
 		samples -= avail;
 
+		// Forget about the space freed while not waiting, it was used already
+		while (SDL_SemTryWait(data->_space) == 0);
+
 		// If emulating and not in speed up mode, synchronize to audio
-		// by waiting till there is enough room in the buffer
-		if (data->sync)
-		{
-			SDL_CondWait(data->_cond, data->_mutex);
-		}
-		else
+		// by waiting till there is enough room in the buffer.
+		// Don't wait longer than the buffer lasts, in case the audio
+		// device has stopped consuming.
+		if (!data->sync
+				|| SDL_SemWaitTimeout(data->_space, data->delay * 1000) != 0)
 		{
 			// Drop the remaining of the audio data
-			SDL_UnlockMutex(data->_mutex);
+			data->written -= samples * 4;
+			sound_sdl_mark_latency(data);
 			return;
 		}
 	}
 
 	ring_buffer_write(data->_rbuf, finalWave, samples * 4);
+	sound_sdl_mark_latency(data);
+}
 
-	SDL_UnlockMutex(data->_mutex);
+static gint sound_sdl_get_latency(SoundDriver *driver) {
+	g_assert(driver != NULL);
+	DriverData *data = (DriverData *)driver->driverData;
+
+	gint latency = g_atomic_int_get(&data->latency);
+	return latency ? latency : -1;
+}
+
+static gfloat sound_sdl_get_buffer_fill(SoundDriver *driver) {
+	g_assert(driver != NULL);
+	DriverData *data = (DriverData *)driver->driverData;
+
+	return (gfloat)ring_buffer_len(data->_rbuf) / ring_buffer_capacity(data->_rbuf);
 }
 
 static void sound_sdl_pause(SoundDriver *driver, gboolean pause) {
@@ -104,7 +181,14 @@ static void sound_sdl_reset(SoundDriver *driver) {
 	g_assert(driver != NULL);
 	DriverData *data = (DriverData *)driver->driverData;
 
+	// The audio callback must not be reading while the buffer is reset
+	SDL_LockAudio();
 	ring_buffer_reset(data->_rbuf);
+	ring_buffer_reset(data->markers);
+	data->written = 0;
+	data->read = 0;
+	data->hasPending = FALSE;
+	SDL_UnlockAudio();
 }
 
 static void sound_sdl_callback(void *data, guint8 *stream, int len) {
@@ -118,6 +202,8 @@ SoundDriver *sound_sdl_init(GError **err) {
 	driver->write = sound_sdl_write;
 	driver->pause = sound_sdl_pause;
 	driver->reset = sound_sdl_reset;
+	driver->get_buffer_fill = sound_sdl_get_buffer_fill;
+	driver->get_latency = sound_sdl_get_latency;
 
 	guint sampleRate = settings_sound_sample_rate();
 
@@ -127,11 +213,12 @@ SoundDriver *sound_sdl_init(GError **err) {
 	audio.freq = sampleRate;
 	audio.format = AUDIO_S16SYS;
 	audio.channels = 2;
-	audio.samples = 1024;
+	audio.samples = settings_sound_device_buffer_size();
 	audio.callback = sound_sdl_callback;
 	audio.userdata = driver;
 
-	if (SDL_OpenAudio(&audio, NULL)) {
+	SDL_AudioSpec obtained;
+	if (SDL_OpenAudio(&audio, &obtained)) {
 		g_set_error(err, SOUND_ERROR, G_SOUND_ERROR_FAILED,
 				"Failed to open audio: %s", SDL_GetError());
 		g_free(driver);
@@ -139,9 +226,15 @@ SoundDriver *sound_sdl_init(GError **err) {
 	}
 
 	DriverData *data = g_new(DriverData, 1);
-	data->_rbuf = ring_buffer_new(delay * sampleRate * 2 * sizeof(guint16));
-	data->_cond = SDL_CreateCond();
-	data->_mutex = SDL_CreateMutex();
+	data->delay = settings_sound_buffer_length() / 1000.0f;
+	data->_rbuf = ring_buffer_new(data->delay * sampleRate * 2 * sizeof(guint16));
+	data->_space = SDL_CreateSemaphore(0);
+	data->markers = ring_buffer_new(LATENCY_MARKERS * sizeof(LatencyMarker));
+	data->written = 0;
+	data->read = 0;
+	data->hasPending = FALSE;
+	data->deviceLatency = (gint64)obtained.samples * G_USEC_PER_SEC / obtained.freq;
+	data->latency = 0;
 	data->_initialized = TRUE;
 	data->sync = TRUE;
 
@@ -159,16 +252,11 @@ void sound_sdl_free(SoundDriver *driver) {
 	if (!data->_initialized)
 		return;
 
-	SDL_mutexP(data->_mutex);
-
-	SDL_CondSignal(data->_cond);
-	SDL_UnlockMutex(data->_mutex);
+	SDL_CloseAudio();
 
-	SDL_DestroyCond(data->_cond);
-	SDL_DestroyMutex(data->_mutex);
+	SDL_DestroySemaphore(data->_space);
 	ring_buffer_free(data->_rbuf);
-
-	SDL_CloseAudio();
+	ring_buffer_free(data->markers);
 
 	SDL_QuitSubSystem(SDL_INIT_AUDIO);
 
@@ -19,11 +19,18 @@
 #include <SDL.h>
 
 #include "../gba/GBA.h"
+#include "../gba/Bios.h"
 #include "../gba/Cartridge.h"
 #include "../gba/Display.h"
+#include "../gba/EventLog.h"
+#include "../gba/Movie.h"
+#include "../gba/PerfCounters.h"
+#include "../gba/Profiler.h"
 #include "../gba/Sound.h"
+#include "../gba/Trace.h"
 
 #include "DisplaySDL.h"
+#include "FramePacer.h"
 #include "InputSDL.h"
 #include "SoundSDL.h"
 #include "Timer.h"
@@ -44,6 +51,13 @@ static InputDriver *inputDriver = NULL;
 gchar *filename = NULL;
 
 static gboolean emulating = FALSE;
+static FrameSync frameSync = FRAME_SYNC_AUDIO;
+
+static void vba_set_fast_forward(gboolean enable) {
+	// Sound output only blocks when it paces the emulation
+	sound_sdl_enable_sync(soundDriver, frameSync == FRAME_SYNC_AUDIO && !enable);
+	frame_pacer_set_fast_forward(enable);
+}
 
 static gboolean main_process_event(const SDL_Event *event) {
 	switch (event->type) {
@@ -64,14 +78,14 @@ static gboolean main_process_event(const SDL_Event *event) {
 			}
 			break;
 		case SDLK_SPACE:
-			sound_sdl_enable_sync(soundDriver, TRUE);
+			vba_set_fast_forward(FALSE);
 			return TRUE;
 		}
 		break;
 	case SDL_KEYDOWN:
 		switch (event->key.keysym.sym) {
 		case SDLK_SPACE:
-			sound_sdl_enable_sync(soundDriver, FALSE);
+			vba_set_fast_forward(TRUE);
 			return TRUE;
 		}
 		break;
@@ -118,6 +132,7 @@ static gboolean loadROM(const char *file, GError **err) {
 		CPUCleanUp();
 		return FALSE;
 	}
+	Bios::setHLE(settings_bios_hle());
 
 	CPUInit();
 	CPUReset();
@@ -126,6 +141,10 @@ static gboolean loadROM(const char *file, GError **err) {
 }
 
 static void vba_free() {
+	if (soundGetMode() == SOUND_MODE_HASH) {
+		g_print("Audio hash: %08x\n", soundGetHash());
+	}
+
 	soundShutdown();
 	cartridge_unload();
 	display_free();
@@ -210,12 +229,35 @@ int main(int argc, char **argv)
 
 	display_init(gamescreen_get_display_driver(game));
 
+	// Init the frame pacing
+	if (g_strcmp0(settings_frame_sync(), "timer") == 0) {
+		frameSync = FRAME_SYNC_TIMER;
+	} else if (g_strcmp0(settings_frame_sync(), "vsync") == 0) {
+		frameSync = FRAME_SYNC_VSYNC;
+	}
+	frame_pacer_init(frameSync, display_sdl_get_refresh_rate(display));
+
 	// Init the sound driver
 	soundDriver = sound_sdl_init(&err);
 	if (soundDriver == NULL) {
 		vba_fatal_error(err);
 	}
+	vba_set_fast_forward(FALSE);
 	soundSetVolume(settings_sound_volume());
+	soundSetTickPeriod(settings_sound_tick_period());
+	if (g_strcmp0(settings_sound_quality(), "fast") == 0) {
+		soundSetQuality(SOUND_QUALITY_FAST);
+	} else if (g_strcmp0(settings_sound_quality(), "good") == 0) {
+		soundSetQuality(SOUND_QUALITY_GOOD);
+	}
+	if (settings_sound_dynamic_rate_control() || frameSync != FRAME_SYNC_AUDIO) {
+		soundSetDynamicRateControl(settings_sound_max_rate_delta());
+	}
+	if (g_strcmp0(settings_sound_mode(), "null") == 0) {
+		soundSetMode(SOUND_MODE_NULL);
+	} else if (g_strcmp0(settings_sound_mode(), "hash") == 0) {
+		soundSetMode(SOUND_MODE_HASH);
+	}
 	soundInit(soundDriver);
 
 	// Init the input driver
@@ -231,18 +273,83 @@ int main(int argc, char **argv)
 
 	gamescreen_read_battery(game);
 
+	if (settings_get_record_movie() != NULL) {
+		if (!movie_record_start(settings_get_record_movie(), inputDriver,
+				settings_movie_keyframe_interval(), &err)) {
+			vba_fatal_error(err);
+		}
+	} else if (settings_get_play_movie() != NULL) {
+		if (!movie_play_start(settings_get_play_movie(), inputDriver, &err)) {
+			vba_fatal_error(err);
+		}
+	}
+
+	if (settings_get_capture_sound() != NULL) {
+		if (!soundCaptureStart(settings_get_capture_sound(), settings_capture_stems(), &err)) {
+			vba_fatal_error(err);
+		}
+	}
+
+	if (settings_get_trace_file() != NULL) {
+		if (!trace_start(settings_get_trace_file(), &err)) {
+			vba_fatal_error(err);
+		}
+	}
+
+	if (settings_get_profile_file() != NULL) {
+		if (!profiler_start(settings_get_profile_file(), settings_get_profile_symbols(), &err)) {
+			vba_fatal_error(err);
+		}
+	}
+
+	if (!event_log_start(settings_get_event_log_file(), settings_get_log_channels(), &err)) {
+		vba_fatal_error(err);
+	}
+
 	emulating = TRUE;
 
 	display_sdl_set_window_title(display, cartridge_get_game_title());
 
 	while (emulating) {
 		screens_update_current();
+
+		gint64 frontendStart = perf_counters_get_time();
+		TRACE_BEGIN("display_sdl_render");
 		display_sdl_render(display);
+		TRACE_END("display_sdl_render");
 		timers_update();
 		events_poll();
+		perf_counters_add_host_time(PERF_HOST_FRONTEND, perf_counters_get_time() - frontendStart);
+
+		frame_pacer_wait();
 	}
 
 	fprintf(stdout, "Shutting down\n");
+	if (!movie_stop(&err)) {
+		g_printerr("%s\n", err->message);
+		g_clear_error(&err);
+	}
+
+	if (!soundCaptureStop(&err)) {
+		g_printerr("%s\n", err->message);
+		g_clear_error(&err);
+	}
+
+	if (!trace_stop(&err)) {
+		g_printerr("%s\n", err->message);
+		g_clear_error(&err);
+	}
+
+	if (!profiler_stop(&err)) {
+		g_printerr("%s\n", err->message);
+		g_clear_error(&err);
+	}
+
+	if (!event_log_stop(&err)) {
+		g_printerr("%s\n", err->message);
+		g_clear_error(&err);
+	}
+
 	gamescreen_write_battery(game);
 
 	vba_free();
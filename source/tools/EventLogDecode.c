@@ -0,0 +1,154 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// Prints the records of an event log written with --event-log, one line
+// per event with the emulated frame and scanline, and the host time since
+// the start of the log. The records of each emulator thread are written
+// in batches, so events of different threads are not interleaved by time.
+
+#include "../gba/EventLog.h"
+
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+// Records read from the file at once
+#define DECODE_CHUNK_RECORDS 256
+
+static guint32 channels = 0;
+static gboolean summary = FALSE;
+static gchar **filenames = NULL;
+
+static GOptionEntry options[] = {
+	{ "channels", 'c', 0, G_OPTION_ARG_INT, &channels, "Only print the channels of MASK, bit n selecting channel n", "MASK" },
+	{ "summary", 's', 0, G_OPTION_ARG_NONE, &summary, "Only print the number of events of each channel", NULL },
+	{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &filenames, NULL, "FILE" },
+	{ NULL }
+};
+
+static gboolean decode_read_header(FILE *f, const gchar *file, EventLogHeader *header, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	if (fread(header, sizeof(*header), 1, f) != 1
+			|| memcmp(header->magic, EVENT_LOG_MAGIC, sizeof(header->magic)) != 0) {
+		g_set_error(err, EVENT_LOG_ERROR, G_EVENT_LOG_ERROR_BAD_FILE,
+				"%s is not an event log", file);
+		return FALSE;
+	}
+
+	if (header->version != EVENT_LOG_VERSION || header->recordSize != sizeof(EventLogRecord)) {
+		g_set_error(err, EVENT_LOG_ERROR, G_EVENT_LOG_ERROR_BAD_FILE,
+				"%s was written by an incompatible version, or on a different host", file);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean decode(const gchar *file, GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+	FILE *f = g_fopen(file, "rb");
+	if (f == NULL) {
+		g_set_error(err, EVENT_LOG_ERROR, G_EVENT_LOG_ERROR_FAILED,
+				"Failed to open event log file %s: %s", file, g_strerror(errno));
+		return FALSE;
+	}
+
+	EventLogHeader header;
+	if (!decode_read_header(f, file, &header, err)) {
+		fclose(f);
+		return FALSE;
+	}
+
+	EventLogRecord records[DECODE_CHUNK_RECORDS];
+	guint64 counts[32] = { 0 };
+	GString *text = g_string_new(NULL);
+
+	size_t count;
+	while ((count = fread(records, sizeof(EventLogRecord), G_N_ELEMENTS(records), f)) > 0) {
+		for (size_t i = 0; i < count; i++) {
+			const EventLogRecord *record = &records[i];
+
+			if (record->channel >= G_N_ELEMENTS(counts)
+					|| (channels != 0 && !(channels & (1 << record->channel)))) {
+				continue;
+			}
+
+			counts[record->channel]++;
+			if (summary) {
+				continue;
+			}
+
+			gint64 time = record->time - header.startTime;
+			g_string_printf(text, "%6u %3u %10" G_GINT64_FORMAT ".%03d ms  ",
+					record->frame, record->vcount, time / 1000000, (int)(time / 1000 % 1000));
+			event_log_format(record, text);
+			g_print("%s\n", text->str);
+		}
+	}
+
+	g_string_free(text, TRUE);
+
+	gboolean failed = ferror(f);
+	fclose(f);
+
+	if (failed) {
+		g_set_error(err, EVENT_LOG_ERROR, G_EVENT_LOG_ERROR_FAILED,
+				"Failed to read event log file %s", file);
+		return FALSE;
+	}
+
+	if (summary) {
+		for (guint channel = 0; channel < G_N_ELEMENTS(counts); channel++) {
+			if (counts[channel] > 0) {
+				g_print("Channel %2u: %" G_GUINT64_FORMAT " events\n", channel, counts[channel]);
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+int main(int argc, char **argv) {
+	GError *err = NULL;
+
+	GOptionContext *context = g_option_context_new("- print the events of an event log");
+	g_option_context_add_main_entries(context, options, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &err)) {
+		g_printerr("%s\n", err->message);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	if (filenames == NULL || g_strv_length(filenames) != 1) {
+		g_printerr("Usage: %s [OPTION...] FILE\n", argv[0]);
+		return 1;
+	}
+
+	if (!decode(filenames[0], &err)) {
+		g_printerr("%s\n", err->message);
+		g_clear_error(&err);
+		return 1;
+	}
+
+	g_strfreev(filenames);
+
+	return 0;
+}
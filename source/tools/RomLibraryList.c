@@ -0,0 +1,93 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2005-2006 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// Scans directories for ROMs and prints the ROM library, one line per ROM
+// with its game code, CRC32, title and path. The library cache is shared
+// with the emulator, so that rescans only read the new or modified files.
+
+#include "../common/RomLibrary.h"
+#include "../common/Settings.h"
+
+#include <glib.h>
+
+static gchar *cacheDir = NULL;
+static gboolean noCache = FALSE;
+static gchar **directories = NULL;
+
+static GOptionEntry options[] = {
+	{ "cache-dir", 'c', 0, G_OPTION_ARG_FILENAME, &cacheDir, "Store the library cache in DIR instead of the emulator cache directory", "DIR" },
+	{ "no-cache", 'n', 0, G_OPTION_ARG_NONE, &noCache, "Read all the ROMs, and do not save the library cache", NULL },
+	{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &directories, NULL, "DIRECTORY..." },
+	{ NULL }
+};
+
+static void print_entries(RomLibrary *library) {
+	GPtrArray *entries = rom_library_get_entries(library);
+
+	for (guint i = 0; i < entries->len; i++) {
+		const RomLibraryEntry *entry = g_ptr_array_index(entries, i);
+		const gchar *title = entry->game != NULL && entry->game->title != NULL ? entry->game->title : entry->digest.title;
+
+		g_print("%-4s %08x  %-40s %s\n", entry->digest.code, entry->digest.crc32, title, entry->path);
+	}
+
+	g_print("%u ROMs\n", entries->len);
+	g_ptr_array_free(entries, TRUE);
+}
+
+int main(int argc, char **argv) {
+	GError *err = NULL;
+
+	GOptionContext *context = g_option_context_new("- list the ROMs found in directories");
+	g_option_context_add_main_entries(context, options, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &err)) {
+		g_printerr("%s\n", err->message);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	if (directories == NULL) {
+		g_printerr("Usage: %s [OPTION...] DIRECTORY...\n", argv[0]);
+		return 1;
+	}
+
+	settings_init();
+
+	const gchar *libraryCacheDir = NULL;
+	if (!noCache) {
+		libraryCacheDir = cacheDir != NULL ? cacheDir : settings_get_cache_dir();
+	}
+
+	RomLibrary *library = rom_library_new(libraryCacheDir);
+	if (!rom_library_scan(library, (const gchar * const *)directories, &err)) {
+		g_printerr("%s\n", err->message);
+		g_clear_error(&err);
+		rom_library_free(library);
+		settings_free();
+		return 1;
+	}
+
+	print_entries(library);
+
+	rom_library_free(library);
+	settings_free();
+	g_strfreev(directories);
+	g_free(cacheDir);
+
+	return 0;
+}